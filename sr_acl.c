@@ -0,0 +1,757 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_acl.c
+ *
+ * Description:
+ *
+ * Access control list, see sr_acl.h.
+ *
+ * Each tuple's table is a linear probing array of slots holding the
+ * masked key and the first rule with that key, sized to at least four
+ * times the tuple's rules: most probes are misses, and a miss only ends
+ * at an empty slot, so the table is kept sparse.  Tuples are created in
+ * the order of their first rule, which is the order lookups want them
+ * in.  A lookup touches one table per tuple, so tuples are hashed in
+ * groups and their slots prefetched before any is compared.
+ *
+ * Readers bracket their use of the current set with sr_acl_acquire and
+ * sr_acl_release.  With use_locks they count themselves in acl->readers
+ * before loading acl->cur, so a writer that swapped the pointer and then
+ * sees no readers knows nobody can still hold the old set.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <sched.h>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "sr_protocol.h"
+#include "sr_acl.h"
+
+#define SR_ACL_LINE_MAX 512
+#define SR_ACL_TOKENS   6
+#define SR_ACL_GROUP    8   /* tuples whose slots are loaded together */
+
+#ifdef __GNUC__
+#define SR_ACL_PREFETCH(p) __builtin_prefetch((p))
+#else
+#define SR_ACL_PREFETCH(p) do{}while(0)
+#endif
+
+/* -- tuple signatures: prefix lengths x exact/wild protocol x port kinds -- */
+#define SR_ACL_SIGS (33 * 33 * 2 * 4)
+
+/*---------------------------------------------------------------------
+ * Method: sr_acl_hash(..)
+ * Scope:  Local
+ *
+ * Multiplicative hash of a masked key.  Lookups hash once per tuple, so
+ * the fields are multiplied independently rather than chained through a
+ * full mixer; the final fold brings the high product bits down to the
+ * bits the table mask keeps.
+ *
+ *---------------------------------------------------------------------*/
+
+static uint32_t sr_acl_hash(uint32_t src, uint32_t dst, uint16_t sport,
+                            uint16_t dport, uint8_t proto)
+{
+    uint32_t h = src * 0x9e3779b1 + dst * 0x85ebca6b +
+                 (((uint32_t)sport << 16 | dport) ^ proto) * 0xc2b2ae35;
+
+    h ^= h >> 16;
+    h *= 0x27d4eb2f;
+    return h ^ (h >> 15);
+} /* -- sr_acl_hash -- */
+
+static uint32_t sr_acl_mask(int bits)
+{
+    return bits ? htonl(0xffffffffu << (32 - bits)) : 0;
+} /* -- sr_acl_mask -- */
+
+static int sr_acl_port_exact(const struct sr_acl_rule* r, int dst)
+{
+    return dst ? r->dport_lo == r->dport_hi : r->sport_lo == r->sport_hi;
+} /* -- sr_acl_port_exact -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_acl_classify(..)
+ * Scope:  Global
+ *
+ * Index of the first rule matching key, or -1 if none does.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_acl_classify(const struct sr_acl_set* set, const struct sr_acl_key* key)
+{
+    struct sr_acl_key want[SR_ACL_GROUP];
+    uint32_t slot[SR_ACL_GROUP];
+    uint32_t best = set->nrules;
+    uint32_t t, n, j;
+
+    for (t = 0; t < set->ntuples; t += n)
+    {
+        n = set->ntuples - t;
+        if (n > SR_ACL_GROUP)
+        { n = SR_ACL_GROUP; }
+
+        /* -- hash a group of tuples and start loading their first slots -- */
+        for (j = 0; j < n; j++)
+        {
+            const struct sr_acl_tuple* tp = &set->tuples[t + j];
+            struct sr_acl_key* w = &want[j];
+
+            w->src = key->src & tp->smask;
+            w->dst = key->dst & tp->dmask;
+            w->sport = (tp->ports & SR_ACL_SPORT_EXACT) ? key->sport : 0;
+            w->dport = (tp->ports & SR_ACL_DPORT_EXACT) ? key->dport : 0;
+            w->proto = tp->proto_any ? 0 : key->proto;
+            slot[j] = sr_acl_hash(w->src, w->dst, w->sport, w->dport,
+                                  w->proto) & tp->tab_mask;
+            SR_ACL_PREFETCH(&tp->tab[slot[j]]);
+        }
+
+        for (j = 0; j < n; j++)
+        {
+            const struct sr_acl_tuple* tp = &set->tuples[t + j];
+            const struct sr_acl_key* w = &want[j];
+            uint32_t i, r, proto_rule;
+
+            /* -- every rule in this and the later tuples comes after best -- */
+            if (tp->min_prio >= best)
+            { return (best < set->nrules) ? (int)best : -1; }
+
+            for (i = slot[j]; (proto_rule = tp->tab[i].proto_rule) != 0;
+                 i = (i + 1) & tp->tab_mask)
+            {
+                const struct sr_acl_slot* s = &tp->tab[i];
+
+                if (s->src != w->src || s->dst != w->dst || s->sport != w->sport ||
+                    s->dport != w->dport || (proto_rule >> 24) != w->proto)
+                { continue; }
+
+                /* -- rules sharing the key, in order; next - 1 wraps to ~0 -- */
+                for (r = (proto_rule & 0xffffff) - 1; r < best;
+                     r = set->rules[r].next - 1)
+                {
+                    const struct sr_acl_rule* rule = &set->rules[r];
+
+                    if (key->sport >= rule->sport_lo && key->sport <= rule->sport_hi &&
+                        key->dport >= rule->dport_lo && key->dport <= rule->dport_hi)
+                    {
+                        best = r;
+                        break;
+                    }
+                }
+                break;
+            }
+        }
+    }
+
+    return (best < set->nrules) ? (int)best : -1;
+} /* -- sr_acl_classify -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_acl_filter(..)
+ * Scope:  Global
+ *
+ * SR_ACL_DENY if the frame is an IPv4 packet the set drops, otherwise
+ * SR_ACL_PERMIT.  info is the frame as sr_pkt_parse found it; ports
+ * are only matched when it saw a transport header.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_acl_filter(struct sr_acl_set* set, const uint8_t* packet,
+                  const struct sr_pktinfo* info)
+{
+    const sr_ip_hdr_t* ip;
+    struct sr_acl_key key;
+    uint16_t ports[2];
+    int r;
+
+    if (info->ethertype != ethertype_ip)
+    { return SR_ACL_PERMIT; }
+
+    ip = (const sr_ip_hdr_t*)(packet + info->l3);
+    key.src = ip->ip_src;
+    key.dst = ip->ip_dst;
+    key.proto = info->proto;
+    key.sport = key.dport = 0;
+    if ((key.proto == ip_protocol_tcp || key.proto == ip_protocol_udp) &&
+        (info->flags & SR_PKT_L4_OK))
+    {
+        memcpy(ports, packet + info->l4, sizeof(ports));
+        key.sport = ntohs(ports[0]);
+        key.dport = ntohs(ports[1]);
+    }
+
+    if ((r = sr_acl_classify(set, &key)) < 0)
+    {
+        set->nomatch++;
+        return SR_ACL_PERMIT;
+    }
+    set->rules[r].hits++;
+    return set->rules[r].action;
+} /* -- sr_acl_filter -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_acl_compile(..)
+ * Scope:  Global
+ *
+ * Build the tuple space for rules (in priority order).  The rules are
+ * copied.  Returns NULL if out of memory.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_acl_set* sr_acl_compile(const struct sr_acl_rule* rules,
+                                  uint32_t nrules)
+{
+    struct sr_acl_set* set;
+    uint32_t *sig_map = 0, *count = 0, *tail = 0, *rule_tuple = 0;
+    uint32_t r, t, size;
+
+    if (nrules > SR_ACL_MAX_RULES)
+    { return 0; }
+    if ((set = (struct sr_acl_set*)calloc(1, sizeof(*set))) == 0)
+    { return 0; }
+
+    set->rules = (struct sr_acl_rule*)calloc(nrules + 1, sizeof(struct sr_acl_rule));
+    set->tuples = (struct sr_acl_tuple*)calloc(nrules + 1, sizeof(struct sr_acl_tuple));
+    sig_map = (uint32_t*)calloc(SR_ACL_SIGS, sizeof(uint32_t));
+    count = (uint32_t*)calloc(nrules + 1, sizeof(uint32_t));
+    tail = (uint32_t*)calloc(nrules + 1, sizeof(uint32_t));
+    rule_tuple = (uint32_t*)calloc(nrules + 1, sizeof(uint32_t));
+    if (!set->rules || !set->tuples || !sig_map || !count || !tail || !rule_tuple)
+    { goto fail; }
+    if (nrules)
+    { memcpy(set->rules, rules, nrules * sizeof(struct sr_acl_rule)); }
+    set->nrules = nrules;
+
+    /* -- pass 1: find each rule's tuple, creating tuples in rule order -- */
+    for (r = 0; r < nrules; r++)
+    {
+        struct sr_acl_rule* rule = &set->rules[r];
+        uint8_t ports = (sr_acl_port_exact(rule, 0) ? SR_ACL_SPORT_EXACT : 0) |
+                        (sr_acl_port_exact(rule, 1) ? SR_ACL_DPORT_EXACT : 0);
+        uint32_t sig;
+
+        rule->smask = sr_acl_mask(rule->sbits);
+        rule->dmask = sr_acl_mask(rule->dbits);
+        rule->src &= rule->smask;
+        rule->dst &= rule->dmask;
+        if (rule->proto_any)
+        { rule->proto = 0; }
+        rule->next = 0;
+        rule->hits = 0;
+
+        sig = ((rule->sbits * 33 + rule->dbits) * 2 + (rule->proto_any ? 1 : 0)) * 4 + ports;
+        if (sig_map[sig] == 0)
+        {
+            struct sr_acl_tuple* tp = &set->tuples[set->ntuples];
+
+            tp->sbits = rule->sbits;
+            tp->dbits = rule->dbits;
+            tp->smask = rule->smask;
+            tp->dmask = rule->dmask;
+            tp->proto_any = rule->proto_any ? 1 : 0;
+            tp->ports = ports;
+            tp->min_prio = r;
+            sig_map[sig] = ++set->ntuples;
+        }
+        rule_tuple[r] = sig_map[sig] - 1;
+        count[rule_tuple[r]]++;
+    }
+
+    for (t = 0; t < set->ntuples; t++)
+    {
+        for (size = 4; size < 4 * count[t]; size <<= 1)
+        { }
+        set->tuples[t].tab_mask = size - 1;
+        set->tuples[t].tab = (struct sr_acl_slot*)calloc(size, sizeof(struct sr_acl_slot));
+        if (!set->tuples[t].tab)
+        { goto fail; }
+    }
+
+    /* -- pass 2: insert, chaining rules that share a key -- */
+    for (r = 0; r < nrules; r++)
+    {
+        const struct sr_acl_rule* rule = &set->rules[r];
+        struct sr_acl_tuple* tp = &set->tuples[rule_tuple[r]];
+        uint16_t sport = (tp->ports & SR_ACL_SPORT_EXACT) ? rule->sport_lo : 0;
+        uint16_t dport = (tp->ports & SR_ACL_DPORT_EXACT) ? rule->dport_lo : 0;
+        uint32_t i;
+
+        for (i = sr_acl_hash(rule->src, rule->dst, sport, dport, rule->proto) & tp->tab_mask;
+             tp->tab[i].proto_rule != 0;
+             i = (i + 1) & tp->tab_mask)
+        {
+            struct sr_acl_slot* s = &tp->tab[i];
+
+            if (s->src == rule->src && s->dst == rule->dst && s->sport == sport &&
+                s->dport == dport && (s->proto_rule >> 24) == rule->proto)
+            { break; }
+        }
+
+        if (tp->tab[i].proto_rule != 0)
+        {
+            uint32_t head = (tp->tab[i].proto_rule & 0xffffff) - 1;
+
+            set->rules[tail[head]].next = r + 1;
+            tail[head] = r;
+        }
+        else
+        {
+            tp->tab[i].src = rule->src;
+            tp->tab[i].dst = rule->dst;
+            tp->tab[i].sport = sport;
+            tp->tab[i].dport = dport;
+            tp->tab[i].proto_rule = (uint32_t)rule->proto << 24 | (r + 1);
+            tail[r] = r;
+        }
+    }
+
+    free(sig_map);
+    free(count);
+    free(tail);
+    free(rule_tuple);
+    return set;
+
+fail:
+    free(sig_map);
+    free(count);
+    free(tail);
+    free(rule_tuple);
+    sr_acl_set_free(set);
+    return 0;
+} /* -- sr_acl_compile -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_acl_set_free(..)
+ * Scope:  Global
+ *---------------------------------------------------------------------*/
+
+void sr_acl_set_free(struct sr_acl_set* set)
+{
+    uint32_t t;
+
+    if (!set)
+    { return; }
+
+    if (set->tuples)
+    {
+        for (t = 0; t < set->ntuples; t++)
+        { free(set->tuples[t].tab); }
+    }
+    free(set->tuples);
+    free(set->rules);
+    free(set);
+} /* -- sr_acl_set_free -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_acl_parse_addr(..)
+ * Scope:  Local
+ *
+ * "any", "a.b.c.d" or "a.b.c.d/len".
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_acl_parse_addr(const char* s, uint32_t* addr, uint8_t* bits)
+{
+    char buf[INET_ADDRSTRLEN + 4];
+    struct in_addr in;
+    char* slash;
+    char* end;
+    long n = 32;
+
+    if (strcmp(s, "any") == 0)
+    {
+        *addr = 0;
+        *bits = 0;
+        return 0;
+    }
+    if (strlen(s) >= sizeof(buf))
+    { return -1; }
+    strcpy(buf, s);
+    if ((slash = strchr(buf, '/')) != 0)
+    {
+        *slash++ = '\0';
+        n = strtol(slash, &end, 10);
+        if (*slash == '\0' || *end != '\0' || n < 0 || n > 32)
+        { return -1; }
+    }
+    if (inet_pton(AF_INET, buf, &in) != 1)
+    { return -1; }
+    *addr = in.s_addr;
+    *bits = (uint8_t)n;
+    return 0;
+} /* -- sr_acl_parse_addr -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_acl_parse_port(..)
+ * Scope:  Local
+ *
+ * "any", "port" or "lo-hi".
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_acl_parse_port(const char* s, uint16_t* lo, uint16_t* hi)
+{
+    unsigned long a, b;
+    char* end;
+
+    if (strcmp(s, "any") == 0)
+    {
+        *lo = 0;
+        *hi = 65535;
+        return 0;
+    }
+    a = strtoul(s, &end, 10);
+    if (end == s || a > 65535)
+    { return -1; }
+    b = a;
+    if (*end == '-')
+    {
+        s = end + 1;
+        b = strtoul(s, &end, 10);
+        if (end == s || b > 65535 || b < a)
+        { return -1; }
+    }
+    if (*end != '\0')
+    { return -1; }
+    *lo = (uint16_t)a;
+    *hi = (uint16_t)b;
+    return 0;
+} /* -- sr_acl_parse_port -- */
+
+static int sr_acl_parse_proto(const char* s, struct sr_acl_rule* r)
+{
+    unsigned long n;
+    char* end;
+
+    r->proto_any = 0;
+    if (strcmp(s, "any") == 0)
+    {
+        r->proto_any = 1;
+        r->proto = 0;
+        return 0;
+    }
+    if (strcmp(s, "tcp") == 0)
+    { r->proto = ip_protocol_tcp; }
+    else if (strcmp(s, "udp") == 0)
+    { r->proto = ip_protocol_udp; }
+    else if (strcmp(s, "icmp") == 0)
+    { r->proto = ip_protocol_icmp; }
+    else
+    {
+        n = strtoul(s, &end, 10);
+        if (end == s || *end != '\0' || n > 255)
+        { return -1; }
+        r->proto = (uint8_t)n;
+    }
+    return 0;
+} /* -- sr_acl_parse_proto -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_acl_parse_file(..)
+ * Scope:  Global
+ *
+ * Read the rules in path into a malloc'd array.  Errors are reported to
+ * err as file:line: message.  Returns 0 on success, -1 on error.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_acl_parse_file(const char* path, struct sr_acl_rule** rules,
+                      uint32_t* nrules, FILE* err)
+{
+    char line[SR_ACL_LINE_MAX];
+    char* tok[SR_ACL_TOKENS + 1];
+    struct sr_acl_rule* v = 0;
+    uint32_t n = 0, cap = 0, lineno = 0;
+    const char* what = 0;
+    FILE* fp;
+
+    /* -- REQUIRES -- */
+    assert(path);
+    assert(rules);
+    assert(nrules);
+
+    if ((fp = fopen(path, "r")) == 0)
+    {
+        fprintf(err, "ACL: cannot open %s\n", path);
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), fp))
+    {
+        struct sr_acl_rule r;
+        char* save = 0;
+        char* hash;
+        int ntok = 0;
+
+        lineno++;
+        if ((hash = strchr(line, '#')) != 0)
+        { *hash = '\0'; }
+        for (tok[ntok] = strtok_r(line, " \t\r\n", &save);
+             tok[ntok] && ntok < SR_ACL_TOKENS;
+             tok[ntok] = strtok_r(0, " \t\r\n", &save))
+        { ntok++; }
+        if (ntok == 0)
+        { continue; }
+
+        memset(&r, 0, sizeof(r));
+        r.line = lineno;
+        r.sport_hi = r.dport_hi = 65535;
+
+        if (ntok < 4 || tok[ntok] != 0)
+        { what = "expected action proto source destination [sport [dport]]"; }
+        else if (strcmp(tok[0], "permit") != 0 && strcmp(tok[0], "deny") != 0)
+        { what = "action must be permit or deny"; }
+        else if (sr_acl_parse_proto(tok[1], &r) < 0)
+        { what = "bad protocol"; }
+        else if (sr_acl_parse_addr(tok[2], &r.src, &r.sbits) < 0)
+        { what = "bad source"; }
+        else if (sr_acl_parse_addr(tok[3], &r.dst, &r.dbits) < 0)
+        { what = "bad destination"; }
+        else if (ntok > 4 && sr_acl_parse_port(tok[4], &r.sport_lo, &r.sport_hi) < 0)
+        { what = "bad source port"; }
+        else if (ntok > 5 && sr_acl_parse_port(tok[5], &r.dport_lo, &r.dport_hi) < 0)
+        { what = "bad destination port"; }
+        else if ((r.sport_lo != 0 || r.sport_hi != 65535 ||
+                  r.dport_lo != 0 || r.dport_hi != 65535) &&
+                 (r.proto_any || (r.proto != ip_protocol_tcp && r.proto != ip_protocol_udp)))
+        { what = "ports need tcp or udp"; }
+        else if (n == SR_ACL_MAX_RULES)
+        { what = "too many rules"; }
+        if (what)
+        {
+            fprintf(err, "%s:%u: %s\n", path, lineno, what);
+            break;
+        }
+        r.action = (tok[0][0] == 'd') ? SR_ACL_DENY : SR_ACL_PERMIT;
+
+        if (n == cap)
+        {
+            struct sr_acl_rule* nv;
+
+            cap = cap ? cap * 2 : 64;
+            if ((nv = (struct sr_acl_rule*)realloc(v, cap * sizeof(*v))) == 0)
+            {
+                what = "out of memory";
+                fprintf(err, "%s:%u: %s\n", path, lineno, what);
+                break;
+            }
+            v = nv;
+        }
+        v[n++] = r;
+    }
+    fclose(fp);
+
+    if (what)
+    {
+        free(v);
+        return -1;
+    }
+    *rules = v;
+    *nrules = n;
+    return 0;
+} /* -- sr_acl_parse_file -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_acl_acquire(..)
+ * Scope:  Global
+ *
+ * The current set, valid until the matching sr_acl_release.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_acl_set* sr_acl_acquire(struct sr_acl* acl)
+{
+    if (!acl->use_locks)
+    { return acl->cur; }
+    __atomic_fetch_add(&acl->readers, 1, __ATOMIC_SEQ_CST);
+    return __atomic_load_n(&acl->cur, __ATOMIC_SEQ_CST);
+} /* -- sr_acl_acquire -- */
+
+void sr_acl_release(struct sr_acl* acl)
+{
+    if (acl->use_locks)
+    { __atomic_fetch_sub(&acl->readers, 1, __ATOMIC_RELEASE); }
+} /* -- sr_acl_release -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_acl_swap(..)
+ * Scope:  Global
+ *
+ * Make set current and free the previous one once no reader holds it.
+ * Writers are serialized by the caller (the control socket).
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_acl_swap(struct sr_acl* acl, struct sr_acl_set* set)
+{
+    struct sr_acl_set* old;
+
+    old = __atomic_exchange_n(&acl->cur, set, __ATOMIC_SEQ_CST);
+    if (acl->use_locks)
+    {
+        while (__atomic_load_n(&acl->readers, __ATOMIC_SEQ_CST) != 0)
+        { sched_yield(); }
+    }
+    sr_acl_set_free(old);
+} /* -- sr_acl_swap -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_acl_load(..)
+ * Scope:  Global
+ *
+ * Parse and compile path and make it the current rule set.  On error
+ * the current set stays in place.  Messages go to out.  Returns 0 on
+ * success, -1 on error.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_acl_load(struct sr_acl* acl, const char* path, FILE* out)
+{
+    struct sr_acl_rule* rules = 0;
+    struct sr_acl_set* set;
+    uint32_t nrules = 0;
+
+    /* -- REQUIRES -- */
+    assert(acl);
+    assert(path);
+
+    if (sr_acl_parse_file(path, &rules, &nrules, out) < 0)
+    { return -1; }
+    set = sr_acl_compile(rules, nrules);
+    free(rules);
+    if (!set)
+    {
+        fprintf(out, "ACL: out of memory compiling %s\n", path);
+        return -1;
+    }
+
+    if (path != acl->path)
+    {
+        strncpy(acl->path, path, sizeof(acl->path) - 1);
+        acl->path[sizeof(acl->path) - 1] = '\0';
+    }
+    fprintf(out, "ACL: %u rule(s) in %u tuple(s) from %s\n",
+            set->nrules, set->ntuples, path);
+    sr_acl_swap(acl, set);
+    return 0;
+} /* -- sr_acl_load -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_acl_create(..)
+ * Scope:  Global
+ *
+ * An ACL with an empty rule set.  use_locks is needed when frames are
+ * classified on a thread other than the one reloading.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_acl* sr_acl_create(int use_locks)
+{
+    struct sr_acl* acl;
+
+    if ((acl = (struct sr_acl*)calloc(1, sizeof(*acl))) == 0 ||
+        (acl->cur = sr_acl_compile(0, 0)) == 0)
+    {
+        fprintf(stderr, "Error: out of memory (sr_acl_create)\n");
+        free(acl);
+        return 0;
+    }
+    acl->use_locks = use_locks;
+    return acl;
+} /* -- sr_acl_create -- */
+
+void sr_acl_destroy(struct sr_acl* acl)
+{
+    if (!acl)
+    { return; }
+    sr_acl_set_free(acl->cur);
+    free(acl);
+} /* -- sr_acl_destroy -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_acl_format_rule(..)
+ * Scope:  Global
+ *
+ * The rule in rules file syntax.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_acl_format_addr(uint32_t addr, uint8_t bits, char* buf, int size)
+{
+    char ip[INET_ADDRSTRLEN];
+
+    if (bits == 0)
+    { return snprintf(buf, size, " any"); }
+    inet_ntop(AF_INET, &addr, ip, sizeof(ip));
+    return snprintf(buf, size, " %s/%u", ip, bits);
+} /* -- sr_acl_format_addr -- */
+
+static int sr_acl_format_port(uint16_t lo, uint16_t hi, char* buf, int size)
+{
+    if (lo == 0 && hi == 65535)
+    { return snprintf(buf, size, " any"); }
+    if (lo == hi)
+    { return snprintf(buf, size, " %u", lo); }
+    return snprintf(buf, size, " %u-%u", lo, hi);
+} /* -- sr_acl_format_port -- */
+
+void sr_acl_format_rule(const struct sr_acl_rule* r, char* buf, int size)
+{
+    int n;
+
+    n = snprintf(buf, size, "%s", (r->action == SR_ACL_DENY) ? "deny" : "permit");
+    if (r->proto_any)
+    { n += snprintf(buf + n, size - n, " any"); }
+    else if (r->proto == ip_protocol_tcp)
+    { n += snprintf(buf + n, size - n, " tcp"); }
+    else if (r->proto == ip_protocol_udp)
+    { n += snprintf(buf + n, size - n, " udp"); }
+    else if (r->proto == ip_protocol_icmp)
+    { n += snprintf(buf + n, size - n, " icmp"); }
+    else
+    { n += snprintf(buf + n, size - n, " %u", r->proto); }
+    n += sr_acl_format_addr(r->src, r->sbits, buf + n, size - n);
+    n += sr_acl_format_addr(r->dst, r->dbits, buf + n, size - n);
+    if (r->sport_lo != 0 || r->sport_hi != 65535 ||
+        r->dport_lo != 0 || r->dport_hi != 65535)
+    {
+        n += sr_acl_format_port(r->sport_lo, r->sport_hi, buf + n, size - n);
+        sr_acl_format_port(r->dport_lo, r->dport_hi, buf + n, size - n);
+    }
+} /* -- sr_acl_format_rule -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_acl_print(..)
+ * Scope:  Global
+ *
+ * Counters and the current rules with their hit counts.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_acl_print(struct sr_acl* acl, FILE* out)
+{
+    struct sr_acl_set* set = sr_acl_acquire(acl);
+    char buf[128];
+    uint32_t r;
+
+    fprintf(out, "acl_file %s\n", acl->path[0] ? acl->path : "-");
+    fprintf(out, "acl_rules %u\n", set->nrules);
+    fprintf(out, "acl_tuples %u\n", set->ntuples);
+    fprintf(out, "acl_nomatch %llu\n", (unsigned long long)set->nomatch);
+    for (r = 0; r < set->nrules; r++)
+    {
+        sr_acl_format_rule(&set->rules[r], buf, sizeof(buf));
+        fprintf(out, "%u: %-60s hits %llu\n", set->rules[r].line, buf,
+                (unsigned long long)set->rules[r].hits);
+    }
+    sr_acl_release(acl);
+} /* -- sr_acl_print -- */
@@ -0,0 +1,152 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_acl.h
+ *
+ * Description:
+ *
+ * Access control list applied to every IPv4 frame before it is routed
+ * (-A rules_file).  One rule per line, first match wins, frames no rule
+ * matches are permitted:
+ *
+ *   # action  proto  source          destination    [sport  [dport]]
+ *   deny      tcp    any             10.0.1.100/32  any     22
+ *   permit    udp    192.168.2.0/24  any            any     1024-65535
+ *   deny      icmp   any             any
+ *
+ * proto is any, tcp, udp, icmp or a number; ports are any, a port or
+ * lo-hi and only allowed with tcp or udp.  Non-first fragments carry no
+ * ports and match as ports 0.
+ *
+ * The rules are compiled into a tuple space: rules with the same source
+ * and destination prefix lengths and the same choice of exact or wild
+ * protocol and ports share one hash table keyed by the masked fields.
+ * A lookup probes one table per tuple, in order of the tuple's first
+ * rule, and stops at the first tuple that cannot beat the best match
+ * found so far, so its cost depends on the number of tuples rather than
+ * the number of rules.  Port ranges are wild in the key and checked on
+ * the (priority ordered) chain of rules sharing it.
+ *
+ * A compiled set is immutable apart from its hit counters.  A reload
+ * compiles the new set aside, publishes it with one pointer swap and
+ * frees the old set once no burst still classifies against it.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_ACL_H
+#define SR_ACL_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#include <stdio.h>
+
+#define SR_ACL_PERMIT 0
+#define SR_ACL_DENY   1
+
+#define SR_ACL_MAX_RULES ((1 << 24) - 1)
+#define SR_ACL_PATH_MAX  256
+
+/* -- sr_acl_tuple.ports -- */
+#define SR_ACL_SPORT_EXACT 0x1
+#define SR_ACL_DPORT_EXACT 0x2
+
+/* ----------------------------------------------------------------------------
+ * struct sr_acl_key
+ *
+ * The fields a frame is classified on.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_acl_key
+{
+    uint32_t src;      /* network byte order */
+    uint32_t dst;
+    uint16_t sport;    /* host byte order, 0 without a transport header */
+    uint16_t dport;
+    uint8_t  proto;
+};
+
+struct sr_acl_rule
+{
+    uint32_t src;      /* network byte order, masked */
+    uint32_t smask;
+    uint32_t dst;
+    uint32_t dmask;
+    uint16_t sport_lo; /* host byte order, inclusive */
+    uint16_t sport_hi;
+    uint16_t dport_lo;
+    uint16_t dport_hi;
+    uint8_t  proto;
+    uint8_t  proto_any;
+    uint8_t  sbits;
+    uint8_t  dbits;
+    uint8_t  action;   /* SR_ACL_PERMIT or SR_ACL_DENY */
+    uint32_t line;     /* in the rules file */
+    uint32_t next;     /* next rule with the same tuple key, index + 1 */
+    uint64_t hits;
+};
+
+/* -- hash slot: masked key and (proto << 24 | first rule index + 1) -- */
+struct sr_acl_slot
+{
+    uint32_t src;
+    uint32_t dst;
+    uint16_t sport;
+    uint16_t dport;
+    uint32_t proto_rule;
+};
+
+struct sr_acl_tuple
+{
+    uint32_t smask;    /* network byte order */
+    uint32_t dmask;
+    uint8_t  sbits;
+    uint8_t  dbits;
+    uint8_t  proto_any;
+    uint8_t  ports;    /* SR_ACL_*PORT_EXACT */
+    uint32_t min_prio; /* index of the tuple's first rule */
+    uint32_t tab_mask;
+    struct sr_acl_slot* tab;
+};
+
+struct sr_acl_set
+{
+    struct sr_acl_rule* rules;
+    uint32_t nrules;
+    struct sr_acl_tuple* tuples; /* ascending min_prio */
+    uint32_t ntuples;
+    uint64_t nomatch;            /* frames permitted by default */
+};
+
+struct sr_acl
+{
+    struct sr_acl_set* cur;
+    int readers;                 /* bursts classifying, with use_locks */
+    int use_locks;
+    char path[SR_ACL_PATH_MAX];  /* rules file, for reload */
+};
+
+struct sr_acl* sr_acl_create(int use_locks);
+void sr_acl_destroy(struct sr_acl* acl);
+int  sr_acl_load(struct sr_acl* acl, const char* path, FILE* err);
+int  sr_acl_parse_file(const char* path, struct sr_acl_rule** rules,
+                       uint32_t* nrules, FILE* err);
+struct sr_pktinfo;
+
+struct sr_acl_set* sr_acl_compile(const struct sr_acl_rule* rules,
+                                  uint32_t nrules);
+void sr_acl_set_free(struct sr_acl_set* set);
+void sr_acl_swap(struct sr_acl* acl, struct sr_acl_set* set);
+struct sr_acl_set* sr_acl_acquire(struct sr_acl* acl);
+void sr_acl_release(struct sr_acl* acl);
+int  sr_acl_classify(const struct sr_acl_set* set, const struct sr_acl_key* key);
+int  sr_acl_filter(struct sr_acl_set* set, const uint8_t* packet,
+                   const struct sr_pktinfo* info);
+void sr_acl_format_rule(const struct sr_acl_rule* r, char* buf, int size);
+void sr_acl_print(struct sr_acl* acl, FILE* out);
+
+#endif /* -- SR_ACL_H -- */
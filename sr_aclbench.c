@@ -0,0 +1,349 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_aclbench.c
+ *
+ * Description:
+ *
+ * Classification benchmark for the ACL (see sr_acl.h).  For each rule
+ * count it generates a random rule set, compiles it and times
+ * sr_acl_classify against a first-match linear scan over the same keys,
+ * checking that both pick the same rule for every key.
+ *
+ *   sr_aclbench [-r COUNTS] [-p PACKETS] [-s SEED] [-f RULES_FILE]
+ *
+ * COUNTS is a comma separated list of rule counts (10,100,1000,10000 by
+ * default).  Half the keys are built to fall inside a random rule, the
+ * rest are random.  With -f the rules come from a rules file instead.
+ *
+ * The generated rules follow the shape of firewall ACLs: mostly exact
+ * or /24 destinations and well known destination ports, wider sources,
+ * a few port ranges, and more specific rules ahead of broader ones.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "sr_protocol.h"
+#include "sr_acl.h"
+
+#define BENCH_PACKETS   65536
+#define BENCH_LOOKUPS   4000000  /* per timed tuple space run */
+#define BENCH_LINEAR    200000000 /* rule checks per timed linear run */
+#define BENCH_MAX_COUNTS 16
+
+/* -- address pools, host byte order: sources in 10/8, destinations in 172.16/12 -- */
+#define BENCH_SRC_NET  0x0a000000u
+#define BENCH_SRC_MASK 0xff000000u
+#define BENCH_DST_NET  0xac100000u
+#define BENCH_DST_MASK 0xfff00000u
+
+static uint64_t bench_state = 88172645463325252ULL;
+
+static double bench_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+} /* -- bench_now -- */
+
+/* -- xorshift64, so runs repeat for a seed -- */
+static uint32_t bench_rand(void)
+{
+    bench_state ^= bench_state << 13;
+    bench_state ^= bench_state >> 7;
+    bench_state ^= bench_state << 17;
+    return (uint32_t)(bench_state >> 32);
+} /* -- bench_rand -- */
+
+/* -- pick from values by percentage weights summing to 100 -- */
+static int bench_pick(const int* values, const int* weights, int n)
+{
+    int x = bench_rand() % 100, i;
+
+    for (i = 0; i < n - 1; i++)
+    {
+        if ((x -= weights[i]) < 0)
+        { break; }
+    }
+    return values[i];
+} /* -- bench_pick -- */
+
+static uint32_t bench_mask(int bits)
+{
+    return bits ? htonl(0xffffffffu << (32 - bits)) : 0;
+} /* -- bench_mask -- */
+
+/* -- longer prefixes first, keeping the generated order otherwise -- */
+static int bench_cmp(const void* a, const void* b)
+{
+    const struct sr_acl_rule* ra = (const struct sr_acl_rule*)a;
+    const struct sr_acl_rule* rb = (const struct sr_acl_rule*)b;
+    int d = (rb->sbits + rb->dbits) - (ra->sbits + ra->dbits);
+
+    return d ? d : (int)ra->line - (int)rb->line;
+} /* -- bench_cmp -- */
+
+/*---------------------------------------------------------------------
+ * Method: bench_rules(..)
+ * Scope:  Local
+ *---------------------------------------------------------------------*/
+
+static void bench_rules(struct sr_acl_rule* rules, uint32_t n)
+{
+    static const int sbits[] = { 0, 8, 16, 24, 32 }, sbits_w[] = { 25, 5, 15, 25, 30 };
+    static const int dbits[] = { 0, 16, 24, 32 },    dbits_w[] = { 2, 8, 30, 60 };
+    static const int protos[] = { ip_protocol_tcp, ip_protocol_udp, ip_protocol_icmp, -1 };
+    static const int protos_w[] = { 50, 30, 5, 15 };
+    static const int wellknown[] = { 22, 25, 53, 80, 123, 143, 443, 993, 3306, 8080 };
+    uint32_t i;
+
+    memset(rules, 0, n * sizeof(*rules));
+    for (i = 0; i < n; i++)
+    {
+        struct sr_acl_rule* r = &rules[i];
+        int proto = bench_pick(protos, protos_w, 4), x;
+
+        r->line = i + 1;
+        r->action = bench_rand() & 1;
+        r->sbits = bench_pick(sbits, sbits_w, 5);
+        r->dbits = bench_pick(dbits, dbits_w, 4);
+        r->src = htonl(BENCH_SRC_NET | (bench_rand() & ~BENCH_SRC_MASK)) & bench_mask(r->sbits);
+        r->dst = htonl(BENCH_DST_NET | (bench_rand() & ~BENCH_DST_MASK)) & bench_mask(r->dbits);
+        r->proto_any = (proto < 0);
+        r->proto = (proto < 0) ? 0 : proto;
+        r->sport_lo = r->dport_lo = 0;
+        r->sport_hi = r->dport_hi = 65535;
+        if (proto != ip_protocol_tcp && proto != ip_protocol_udp)
+        { continue; }
+
+        x = bench_rand() % 100;
+        if (x < 10)
+        { r->sport_lo = 1024; }
+        else if (x < 15)
+        { r->sport_lo = r->sport_hi = 1024 + bench_rand() % 64512; }
+
+        x = bench_rand() % 100;
+        if (x < 60)
+        { r->dport_lo = r->dport_hi = wellknown[bench_rand() % 10]; }
+        else if (x < 85)
+        {
+            r->dport_lo = bench_rand() % 1024;
+            r->dport_hi = r->dport_lo + bench_rand() % 4096;
+        }
+    }
+
+    qsort(rules, n, sizeof(*rules), bench_cmp);
+    for (i = 0; i < n; i++)
+    { rules[i].line = i + 1; }
+} /* -- bench_rules -- */
+
+/*---------------------------------------------------------------------
+ * Method: bench_keys(..)
+ * Scope:  Local
+ *---------------------------------------------------------------------*/
+
+static void bench_keys(const struct sr_acl_rule* rules, uint32_t nrules,
+                       struct sr_acl_key* keys, uint32_t n)
+{
+    static const int protos[] = { ip_protocol_tcp, ip_protocol_udp, ip_protocol_icmp };
+    uint32_t i;
+
+    for (i = 0; i < n; i++)
+    {
+        struct sr_acl_key* k = &keys[i];
+
+        k->src = htonl(BENCH_SRC_NET | (bench_rand() & ~BENCH_SRC_MASK));
+        k->dst = htonl(BENCH_DST_NET | (bench_rand() & ~BENCH_DST_MASK));
+        k->proto = protos[bench_rand() % 3];
+        if (nrules > 0 && (i & 1))
+        {
+            const struct sr_acl_rule* r = &rules[bench_rand() % nrules];
+
+            k->src = r->src | (k->src & ~bench_mask(r->sbits));
+            k->dst = r->dst | (k->dst & ~bench_mask(r->dbits));
+            if (!r->proto_any)
+            { k->proto = r->proto; }
+            k->sport = r->sport_lo + bench_rand() % (r->sport_hi - r->sport_lo + 1);
+            k->dport = r->dport_lo + bench_rand() % (r->dport_hi - r->dport_lo + 1);
+        }
+        else
+        {
+            k->sport = bench_rand();
+            k->dport = bench_rand() % 1024;
+        }
+        if (k->proto != ip_protocol_tcp && k->proto != ip_protocol_udp)
+        { k->sport = k->dport = 0; }
+    }
+} /* -- bench_keys -- */
+
+static int bench_linear(const struct sr_acl_rule* rules, uint32_t n,
+                        const struct sr_acl_key* k)
+{
+    uint32_t i;
+
+    for (i = 0; i < n; i++)
+    {
+        const struct sr_acl_rule* r = &rules[i];
+
+        if ((k->src & bench_mask(r->sbits)) == r->src &&
+            (k->dst & bench_mask(r->dbits)) == r->dst &&
+            (r->proto_any || r->proto == k->proto) &&
+            k->sport >= r->sport_lo && k->sport <= r->sport_hi &&
+            k->dport >= r->dport_lo && k->dport <= r->dport_hi)
+        { return i; }
+    }
+    return -1;
+} /* -- bench_linear -- */
+
+/*---------------------------------------------------------------------
+ * Method: bench_run(..)
+ * Scope:  Local
+ *
+ * Time one rule set.  Returns the number of keys the two classifiers
+ * disagree on.
+ *
+ *---------------------------------------------------------------------*/
+
+static unsigned long bench_run(struct sr_acl_rule* rules, uint32_t nrules,
+                               uint32_t npackets)
+{
+    struct sr_acl_key* keys;
+    struct sr_acl_set* set;
+    unsigned long bad = 0, matched = 0, i, rounds, nlinear;
+    volatile long sink = 0;
+    double t0, tss, lin;
+    long acc;
+
+    keys = (struct sr_acl_key*)calloc(npackets, sizeof(*keys));
+    if (!keys || (set = sr_acl_compile(rules, nrules)) == 0)
+    {
+        fprintf(stderr, "sr_aclbench: out of memory\n");
+        exit(1);
+    }
+    bench_keys(set->rules, nrules, keys, npackets);
+
+    /* -- the linear scan gets fewer keys when the set is large -- */
+    nlinear = npackets;
+    if (nrules > 0 && (unsigned long)nrules * nlinear > BENCH_LINEAR)
+    { nlinear = BENCH_LINEAR / nrules; }
+
+    for (i = 0; i < nlinear; i++)
+    {
+        int a = sr_acl_classify(set, &keys[i]);
+
+        if (a != bench_linear(set->rules, nrules, &keys[i]))
+        { bad++; }
+        matched += (a >= 0);
+    }
+
+    rounds = BENCH_LOOKUPS / npackets + 1;
+    acc = 0;
+    t0 = bench_now();
+    for (i = 0; i < rounds * npackets; i++)
+    { acc += sr_acl_classify(set, &keys[i % npackets]); }
+    tss = (bench_now() - t0) / (rounds * npackets);
+    sink += acc;
+
+    acc = 0;
+    t0 = bench_now();
+    for (i = 0; i < nlinear; i++)
+    { acc += bench_linear(set->rules, nrules, &keys[i]); }
+    lin = (bench_now() - t0) / (nlinear ? nlinear : 1);
+    sink += acc;
+
+    printf("%8u %7u %12.1f %14.1f %8.1f%%\n", nrules, set->ntuples, tss * 1e9,
+           lin * 1e9, nlinear ? 100.0 * matched / nlinear : 0.0);
+
+    sr_acl_set_free(set);
+    free(keys);
+    return bad;
+} /* -- bench_run -- */
+
+static void usage(const char* argv0)
+{
+    fprintf(stderr, "Usage: %s [-r rule counts] [-p packets] [-s seed] "
+            "[-f rules file]\n", argv0);
+} /* -- usage -- */
+
+int main(int argc, char** argv)
+{
+    uint32_t counts[BENCH_MAX_COUNTS] = { 10, 100, 1000, 10000 };
+    int ncounts = 4, c, i;
+    uint32_t npackets = BENCH_PACKETS;
+    const char* file = 0;
+    unsigned long bad = 0;
+    char* p;
+
+    while ((c = getopt(argc, argv, "hr:p:s:f:")) != EOF)
+    {
+        switch (c)
+        {
+            case 'r':
+                for (ncounts = 0, p = strtok(optarg, ","); p && ncounts < BENCH_MAX_COUNTS;
+                     p = strtok(0, ","))
+                { counts[ncounts++] = strtoul(p, 0, 10); }
+                break;
+            case 'p':
+                npackets = strtoul(optarg, 0, 10);
+                break;
+            case 's':
+                bench_state = strtoull(optarg, 0, 10) | 1;
+                break;
+            case 'f':
+                file = optarg;
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if (npackets == 0)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    printf("%8s %7s %12s %14s %9s\n", "rules", "tuples", "tss ns/pkt",
+           "linear ns/pkt", "matched");
+
+    if (file)
+    {
+        struct sr_acl_rule* rules;
+        uint32_t nrules;
+
+        if (sr_acl_parse_file(file, &rules, &nrules, stderr) < 0)
+        { return 1; }
+        bad += bench_run(rules, nrules, npackets);
+        free(rules);
+    }
+    else
+    {
+        for (i = 0; i < ncounts; i++)
+        {
+            struct sr_acl_rule* rules;
+
+            if ((rules = (struct sr_acl_rule*)calloc(counts[i] + 1, sizeof(*rules))) == 0)
+            {
+                fprintf(stderr, "sr_aclbench: out of memory\n");
+                return 1;
+            }
+            bench_rules(rules, counts[i]);
+            bad += bench_run(rules, counts[i], npackets);
+            free(rules);
+        }
+    }
+
+    if (bad)
+    {
+        printf("%lu key(s) classified differently from the linear scan\n", bad);
+        return 2;
+    }
+    return 0;
+} /* -- main -- */
@@ -0,0 +1,503 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_afpacket.c
+ *
+ * Description:
+ *
+ * AF_PACKET netdev backend on PACKET_MMAP rings, for veth pairs and real
+ * NICs.  Each router interface gets a raw socket bound to its device (the
+ * device column of the interface file, see sr_netdev.h) with
+ *
+ *  - a TPACKET_V3 receive ring: the kernel fills whole blocks of frames,
+ *    the router routes them in place, straight out of the ring, and hands
+ *    the block back.
+ *  - a TPACKET_V3 transmit ring: sr_send_packet copies the frame into the
+ *    next free slot; the slots queued during one loop iteration are sent
+ *    with a single send() per device.
+ *
+ * Everything runs on the calling thread, multiplexed with epoll together
+ * with the ARP tick and the control socket, so the ARP cache is unlocked.
+ * The router may rewrite frames in the receive ring since it owns a block
+ * until it returns it; anything kept longer (the ARP queue) is copied.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <net/if.h>
+#include <arpa/inet.h>
+
+#include "sr_router.h"
+#include "sr_netdev.h"
+#include "sr_arpcache.h"
+#include "sr_egress.h"
+
+#ifdef _LINUX_
+#include <linux/if_packet.h>
+#include <linux/if_ether.h>
+#endif /* _LINUX_ */
+
+#define SR_AFP_BLOCK_SIZE (1 << 18) /* 256KB ring blocks */
+#define SR_AFP_RX_BLOCKS  16
+#define SR_AFP_TX_BLOCKS  4
+#define SR_AFP_FRAME_SIZE 2048      /* transmit slot, and rx frame hint */
+#define SR_AFP_BLOCK_TOV  1         /* ms before a partly filled block retires */
+#define SR_AFP_EVENTS     16
+
+#define SR_AFP_TX_DATA (TPACKET3_HDRLEN - sizeof(struct sockaddr_ll))
+
+/* epoll tags: devices use their index, the rest are flagged */
+#define SR_AFP_EV_TIMER  (1ULL << 32)
+#define SR_AFP_EV_CTL    (2ULL << 32)
+#define SR_AFP_EV_CLIENT (3ULL << 32)
+#define SR_AFP_EV_PACER  (4ULL << 32)
+
+struct sr_afp_dev
+{
+    int fd;
+    uint8_t* map;          /* rx ring followed by tx ring */
+    size_t map_len;
+    uint8_t* rx;
+    unsigned int rx_block; /* next block to look at */
+    uint8_t* tx;
+    unsigned int tx_frames;
+    unsigned int tx_head;  /* next slot to fill */
+    unsigned int tx_pending;
+};
+
+struct sr_afp
+{
+    struct sr_afp_dev devs[SR_NETDEV_MAX_IFACES];
+    int ndevs;
+};
+
+/*---------------------------------------------------------------------
+ * Method: sr_afp_close(..)
+ * Scope:  Local
+ *---------------------------------------------------------------------*/
+
+static void sr_afp_close(struct sr_instance* sr)
+{
+    struct sr_afp* afp = sr->netdev_priv;
+    int i;
+
+    if (!afp)
+    { return; }
+
+    for (i = 0; i < afp->ndevs; i++)
+    {
+        if (afp->devs[i].map && afp->devs[i].map != MAP_FAILED)
+        { munmap(afp->devs[i].map, afp->devs[i].map_len); }
+        if (afp->devs[i].fd >= 0)
+        { close(afp->devs[i].fd); }
+    }
+    free(afp);
+    sr->netdev_priv = 0;
+} /* -- sr_afp_close -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_afp_open_dev(..)
+ * Scope:  Local
+ *
+ * Raw socket with mapped rx and tx rings, bound to device name.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_afp_open_dev(struct sr_afp_dev* dev, const char* name)
+{
+    struct tpacket_req3 rx_req, tx_req;
+    struct sockaddr_ll sll;
+    int version = TPACKET_V3;
+    int one = 1;
+    unsigned int ifindex;
+
+    if ((ifindex = if_nametoindex(name)) == 0)
+    {
+        fprintf(stderr, "no such device %s\n", name);
+        return -1;
+    }
+
+    if ((dev->fd = socket(AF_PACKET, SOCK_RAW | SOCK_CLOEXEC, 0)) < 0)
+    {
+        perror("socket(AF_PACKET):sr_afpacket.c::sr_afp_open_dev");
+        return -1;
+    }
+
+    if (setsockopt(dev->fd, SOL_PACKET, PACKET_VERSION, &version,
+                   sizeof(version)) < 0)
+    {
+        perror("PACKET_VERSION:sr_afpacket.c::sr_afp_open_dev");
+        return -1;
+    }
+
+    /* -- our own transmits would otherwise show up on the rx ring -- */
+    setsockopt(dev->fd, SOL_PACKET, PACKET_IGNORE_OUTGOING, &one, sizeof(one));
+    setsockopt(dev->fd, SOL_PACKET, PACKET_QDISC_BYPASS, &one, sizeof(one));
+
+    memset(&rx_req, 0, sizeof(rx_req));
+    rx_req.tp_block_size = SR_AFP_BLOCK_SIZE;
+    rx_req.tp_block_nr = SR_AFP_RX_BLOCKS;
+    rx_req.tp_frame_size = SR_AFP_FRAME_SIZE;
+    rx_req.tp_frame_nr = (SR_AFP_BLOCK_SIZE / SR_AFP_FRAME_SIZE) * SR_AFP_RX_BLOCKS;
+    rx_req.tp_retire_blk_tov = SR_AFP_BLOCK_TOV;
+
+    memset(&tx_req, 0, sizeof(tx_req));
+    tx_req.tp_block_size = SR_AFP_BLOCK_SIZE;
+    tx_req.tp_block_nr = SR_AFP_TX_BLOCKS;
+    tx_req.tp_frame_size = SR_AFP_FRAME_SIZE;
+    tx_req.tp_frame_nr = (SR_AFP_BLOCK_SIZE / SR_AFP_FRAME_SIZE) * SR_AFP_TX_BLOCKS;
+
+    if (setsockopt(dev->fd, SOL_PACKET, PACKET_RX_RING, &rx_req,
+                   sizeof(rx_req)) < 0 ||
+        setsockopt(dev->fd, SOL_PACKET, PACKET_TX_RING, &tx_req,
+                   sizeof(tx_req)) < 0)
+    {
+        perror("PACKET_RX/TX_RING:sr_afpacket.c::sr_afp_open_dev");
+        return -1;
+    }
+
+    dev->map_len = (size_t)SR_AFP_BLOCK_SIZE * (SR_AFP_RX_BLOCKS + SR_AFP_TX_BLOCKS);
+    dev->map = mmap(0, dev->map_len, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_LOCKED | MAP_POPULATE, dev->fd, 0);
+    if (dev->map == MAP_FAILED)
+    {
+        /* -- MAP_LOCKED fails under a low RLIMIT_MEMLOCK -- */
+        dev->map = mmap(0, dev->map_len, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, dev->fd, 0);
+    }
+    if (dev->map == MAP_FAILED)
+    {
+        perror("mmap:sr_afpacket.c::sr_afp_open_dev");
+        return -1;
+    }
+    dev->rx = dev->map;
+    dev->tx = dev->map + (size_t)SR_AFP_BLOCK_SIZE * SR_AFP_RX_BLOCKS;
+    dev->tx_frames = tx_req.tp_frame_nr;
+
+    memset(&sll, 0, sizeof(sll));
+    sll.sll_family = AF_PACKET;
+    sll.sll_protocol = htons(ETH_P_ALL);
+    sll.sll_ifindex = ifindex;
+    if (bind(dev->fd, (struct sockaddr*)&sll, sizeof(sll)) < 0)
+    {
+        perror("bind:sr_afpacket.c::sr_afp_open_dev");
+        return -1;
+    }
+
+    return 0;
+} /* -- sr_afp_open_dev -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_afp_open(..)
+ * Scope:  Local
+ *---------------------------------------------------------------------*/
+
+static int sr_afp_open(struct sr_instance* sr)
+{
+    struct sr_netdev_conf* conf = &(sr->netdev_conf);
+    struct sr_afp* afp;
+    int i;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+
+    if (conf->queues > 1)
+    { fprintf(stderr, "packet backend runs a single queue, ignoring -q\n"); }
+
+    if ((afp = (struct sr_afp*)calloc(1, sizeof(*afp))) == 0)
+    {
+        fprintf(stderr, "Error: out of memory (sr_afp_open)\n");
+        return -1;
+    }
+    sr->netdev_priv = afp;
+
+    for (i = 0; i < conf->nifs; i++)
+    {
+        afp->devs[i].fd = -1;
+        afp->ndevs = i + 1;
+        if (sr_afp_open_dev(&afp->devs[i], conf->ifs[i].device) < 0)
+        {
+            sr_afp_close(sr);
+            return -1;
+        }
+        printf("%s on packet ring %s\n", conf->ifs[i].name,
+               conf->ifs[i].device);
+    }
+
+    return 0;
+} /* -- sr_afp_open -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_afp_rx(..)
+ * Scope:  Local
+ *
+ * Route every frame of the blocks the kernel has handed over, in place,
+ * then give the blocks back.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_afp_rx(struct sr_instance* sr, struct sr_afp_dev* dev,
+                      char* ifname)
+{
+    struct tpacket_block_desc* bd;
+    struct tpacket3_hdr* hdr;
+    uint8_t* pkts[SR_BURST_MAX];
+    unsigned int lens[SR_BURST_MAX];
+    char* names[SR_BURST_MAX];
+    unsigned int count, i, num;
+
+    while (1)
+    {
+        bd = (struct tpacket_block_desc*)(dev->rx +
+                (size_t)dev->rx_block * SR_AFP_BLOCK_SIZE);
+        if (!(__atomic_load_n(&bd->hdr.bh1.block_status, __ATOMIC_ACQUIRE) &
+              TP_STATUS_USER))
+        { break; }
+
+        num = bd->hdr.bh1.num_pkts;
+        hdr = (struct tpacket3_hdr*)((uint8_t*)bd + bd->hdr.bh1.offset_to_first_pkt);
+        count = 0;
+
+        for (i = 0; i < num; i++)
+        {
+            if (hdr->tp_snaplen >= sizeof(struct sr_ethernet_hdr))
+            {
+                pkts[count] = (uint8_t*)hdr + hdr->tp_mac;
+                lens[count] = hdr->tp_snaplen;
+                names[count] = ifname;
+                sr->stats.rx_packets++;
+                sr->stats.rx_bytes += hdr->tp_snaplen;
+                if (++count == SR_BURST_MAX)
+                {
+                    sr_handlepacket_burst(sr, pkts, lens, names, count);
+                    count = 0;
+                }
+            }
+            hdr = (struct tpacket3_hdr*)((uint8_t*)hdr + hdr->tp_next_offset);
+        }
+
+        if (count > 0)
+        { sr_handlepacket_burst(sr, pkts, lens, names, count); }
+
+        __atomic_store_n(&bd->hdr.bh1.block_status, TP_STATUS_KERNEL,
+                         __ATOMIC_RELEASE);
+        dev->rx_block = (dev->rx_block + 1) % SR_AFP_RX_BLOCKS;
+    }
+} /* -- sr_afp_rx -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_afp_flush(..)
+ * Scope:  Local
+ *
+ * Kick the kernel to send the slots queued on dev.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_afp_flush(struct sr_instance* sr, struct sr_afp_dev* dev)
+{
+    if (dev->tx_pending == 0)
+    { return; }
+
+    if (send(dev->fd, 0, 0, MSG_DONTWAIT) < 0 && errno != EAGAIN &&
+        errno != ENOBUFS)
+    { perror("send:sr_afpacket.c::sr_afp_flush"); }
+    sr->stats.syscalls++;
+    dev->tx_pending = 0;
+} /* -- sr_afp_flush -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_afp_send(..)
+ * Scope:  Local
+ *
+ * Copy a frame into the next transmit slot of iface's ring.  The slot is
+ * sent when the loop flushes, or right away once the ring is full.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_afp_send(struct sr_instance* sr, const uint8_t* buf,
+                       unsigned int len, const char* iface)
+{
+    struct sr_afp* afp = sr->netdev_priv;
+    struct sr_netdev_if* nif;
+    struct sr_afp_dev* dev;
+    struct tpacket3_hdr* hdr;
+
+    if (!afp || (nif = sr_netdev_find_if(sr, iface)) == 0)
+    { return -1; }
+    dev = &afp->devs[nif - sr->netdev_conf.ifs];
+
+    if (len > SR_AFP_FRAME_SIZE - SR_AFP_TX_DATA)
+    {
+        /* -- larger than a slot: plain send on the same socket -- */
+        sr->stats.syscalls++;
+        return send(dev->fd, buf, len, 0) == (ssize_t)len ? 0 : -1;
+    }
+
+    hdr = (struct tpacket3_hdr*)(dev->tx +
+            (size_t)dev->tx_head * SR_AFP_FRAME_SIZE);
+
+    if (__atomic_load_n(&hdr->tp_status, __ATOMIC_ACQUIRE) != TP_STATUS_AVAILABLE)
+    {
+        /* -- ring full: push out what is queued and look again -- */
+        dev->tx_pending++;
+        sr_afp_flush(sr, dev);
+        if (__atomic_load_n(&hdr->tp_status, __ATOMIC_ACQUIRE) !=
+            TP_STATUS_AVAILABLE)
+        { return -1; }
+    }
+
+    memcpy((uint8_t*)hdr + SR_AFP_TX_DATA, buf, len);
+    hdr->tp_len = len;
+    hdr->tp_snaplen = len;
+    hdr->tp_next_offset = 0;
+    __atomic_store_n(&hdr->tp_status, TP_STATUS_SEND_REQUEST, __ATOMIC_RELEASE);
+
+    dev->tx_head = (dev->tx_head + 1) % dev->tx_frames;
+    dev->tx_pending++;
+
+    return 0;
+} /* -- sr_afp_send -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_afp_add(..)
+ * Scope:  Local
+ *---------------------------------------------------------------------*/
+
+static int sr_afp_add(int epfd, int fd, uint64_t tag)
+{
+    struct epoll_event ev;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.u64 = tag;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0)
+    {
+        perror("epoll_ctl(..):sr_afpacket.c::sr_afp_add(..)");
+        return -1;
+    }
+    return 0;
+} /* -- sr_afp_add -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_afp_run(..)
+ * Scope:  Local
+ *
+ * Single threaded loop over the rings, the ARP tick and the control
+ * socket.  Transmit slots are flushed once per iteration.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_afp_run(struct sr_instance* sr)
+{
+    struct sr_afp* afp = sr->netdev_priv;
+    struct epoll_event events[SR_AFP_EVENTS];
+    struct itimerspec its;
+    uint64_t tag, expirations;
+    int epfd, tfd, cfd = -1;
+    int i, n, ret = 0, stop = 0;
+
+    /* -- REQUIRES -- */
+    assert(afp);
+
+    sr->cache.use_locks = 0;
+
+    if ((epfd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+    {
+        perror("epoll_create1(..):sr_afpacket.c::sr_afp_run");
+        return -1;
+    }
+
+    for (i = 0; i < afp->ndevs; i++)
+    { sr_afp_add(epfd, afp->devs[i].fd, (uint64_t)i); }
+
+    if ((tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) >= 0)
+    {
+        memset(&its, 0, sizeof(its));
+        its.it_value.tv_sec = 1;
+        its.it_interval.tv_sec = 1;
+        timerfd_settime(tfd, 0, &its, 0);
+        sr_afp_add(epfd, tfd, SR_AFP_EV_TIMER);
+    }
+    if (sr_egress_timer_fd(sr) >= 0)
+    { sr_afp_add(epfd, sr_egress_timer_fd(sr), SR_AFP_EV_PACER); }
+
+    if (sr->ctl_path[0] != '\0' && (cfd = sr_ctl_listen(sr->ctl_path)) >= 0)
+    { sr_afp_add(epfd, cfd, SR_AFP_EV_CTL); }
+
+    while (!stop)
+    {
+        n = epoll_wait(epfd, events, SR_AFP_EVENTS, -1);
+        sr->stats.syscalls++;
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            { continue; }
+            perror("epoll_wait(..):sr_afpacket.c::sr_afp_run");
+            ret = -1;
+            break;
+        }
+
+        for (i = 0; i < n; i++)
+        {
+            tag = events[i].data.u64;
+
+            if (tag < SR_NETDEV_MAX_IFACES)
+            {
+                sr_afp_rx(sr, &afp->devs[tag], sr->netdev_conf.ifs[tag].name);
+            }
+            else if (tag == SR_AFP_EV_TIMER)
+            {
+                if (read(tfd, &expirations, sizeof(expirations)) > 0 &&
+                    sr_arpcache_tick(sr))
+                { stop = 1; }
+            }
+            else if (tag == SR_AFP_EV_PACER)
+            {
+                sr_egress_timer(sr);
+            }
+            else if (tag == SR_AFP_EV_CTL)
+            {
+                int fd = sr_ctl_accept(sr, cfd);
+                if (fd >= 0 && sr_afp_add(epfd, fd, SR_AFP_EV_CLIENT | fd) < 0)
+                { sr_ctl_close(fd); }
+            }
+            else
+            {
+                /* -- control client -- */
+                sr_ctl_serve_epoll(sr, epfd, (int)(tag & 0xffffffffULL), tag);
+            }
+        }
+
+        for (i = 0; i < afp->ndevs; i++)
+        { sr_afp_flush(sr, &afp->devs[i]); }
+    }
+
+    if (cfd >= 0)
+    {
+        sr_ctl_disconnect(sr);
+        close(cfd);
+        unlink(sr->ctl_path);
+    }
+    if (tfd >= 0)
+    { close(tfd); }
+    close(epfd);
+
+    return ret;
+} /* -- sr_afp_run -- */
+
+const struct sr_netdev_ops sr_netdev_afpacket =
+{
+    "packet",
+    sr_afp_open,
+    sr_afp_run,
+    sr_afp_send,
+    sr_afp_close
+};
@@ -1,4 +1,5 @@
 #include <netinet/in.h>
+#include <arpa/inet.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <time.h>
@@ -6,11 +7,33 @@
 #include <pthread.h>
 #include <sched.h>
 #include <string.h>
+#include <errno.h>
 #include "sr_arpcache.h"
 #include "sr_router.h"
 #include "sr_if.h"
+#include "sr_rt.h"
 #include "sr_protocol.h"
+#include "sr_nat.h"
+#include "sr_common.h"
 
+#define SR_ARPCACHE_CACHELINE 64
+
+/* Drops packets from the head of req, the oldest, while it holds more
+   than SR_ARPCACHE_PENDING_MAX. Called with the cache locked. */
+static void sr_arpreq_trim(struct sr_arpcache *cache, struct sr_arpreq *req) {
+    struct sr_packet *pkt;
+
+    while (req->npackets > SR_ARPCACHE_PENDING_MAX) {
+        pkt = req->packets;
+        cache->pending_overflow++;
+        req->packets = pkt->next;
+        if (req->packets == NULL)
+            req->last = NULL;
+        req->npackets--;
+        sr_pbuf_put(pkt->pb);
+        free(pkt);
+    }
+}
 
 /* 
   This function gets called every second. For each request sent out, we keep
@@ -20,7 +43,7 @@
 void sr_arpcache_sweepreqs(struct sr_instance *sr) { 
     /* Fill this in */
     
-    pthread_mutex_lock(&(sr->cache.lock));
+    SR_ARPCACHE_LOCK(&(sr->cache));
     /*resend every request in the ARP cache queue*/
     struct sr_arpreq * req = sr->cache.requests;
     while( req != NULL )
@@ -34,7 +57,7 @@ void sr_arpcache_sweepreqs(struct sr_instance *sr) {
 	
     }	
 
-    pthread_mutex_unlock(&(sr->cache.lock));
+    SR_ARPCACHE_UNLOCK(&(sr->cache));
 }
 
 /* You should not need to touch the rest of this code. */
@@ -42,7 +65,7 @@ void sr_arpcache_sweepreqs(struct sr_instance *sr) {
 /* Checks if an IP->MAC mapping is in the cache. IP is in network byte order.
    You must free the returned structure if it is not NULL. */
 struct sr_arpentry *sr_arpcache_lookup(struct sr_arpcache *cache, uint32_t ip) {
-    pthread_mutex_lock(&(cache->lock));
+    SR_ARPCACHE_LOCK(cache);
     
     struct sr_arpentry *entry = NULL, *copy = NULL;
     
@@ -60,11 +83,20 @@ struct sr_arpentry *sr_arpcache_lookup(struct sr_arpcache *cache, uint32_t ip) {
         memcpy(copy, entry, sizeof(struct sr_arpentry));
     }
         
-    pthread_mutex_unlock(&(cache->lock));
+    SR_ARPCACHE_UNLOCK(cache);
     
     return copy;
 }
 
+void sr_arpcache_prefetch(struct sr_arpcache *cache) {
+    const char *p = (const char *) cache->entries;
+    const char *end = p + sizeof(cache->entries);
+
+    for (; p < end; p += SR_ARPCACHE_CACHELINE) {
+        SR_PREFETCH(p);
+    }
+}
+
 /* Adds an ARP request to the ARP request queue. If the request is already on
    the queue, adds the packet to the linked list of packets for this sr_arpreq
    that corresponds to this ARP request. You should free the passed *packet.
@@ -75,9 +107,10 @@ struct sr_arpreq *sr_arpcache_queuereq(struct sr_arpcache *cache,
                                        uint32_t ip,
                                        uint8_t *packet,           /* borrowed */
                                        unsigned int packet_len,
+                                       const struct sr_pktinfo *info,
                                        char *iface)
 {
-    pthread_mutex_lock(&(cache->lock));
+    SR_ARPCACHE_LOCK(cache);
     
     struct sr_arpreq *req;
     for (req = cache->requests; req != NULL; req = req->next) {
@@ -93,21 +126,35 @@ struct sr_arpreq *sr_arpcache_queuereq(struct sr_arpcache *cache,
         req->next = cache->requests;
         cache->requests = req;
     }
+    if (iface && req->iface[0] == '\0')
+        strncpy(req->iface, iface, sr_IFACE_NAMELEN - 1);
     
     /* Add the packet to the list of packets for this request */
-    if (packet && packet_len && iface) {
-        struct sr_packet *new_pkt = (struct sr_packet *)malloc(sizeof(struct sr_packet));
+    if (packet && packet_len && info && iface) {
+        struct sr_packet *new_pkt = (struct sr_packet *)calloc(1, sizeof(struct sr_packet));
         
-        new_pkt->buf = (uint8_t *)malloc(packet_len);
-        memcpy(new_pkt->buf, packet, packet_len);
+        /* a reference to the received frame, not a copy, see sr_pbuf.h */
+        if (new_pkt == NULL || (new_pkt->pb = sr_pbuf_hold(packet, packet_len)) == NULL) {
+            free(new_pkt);
+            SR_ARPCACHE_UNLOCK(cache);
+            return req;
+        }
+        new_pkt->buf = new_pkt->pb->data;
         new_pkt->len = packet_len;
-		new_pkt->iface = (char *)malloc(sr_IFACE_NAMELEN);
-        strncpy(new_pkt->iface, iface, sr_IFACE_NAMELEN);
-        new_pkt->next = req->packets;
-        req->packets = new_pkt;
+        strncpy(new_pkt->iface, iface, sr_IFACE_NAMELEN - 1);
+        new_pkt->info = *info;
+        new_pkt->queued = info->received;
+        new_pkt->next = NULL;
+        if (req->last)
+            req->last->next = new_pkt;
+        else
+            req->packets = new_pkt;
+        req->last = new_pkt;
+        req->npackets++;
+        sr_arpreq_trim(cache, req);
     }
     
-    pthread_mutex_unlock(&(cache->lock));
+    SR_ARPCACHE_UNLOCK(cache);
     
     return req;
 }
@@ -118,9 +165,10 @@ struct sr_arpreq *sr_arpcache_queuereq(struct sr_arpcache *cache,
    2) Inserts this IP to MAC mapping in the cache, and marks it valid. */
 struct sr_arpreq *sr_arpcache_insert(struct sr_arpcache *cache,
                                      unsigned char *mac,
-                                     uint32_t ip)
+                                     uint32_t ip,
+                                     const char *iface)
 {
-    pthread_mutex_lock(&(cache->lock));
+    SR_ARPCACHE_LOCK(cache);
     
     struct sr_arpreq *req, *prev = NULL, *next = NULL; 
     for (req = cache->requests; req != NULL; req = req->next) {
@@ -139,20 +187,36 @@ struct sr_arpreq *sr_arpcache_insert(struct sr_arpcache *cache,
         prev = req;
     }
     
-    int i;
-    for (i = 0; i < SR_ARPCACHE_SZ; i++) {
-        if (!(cache->entries[i].valid))
-            break;
+    /* a static mapping for the IP wins over what the network says; a
+       learned one, tentative or not, is refreshed in place */
+    int i, j, free_slot = SR_ARPCACHE_SZ, same = SR_ARPCACHE_SZ;
+    for (j = 0; j < SR_ARPCACHE_SZ; j++) {
+        if (!(cache->entries[j].valid)) {
+            if (free_slot == SR_ARPCACHE_SZ)
+                free_slot = j;
+        }
+        else if (cache->entries[j].ip == ip) {
+            if (cache->entries[j].is_static)
+                break;
+            same = j;
+        }
     }
+    i = (j != SR_ARPCACHE_SZ) ? SR_ARPCACHE_SZ :
+        (same != SR_ARPCACHE_SZ) ? same : free_slot;
     
     if (i != SR_ARPCACHE_SZ) {
         memcpy(cache->entries[i].mac, mac, 6);
         cache->entries[i].ip = ip;
         cache->entries[i].added = time(NULL);
         cache->entries[i].valid = 1;
+        cache->entries[i].is_static = 0;
+        cache->entries[i].tentative = 0;
+        memset(cache->entries[i].iface, 0, sr_IFACE_NAMELEN);
+        if (iface)
+            strncpy(cache->entries[i].iface, iface, sr_IFACE_NAMELEN - 1);
     }
     
-    pthread_mutex_unlock(&(cache->lock));
+    SR_ARPCACHE_UNLOCK(cache);
     
     return req;
 }
@@ -160,7 +224,7 @@ struct sr_arpreq *sr_arpcache_insert(struct sr_arpcache *cache,
 /* Frees all memory associated with this arp request entry. If this arp request
    entry is on the arp request queue, it is removed from the queue. */
 void sr_arpreq_destroy(struct sr_arpcache *cache, struct sr_arpreq *entry) {
-    pthread_mutex_lock(&(cache->lock));
+    SR_ARPCACHE_LOCK(cache);
     
     if (entry) {
         struct sr_arpreq *req, *prev = NULL, *next = NULL; 
@@ -184,17 +248,302 @@ void sr_arpreq_destroy(struct sr_arpcache *cache, struct sr_arpreq *entry) {
         
         for (pkt = entry->packets; pkt; pkt = nxt) {
             nxt = pkt->next;
-            if (pkt->buf)
-                free(pkt->buf);
-            if (pkt->iface)
-                free(pkt->iface);
+            sr_pbuf_put(pkt->pb);
             free(pkt);
         }
         
         free(entry);
     }
     
-    pthread_mutex_unlock(&(cache->lock));
+    SR_ARPCACHE_UNLOCK(cache);
+}
+
+int sr_arpcache_pending_ok(struct sr_arpcache *cache, struct sr_packet *pkt) {
+    uint64_t now = sr_now_ns();
+    uint64_t waited = now > pkt->queued ? now - pkt->queued : 0;
+    int ok = waited <= SR_ARPCACHE_PENDING_TO;
+
+    SR_ARPCACHE_LOCK(cache);
+    if (ok) {
+        cache->pending_sent++;
+        sr_sojourn_add(&cache->sojourn, waited);
+    } else {
+        cache->pending_expired++;
+    }
+    SR_ARPCACHE_UNLOCK(cache);
+
+    return ok;
+}
+
+void sr_arpcache_print_pending(struct sr_arpcache *cache, FILE *out) {
+    struct sr_arpreq *req;
+    char ip[INET_ADDRSTRLEN];
+    uint64_t now = sr_now_ns();
+
+    SR_ARPCACHE_LOCK(cache);
+    for (req = cache->requests; req != NULL; req = req->next) {
+        inet_ntop(AF_INET, &req->ip, ip, sizeof(ip));
+        fprintf(out, "%s %s sent %u packets %u", ip, req->iface,
+                req->times_sent, req->npackets);
+        if (req->packets && now > req->packets->queued)
+            fprintf(out, " oldest %llu us",
+                    (unsigned long long)((now - req->packets->queued) / 1000));
+        fprintf(out, "\n");
+    }
+    fprintf(out, "sent %llu expired %llu overflow %llu ",
+            (unsigned long long)cache->pending_sent,
+            (unsigned long long)cache->pending_expired,
+            (unsigned long long)cache->pending_overflow);
+    sr_sojourn_print(&cache->sojourn, out);
+    fprintf(out, "\n");
+    sr_sojourn_print_buckets(&cache->sojourn, "sojourn", out);
+    SR_ARPCACHE_UNLOCK(cache);
+}
+
+/* Adds or overwrites a permanent IP->MAC mapping, handing back any request
+   queued for the IP. */
+int sr_arpcache_add_static(struct sr_arpcache *cache,
+                           unsigned char *mac,
+                           uint32_t ip,
+                           struct sr_arpreq **req)
+{
+    SR_ARPCACHE_LOCK(cache);
+
+    for (*req = cache->requests; *req != NULL; *req = (*req)->next) {
+        if ((*req)->ip == ip)
+            break;
+    }
+
+    int i, slot = -1;
+    for (i = 0; i < SR_ARPCACHE_SZ; i++) {
+        if (cache->entries[i].valid && cache->entries[i].ip == ip) {
+            slot = i;
+            break;
+        }
+        if (slot < 0 && !(cache->entries[i].valid))
+            slot = i;
+    }
+
+    if (slot >= 0) {
+        memcpy(cache->entries[slot].mac, mac, 6);
+        cache->entries[slot].ip = ip;
+        cache->entries[slot].added = time(NULL);
+        cache->entries[slot].valid = 1;
+        cache->entries[slot].is_static = 1;
+        cache->entries[slot].tentative = 0;
+        cache->entries[slot].iface[0] = '\0';
+    }
+
+    SR_ARPCACHE_UNLOCK(cache);
+
+    return (slot >= 0) ? 0 : -1;
+}
+
+/* Removes the mapping for ip, static or not. */
+int sr_arpcache_remove(struct sr_arpcache *cache, uint32_t ip)
+{
+    int i, found = -1;
+
+    SR_ARPCACHE_LOCK(cache);
+    for (i = 0; i < SR_ARPCACHE_SZ; i++) {
+        if (cache->entries[i].valid && cache->entries[i].ip == ip) {
+            cache->entries[i].valid = 0;
+            cache->entries[i].is_static = 0;
+            found = 0;
+        }
+    }
+    SR_ARPCACHE_UNLOCK(cache);
+
+    return found;
+}
+
+/* Invalidates every entry that is not static. */
+int sr_arpcache_flush(struct sr_arpcache *cache)
+{
+    int i, n = 0;
+
+    SR_ARPCACHE_LOCK(cache);
+    for (i = 0; i < SR_ARPCACHE_SZ; i++) {
+        if (cache->entries[i].valid && !(cache->entries[i].is_static)) {
+            cache->entries[i].valid = 0;
+            n++;
+        }
+    }
+    SR_ARPCACHE_UNLOCK(cache);
+
+    return n;
+}
+
+/* Writes the valid entries to out, one line per entry:
+   "ip mac interface added", with "- static" in place of the last two for
+   a static entry and added in seconds since the epoch. */
+int sr_arpcache_write(struct sr_arpcache *cache, FILE *out)
+{
+    struct sr_arpentry entries[SR_ARPCACHE_SZ];
+    char ip[INET_ADDRSTRLEN];
+    int i;
+
+    SR_ARPCACHE_LOCK(cache);
+    memcpy(entries, cache->entries, sizeof(entries));
+    SR_ARPCACHE_UNLOCK(cache);
+
+    fprintf(out, "# ip mac interface added|static\n");
+    for (i = 0; i < SR_ARPCACHE_SZ; i++) {
+        struct sr_arpentry *cur = &(entries[i]);
+        if (!cur->valid)
+            continue;
+        inet_ntop(AF_INET, &cur->ip, ip, sizeof(ip));
+        fprintf(out, "%s %02x:%02x:%02x:%02x:%02x:%02x ", ip,
+                cur->mac[0], cur->mac[1], cur->mac[2],
+                cur->mac[3], cur->mac[4], cur->mac[5]);
+        if (cur->is_static)
+            fprintf(out, "- static\n");
+        else
+            fprintf(out, "%s %ld\n", cur->iface[0] ? cur->iface : "-",
+                    (long)cur->added);
+    }
+    return ferror(out) ? -1 : 0;
+}
+
+/* Writes the snapshot to path.tmp and renames it over path, so a crash
+   while saving leaves the last snapshot. */
+int sr_arpcache_save(struct sr_arpcache *cache, const char *path)
+{
+    char tmp[512];
+    FILE *out;
+    int err;
+
+    SR_ARPCACHE_LOCK(cache);
+    cache->saved = time(NULL);
+    SR_ARPCACHE_UNLOCK(cache);
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    if ((out = fopen(tmp, "w")) == NULL) {
+        fprintf(stderr, "arp: cannot write %s: %s\n", tmp, strerror(errno));
+        return -1;
+    }
+    err = sr_arpcache_write(cache, out);
+    if (fclose(out) != 0 || err || rename(tmp, path) != 0) {
+        fprintf(stderr, "arp: cannot save %s: %s\n", path, strerror(errno));
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+/* Reloads the snapshot at path, skipping entries older than
+   SR_ARPCACHE_WARM_MAX_AGE or learned on an interface we no longer have.
+   Learned entries come back tentative and are asked for again, or, from
+   the router handing over to us (current), as they were there. Returns
+   how many were loaded; no file is not an error, the first start has
+   none. */
+static int sr_arpcache_load(struct sr_instance *sr, const char *path,
+                            int current)
+{
+    struct sr_arpcache *cache = &(sr->cache);
+    struct sr_arpreq *req;
+    struct in_addr addr;
+    unsigned int m[6];
+    unsigned char mac[6];
+    char line[256], ipstr[64], macstr[64], iface[64], added[64];
+    time_t now = time(NULL);
+    long when;
+    int i, n = 0, lineno = 0;
+    FILE *in;
+
+    if ((in = fopen(path, "r")) == NULL) {
+        if (errno != ENOENT)
+            fprintf(stderr, "arp: cannot read %s: %s\n", path, strerror(errno));
+        return 0;
+    }
+    while (fgets(line, sizeof(line), in)) {
+        lineno++;
+        if (line[0] == '#' || line[0] == '\n')
+            continue;
+        if (sscanf(line, "%63s %63s %63s %63s", ipstr, macstr, iface, added) != 4 ||
+            !inet_aton(ipstr, &addr) ||
+            sscanf(macstr, "%2x:%2x:%2x:%2x:%2x:%2x", &m[0], &m[1], &m[2],
+                   &m[3], &m[4], &m[5]) != 6) {
+            fprintf(stderr, "arp: %s:%d: bad entry\n", path, lineno);
+            continue;
+        }
+        for (i = 0; i < 6; i++)
+            mac[i] = (unsigned char)m[i];
+
+        if (strcmp(added, "static") == 0) {
+            if (sr_arpcache_add_static(cache, mac, addr.s_addr, &req) == 0)
+                n++;
+            if (req)
+                handle_ARP_send_pending(sr, req, mac, req->iface);
+            continue;
+        }
+        when = strtol(added, NULL, 10);
+        if (difftime(now, (time_t)when) > SR_ARPCACHE_WARM_MAX_AGE ||
+            sr_get_interface(sr, iface) == NULL)
+            continue;
+
+        /* usable now, confirmed by the reply to the request sent for it */
+        req = sr_arpcache_insert(cache, mac, addr.s_addr, iface);
+        if (req)
+            sr_arpreq_destroy(cache, req);
+        SR_ARPCACHE_LOCK(cache);
+        for (i = 0; i < SR_ARPCACHE_SZ; i++) {
+            if (cache->entries[i].valid && cache->entries[i].ip == addr.s_addr &&
+                !cache->entries[i].is_static) {
+                if (current)
+                    cache->entries[i].added = (time_t)when;
+                else
+                    cache->entries[i].tentative = 1;
+            }
+        }
+        SR_ARPCACHE_UNLOCK(cache);
+        if (!current)
+            handle_arpreq(sr, sr_arpcache_queuereq(cache, addr.s_addr, NULL, 0, NULL, iface));
+        n++;
+    }
+    fclose(in);
+    return n;
+}
+
+void sr_arpcache_warm(struct sr_instance *sr)
+{
+    struct sr_arpcache *cache = &(sr->cache);
+    struct sr_arpentry *entry;
+    struct sr_rt *rt;
+    int loaded = 0, asked = 0;
+
+    /* taking over from a running router, its cache comes instead */
+    if (cache->warm || sr->if_list == NULL || sr->handover)
+        return;
+    cache->warm = 1;
+
+    if (sr->arp_path[0] != '\0')
+        loaded = sr_arpcache_load(sr, sr->arp_path, 0);
+
+    /* the first packet to each next hop should not wait for ARP */
+    SR_RT_RDLOCK(sr);
+    for (rt = sr->routing_table; rt; rt = rt->next) {
+        if (rt->gw.s_addr == 0 || sr_get_interface(sr, rt->interface) == NULL)
+            continue;
+        if ((entry = sr_arpcache_lookup(cache, rt->gw.s_addr)) != NULL) {
+            free(entry);
+            continue;
+        }
+        handle_arpreq(sr, sr_arpcache_queuereq(cache, rt->gw.s_addr, NULL, 0,
+                                               NULL, rt->interface));
+        asked++;
+    }
+    SR_RT_UNLOCK(sr);
+
+    if (loaded || asked)
+        printf("ARP warm start: %d entries reloaded, %d next hops asked for\n",
+               loaded, asked);
+}
+
+int sr_arpcache_adopt(struct sr_instance *sr, const char *path)
+{
+    sr->cache.warm = 1;
+    return sr_arpcache_load(sr, path, 1);
 }
 
 /* Prints out the ARP table. */
@@ -214,17 +563,24 @@ void sr_arpcache_dump(struct sr_arpcache *cache) {
 
 /* Initialize table + table lock. Returns 0 on success. */
 int sr_arpcache_init(struct sr_arpcache *cache) {  
-    /* Seed RNG to kick out a random entry if all entries full. */
-    srand(time(NULL));
-    
+    /* rand() picks the entry to kick out if all entries are full; it is
+     * seeded once per process in main(). */
+
     /* Invalidate all entries */
     memset(cache->entries, 0, sizeof(cache->entries));
     cache->requests = NULL;
+    cache->warm = 0;
+    cache->saved = time(NULL);
+    cache->pending_sent = 0;
+    cache->pending_expired = 0;
+    cache->pending_overflow = 0;
+    memset(&(cache->sojourn), 0, sizeof(cache->sojourn));
     
     /* Acquire mutex lock */
     pthread_mutexattr_init(&(cache->attr));
     pthread_mutexattr_settype(&(cache->attr), PTHREAD_MUTEX_RECURSIVE);
     int success = pthread_mutex_init(&(cache->lock), &(cache->attr));
+    cache->use_locks = 1;
     
     return success;
 }
@@ -234,31 +590,61 @@ int sr_arpcache_destroy(struct sr_arpcache *cache) {
     return pthread_mutex_destroy(&(cache->lock)) && pthread_mutexattr_destroy(&(cache->attr));
 }
 
-/* Thread which sweeps through the cache and invalidates entries that were added
-   more than SR_ARPCACHE_TO seconds ago. */
+/* Invalidates entries that were added more than SR_ARPCACHE_TO seconds ago
+   (tentative ones SR_ARPCACHE_TENTATIVE_TO), sweeps the request queue,
+   snapshots the cache every SR_ARPCACHE_SAVE_INTERVAL seconds, does the same for the IPv6 neighbor cache and
+   expires idle NAT mappings. */
+int sr_arpcache_tick(struct sr_instance *sr) {
+    struct sr_arpcache *cache = &(sr->cache);
+
+    SR_ARPCACHE_LOCK(cache);
+
+    time_t curtime = time(NULL);
+
+    int i;
+    for (i = 0; i < SR_ARPCACHE_SZ; i++) {
+        if ((cache->entries[i].valid) && !(cache->entries[i].is_static) &&
+            (difftime(curtime,cache->entries[i].added) >
+             (cache->entries[i].tentative ? SR_ARPCACHE_TENTATIVE_TO : SR_ARPCACHE_TO))) {
+            cache->entries[i].valid = 0;
+        }
+    }
+
+    sr_arpcache_sweepreqs(sr);
+
+    SR_ARPCACHE_UNLOCK(cache);
+
+    /* SIGINT and SIGTERM only ask; the snapshot is taken here, on the
+       thread that owns the cache */
+    if (sr->arp_path[0] != '\0') {
+        if (sr_stop_requested) {
+            sr_arpcache_save(cache, sr->arp_path);
+            return 1;
+        }
+        if (difftime(curtime, cache->saved) >= SR_ARPCACHE_SAVE_INTERVAL)
+            sr_arpcache_save(cache, sr->arp_path);
+    }
+
+    sr_ndcache_tick(sr);
+
+    if (sr->nat)
+        sr_nat_tick(sr->nat);
+    return 0;
+}
+
+/* Thread which runs sr_arpcache_tick once a second. On a stop it ends
+   the session's reads, which the blocking receive loop waits in. */
 void *sr_arpcache_timeout(void *sr_ptr) {
     struct sr_instance *sr = sr_ptr;
-    struct sr_arpcache *cache = &(sr->cache);
-    
+
     while (1) {
         sleep(1.0);
-        
-        pthread_mutex_lock(&(cache->lock));
-    
-        time_t curtime = time(NULL);
-        
-        int i;    
-        for (i = 0; i < SR_ARPCACHE_SZ; i++) {
-            if ((cache->entries[i].valid) && (difftime(curtime,cache->entries[i].added) > SR_ARPCACHE_TO)) {
-                cache->entries[i].valid = 0;
-            }
+        if (sr_arpcache_tick(sr)) {
+            sr_vns_stop(sr);
+            break;
         }
-        
-        sr_arpcache_sweepreqs(sr);
-
-        pthread_mutex_unlock(&(cache->lock));
     }
-    
+
     return NULL;
 }
 
@@ -68,16 +68,30 @@
 
 #include <inttypes.h>
 #include <time.h>
+#include <stdio.h>
 #include <pthread.h>
 #include "sr_if.h"
+#include "sr_codel.h"
+#include "sr_pbuf.h"
+
+struct sr_instance;
 
 #define SR_ARPCACHE_SZ    100  
 #define SR_ARPCACHE_TO    15.0
+#define SR_ARPCACHE_TENTATIVE_TO 6.0    /* a reloaded entry's time to answer
+                                           the 5 requests that confirm it */
+#define SR_ARPCACHE_SAVE_INTERVAL 30    /* seconds between snapshots (-a) */
+#define SR_ARPCACHE_WARM_MAX_AGE 3600   /* older snapshot entries are skipped */
+#define SR_ARPCACHE_PENDING_MAX 128     /* packets waiting on one request */
+#define SR_ARPCACHE_PENDING_TO ((uint64_t)SR_CODEL_CEILING * 1000) /* ns */
 
 struct sr_packet {
+    struct sr_pbuf *pb;         /* holds the frame, see sr_pbuf_hold */
     uint8_t *buf;               /* A raw Ethernet frame, presumably with the dest MAC empty */
     unsigned int len;           /* Length of raw Ethernet frame */
-    char *iface;                /* The outgoing interface */
+    char iface[sr_IFACE_NAMELEN]; /* The outgoing interface */
+    uint64_t queued;            /* sr_now_ns() when it was queued */
+    struct sr_pktinfo info;     /* as parsed on receipt */
     struct sr_packet *next;
 };
 
@@ -86,6 +100,9 @@ struct sr_arpentry {
     uint32_t ip;                /* IP addr in network byte order */
     time_t added;         
     int valid;
+    int is_static;              /* set over the control socket, never expires */
+    int tentative;              /* reloaded from a snapshot, not yet confirmed */
+    char iface[sr_IFACE_NAMELEN]; /* where it was learned, empty if static */
 };
 
 struct sr_arpreq {
@@ -95,7 +112,12 @@ struct sr_arpreq {
                                    never sent, will be 0. */
     uint32_t times_sent;        /* Number of times this request was sent. You 
                                    should update this. */
-    struct sr_packet *packets;  /* List of pkts waiting on this req to finish */
+    struct sr_packet *packets;  /* List of pkts waiting on this req to finish,
+                                   oldest first */
+    struct sr_packet *last;     /* where the next one goes */
+    unsigned int npackets;
+    char iface[sr_IFACE_NAMELEN]; /* where to ask, from the first packet or
+                                     the route of a packetless request */
     struct sr_arpreq *next;
 };
 
@@ -104,37 +126,112 @@ struct sr_arpcache {
     struct sr_arpreq *requests;
     pthread_mutex_t lock;
     pthread_mutexattr_t attr;
+    int use_locks;              /* 0 when only one thread ever touches the
+                                   cache (event loop mode) */
+    int warm;                   /* sr_arpcache_warm has run */
+    time_t saved;               /* last snapshot */
+    uint64_t pending_sent;      /* waiting packets sent on a reply */
+    uint64_t pending_expired;   /* not sent, older than SR_ARPCACHE_PENDING_TO */
+    uint64_t pending_overflow;  /* dropped beyond SR_ARPCACHE_PENDING_MAX */
+    struct sr_sojourn sojourn;  /* how long the sent ones waited */
 };
 
+#define SR_ARPCACHE_LOCK(cache) \
+    do { if ((cache)->use_locks) pthread_mutex_lock(&((cache)->lock)); } while (0)
+#define SR_ARPCACHE_UNLOCK(cache) \
+    do { if ((cache)->use_locks) pthread_mutex_unlock(&((cache)->lock)); } while (0)
+
 /* Checks if an IP->MAC mapping is in the cache. IP is in network byte order. 
    You must free the returned structure if it is not NULL. */
 struct sr_arpentry *sr_arpcache_lookup(struct sr_arpcache *cache, uint32_t ip);
 
+/* Prefetches what sr_arpcache_lookup reads. The entries are a flat array
+   every lookup scans to the end, so that is all of them. */
+void sr_arpcache_prefetch(struct sr_arpcache *cache);
+
 /* Adds an ARP request to the ARP request queue. If the request is already on
    the queue, adds the packet to the linked list of packets for this sr_arpreq
-   that corresponds to this ARP request. The packet argument should not be
-   freed by the caller.
+   that corresponds to this ARP request. The packet is only borrowed; the
+   queue holds it with sr_pbuf_hold, which takes a reference rather than
+   a copy while the packet is in the receive buffer being handled.
 
    A pointer to the ARP request is returned; it should be freed. The caller
-   can remove the ARP request from the queue by calling sr_arpreq_destroy. */
+   can remove the ARP request from the queue by calling sr_arpreq_destroy.
+
+   With a NULL packet the request has no packets waiting, only iface to
+   send it on.
+
+   The packets are kept in arrival order. A request holds at most
+   SR_ARPCACHE_PENDING_MAX of them, the oldest are dropped to make room.
+   Ones that wait longer than SR_ARPCACHE_PENDING_TO are not sent when
+   the reply comes (sr_arpcache_pending_ok) but stay until then, so that
+   their senders still hear host unreachable if it never does. */
 struct sr_arpreq *sr_arpcache_queuereq(struct sr_arpcache *cache,
                          uint32_t ip,
                          uint8_t *packet,               /* borrowed */
                          unsigned int packet_len,
+                         const struct sr_pktinfo *info, /* of packet */
                          char *iface);
 
 /* This method performs two functions:
    1) Looks up this IP in the request queue. If it is found, returns a pointer
       to the sr_arpreq with this IP. Otherwise, returns NULL.
-   2) Inserts this IP to MAC mapping in the cache, and marks it valid. */
+   2) Inserts this IP to MAC mapping, learned on iface, in the cache, and
+      marks it valid and confirmed. */
 struct sr_arpreq *sr_arpcache_insert(struct sr_arpcache *cache,
                                      unsigned char *mac,
-                                     uint32_t ip);
+                                     uint32_t ip,
+                                     const char *iface);
+
+/* Called for each waiting packet as the reply arrives. Returns 1 if it
+   should be sent, recording how long it waited, or 0 if it waited longer
+   than SR_ARPCACHE_PENDING_TO and should be dropped. */
+int sr_arpcache_pending_ok(struct sr_arpcache *cache, struct sr_packet *pkt);
+
+/* Lists the requests with packets waiting, and the counters and sojourn
+   times of the packets that waited, for the control socket. */
+void sr_arpcache_print_pending(struct sr_arpcache *cache, FILE *out);
 
 /* Frees all memory associated with this arp request entry. If this arp request
    entry is on the arp request queue, it is removed from the queue. */
 void sr_arpreq_destroy(struct sr_arpcache *cache, struct sr_arpreq *entry);
 
+/* Adds or overwrites a permanent IP->MAC mapping. If a request is queued
+   for the IP it is returned in *req, as by sr_arpcache_insert: the caller
+   sends its packets to mac (handle_ARP_send_pending), which destroys it.
+   Returns 0, or -1 if the cache is full. */
+int sr_arpcache_add_static(struct sr_arpcache *cache,
+                           unsigned char *mac,
+                           uint32_t ip,
+                           struct sr_arpreq **req);
+
+/* Removes the mapping for ip, static or not. Returns 0, or -1 if there is
+   none. */
+int sr_arpcache_remove(struct sr_arpcache *cache, uint32_t ip);
+
+/* Invalidates every entry that is not static. Returns how many. */
+int sr_arpcache_flush(struct sr_arpcache *cache);
+
+/* Writes the valid entries to path, through a temporary file renamed into
+   place. Returns 0, or -1 with a message on stderr. */
+int sr_arpcache_save(struct sr_arpcache *cache, const char *path);
+
+/* Writes the valid entries to out in the format of the snapshot. Returns
+   0, or -1 on a write error. */
+int sr_arpcache_write(struct sr_arpcache *cache, FILE *out);
+
+/* Warm start, once the interfaces and routes are known: reloads the
+   snapshot at sr->arp_path as tentative entries, usable at once but asked
+   for again and dropped after SR_ARPCACHE_TENTATIVE_TO unless confirmed,
+   and sends an ARP request for the gateway of every route. Later calls do
+   nothing. */
+void sr_arpcache_warm(struct sr_instance *sr);
+
+/* Hot restart: loads the entries written by sr_arpcache_write in the
+   router handing over to us as they were there, confirmed and as old,
+   in place of the warm start. Returns how many. */
+int sr_arpcache_adopt(struct sr_instance *sr, const char *path);
+
 /* Prints out the ARP table. */
 void sr_arpcache_dump(struct sr_arpcache *cache);
 
@@ -147,4 +244,11 @@ int   sr_arpcache_init(struct sr_arpcache *cache);
 int   sr_arpcache_destroy(struct sr_arpcache *cache);
 void *sr_arpcache_timeout(void *cache_ptr);
 
+/* One pass of the cleanup thread: expire stale entries and sweep the
+   request queue.  The event loop calls this from its timer instead of
+   running the thread.  Returns 1 once SIGINT or SIGTERM asked the router
+   to stop, with the snapshot saved; the caller's loop then returns as
+   when the session ends, so the router shuts down as usual. */
+int   sr_arpcache_tick(struct sr_instance *sr);
+
 #endif
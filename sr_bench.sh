@@ -0,0 +1,181 @@
+#!/bin/sh
+#
+# sr_bench.sh: forwarding benchmarks, run from the build directory after
+# make.  Every case starts the router on a local transport with two
+# interfaces (eth1 10.0.1.1, eth2 10.0.2.1), offers COUNT 64 byte UDP
+# frames on eth1 for 10.0.2.2 and prints the rate forwarded out of eth2,
+# one line per configuration.
+#
+#   sh sr_bench.sh burst [COUNT]  frames per sr_handlepacket_burst pass,
+#                                 1 8 32 256 (or $BURSTS), over shm
+#   sh sr_bench.sh loops [COUNT]  VNS session driven by the epoll loop (-E)
+#                                 and by io_uring (-U): rate and the
+#                                 router's system calls per frame
+#   sh sr_bench.sh scale [COUNT]  1 to $CORES (default all online) routers
+#                                 in one process (-f), each pinned to its
+#                                 core with its own sr_netgen; the rate is
+#                                 the sum over the routers
+#   sh sr_bench.sh tap [COUNT]    the VNS session (-E) against TAP devices
+#                                 with 1 (or $QUEUES) queues, frames sent
+#                                 and received on the devices; needs root
+#   sh sr_bench.sh packet [COUNT] the VNS session (-E, -U) against
+#                                 AF_PACKET rings on two veth pairs whose
+#                                 far ends are in a namespace of their
+#                                 own with the generator; needs root
+#
+# Router and load generator share the host: on few cores the rates are
+# for comparing the configurations, not for the router alone.
+
+COUNT=${2:-2000000}
+DIR=`mktemp -d /tmp/sr_bench.XXXXXX` || exit 1
+trap 'rm -rf $DIR' 0
+
+cat > $DIR/ifs <<EOF
+eth1 0a:00:00:00:01:01 10.0.1.1
+eth2 0a:00:00:00:02:02 10.0.2.1
+EOF
+cat > $DIR/rtable <<EOF
+10.0.1.0 10.0.1.2 255.255.255.0 eth1
+10.0.2.0 10.0.2.2 255.255.255.0 eth2
+EOF
+
+# wait_for PATH: until the router has created PATH
+wait_for()
+{
+  n=0
+  while [ ! -e $1 ] && [ $n -lt 50 ]
+  do
+    sleep 0.1
+    n=`expr $n + 1`
+  done
+}
+
+# shm_run [ROUTER_ARGS..]: one sr_shmgen run against a router on shm,
+# which exits when the generator detaches
+shm_run()
+{
+  rm -f $DIR/shm.sock
+  ./sr -d shm:$DIR/shm.sock -i $DIR/ifs -r $DIR/rtable "$@" > $DIR/sr.log 2>&1 &
+  wait_for $DIR/shm.sock
+  ./sr_shmgen -s $DIR/shm.sock -d 10.0.2.2 -n $COUNT | tail -1
+  wait
+}
+
+# vns_run [ROUTER_ARGS..]: one sr_netgen run as the VNS server of a
+# router, which exits when the generator closes the session
+vns_run()
+{
+  rm -f $DIR/ctl.sock
+  ./sr_netgen -i $DIR/ifs -d 10.0.2.2 -v ${VNS_PORT:-8700} -n $COUNT \
+      -c $DIR/ctl.sock > $DIR/gen.log &
+  sleep 0.2
+  ./sr -s 127.0.0.1 -p ${VNS_PORT:-8700} -r $DIR/rtable -c $DIR/ctl.sock -R 0 \
+      "$@" > $DIR/sr.log 2>&1
+  wait
+  tail -1 $DIR/gen.log
+  grep "^router" $DIR/gen.log | sed 's/^/          /'
+}
+
+# scale_run N: N routers under sr_multi, each the VNS client of its own
+# generator, all offered COUNT frames at once
+scale_run()
+{
+  : > $DIR/inst
+  i=0
+  while [ $i -lt $1 ]
+  do
+    port=`expr ${VNS_PORT:-8700} + $i`
+    echo "vrhost $i 127.0.0.1 $port $DIR/rtable `expr $i % $CORES`" >> $DIR/inst
+    ./sr_netgen -i $DIR/ifs -d 10.0.2.2 -v $port -n $COUNT > $DIR/gen.$i.log &
+    i=`expr $i + 1`
+  done
+  sleep 0.2
+  ./sr -f $DIR/inst > $DIR/sr.log 2>&1
+  wait
+  cat $DIR/gen.*.log | awk '/Mpps forwarded/ { n++; sum += $4 }
+      END { printf "%.3f Mpps forwarded over %d router(s)\n", sum, n }'
+  rm -f $DIR/gen.*.log
+}
+
+# dev_run NETDEV IFS DEV1,DEV2 [ROUTER_ARGS..]: one sr_netgen run on the
+# devices facing a router on a local netdev, stopped after the run
+dev_run()
+{
+  netdev=$1 ifs=$2 devs=$3
+  shift 3
+  rm -f $DIR/ctl.sock
+  ./sr -d $netdev -i $ifs -r $DIR/rtable -c $DIR/ctl.sock "$@" > $DIR/sr.log 2>&1 &
+  wait_for $DIR/ctl.sock
+  $GEN_NS ./sr_netgen -i $ifs -d 10.0.2.2 -k $devs -n $COUNT -c $DIR/ctl.sock \
+      > $DIR/gen.log
+  kill $! 2> /dev/null
+  wait
+  tail -1 $DIR/gen.log
+  grep "^sent\|^router" $DIR/gen.log | sed 's/^/          /'
+}
+
+case "$1" in
+  burst)
+    for b in ${BURSTS:-1 8 32 256}
+    do
+      printf "burst %4d: " $b
+      SR_BURST=$b shm_run
+    done
+    ;;
+  loops)
+    for l in -E -U
+    do
+      printf "vns %s: " $l
+      vns_run $l
+    done
+    ;;
+  scale)
+    CORES=${CORES:-`getconf _NPROCESSORS_ONLN`}
+    n=1
+    while [ $n -le $CORES ]
+    do
+      printf "routers %3d: " $n
+      scale_run $n
+      n=`expr $n + 1`
+    done
+    ;;
+  tap)
+    cat > $DIR/ifs.tap <<EOF
+eth1 0a:00:00:00:01:01 10.0.1.1 srb-tap1
+eth2 0a:00:00:00:02:02 10.0.2.1 srb-tap2
+EOF
+    printf "vns -E: "
+    vns_run -E
+    for q in ${QUEUES:-1}
+    do
+      printf "tap -q %d: " $q
+      dev_run tap $DIR/ifs.tap srb-tap1,srb-tap2 -q $q
+    done
+    ;;
+  packet)
+    NS=srb-gen.$$
+    cat > $DIR/ifs.veth <<EOF
+eth1 0a:00:00:00:01:01 10.0.1.1 srb-veth1
+eth2 0a:00:00:00:02:02 10.0.2.1 srb-veth2
+EOF
+    ip netns add $NS || exit 1
+    trap 'ip netns del $NS; rm -rf $DIR' 0
+    for i in 1 2
+    do
+      ip link add srb-veth$i type veth peer name srb-peer$i netns $NS || exit 1
+      ip link set srb-veth$i up
+      ip -n $NS link set srb-peer$i up
+    done
+    for l in -E -U
+    do
+      printf "vns %s: " $l
+      vns_run $l
+    done
+    printf "packet: "
+    GEN_NS="ip netns exec $NS" dev_run packet $DIR/ifs.veth srb-peer1,srb-peer2
+    ;;
+  *)
+    echo "Usage: `basename $0` burst|loops|scale|tap|packet [count]"
+    exit 1
+    ;;
+esac
@@ -0,0 +1,328 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_cksum.c
+ *
+ * Description:
+ *
+ * Internet checksum kernels and runtime CPU dispatch.
+ *
+ * The one's complement sum is byte order independent (RFC 1071 sec. 2),
+ * so all kernels add 16-bit words in host order and the byte swap the
+ * original cksum() did per word collapses into nothing: the complement of
+ * the host order sum is already the checksum in network byte order.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#include "sr_cksum.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SR_CKSUM_X86 1
+#include <immintrin.h>
+#endif
+
+static uint16_t sr_cksum_resolve(const void* data, int len);
+
+sr_cksum_fn sr_cksum_sum = sr_cksum_resolve;
+static const char* sr_cksum_impl_name = "unresolved";
+
+/*---------------------------------------------------------------------
+ * Method: sr_cksum_fold(..)
+ * Scope:  Local
+ *
+ * Fold a wide accumulator down to 16 bits with end-around carry.
+ *
+ *---------------------------------------------------------------------*/
+
+static uint16_t sr_cksum_fold(uint64_t sum)
+{
+    while (sum >> 16)
+        sum = (sum & 0xffff) + (sum >> 16);
+    return (uint16_t)sum;
+} /* -- sr_cksum_fold -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_cksum_tail(..)
+ * Scope:  Local
+ *
+ * Add the last (< 8) bytes of a buffer to a host order accumulator.  A
+ * trailing odd byte is padded with a zero byte after it, which is what
+ * loading it into the first byte of a 16-bit word does on any host.
+ *
+ *---------------------------------------------------------------------*/
+
+static uint64_t sr_cksum_tail(uint64_t sum, const uint8_t* data, int len)
+{
+    uint16_t w;
+
+    for (; len >= 2; data += 2, len -= 2) {
+        memcpy(&w, data, 2);
+        sum += w;
+    }
+    if (len > 0) {
+        w = 0;
+        memcpy(&w, data, 1);
+        sum += w;
+    }
+    return sum;
+} /* -- sr_cksum_tail -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_cksum_sum_ref(..)
+ * Scope:  Global
+ *
+ * Reference kernel, the original word at a time loop from sr_utils.c.
+ *
+ *---------------------------------------------------------------------*/
+
+uint16_t sr_cksum_sum_ref(const void* _data, int len)
+{
+    const uint8_t* data = _data;
+    uint32_t sum;
+
+    for (sum = 0; len >= 2; data += 2, len -= 2)
+        sum += data[0] << 8 | data[1];
+    if (len > 0)
+        sum += data[0] << 8;
+    while (sum > 0xffff)
+        sum = (sum >> 16) + (sum & 0xffff);
+    return ntohs((uint16_t)sum);
+} /* -- sr_cksum_sum_ref -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_cksum_sum_wide(..)
+ * Scope:  Global
+ *
+ * Portable kernel: two 32-bit halves of every 64-bit load go into a
+ * 64-bit accumulator, which cannot overflow for any int sized buffer.
+ *
+ *---------------------------------------------------------------------*/
+
+uint16_t sr_cksum_sum_wide(const void* _data, int len)
+{
+    const uint8_t* data = _data;
+    uint64_t sum = 0;
+    uint64_t v;
+
+    for (; len >= 32; data += 32, len -= 32) {
+        memcpy(&v, data, 8);
+        sum += (v & 0xffffffff) + (v >> 32);
+        memcpy(&v, data + 8, 8);
+        sum += (v & 0xffffffff) + (v >> 32);
+        memcpy(&v, data + 16, 8);
+        sum += (v & 0xffffffff) + (v >> 32);
+        memcpy(&v, data + 24, 8);
+        sum += (v & 0xffffffff) + (v >> 32);
+    }
+    for (; len >= 8; data += 8, len -= 8) {
+        memcpy(&v, data, 8);
+        sum += (v & 0xffffffff) + (v >> 32);
+    }
+
+    return sr_cksum_fold(sr_cksum_tail(sum, data, len));
+} /* -- sr_cksum_sum_wide -- */
+
+#ifdef SR_CKSUM_X86
+
+/* 32-bit lanes take at most two 16-bit words per iteration, so spill
+ * them into the 64-bit sum well before 2^16 iterations */
+#define SR_CKSUM_SPILL 16384
+
+/*---------------------------------------------------------------------
+ * Method: sr_cksum_sum_sse2(..)
+ * Scope:  Global
+ *
+ * 16 bytes per iteration, words zero-extended into four 32-bit lanes.
+ *
+ *---------------------------------------------------------------------*/
+
+__attribute__((target("sse2")))
+uint16_t sr_cksum_sum_sse2(const void* _data, int len)
+{
+    const uint8_t* data = _data;
+    const __m128i zero = _mm_setzero_si128();
+    uint64_t sum = 0;
+    uint32_t lanes[4];
+
+    while (len >= 16) {
+        __m128i acc = _mm_setzero_si128();
+        int n = 0;
+
+        for (; len >= 16 && n < SR_CKSUM_SPILL; data += 16, len -= 16, n++) {
+            __m128i v = _mm_loadu_si128((const __m128i*)data);
+            acc = _mm_add_epi32(acc, _mm_unpacklo_epi16(v, zero));
+            acc = _mm_add_epi32(acc, _mm_unpackhi_epi16(v, zero));
+        }
+
+        _mm_storeu_si128((__m128i*)lanes, acc);
+        sum += (uint64_t)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    }
+
+    return sr_cksum_fold(sr_cksum_tail(sum, data, len));
+} /* -- sr_cksum_sum_sse2 -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_cksum_sum_avx2(..)
+ * Scope:  Global
+ *
+ * 64 bytes per iteration over two independent 256-bit accumulators.
+ *
+ *---------------------------------------------------------------------*/
+
+__attribute__((target("avx2")))
+uint16_t sr_cksum_sum_avx2(const void* _data, int len)
+{
+    const uint8_t* data = _data;
+    const __m256i zero = _mm256_setzero_si256();
+    uint64_t sum = 0;
+    uint32_t lanes[8];
+    int i;
+
+    while (len >= 32) {
+        __m256i acc0 = _mm256_setzero_si256();
+        __m256i acc1 = _mm256_setzero_si256();
+        int n = 0;
+
+        for (; len >= 64 && n < SR_CKSUM_SPILL; data += 64, len -= 64, n++) {
+            __m256i v0 = _mm256_loadu_si256((const __m256i*)data);
+            __m256i v1 = _mm256_loadu_si256((const __m256i*)(data + 32));
+            acc0 = _mm256_add_epi32(acc0, _mm256_unpacklo_epi16(v0, zero));
+            acc1 = _mm256_add_epi32(acc1, _mm256_unpackhi_epi16(v0, zero));
+            acc0 = _mm256_add_epi32(acc0, _mm256_unpacklo_epi16(v1, zero));
+            acc1 = _mm256_add_epi32(acc1, _mm256_unpackhi_epi16(v1, zero));
+        }
+        if (len >= 32 && n < SR_CKSUM_SPILL) {
+            __m256i v0 = _mm256_loadu_si256((const __m256i*)data);
+            acc0 = _mm256_add_epi32(acc0, _mm256_unpacklo_epi16(v0, zero));
+            acc1 = _mm256_add_epi32(acc1, _mm256_unpackhi_epi16(v0, zero));
+            data += 32;
+            len -= 32;
+        }
+
+        _mm256_storeu_si256((__m256i*)lanes, acc0);
+        for (i = 0; i < 8; i++)
+            sum += lanes[i];
+        _mm256_storeu_si256((__m256i*)lanes, acc1);
+        for (i = 0; i < 8; i++)
+            sum += lanes[i];
+    }
+
+    return sr_cksum_fold(sr_cksum_tail(sum, data, len));
+} /* -- sr_cksum_sum_avx2 -- */
+
+#else /* -- !SR_CKSUM_X86 -- */
+
+uint16_t sr_cksum_sum_sse2(const void* data, int len)
+{ return sr_cksum_sum_wide(data, len); }
+
+uint16_t sr_cksum_sum_avx2(const void* data, int len)
+{ return sr_cksum_sum_wide(data, len); }
+
+#endif /* -- SR_CKSUM_X86 -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_cksum_select(..)
+ * Scope:  Global
+ *
+ * Install a kernel in sr_cksum_sum.  With name == NULL the fastest one
+ * the CPU reports support for is used.  Returns 0 on success, -1 if the
+ * named kernel is unknown or not supported here.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_cksum_select(const char* name)
+{
+    const char* env = getenv("SR_CKSUM");
+    int have_sse2 = 0, have_avx2 = 0;
+
+#ifdef SR_CKSUM_X86
+    __builtin_cpu_init();
+    have_sse2 = __builtin_cpu_supports("sse2");
+    have_avx2 = __builtin_cpu_supports("avx2");
+#endif
+
+    if (name == NULL)
+        name = env;
+
+    if (name == NULL) {
+        name = have_avx2 ? "avx2" : (have_sse2 ? "sse2" : "wide");
+    }
+
+    if (strcmp(name, "ref") == 0) {
+        sr_cksum_sum = sr_cksum_sum_ref;
+    } else if (strcmp(name, "wide") == 0) {
+        sr_cksum_sum = sr_cksum_sum_wide;
+    } else if (strcmp(name, "sse2") == 0 && have_sse2) {
+        sr_cksum_sum = sr_cksum_sum_sse2;
+    } else if (strcmp(name, "avx2") == 0 && have_avx2) {
+        sr_cksum_sum = sr_cksum_sum_avx2;
+    } else {
+        return -1;
+    }
+
+    sr_cksum_impl_name = name;
+    return 0;
+} /* -- sr_cksum_select -- */
+
+const char* sr_cksum_name(void)
+{
+    return sr_cksum_impl_name;
+} /* -- sr_cksum_name -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_cksum_resolve(..)
+ * Scope:  Local
+ *
+ * Initial value of sr_cksum_sum: selects a kernel, then forwards the
+ * call.  Racing first callers all store the same pointer.
+ *
+ *---------------------------------------------------------------------*/
+
+static uint16_t sr_cksum_resolve(const void* data, int len)
+{
+    if (sr_cksum_select(NULL) != 0)
+        sr_cksum_select("wide");
+    return sr_cksum_sum(data, len);
+} /* -- sr_cksum_resolve -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_cksum_update16(..)
+ * Scope:  Global
+ *
+ * Incremental update (RFC 1624 eqn. 3) of a checksum field after one
+ * 16-bit word it covers changed from old to new:
+ *
+ *   HC' = ~(~HC + ~m + m')
+ *
+ * All three values are taken as stored in the packet; like the full sum
+ * this is byte order independent.
+ *
+ *---------------------------------------------------------------------*/
+
+uint16_t sr_cksum_update16(uint16_t cksum, uint16_t old, uint16_t new)
+{
+    uint32_t sum = (uint16_t)~cksum;
+
+    sum += (uint16_t)~old;
+    sum += new;
+    return (uint16_t)~sr_cksum_fold(sum);
+} /* -- sr_cksum_update16 -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_cksum_update32(..)
+ * Scope:  Global
+ *
+ * As sr_cksum_update16 for a 32-bit field such as an IP address.
+ *
+ *---------------------------------------------------------------------*/
+
+uint16_t sr_cksum_update32(uint16_t cksum, uint32_t old, uint32_t new)
+{
+    uint32_t sum = (uint16_t)~cksum;
+
+    sum += (uint16_t)~(old >> 16) + (uint16_t)~(old & 0xffff);
+    sum += (new >> 16) + (new & 0xffff);
+    return (uint16_t)~sr_cksum_fold(sum);
+} /* -- sr_cksum_update32 -- */
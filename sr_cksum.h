@@ -0,0 +1,44 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_cksum.h
+ *
+ * Description:
+ *
+ * Internet checksum (RFC 1071) kernels.  Every kernel returns the folded
+ * 16-bit one's complement sum of the buffer in host byte order; the
+ * checksum itself is the complement of that.  The best kernel for the
+ * running CPU is picked once, on first use, through sr_cksum_sum.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_CKSUM_H
+#define SR_CKSUM_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+typedef uint16_t (*sr_cksum_fn)(const void* data, int len);
+
+/* -- dispatched kernel, resolved via cpuid on the first call -- */
+extern sr_cksum_fn sr_cksum_sum;
+
+uint16_t sr_cksum_sum_ref(const void* data, int len);
+uint16_t sr_cksum_sum_wide(const void* data, int len);
+uint16_t sr_cksum_sum_sse2(const void* data, int len);
+uint16_t sr_cksum_sum_avx2(const void* data, int len);
+
+/* pick a kernel by name ("ref", "wide", "sse2", "avx2") or NULL for the
+ * best one the CPU supports; the SR_CKSUM environment variable overrides */
+int         sr_cksum_select(const char* name);
+const char* sr_cksum_name(void);
+
+/* incremental updates (RFC 1624) after a covered field changed; all
+ * arguments and the result as stored in the packet */
+uint16_t sr_cksum_update16(uint16_t cksum, uint16_t old, uint16_t new);
+uint16_t sr_cksum_update32(uint16_t cksum, uint32_t old, uint32_t new);
+
+#endif /* -- SR_CKSUM_H -- */
@@ -0,0 +1,252 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_cksumbench.c
+ *
+ * Description:
+ *
+ * Checksum kernel check and benchmark (see sr_cksum.h).  Every kernel the
+ * CPU supports is first checked against the original cksum() loop for
+ * every length from 0 to 9000 bytes at each start offset 0-7 of random
+ * data, through the cksum() result as the router uses it and through
+ * cksum_verify() on the buffer with that checksum appended.  Then each
+ * kernel is timed over buffers of the sizes the router sums (an IPv4
+ * header, small and full sized ICMP payloads, a jumbo frame).
+ *
+ *   sr_cksumbench [-m MAXLEN] [-b BYTES] [-k KERNEL] [-s SEED]
+ *
+ * -b is the number of bytes summed per timed size (1 GB by default), -k
+ * limits the run to one kernel.  Exits 2 if any kernel disagrees with
+ * the original loop.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <arpa/inet.h>
+
+#include "sr_cksum.h"
+
+#define BENCH_MAXLEN    9000
+#define BENCH_OFFSETS   8
+#define BENCH_BYTES     (1ULL << 30)  /* summed per kernel and size */
+
+static const char* bench_kernels[] = { "ref", "wide", "sse2", "avx2" };
+static const int bench_sizes[] = { 20, 64, 84, 576, 1500, 9000 };
+
+#define BENCH_NKERNELS ((int)(sizeof(bench_kernels) / sizeof(bench_kernels[0])))
+#define BENCH_NSIZES   ((int)(sizeof(bench_sizes) / sizeof(bench_sizes[0])))
+
+static uint64_t bench_state = 88172645463325252ULL;
+
+static double bench_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+} /* -- bench_now -- */
+
+/* -- xorshift64, so runs repeat for a seed -- */
+static uint32_t bench_rand(void)
+{
+    bench_state ^= bench_state << 13;
+    bench_state ^= bench_state >> 7;
+    bench_state ^= bench_state << 17;
+    return (uint32_t)(bench_state >> 32);
+} /* -- bench_rand -- */
+
+/*---------------------------------------------------------------------
+ * Method: bench_cksum_old(..)
+ * Scope:  Local
+ *
+ * cksum() from sr_utils.c as it was before the kernels, kept verbatim
+ * as the reference the check compares against.
+ *
+ *---------------------------------------------------------------------*/
+
+static uint16_t bench_cksum_old(const void* _data, int len)
+{
+    const uint8_t* data = _data;
+    uint32_t sum;
+
+    for (sum = 0; len >= 2; data += 2, len -= 2)
+        sum += data[0] << 8 | data[1];
+    if (len > 0)
+        sum += data[0] << 8;
+    while (sum > 0xffff)
+        sum = (sum >> 16) + (sum & 0xffff);
+    sum = htons(~sum);
+    return sum ? sum : 0xffff;
+} /* -- bench_cksum_old -- */
+
+/*---------------------------------------------------------------------
+ * Method: bench_check(..)
+ * Scope:  Local
+ *
+ * Compare the selected kernel with the original loop over every length
+ * and offset.  buf has room for BENCH_MAXLEN + BENCH_OFFSETS + 2 bytes.
+ * Returns the number of mismatches.
+ *
+ *---------------------------------------------------------------------*/
+
+static unsigned long bench_check(uint8_t* buf, int maxlen)
+{
+    uint8_t copy[BENCH_MAXLEN + BENCH_OFFSETS + 2];
+    unsigned long bad = 0;
+    uint16_t want, got;
+    int len, off;
+
+    for (len = 0; len <= maxlen; len++)
+    {
+        for (off = 0; off < BENCH_OFFSETS; off++)
+        {
+            want = bench_cksum_old(buf + off, len);
+            got = (uint16_t)~sr_cksum_sum(buf + off, len);
+            if ((got ? got : 0xffff) != want)
+            {
+                if (bad++ < 10)
+                { printf("  len %d offset %d: %04x, want %04x\n", len, off, got, want); }
+                continue;
+            }
+
+            /* -- a checksummed buffer must verify, one flipped bit must not -- */
+            if (len % 2 == 0)
+            {
+                memcpy(copy, buf + off, len);
+                memcpy(copy + len, &want, 2);
+                if (sr_cksum_sum(copy, len + 2) != 0xffff)
+                {
+                    if (bad++ < 10)
+                    { printf("  len %d offset %d: does not verify\n", len, off); }
+                    continue;
+                }
+                copy[bench_rand() % (len + 2)] ^= 1 << (bench_rand() % 8);
+                if (sr_cksum_sum(copy, len + 2) == 0xffff)
+                {
+                    if (bad++ < 10)
+                    { printf("  len %d offset %d: verifies corrupted\n", len, off); }
+                }
+            }
+        }
+    }
+    return bad;
+} /* -- bench_check -- */
+
+/*---------------------------------------------------------------------
+ * Method: bench_time(..)
+ * Scope:  Local
+ *
+ * Time the selected kernel over total bytes in len byte buffers walking
+ * through buf, returning GB/s.
+ *
+ *---------------------------------------------------------------------*/
+
+static double bench_time(const uint8_t* buf, int buflen, int len,
+                         unsigned long long total)
+{
+    unsigned long long i, n = total / len + 1;
+    volatile uint32_t sink;
+    uint32_t acc = 0;
+    int off = 0;
+    double t0, t;
+
+    t0 = bench_now();
+    for (i = 0; i < n; i++)
+    {
+        acc += sr_cksum_sum(buf + off, len);
+        if ((off += len) + len > buflen)
+        { off = (off + 1) % BENCH_OFFSETS; }
+    }
+    t = bench_now() - t0;
+    sink = acc;
+    (void)sink;
+    return (double)n * len / t / 1e9;
+} /* -- bench_time -- */
+
+static void usage(const char* argv0)
+{
+    fprintf(stderr, "Usage: %s [-m max length] [-b bytes] [-k kernel] "
+            "[-s seed]\n", argv0);
+} /* -- usage -- */
+
+int main(int argc, char** argv)
+{
+    unsigned long long total = BENCH_BYTES;
+    int maxlen = BENCH_MAXLEN, buflen = 1 << 20, c, i, j;
+    const char* only = 0;
+    unsigned long bad = 0, b;
+    uint8_t* buf;
+
+    while ((c = getopt(argc, argv, "hm:b:k:s:")) != EOF)
+    {
+        switch (c)
+        {
+            case 'm':
+                maxlen = atoi(optarg);
+                break;
+            case 'b':
+                total = strtoull(optarg, 0, 10);
+                break;
+            case 'k':
+                only = optarg;
+                break;
+            case 's':
+                bench_state = strtoull(optarg, 0, 10) | 1;
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if (maxlen < 0 || maxlen > BENCH_MAXLEN || total == 0)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    /* -- random data, so carries and odd tails are exercised -- */
+    if ((buf = (uint8_t*)malloc(buflen)) == 0)
+    {
+        fprintf(stderr, "sr_cksumbench: out of memory\n");
+        return 1;
+    }
+    for (i = 0; i < buflen; i++)
+    { buf[i] = (uint8_t)bench_rand(); }
+
+    printf("%-6s %10s", "kernel", "check");
+    for (j = 0; j < BENCH_NSIZES; j++)
+    { printf(" %6dB", bench_sizes[j]); }
+    printf("   (GB/s)\n");
+
+    for (i = 0; i < BENCH_NKERNELS; i++)
+    {
+        if (only && strcmp(only, bench_kernels[i]) != 0)
+        { continue; }
+        if (sr_cksum_select(bench_kernels[i]) != 0)
+        {
+            printf("%-6s not supported here\n", bench_kernels[i]);
+            continue;
+        }
+
+        b = bench_check(buf, maxlen);
+        bad += b;
+        printf("%-6s %10s", sr_cksum_name(), b ? "FAILED" : "ok");
+        fflush(stdout);
+        for (j = 0; j < BENCH_NSIZES; j++)
+        {
+            printf(" %7.2f", bench_time(buf, buflen, bench_sizes[j], total));
+            fflush(stdout);
+        }
+        printf("\n");
+    }
+
+    if (bad)
+    {
+        printf("%lu length/offset pair(s) differ from the original cksum\n", bad);
+        return 2;
+    }
+    return 0;
+} /* -- main -- */
@@ -0,0 +1,166 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_codel.c
+ *
+ * Description:
+ *
+ * CoDel drop decision and sojourn time histograms, see sr_codel.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+
+#include "sr_codel.h"
+
+/* -- target_us 0 turns dropping off -- */
+void sr_codel_init(struct sr_codel* c, uint32_t target_us, uint32_t interval_us)
+{
+    memset(c, 0, sizeof(*c));
+    c->target = (uint64_t)target_us * 1000;
+    c->interval = (uint64_t)interval_us * 1000;
+} /* -- sr_codel_init -- */
+
+/* -- when to drop next, interval / sqrt(count) after t -- */
+static uint64_t sr_codel_control_law(const struct sr_codel* c, uint64_t t)
+{
+    return t + (uint64_t)(c->interval / sqrt((double)c->count));
+} /* -- sr_codel_control_law -- */
+
+/* -- the RFC 8289 state machine, see sr_codel_drop -- */
+static int sr_codel_decide(struct sr_codel* c, uint64_t sojourn,
+                           unsigned int backlog, uint64_t now)
+{
+    int ok_to_drop = 0;
+    uint32_t delta;
+
+    if (sojourn < c->target || backlog <= SR_CODEL_MTU)
+    { c->first_above = 0; }
+    else if (c->first_above == 0)
+    { c->first_above = now + c->interval; }
+    else if (now >= c->first_above)
+    { ok_to_drop = 1; }
+
+    if (c->dropping)
+    {
+        if (!ok_to_drop)
+        {
+            c->dropping = 0;
+            return 0;
+        }
+        if (now < c->drop_next)
+        { return 0; }
+        c->count++;
+        c->drop_next = sr_codel_control_law(c, c->drop_next);
+        return 1;
+    }
+
+    if (!ok_to_drop)
+    { return 0; }
+
+    /* -- start dropping, sooner if it stopped only a little while ago -- */
+    c->dropping = 1;
+    delta = c->count - c->lastcount;
+    c->count = (delta > 1 && now - c->drop_next < 16 * c->interval) ? delta : 1;
+    c->drop_next = sr_codel_control_law(c, now);
+    c->lastcount = c->count;
+    return 1;
+} /* -- sr_codel_decide -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_codel_drop(..)
+ * Scope:  Global
+ *
+ * Decide on the packet at the head of a queue, about to be sent after
+ * waiting sojourn ns, with backlog bytes queued including it.  Returns 1
+ * if it should be dropped instead; the caller then asks again about the
+ * new head.  This is the dequeue of RFC 8289 taken one head at a time,
+ * with the target + interval ceiling on top.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_codel_drop(struct sr_codel* c, uint64_t sojourn, unsigned int backlog,
+                  uint64_t now)
+{
+    if (!c->target)
+    { return 0; }
+    return sr_codel_decide(c, sojourn, backlog, now) ||
+           sojourn > c->target + c->interval;
+} /* -- sr_codel_drop -- */
+
+void sr_sojourn_add(struct sr_sojourn* h, uint64_t ns)
+{
+    uint64_t us = ns / 1000;
+    int b = 0;
+
+    while (us && b < SR_SOJOURN_BUCKETS - 1)
+    {
+        us >>= 1;
+        b++;
+    }
+    h->count[b]++;
+    h->packets++;
+    h->total += ns;
+    if (ns > h->max)
+    { h->max = ns; }
+} /* -- sr_sojourn_add -- */
+
+/* -- upper bound in us of the bucket holding quantile q, 0 if empty -- */
+uint64_t sr_sojourn_quantile(const struct sr_sojourn* h, double q)
+{
+    uint64_t want, seen = 0;
+    int b;
+
+    if (h->packets == 0)
+    { return 0; }
+    want = (uint64_t)(q * h->packets);
+    if (want >= h->packets)
+    { want = h->packets - 1; }
+    for (b = 0; b < SR_SOJOURN_BUCKETS - 1; b++)
+    {
+        seen += h->count[b];
+        if (seen > want)
+        { break; }
+    }
+    return 1ULL << b;
+} /* -- sr_sojourn_quantile -- */
+
+/* -- one line summary, no newline -- */
+void sr_sojourn_print(const struct sr_sojourn* h, FILE* out)
+{
+    if (h->packets == 0)
+    {
+        fprintf(out, "sojourn none");
+        return;
+    }
+    fprintf(out, "sojourn avg %llu us p50 <%llu us p99 <%llu us max %llu us",
+            (unsigned long long)(h->total / h->packets / 1000),
+            (unsigned long long)sr_sojourn_quantile(h, 0.5),
+            (unsigned long long)sr_sojourn_quantile(h, 0.99),
+            (unsigned long long)(h->max / 1000));
+} /* -- sr_sojourn_print -- */
+
+/* -- every bucket that has packets, one line each -- */
+void sr_sojourn_print_buckets(const struct sr_sojourn* h, const char* prefix,
+                              FILE* out)
+{
+    int b;
+
+    for (b = 0; b < SR_SOJOURN_BUCKETS; b++)
+    {
+        if (h->count[b] == 0)
+        { continue; }
+        if (b == SR_SOJOURN_BUCKETS - 1)
+        {
+            fprintf(out, "%s >=%llu us %llu\n", prefix,
+                    1ULL << (b - 1), (unsigned long long)h->count[b]);
+        }
+        else
+        {
+            fprintf(out, "%s <%llu us %llu\n", prefix,
+                    1ULL << b, (unsigned long long)h->count[b]);
+        }
+    }
+} /* -- sr_sojourn_print_buckets -- */
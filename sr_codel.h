@@ -0,0 +1,71 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_codel.h
+ *
+ * Description:
+ *
+ * CoDel active queue management (RFC 8289) and sojourn time histograms
+ * for the router's internal queues.  Every queued packet is stamped with
+ * sr_now_ns() when it is queued; its sojourn time is how long it then
+ * waited.  A queue whose packets have all waited longer than target for
+ * a whole interval has a standing backlog, and CoDel drops from its head,
+ * the next drop coming sooner (interval / sqrt(drops)) until the delay
+ * falls below target again.  That slows down traffic that backs off
+ * when it loses packets; a flood that does not would still keep the
+ * queue at its length limit, so a packet that has waited longer than
+ * target + interval is dropped regardless.
+ *
+ * The histograms count sojourn times in power of two microsecond buckets:
+ * bucket 0 holds those under 1 us and bucket b those from 2^(b-1) up to
+ * 2^b us, the last one everything longer.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_CODEL_H
+#define SR_CODEL_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#include <stdio.h>
+
+#define SR_CODEL_TARGET   5000     /* us, acceptable standing queue delay */
+#define SR_CODEL_INTERVAL 100000   /* us, how long it may be exceeded */
+#define SR_CODEL_MTU      1514     /* bytes, a backlog no larger is not standing */
+#define SR_CODEL_CEILING  (SR_CODEL_TARGET + SR_CODEL_INTERVAL) /* us, by default */
+#define SR_SOJOURN_BUCKETS 24      /* up to 2^22 us, about 4 s, then "longer" */
+
+struct sr_codel
+{
+    uint64_t target;        /* ns, 0 for off */
+    uint64_t interval;      /* ns */
+    uint64_t first_above;   /* ns the head delay stayed above target until
+                               dropping may start, 0 if below */
+    uint64_t drop_next;     /* ns of the next drop while dropping */
+    uint32_t count;         /* drops since dropping started */
+    uint32_t lastcount;
+    int dropping;
+};
+
+struct sr_sojourn
+{
+    uint64_t count[SR_SOJOURN_BUCKETS];
+    uint64_t packets;
+    uint64_t total;         /* ns */
+    uint64_t max;           /* ns */
+};
+
+void sr_codel_init(struct sr_codel* c, uint32_t target_us, uint32_t interval_us);
+int  sr_codel_drop(struct sr_codel* c, uint64_t sojourn, unsigned int backlog,
+                   uint64_t now);
+void sr_sojourn_add(struct sr_sojourn* h, uint64_t ns);
+uint64_t sr_sojourn_quantile(const struct sr_sojourn* h, double q);
+void sr_sojourn_print(const struct sr_sojourn* h, FILE* out);
+void sr_sojourn_print_buckets(const struct sr_sojourn* h, const char* prefix,
+                              FILE* out);
+
+#endif /* SR_CODEL_H */
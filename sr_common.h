@@ -0,0 +1,53 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_common.h
+ *
+ * Description:
+ *
+ * Small helpers the parts of the router share: the hash mixer behind
+ * the flow and NAT tables, and the clock that packets are stamped with
+ * and timeouts and durations are measured on.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_COMMON_H
+#define SR_COMMON_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#include <time.h>
+
+#define SR_NS_PER_SEC 1000000000ULL
+
+/* -- 32-bit finalizer from MurmurHash3 -- */
+static __inline__ uint32_t sr_hash_mix(uint32_t h)
+{
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    h ^= h >> 16;
+    return h;
+} /* -- sr_hash_mix -- */
+
+/* -- clock in nanoseconds -- */
+static __inline__ uint64_t sr_clock_ns(clockid_t clock)
+{
+    struct timespec ts;
+
+    clock_gettime(clock, &ts);
+    return (uint64_t)ts.tv_sec * SR_NS_PER_SEC + ts.tv_nsec;
+} /* -- sr_clock_ns -- */
+
+/* -- CLOCK_MONOTONIC in nanoseconds, the router's clock -- */
+static __inline__ uint64_t sr_now_ns(void)
+{
+    return sr_clock_ns(CLOCK_MONOTONIC);
+} /* -- sr_now_ns -- */
+
+#endif /* -- SR_COMMON_H -- */
@@ -0,0 +1,1399 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_ctl.c
+ *
+ * Description:
+ *
+ * Unix domain control socket.  A client connects, writes one command line
+ * and reads the reply until the router closes the connection, e.g.
+ *
+ *   $ echo stats | socat - UNIX-CONNECT:/tmp/sr.ctl
+ *
+ * Several lines sent in one write (up to SR_CTL_BATCH_MAX bytes) are run
+ * in order and their replies concatenated, which is how route updates
+ * reach thousands per second.
+ *
+ * Clients are served without blocking: the command is read as it comes
+ * until its last line is complete, the reply is built in memory and
+ * written as the client takes it, so a silent or slow client holds only
+ * its own connection.  At most SR_CTL_CLIENTS are connected at once.
+ *
+ * In event loop mode the listening socket and clients are polled by the
+ * loop (sr_reactor.c, sr_uring.c or a netdev backend's); in threaded
+ * mode sr_ctl_start runs its own epoll thread.
+ *
+ * A route load runs on a worker thread (sr_rt_load_start).  The batch
+ * stops at that line and the loop polls the job's eventfd in place of
+ * the client (sr_ctl_wait_fd); when it fires the load is finished into
+ * the reply and the lines after it run.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "sr_router.h"
+#include "sr_rt.h"
+#include "sr_if.h"
+#include "sr_arpcache.h"
+#include "sr_nat.h"
+#include "sr_acl.h"
+#include "sr_fib6.h"
+#include "sr_ndcache.h"
+#include "sr_trace.h"
+#include "sr_sflow.h"
+#include "sr_egress.h"
+#include "sr_pbuf.h"
+
+#define SR_CTL_BATCH_MAX 65536
+#define SR_CTL_MAX_ARGS 8
+#define SR_CTL_EVENTS 16
+
+/* -- a connected client, free while in is NULL -- */
+struct sr_ctl_client
+{
+    int fd;
+    struct sr_instance* sr;  /* whose loop polls fd */
+    char* in;                /* command lines, SR_CTL_BATCH_MAX bytes */
+    unsigned int in_len;
+    int eof;                 /* client stopped sending */
+    FILE* reply;             /* lines running into out, NULL otherwise */
+    char* save;              /* strtok_r position among them */
+    struct sr_rt_load* load; /* route load the lines wait for, or NULL */
+    char* out;               /* reply, NULL until the lines have run */
+    size_t out_len;
+    size_t out_off;          /* bytes of it written */
+};
+
+static struct sr_ctl_client sr_ctl_clients[SR_CTL_CLIENTS];
+static pthread_mutex_t sr_ctl_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* -- the client whose lines this thread runs, for sr_ctl_route -- */
+static __thread struct sr_ctl_client* sr_ctl_running;
+
+struct sr_ctl_cmd
+{
+    const char* name;
+    const char* help;
+    void (*handler)(struct sr_instance* sr, FILE* out, int argc, char** argv);
+};
+
+static void sr_ctl_help(struct sr_instance* sr, FILE* out, int argc, char** argv);
+
+/*---------------------------------------------------------------------
+ * Method: sr_ctl_stats(..)
+ * Scope:  Local
+ *---------------------------------------------------------------------*/
+
+static void sr_ctl_stats(struct sr_instance* sr, FILE* out, int argc, char** argv)
+{
+    fprintf(out, "rx_packets %llu\n", (unsigned long long)sr->stats.rx_packets);
+    fprintf(out, "rx_bytes %llu\n", (unsigned long long)sr->stats.rx_bytes);
+    fprintf(out, "tx_packets %llu\n", (unsigned long long)sr->stats.tx_packets);
+    fprintf(out, "tx_bytes %llu\n", (unsigned long long)sr->stats.tx_bytes);
+    fprintf(out, "tx_errors %llu\n", (unsigned long long)sr->stats.tx_errors);
+    fprintf(out, "syscalls %llu\n", (unsigned long long)sr->stats.syscalls);
+    fprintf(out, "vns_drops %llu\n", (unsigned long long)sr->stats.vns_drops);
+    fprintf(out, "vns_reconnects %llu\n",
+            (unsigned long long)sr->stats.vns_reconnects);
+    fprintf(out, "vns_failed_attempts %llu\n",
+            (unsigned long long)sr->stats.vns_failed_attempts);
+    fprintf(out, "vns_recover_last_us %llu\n",
+            (unsigned long long)sr->stats.vns_recover_last_us);
+    fprintf(out, "vns_recover_max_us %llu\n",
+            (unsigned long long)sr->stats.vns_recover_max_us);
+    fprintf(out, "vns_down_us %llu\n", (unsigned long long)sr->stats.vns_down_us);
+    sr_pbuf_print(out);
+    SR_RT_RDLOCK(sr);
+    if (sr->fib)
+    {
+        fprintf(out, "fib_routes %u\n", sr->fib->routes);
+        fprintf(out, "fib_prefixes %u\n", sr->fib->prefixes);
+        fprintf(out, "fib_nodes %u\n", sr->fib->nodes);
+        fprintf(out, "fib_updates %llu\n", (unsigned long long)sr->fib->updates);
+    }
+    if (sr->fwd_fib)
+    {
+        fprintf(out, "fwd_routes %u\n", sr->fwd_fib->routes);
+        fprintf(out, "fwd_prefixes %u\n", sr->fwd_fib->prefixes);
+        fprintf(out, "fwd_nodes %u\n", sr->fwd_fib->nodes);
+    }
+    if (sr->fib6)
+    {
+        fprintf(out, "fib6_routes %u\n", sr->fib6->routes);
+        fprintf(out, "fib6_nodes %u\n", sr->fib6->nodes);
+        fprintf(out, "fib6_updates %llu\n", (unsigned long long)sr->fib6->updates);
+    }
+    SR_RT_UNLOCK(sr);
+} /* -- sr_ctl_stats -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ctl_ifaces(..)
+ * Scope:  Local
+ *---------------------------------------------------------------------*/
+
+static void sr_ctl_ifaces(struct sr_instance* sr, FILE* out, int argc, char** argv)
+{
+    struct sr_if* if_walker;
+    struct in_addr ip_addr;
+    char ip6[INET6_ADDRSTRLEN];
+
+    for (if_walker = sr->if_list; if_walker; if_walker = if_walker->next)
+    {
+        ip_addr.s_addr = if_walker->ip;
+        fprintf(out, "%s %02x:%02x:%02x:%02x:%02x:%02x %s", if_walker->name,
+                if_walker->addr[0], if_walker->addr[1], if_walker->addr[2],
+                if_walker->addr[3], if_walker->addr[4], if_walker->addr[5],
+                inet_ntoa(ip_addr));
+        if (if_walker->ip6_plen)
+        {
+            fprintf(out, " %s/%d",
+                    inet_ntop(AF_INET6, if_walker->ip6, ip6, sizeof(ip6)),
+                    if_walker->ip6_plen);
+        }
+        fprintf(out, " %s\n",
+                inet_ntop(AF_INET6, if_walker->ip6_ll, ip6, sizeof(ip6)));
+    }
+} /* -- sr_ctl_ifaces -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ctl_print_route(..)
+ * Scope:  Local
+ *---------------------------------------------------------------------*/
+
+static void sr_ctl_print_route(FILE* out, const struct sr_rt* rt)
+{
+    char dest[INET_ADDRSTRLEN], gw[INET_ADDRSTRLEN], mask[INET_ADDRSTRLEN];
+
+    inet_ntop(AF_INET, &rt->dest, dest, sizeof(dest));
+    inet_ntop(AF_INET, &rt->gw, gw, sizeof(gw));
+    inet_ntop(AF_INET, &rt->mask, mask, sizeof(mask));
+    fprintf(out, "%s %s %s %s weight %u tx_packets %llu tx_bytes %llu\n",
+            dest, gw, mask, rt->interface, rt->weight,
+            (unsigned long long)rt->tx_packets,
+            (unsigned long long)rt->tx_bytes);
+} /* -- sr_ctl_print_route -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ctl_parse_prefix(..)
+ * Scope:  Local
+ *
+ * Parse "a.b.c.d/len" (or a bare address for a /32).  Returns 0 on
+ * success.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_ctl_parse_prefix(char* str, struct in_addr* dest,
+                               struct in_addr* mask)
+{
+    char* slash;
+    char* end;
+    long len = 32;
+
+    if ((slash = strchr(str, '/')) != 0)
+    {
+        *slash++ = '\0';
+        len = strtol(slash, &end, 10);
+        if (end == slash || *end != '\0' || len < 0 || len > 32)
+        { return -1; }
+    }
+    if (inet_aton(str, dest) == 0)
+    { return -1; }
+    mask->s_addr = len ? htonl(0xffffffffU << (32 - len)) : 0;
+    return 0;
+} /* -- sr_ctl_parse_prefix -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ctl_route(..)
+ * Scope:  Local
+ *
+ * route add|replace DEST/LEN GW IFACE [WEIGHT]
+ * route del DEST/LEN [GW IFACE]
+ * route get IP
+ * route load MRT_FILE MAP_FILE
+ * route compress [off]
+ *
+ * Updates change only the prefix they name; see sr_rt_add and friends.
+ * A load adds a table dump on a worker thread, see sr_rt_load_start;
+ * updates are refused until it is done.  Compression forwards
+ * with an ORTC copy of the table, made again after every load until
+ * turned off; see sr_rt_compress.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_ctl_route(struct sr_instance* sr, FILE* out, int argc, char** argv)
+{
+    struct in_addr dest, mask, gw;
+    struct sr_rt* rt;
+    unsigned long weight = SR_RT_DEFAULT_WEIGHT;
+    char* end;
+    int ret;
+
+    if (argc == 3 && strcmp(argv[1], "get") == 0)
+    {
+        if (inet_aton(argv[2], &dest) == 0)
+        {
+            fprintf(out, "error: bad address %s\n", argv[2]);
+            return;
+        }
+        SR_RT_RDLOCK(sr);
+        rt = sr->fib ? sr_fib_lookup(sr->fib, dest.s_addr) : 0;
+        if (rt == 0)
+        { fprintf(out, "no route\n"); }
+        for (; rt; rt = rt->ecmp_next)
+        { sr_ctl_print_route(out, rt); }
+        SR_RT_UNLOCK(sr);
+        return;
+    }
+
+    if (argc == 4 && strcmp(argv[1], "load") == 0)
+    {
+        if (sr_ctl_running)
+        { sr_ctl_running->load = sr_rt_load_start(sr, argv[2], argv[3], out); }
+        if (sr_ctl_running == 0 || sr_ctl_running->load == 0)
+        { fprintf(out, "error: routes unchanged\n"); }
+        return;
+    }
+
+    if (argc == 2 && strcmp(argv[1], "compress") == 0)
+    {
+        sr->rt_compress = 1;
+        if (sr_rt_compress(sr, out) != 0)
+        { fprintf(out, "error: forwarding from the full table\n"); }
+        return;
+    }
+    if (argc == 3 && strcmp(argv[1], "compress") == 0 &&
+        strcmp(argv[2], "off") == 0)
+    {
+        sr->rt_compress = 0;
+        sr_rt_uncompress(sr);
+        fprintf(out, "ok\n");
+        return;
+    }
+
+    if (argc < 3 || sr_ctl_parse_prefix(argv[2], &dest, &mask) != 0)
+    {
+        fprintf(out, "usage: route add|replace DEST/LEN GW IFACE [WEIGHT]\n"
+                     "       route del DEST/LEN [GW IFACE]\n"
+                     "       route get IP\n"
+                     "       route load MRT_FILE MAP_FILE\n"
+                     "       route compress [off]\n");
+        return;
+    }
+
+    /* -- the loader is copying the table -- */
+    if (sr->rt_load)
+    {
+        fprintf(out, "error: a route load is running, routes unchanged\n");
+        return;
+    }
+
+    if (strcmp(argv[1], "del") == 0 && (argc == 3 || argc == 5))
+    {
+        if (argc == 5 && inet_aton(argv[3], &gw) == 0)
+        {
+            fprintf(out, "error: bad gateway %s\n", argv[3]);
+            return;
+        }
+        ret = sr_rt_del(sr, dest, mask, (argc == 5) ? &gw : 0,
+                        (argc == 5) ? argv[4] : 0);
+        if (ret < 0)
+        { fprintf(out, "error: %s\n", sr_fib_strerror(ret)); }
+        else if (ret == 0)
+        { fprintf(out, "error: no such route\n"); }
+        else
+        { fprintf(out, "ok %d\n", ret); }
+        return;
+    }
+
+    if ((strcmp(argv[1], "add") != 0 && strcmp(argv[1], "replace") != 0) ||
+        (argc != 5 && argc != 6))
+    {
+        fprintf(out, "error: bad route command\n");
+        return;
+    }
+    if (inet_aton(argv[3], &gw) == 0)
+    {
+        fprintf(out, "error: bad gateway %s\n", argv[3]);
+        return;
+    }
+    if (sr_get_interface(sr, argv[4]) == 0)
+    {
+        fprintf(out, "error: no interface %s\n", argv[4]);
+        return;
+    }
+    if (argc == 6)
+    {
+        weight = strtoul(argv[5], &end, 10);
+        if (end == argv[5] || *end != '\0')
+        {
+            fprintf(out, "error: bad weight %s\n", argv[5]);
+            return;
+        }
+    }
+
+    if (argv[1][0] == 'a')
+    { ret = sr_rt_add(sr, dest, gw, mask, argv[4], (unsigned int)weight); }
+    else
+    { ret = sr_rt_replace(sr, dest, gw, mask, argv[4], (unsigned int)weight); }
+    if (ret != SR_FIB_OK)
+    { fprintf(out, "error: %s\n", sr_fib_strerror(ret)); }
+    else
+    { fprintf(out, "ok\n"); }
+} /* -- sr_ctl_route -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ctl_routes(..)
+ * Scope:  Local
+ *---------------------------------------------------------------------*/
+
+static void sr_ctl_routes(struct sr_instance* sr, FILE* out, int argc, char** argv)
+{
+    struct sr_rt* rt_walker;
+    struct sr_rt* copy;
+    size_t n = 0, i;
+
+    /* -- copied out under the lock, printed after -- */
+    SR_RT_RDLOCK(sr);
+    for (rt_walker = sr->routing_table; rt_walker; rt_walker = rt_walker->next)
+    { n++; }
+    if ((copy = (struct sr_rt*)malloc((n ? n : 1) * sizeof(*copy))) == 0)
+    {
+        SR_RT_UNLOCK(sr);
+        fprintf(out, "error: out of memory\n");
+        return;
+    }
+    for (i = 0, rt_walker = sr->routing_table; rt_walker; rt_walker = rt_walker->next)
+    { copy[i++] = *rt_walker; }
+    SR_RT_UNLOCK(sr);
+
+    for (i = 0; i < n; i++)
+    { sr_ctl_print_route(out, &copy[i]); }
+    free(copy);
+} /* -- sr_ctl_routes -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ctl_print_route6(..)
+ * Scope:  Local
+ *---------------------------------------------------------------------*/
+
+static void sr_ctl_print_route6(FILE* out, const struct sr_rt6* rt)
+{
+    char dest[INET6_ADDRSTRLEN], gw[INET6_ADDRSTRLEN];
+
+    inet_ntop(AF_INET6, rt->dest, dest, sizeof(dest));
+    inet_ntop(AF_INET6, rt->gw, gw, sizeof(gw));
+    fprintf(out, "%s/%d %s %s tx_packets %llu tx_bytes %llu\n",
+            dest, rt->len, gw, rt->interface,
+            (unsigned long long)rt->tx_packets,
+            (unsigned long long)rt->tx_bytes);
+} /* -- sr_ctl_print_route6 -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ctl_route6(..)
+ * Scope:  Local
+ *
+ * route6 add DEST/LEN GW IFACE
+ * route6 del DEST/LEN
+ * route6 get IP
+ *
+ * GW is :: for a connected prefix.  See sr_rt6_add.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_ctl_route6(struct sr_instance* sr, FILE* out, int argc, char** argv)
+{
+    uint8_t dest[16], gw[16];
+    struct sr_rt6* rt;
+    int len, ret;
+
+    if (argc == 3 && strcmp(argv[1], "get") == 0)
+    {
+        if (inet_pton(AF_INET6, argv[2], dest) != 1)
+        {
+            fprintf(out, "error: bad address %s\n", argv[2]);
+            return;
+        }
+        SR_RT_RDLOCK(sr);
+        if ((rt = sr->fib6 ? sr_fib6_lookup(sr->fib6, dest) : 0) == 0)
+        { fprintf(out, "no route\n"); }
+        else
+        { sr_ctl_print_route6(out, rt); }
+        SR_RT_UNLOCK(sr);
+        return;
+    }
+
+    if (argc < 3 || sr_fib6_parse(argv[2], dest, &len) != 0)
+    {
+        fprintf(out, "usage: route6 add DEST/LEN GW IFACE\n"
+                     "       route6 del DEST/LEN\n"
+                     "       route6 get IP\n");
+        return;
+    }
+
+    if (argc == 3 && strcmp(argv[1], "del") == 0)
+    {
+        if (sr_rt6_del(sr, dest, len) == 0)
+        { fprintf(out, "error: no such route\n"); }
+        else
+        { fprintf(out, "ok 1\n"); }
+        return;
+    }
+
+    if (argc != 5 || strcmp(argv[1], "add") != 0)
+    {
+        fprintf(out, "error: bad route6 command\n");
+        return;
+    }
+    if (inet_pton(AF_INET6, argv[3], gw) != 1)
+    {
+        fprintf(out, "error: bad gateway %s\n", argv[3]);
+        return;
+    }
+    if (sr_get_interface(sr, argv[4]) == 0)
+    {
+        fprintf(out, "error: no interface %s\n", argv[4]);
+        return;
+    }
+    if ((ret = sr_rt6_add(sr, dest, len, gw, argv[4])) != SR_FIB_OK)
+    { fprintf(out, "error: %s\n", sr_fib_strerror(ret)); }
+    else
+    { fprintf(out, "ok\n"); }
+} /* -- sr_ctl_route6 -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ctl_routes6(..)
+ * Scope:  Local
+ *---------------------------------------------------------------------*/
+
+static void sr_ctl_routes6(struct sr_instance* sr, FILE* out, int argc, char** argv)
+{
+    struct sr_rt6* rt;
+
+    SR_RT_RDLOCK(sr);
+    for (rt = sr->fib6 ? sr->fib6->head : 0; rt; rt = rt->next)
+    { sr_ctl_print_route6(out, rt); }
+    SR_RT_UNLOCK(sr);
+} /* -- sr_ctl_routes6 -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ctl_arp(..)
+ * Scope:  Local
+ *
+ * "arp" lists the valid entries, marking tentative the ones reloaded
+ * from the -a snapshot and not yet confirmed, "arp static IP MAC" pins a mapping,
+ * "arp del IP" removes one and "arp flush" drops all but the static
+ * ones.  "arp pending" lists the requests with the packets waiting on
+ * them and how long the ones sent so far waited.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_ctl_arp(struct sr_instance* sr, FILE* out, int argc, char** argv)
+{
+    struct sr_arpcache* cache = &(sr->cache);
+    struct sr_arpreq* req;
+    struct in_addr addr;
+    unsigned int m[6];
+    unsigned char mac[6];
+    char ip[INET_ADDRSTRLEN];
+    char extra;
+    time_t now = time(NULL);
+    int i;
+
+    if (argc == 2 && strcmp(argv[1], "flush") == 0)
+    {
+        fprintf(out, "ok %d\n", sr_arpcache_flush(cache));
+        return;
+    }
+    if (argc == 2 && strcmp(argv[1], "pending") == 0)
+    {
+        sr_arpcache_print_pending(cache, out);
+        return;
+    }
+    if (argc == 3 && strcmp(argv[1], "del") == 0 && inet_aton(argv[2], &addr))
+    {
+        if (sr_arpcache_remove(cache, addr.s_addr) != 0)
+        { fprintf(out, "error: no entry for %s\n", argv[2]); }
+        else
+        { fprintf(out, "ok\n"); }
+        return;
+    }
+    if (argc == 4 && strcmp(argv[1], "static") == 0 && inet_aton(argv[2], &addr))
+    {
+        if (sscanf(argv[3], "%2x:%2x:%2x:%2x:%2x:%2x%c", &m[0], &m[1], &m[2],
+                   &m[3], &m[4], &m[5], &extra) != 6)
+        {
+            fprintf(out, "error: bad MAC %s\n", argv[3]);
+            return;
+        }
+        for (i = 0; i < 6; i++)
+        { mac[i] = (unsigned char)m[i]; }
+        if (sr_arpcache_add_static(cache, mac, addr.s_addr, &req) != 0)
+        { fprintf(out, "error: ARP cache full\n"); }
+        else
+        { fprintf(out, "ok\n"); }
+        /* -- what waited on the address goes out to the MAC given -- */
+        if (req)
+        { handle_ARP_send_pending(sr, req, mac, req->iface); }
+        return;
+    }
+    if (argc != 1)
+    {
+        fprintf(out, "usage: arp [static IP MAC | del IP | flush | pending]\n");
+        return;
+    }
+
+    SR_ARPCACHE_LOCK(cache);
+    for (i = 0; i < SR_ARPCACHE_SZ; i++)
+    {
+        struct sr_arpentry* cur = &(cache->entries[i]);
+        if (!cur->valid)
+        { continue; }
+        inet_ntop(AF_INET, &cur->ip, ip, sizeof(ip));
+        if (cur->is_static)
+        {
+            fprintf(out, "%s %02x:%02x:%02x:%02x:%02x:%02x static\n", ip,
+                    cur->mac[0], cur->mac[1], cur->mac[2],
+                    cur->mac[3], cur->mac[4], cur->mac[5]);
+            continue;
+        }
+        fprintf(out, "%s %02x:%02x:%02x:%02x:%02x:%02x age %.0f%s\n", ip,
+                cur->mac[0], cur->mac[1], cur->mac[2],
+                cur->mac[3], cur->mac[4], cur->mac[5],
+                difftime(now, cur->added), cur->tentative ? " tentative" : "");
+    }
+    SR_ARPCACHE_UNLOCK(cache);
+} /* -- sr_ctl_arp -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ctl_nd(..)
+ * Scope:  Local
+ *
+ * The IPv6 neighbor cache, with the same subcommands as "arp".
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_ctl_nd(struct sr_instance* sr, FILE* out, int argc, char** argv)
+{
+    struct sr_ndcache* cache = &(sr->nd);
+    uint8_t addr[16];
+    unsigned int m[6];
+    unsigned char mac[6];
+    char ip[INET6_ADDRSTRLEN];
+    char extra;
+    time_t now = time(NULL);
+    int i;
+
+    if (argc == 2 && strcmp(argv[1], "flush") == 0)
+    {
+        fprintf(out, "ok %d\n", sr_ndcache_flush(cache));
+        return;
+    }
+    if (argc == 3 && strcmp(argv[1], "del") == 0 &&
+        inet_pton(AF_INET6, argv[2], addr) == 1)
+    {
+        if (sr_ndcache_remove(cache, addr) != 0)
+        { fprintf(out, "error: no entry for %s\n", argv[2]); }
+        else
+        { fprintf(out, "ok\n"); }
+        return;
+    }
+    if (argc == 4 && strcmp(argv[1], "static") == 0 &&
+        inet_pton(AF_INET6, argv[2], addr) == 1)
+    {
+        if (sscanf(argv[3], "%2x:%2x:%2x:%2x:%2x:%2x%c", &m[0], &m[1], &m[2],
+                   &m[3], &m[4], &m[5], &extra) != 6)
+        {
+            fprintf(out, "error: bad MAC %s\n", argv[3]);
+            return;
+        }
+        for (i = 0; i < 6; i++)
+        { mac[i] = (unsigned char)m[i]; }
+        if (sr_ndcache_add_static(cache, mac, addr) != 0)
+        { fprintf(out, "error: neighbor cache full\n"); }
+        else
+        { fprintf(out, "ok\n"); }
+        return;
+    }
+    if (argc != 1)
+    {
+        fprintf(out, "usage: nd [static IP MAC | del IP | flush]\n");
+        return;
+    }
+
+    SR_NDCACHE_LOCK(cache);
+    for (i = 0; i < SR_NDCACHE_SZ; i++)
+    {
+        struct sr_ndentry* cur = &(cache->entries[i]);
+        if (!cur->valid)
+        { continue; }
+        inet_ntop(AF_INET6, cur->ip, ip, sizeof(ip));
+        if (cur->is_static)
+        {
+            fprintf(out, "%s %02x:%02x:%02x:%02x:%02x:%02x static\n", ip,
+                    cur->mac[0], cur->mac[1], cur->mac[2],
+                    cur->mac[3], cur->mac[4], cur->mac[5]);
+            continue;
+        }
+        fprintf(out, "%s %02x:%02x:%02x:%02x:%02x:%02x age %.0f\n", ip,
+                cur->mac[0], cur->mac[1], cur->mac[2],
+                cur->mac[3], cur->mac[4], cur->mac[5],
+                difftime(now, cur->added));
+    }
+    SR_NDCACHE_UNLOCK(cache);
+} /* -- sr_ctl_nd -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ctl_nat(..)
+ * Scope:  Local
+ *---------------------------------------------------------------------*/
+
+static void sr_ctl_nat(struct sr_instance* sr, FILE* out, int argc, char** argv)
+{
+    if (!sr->nat)
+    {
+        fprintf(out, "NAT not enabled\n");
+        return;
+    }
+    sr_nat_print_stats(sr->nat, out);
+} /* -- sr_ctl_nat -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ctl_acl(..)
+ * Scope:  Local
+ *
+ * "acl" lists the rules with their hit counts, "acl reload [file]"
+ * recompiles the rules file (or a new one) and swaps it in.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_ctl_acl(struct sr_instance* sr, FILE* out, int argc, char** argv)
+{
+    if (!sr->acl)
+    {
+        fprintf(out, "ACL not enabled\n");
+        return;
+    }
+    if (argc == 1)
+    {
+        sr_acl_print(sr->acl, out);
+        return;
+    }
+    if (strcmp(argv[1], "reload") != 0 || argc > 3)
+    {
+        fprintf(out, "usage: acl [reload [file]]\n");
+        return;
+    }
+    if (sr_acl_load(sr->acl, (argc == 3) ? argv[2] : sr->acl->path, out) != 0)
+    { fprintf(out, "error: rules unchanged\n"); }
+} /* -- sr_ctl_acl -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ctl_trace(..)
+ * Scope:  Local
+ *
+ * "trace" reports the event trace, "trace level LEVEL" changes what it
+ * records.  The trace is the process's, shared by all routers.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_ctl_trace(struct sr_instance* sr, FILE* out, int argc, char** argv)
+{
+    int level;
+
+    if (argc == 1)
+    {
+        sr_trace_report(out);
+        return;
+    }
+    if (argc != 3 || strcmp(argv[1], "level") != 0 ||
+        (level = sr_trace_parse_level(argv[2])) < 0)
+    {
+        fprintf(out, "usage: trace [level off|error|warn|info|debug]\n");
+        return;
+    }
+    if (sr_trace_set_level(level) != 0)
+    {
+        fprintf(out, "error: no trace, start the router with -L\n");
+        return;
+    }
+    fprintf(out, "ok\n");
+} /* -- sr_ctl_trace -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ctl_sflow(..)
+ * Scope:  Local
+ *
+ * "sflow" shows the sampler's counters, "sflow rate IFACE|all N
+ * [in|out]" samples one in N frames, both directions by default, 0 for
+ * none.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_ctl_sflow(struct sr_instance* sr, FILE* out, int argc, char** argv)
+{
+    struct sr_if* iface;
+    unsigned long rate;
+    char* end;
+    int all, in = 1, eg = 1, n = 0;
+
+    if (!sr->sflow)
+    {
+        fprintf(out, "sampling not enabled, start the router with -S\n");
+        return;
+    }
+    if (argc == 1)
+    {
+        sr_sflow_print(sr, out);
+        return;
+    }
+    if ((argc != 4 && argc != 5) || strcmp(argv[1], "rate") != 0 ||
+        (rate = strtoul(argv[3], &end, 10), *end != '\0' || end == argv[3]) ||
+        (argc == 5 && strcmp(argv[4], "in") != 0 && strcmp(argv[4], "out") != 0))
+    {
+        fprintf(out, "usage: sflow [rate IFACE|all N [in|out]]\n");
+        return;
+    }
+    if (argc == 5)
+    {
+        in = (strcmp(argv[4], "in") == 0);
+        eg = !in;
+    }
+
+    all = (strcmp(argv[2], "all") == 0);
+    for (iface = sr->if_list; iface; iface = iface->next)
+    {
+        if (!all && strcmp(iface->name, argv[2]) != 0)
+        { continue; }
+        if (in)
+        { sr_sflow_set_rate(sr, iface, SR_SFLOW_IN, (uint32_t)rate); }
+        if (eg)
+        { sr_sflow_set_rate(sr, iface, SR_SFLOW_OUT, (uint32_t)rate); }
+        n++;
+    }
+    if (n == 0)
+    {
+        fprintf(out, "error: no interface %s\n", argv[2]);
+        return;
+    }
+    fprintf(out, "ok\n");
+} /* -- sr_ctl_sflow -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ctl_egress(..)
+ * Scope:  Local
+ *
+ * "egress" shows the queues of every interface, "egress quantum CLASS
+ * BYTES" sets a data class's DRR quantum, "egress limit PACKETS" the
+ * length of every queue, "egress rate IFACE|all MBIT [BURST]" the
+ * shaping rate (0 for none) and bucket depth in bytes and "egress codel
+ * TARGET INTERVAL" the CoDel target and interval in us (target 0 for
+ * off).  "egress sojourn" shows the sojourn histograms.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_ctl_egress(struct sr_instance* sr, FILE* out, int argc, char** argv)
+{
+    struct sr_if* iface = 0;
+    unsigned long cls, val, burst = 0, interval;
+    char* end;
+
+    if (!sr->egress_limit)
+    {
+        fprintf(out, "egress scheduler not enabled, start the router with -Q\n");
+        return;
+    }
+    if (argc == 1)
+    {
+        sr_egress_print(sr, out);
+        return;
+    }
+    if (argc == 2 && strcmp(argv[1], "sojourn") == 0)
+    {
+        sr_egress_print_sojourn(sr, out);
+        return;
+    }
+    if (argc == 4 && strcmp(argv[1], "codel") == 0)
+    {
+        val = strtoul(argv[2], &end, 10);
+        if (*end != '\0' || end == argv[2])
+        {
+            fprintf(out, "error: bad target %s\n", argv[2]);
+            return;
+        }
+        interval = strtoul(argv[3], &end, 10);
+        if (*end != '\0' || interval == 0 || interval < val)
+        {
+            fprintf(out, "error: interval must be at least the target\n");
+            return;
+        }
+        sr_egress_set_codel(sr, (uint32_t)val, (uint32_t)interval);
+        fprintf(out, "ok\n");
+        return;
+    }
+    if (argc == 4 && strcmp(argv[1], "quantum") == 0)
+    {
+        cls = strtoul(argv[2], &end, 10);
+        if (*end != '\0' || end == argv[2] || cls >= SR_EGRESS_CLASSES)
+        {
+            fprintf(out, "error: class must be 0..%d\n", SR_EGRESS_CLASSES - 1);
+            return;
+        }
+        val = strtoul(argv[3], &end, 10);
+        if (*end != '\0' || val < 64)
+        {
+            fprintf(out, "error: quantum must be at least 64 bytes\n");
+            return;
+        }
+        sr_egress_set_quantum(sr, (int)cls, (uint32_t)val);
+        fprintf(out, "ok\n");
+        return;
+    }
+    if (argc == 3 && strcmp(argv[1], "limit") == 0)
+    {
+        val = strtoul(argv[2], &end, 10);
+        if (*end != '\0' || val == 0)
+        {
+            fprintf(out, "error: bad limit %s\n", argv[2]);
+            return;
+        }
+        sr_egress_set_limit(sr, (unsigned int)val);
+        fprintf(out, "ok\n");
+        return;
+    }
+    if ((argc == 4 || argc == 5) && strcmp(argv[1], "rate") == 0)
+    {
+        if (strcmp(argv[2], "all") != 0 &&
+            (iface = sr_get_interface(sr, argv[2])) == 0)
+        {
+            fprintf(out, "error: no interface %s\n", argv[2]);
+            return;
+        }
+        val = strtoul(argv[3], &end, 10);
+        if (*end != '\0' || end == argv[3])
+        {
+            fprintf(out, "error: bad rate %s\n", argv[3]);
+            return;
+        }
+        if (argc == 5)
+        {
+            burst = strtoul(argv[4], &end, 10);
+            if (*end != '\0' || burst < SR_EGRESS_BURST_MIN)
+            {
+                fprintf(out, "error: burst must be at least %d bytes\n",
+                        SR_EGRESS_BURST_MIN);
+                return;
+            }
+        }
+        sr_egress_set_rate(sr, iface, (uint32_t)val, (uint32_t)burst);
+        fprintf(out, "ok\n");
+        return;
+    }
+    fprintf(out, "usage: egress [quantum CLASS BYTES | limit PACKETS | "
+            "rate IFACE|all MBIT [BURST] | codel TARGET INTERVAL | sojourn]\n");
+} /* -- sr_ctl_egress -- */
+
+static const struct sr_ctl_cmd sr_ctl_cmds[] =
+{
+    { "help",   "list commands",              sr_ctl_help   },
+    { "stats",  "packet counters",            sr_ctl_stats  },
+    { "ifaces", "interface list",             sr_ctl_ifaces },
+    { "routes", "routing table and per route counters", sr_ctl_routes },
+    { "route",  "route add|del|replace|get|load, see route with no arguments", sr_ctl_route },
+    { "routes6", "IPv6 routes and per route counters", sr_ctl_routes6 },
+    { "route6", "route6 add|del|get, see route6 with no arguments", sr_ctl_route6 },
+    { "arp",    "ARP cache entries, arp static|del|flush|pending", sr_ctl_arp },
+    { "nd",     "IPv6 neighbor cache, nd static|del|flush", sr_ctl_nd },
+    { "nat",    "NAT mapping counters",       sr_ctl_nat    },
+    { "acl",    "ACL rules and hits, acl reload [file]", sr_ctl_acl },
+    { "trace",  "event trace state, trace level LEVEL", sr_ctl_trace },
+    { "sflow",  "packet sampling counters, sflow rate IFACE|all N [in|out]", sr_ctl_sflow },
+    { "egress", "egress queues, egress quantum CLASS BYTES | limit PACKETS | rate IFACE|all MBIT [BURST] | codel TARGET INTERVAL | sojourn", sr_ctl_egress },
+    { 0, 0, 0 }
+};
+
+static void sr_ctl_help(struct sr_instance* sr, FILE* out, int argc, char** argv)
+{
+    const struct sr_ctl_cmd* cmd;
+
+    for (cmd = sr_ctl_cmds; cmd->name; cmd++)
+    { fprintf(out, "%-8s %s\n", cmd->name, cmd->help); }
+} /* -- sr_ctl_help -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ctl_listen(..)
+ * Scope:  Global
+ *
+ * Create a non-blocking listening socket at path, replacing a stale
+ * socket file.  Returns the descriptor or -1 on error.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_ctl_listen(const char* path)
+{
+    struct sockaddr_un addr;
+    int fd;
+
+    /* -- REQUIRES -- */
+    assert(path);
+
+    if (strlen(path) >= sizeof(addr.sun_path))
+    {
+        fprintf(stderr, "Control socket path too long: %s\n", path);
+        return -1;
+    }
+
+    if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+    {
+        perror("socket(..):sr_ctl.c::sr_ctl_listen(..)");
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    unlink(path);
+
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+        listen(fd, 8) < 0)
+    {
+        perror("bind/listen(..):sr_ctl.c::sr_ctl_listen(..)");
+        close(fd);
+        return -1;
+    }
+
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    return fd;
+} /* -- sr_ctl_listen -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ctl_exec(..)
+ * Scope:  Local
+ *
+ * Run one command line, writing the reply to out.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_ctl_exec(struct sr_instance* sr, FILE* out, char* line)
+{
+    char* argv[SR_CTL_MAX_ARGS];
+    char* save = 0;
+    const struct sr_ctl_cmd* cmd;
+    int argc = 0;
+
+    for (argv[argc] = strtok_r(line, " \t\r", &save);
+         argv[argc] && argc < SR_CTL_MAX_ARGS - 1;
+         argv[argc] = strtok_r(0, " \t\r", &save))
+    { argc++; }
+
+    if (argc == 0)
+    { return; }
+
+    for (cmd = sr_ctl_cmds; cmd->name; cmd++)
+    {
+        if (strcmp(cmd->name, argv[0]) == 0)
+        { break; }
+    }
+
+    if (cmd->name)
+    { cmd->handler(sr, out, argc, argv); }
+    else
+    { fprintf(out, "error: unknown command '%s', try help\n", argv[0]); }
+} /* -- sr_ctl_exec -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ctl_client_find(..)
+ * Scope:  Local
+ *
+ * The state of connected client fd, NULL if it has none.  Called with
+ * sr_ctl_lock held.
+ *
+ *---------------------------------------------------------------------*/
+
+static struct sr_ctl_client* sr_ctl_client_find(int fd)
+{
+    int i;
+
+    for (i = 0; i < SR_CTL_CLIENTS; i++)
+    {
+        if (sr_ctl_clients[i].in && sr_ctl_clients[i].fd == fd)
+        { return &sr_ctl_clients[i]; }
+    }
+    return 0;
+} /* -- sr_ctl_client_find -- */
+
+/* -- close the client and free its slot, with sr_ctl_lock held -- */
+static void sr_ctl_client_free(struct sr_ctl_client* c)
+{
+    if (c->load)
+    { sr_rt_load_finish(c->sr, c->load, 0); }
+    if (c->reply)
+    { fclose(c->reply); }
+    close(c->fd);
+    free(c->out);
+    free(c->in);
+    memset(c, 0, sizeof(*c));
+} /* -- sr_ctl_client_free -- */
+
+static void sr_ctl_client_done(struct sr_ctl_client* c)
+{
+    pthread_mutex_lock(&sr_ctl_lock);
+    sr_ctl_client_free(c);
+    pthread_mutex_unlock(&sr_ctl_lock);
+} /* -- sr_ctl_client_done -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ctl_accept(..)
+ * Scope:  Global
+ *
+ * Accept a client on the listening socket lfd for router sr.  Returns
+ * its non-blocking descriptor, to be polled for reading and handed to
+ * sr_ctl_serve, or -1 if there is none.  Past SR_CTL_CLIENTS connected
+ * clients a new one is told so and closed.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_ctl_accept(struct sr_instance* sr, int lfd)
+{
+    static const char busy[] = "error: too many control clients\n";
+    struct sr_ctl_client* c = 0;
+    char* in;
+    int fd, i;
+
+    if ((fd = accept(lfd, 0, 0)) < 0)
+    { return -1; }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    if ((in = (char*)malloc(SR_CTL_BATCH_MAX)) == 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    pthread_mutex_lock(&sr_ctl_lock);
+    for (i = 0; i < SR_CTL_CLIENTS && c == 0; i++)
+    {
+        if (sr_ctl_clients[i].in == 0)
+        { c = &sr_ctl_clients[i]; }
+    }
+    if (c)
+    {
+        c->fd = fd;
+        c->sr = sr;
+        c->in = in;
+    }
+    pthread_mutex_unlock(&sr_ctl_lock);
+
+    if (c == 0)
+    {
+        if (write(fd, busy, sizeof(busy) - 1) < 0)
+        { /* -- closing tells it anyway -- */ }
+        close(fd);
+        free(in);
+        return -1;
+    }
+    return fd;
+} /* -- sr_ctl_accept -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ctl_serve(..)
+ * Scope:  Global
+ *
+ * Make progress on client fd without blocking: read what it sent and,
+ * once its command lines are complete (the last ends in a newline, or
+ * the client stopped sending), run them into a reply buffer and write
+ * as much of the reply as the socket takes.  A line that starts a route
+ * load suspends the rest until the load is done.
+ *
+ * RETURN VALUES: SR_CTL_READ or SR_CTL_WRITE for what to poll fd for
+ * next, SR_CTL_LOAD to poll sr_ctl_wait_fd(fd) for reading instead, 0
+ * once the reply is out and fd is closed
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_ctl_serve(struct sr_instance* sr, int fd)
+{
+    struct sr_ctl_client* c;
+    char* line = 0;
+    ssize_t n;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+
+    pthread_mutex_lock(&sr_ctl_lock);
+    c = sr_ctl_client_find(fd);
+    pthread_mutex_unlock(&sr_ctl_lock);
+    if (c == 0)
+    {
+        close(fd);
+        return 0;
+    }
+
+    if (c->out == 0 && c->reply == 0)
+    {
+        while (c->in_len < SR_CTL_BATCH_MAX - 1)
+        {
+            n = read(fd, c->in + c->in_len, SR_CTL_BATCH_MAX - 1 - c->in_len);
+            if (n > 0)
+            {
+                c->in_len += n;
+                continue;
+            }
+            if (n < 0 && errno == EINTR)
+            { continue; }
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            { break; }
+            if (n < 0 || c->in_len == 0)
+            {
+                sr_ctl_client_done(c);
+                return 0;
+            }
+            c->eof = 1;
+            break;
+        }
+
+        /* -- a line still coming in -- */
+        if (!c->eof && c->in_len < SR_CTL_BATCH_MAX - 1 &&
+            (c->in_len == 0 || c->in[c->in_len - 1] != '\n'))
+        { return SR_CTL_READ; }
+
+        /* -- the reply is built in memory, so no handler writes to the
+         *    socket with a lock held -- */
+        if ((c->reply = open_memstream(&c->out, &c->out_len)) == 0)
+        {
+            sr_ctl_client_done(c);
+            return 0;
+        }
+        c->in[c->in_len] = '\0';
+        line = strtok_r(c->in, "\n", &c->save);
+    }
+    else if (c->reply)
+    {
+        /* -- the load the lines wait for is done -- */
+        if (sr_rt_load_finish(sr, c->load, c->reply) != 0)
+        { fprintf(c->reply, "error: routes unchanged\n"); }
+        c->load = 0;
+        line = strtok_r(0, "\n", &c->save);
+    }
+
+    if (c->reply)
+    {
+        sr_ctl_running = c;
+        for (; line; line = strtok_r(0, "\n", &c->save))
+        {
+            sr_ctl_exec(sr, c->reply, line);
+            if (c->load)
+            { break; }
+        }
+        sr_ctl_running = 0;
+        if (c->load)
+        { return SR_CTL_LOAD; }
+        fclose(c->reply);
+        c->reply = 0;
+    }
+
+    while (c->out_off < c->out_len)
+    {
+        n = write(fd, c->out + c->out_off, c->out_len - c->out_off);
+        if (n > 0)
+        {
+            c->out_off += n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR)
+        { continue; }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        { return SR_CTL_WRITE; }
+        break;
+    }
+
+    sr_ctl_client_done(c);
+    return 0;
+} /* -- sr_ctl_serve -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ctl_wait_fd(..)
+ * Scope:  Global
+ *
+ * The descriptor to poll for client fd: the eventfd of the route load
+ * its lines wait for, else fd itself.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_ctl_wait_fd(int fd)
+{
+    struct sr_ctl_client* c;
+    int wait = fd;
+
+    pthread_mutex_lock(&sr_ctl_lock);
+    if ((c = sr_ctl_client_find(fd)) != 0 && c->load)
+    { wait = sr_rt_load_fd(c->load); }
+    pthread_mutex_unlock(&sr_ctl_lock);
+    return wait;
+} /* -- sr_ctl_wait_fd -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ctl_serve_epoll(..)
+ * Scope:  Global
+ *
+ * sr_ctl_serve for an event loop that polls client fd in epfd with user
+ * data data, re-arming fd for what the client needs next.  Around a
+ * route load the job's eventfd is polled in its place, with the same
+ * data.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_ctl_serve_epoll(struct sr_instance* sr, int epfd, int fd, uint64_t data)
+{
+    struct epoll_event ev;
+    int want, wait, next;
+
+    /* -- closing fd removed it from epfd, as finishing a load did the
+     *    eventfd -- */
+    wait = sr_ctl_wait_fd(fd);
+    if ((want = sr_ctl_serve(sr, fd)) == 0)
+    { return; }
+    next = (want == SR_CTL_LOAD) ? sr_ctl_wait_fd(fd) : fd;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = (want == SR_CTL_WRITE) ? EPOLLOUT : EPOLLIN;
+    ev.data.u64 = data;
+    if (wait == fd && next == fd)
+    {
+        epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev);
+        return;
+    }
+    if (wait == fd)
+    { epoll_ctl(epfd, EPOLL_CTL_DEL, fd, 0); }
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, next, &ev) < 0)
+    { sr_ctl_close(fd); }
+} /* -- sr_ctl_serve_epoll -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ctl_disconnect(..)
+ * Scope:  Global
+ *
+ * Close the clients of router sr, for an event loop that is returning.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_ctl_disconnect(struct sr_instance* sr)
+{
+    int i;
+
+    pthread_mutex_lock(&sr_ctl_lock);
+    for (i = 0; i < SR_CTL_CLIENTS; i++)
+    {
+        if (sr_ctl_clients[i].in && sr_ctl_clients[i].sr == sr)
+        { sr_ctl_client_free(&sr_ctl_clients[i]); }
+    }
+    pthread_mutex_unlock(&sr_ctl_lock);
+} /* -- sr_ctl_disconnect -- */
+
+/* -- drop client fd without serving it, when it cannot be polled -- */
+void sr_ctl_close(int fd)
+{
+    struct sr_ctl_client* c;
+
+    pthread_mutex_lock(&sr_ctl_lock);
+    if ((c = sr_ctl_client_find(fd)) != 0)
+    { sr_ctl_client_free(c); }
+    else
+    { close(fd); }
+    pthread_mutex_unlock(&sr_ctl_lock);
+} /* -- sr_ctl_close -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ctl_thread(..)
+ * Scope:  Local
+ *
+ * Event loop for the control socket in threaded mode.
+ *
+ *---------------------------------------------------------------------*/
+
+static void* sr_ctl_thread(void* arg)
+{
+    struct sr_instance* sr = arg;
+    struct epoll_event ev, events[SR_CTL_EVENTS];
+    int epfd, lfd, fd, i, n;
+
+    if ((lfd = sr_ctl_listen(sr->ctl_path)) < 0)
+    { return NULL; }
+    if ((epfd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+    {
+        perror("epoll_create1(..):sr_ctl.c::sr_ctl_thread(..)");
+        close(lfd);
+        return NULL;
+    }
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = lfd;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, lfd, &ev);
+
+    while (1)
+    {
+        if ((n = epoll_wait(epfd, events, SR_CTL_EVENTS, -1)) < 0)
+        {
+            if (errno == EINTR)
+            { continue; }
+            perror("epoll_wait(..):sr_ctl.c::sr_ctl_thread(..)");
+            break;
+        }
+        for (i = 0; i < n; i++)
+        {
+            if (events[i].data.fd != lfd)
+            {
+                sr_ctl_serve_epoll(sr, epfd, events[i].data.fd, events[i].data.u64);
+                continue;
+            }
+            if ((fd = sr_ctl_accept(sr, lfd)) < 0)
+            { continue; }
+            ev.data.u64 = 0;
+            ev.data.fd = fd;
+            if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0)
+            { sr_ctl_close(fd); }
+        }
+    }
+
+    sr_ctl_disconnect(sr);
+    close(epfd);
+    close(lfd);
+    return NULL;
+} /* -- sr_ctl_thread -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ctl_start(..)
+ * Scope:  Global
+ *
+ * Serve sr->ctl_path from a detached thread.  Returns 0 on success.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_ctl_start(struct sr_instance* sr)
+{
+    pthread_t thread;
+    pthread_attr_t attr;
+    int ret;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    ret = pthread_create(&thread, &attr, sr_ctl_thread, sr);
+    pthread_attr_destroy(&attr);
+
+    return ret;
+} /* -- sr_ctl_start -- */
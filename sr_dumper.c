@@ -1,5 +1,6 @@
 #include <sys/time.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 
 #include <stdio.h>
 #include "sr_dumper.h"
@@ -47,20 +48,27 @@ sr_dump_open(const char *fname, int thiszone, int snaplen)
 }
 
 /*
- * Output a packet to the initialized dump file.
+ * Output a packet to the initialized dump file.  The record is written
+ * with one writev straight from sp, after anything stdio still holds,
+ * rather than copied into the stdio buffer.
  */
 void
 sr_dump(FILE *fp, const struct pcap_pkthdr *h, const unsigned char *sp)
 {
         struct pcap_sf_pkthdr sf_hdr;
+        struct iovec iov[2];
 
         sf_hdr.ts.tv_sec  = h->ts.tv_sec;
         sf_hdr.ts.tv_usec = h->ts.tv_usec;
         sf_hdr.caplen     = h->caplen;
         sf_hdr.len        = h->len;
+        iov[0].iov_base = &sf_hdr;
+        iov[0].iov_len  = sizeof(sf_hdr);
+        iov[1].iov_base = (void *)sp;
+        iov[1].iov_len  = h->caplen;
+        fflush(fp);
         /* XXX we should check the return status */
-        (void)fwrite(&sf_hdr, sizeof(sf_hdr), 1, fp);
-        (void)fwrite((char *)sp, h->caplen, 1, fp);
+        (void)writev(fileno(fp), iov, 2);
 }
 
 void
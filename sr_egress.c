@@ -0,0 +1,739 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_egress.c
+ *
+ * Description:
+ *
+ * Per interface priority and deficit round robin queues and token
+ * bucket shaping, see sr_egress.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <poll.h>
+
+#include <sys/timerfd.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "sr_router.h"
+#include "sr_if.h"
+#include "sr_protocol.h"
+#include "sr_egress.h"
+#include "sr_common.h"
+
+#define SR_EGRESS_LOCK(eg) \
+    do { if ((eg)->use_locks) pthread_mutex_lock(&((eg)->lock)); } while (0)
+#define SR_EGRESS_UNLOCK(eg) \
+    do { if ((eg)->use_locks) pthread_mutex_unlock(&((eg)->lock)); } while (0)
+
+#define SR_EGRESS_NS 1000000000ULL
+
+/* -- receive bursts being handled by this thread, see sr_egress_hold,
+ *    and when the outermost began, the queueing time of its frames -- */
+static __thread int sr_egress_holds;
+static __thread uint64_t sr_egress_held_at;
+
+/* -- shape eg to mbit Mbit/s (0 for not) with a burst bytes deep bucket,
+ *    0 for SR_EGRESS_BURST_US worth -- */
+static void sr_egress_shape(struct sr_egress_if* eg, uint32_t mbit,
+                            uint32_t burst, uint64_t now)
+{
+    eg->rate = (uint64_t)mbit * 125000;
+    if (burst == 0)
+    { burst = (uint32_t)(eg->rate * SR_EGRESS_BURST_US / 1000000); }
+    if (burst < SR_EGRESS_BURST_MIN)
+    { burst = SR_EGRESS_BURST_MIN; }
+    eg->burst = burst;
+    eg->tokens = burst;
+    eg->stamp = now;
+} /* -- sr_egress_shape -- */
+
+/* -- data class of a frame, from the DSCP of IPv4 and IPv6 -- */
+static int sr_egress_class(const uint8_t* buf, unsigned int len)
+{
+    const sr_ethernet_hdr_t* eth = (const sr_ethernet_hdr_t*)buf;
+    unsigned int dscp;
+
+    if (ntohs(eth->ether_type) == ethertype_ip &&
+        len >= sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t))
+    {
+        dscp = ((const sr_ip_hdr_t*)(eth + 1))->ip_tos >> 2;
+    }
+    else if (ntohs(eth->ether_type) == ethertype_ip6 &&
+             len >= sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip6_hdr_t))
+    {
+        dscp = (ntohl(((const sr_ip6_hdr_t*)(eth + 1))->ip6_flow) >> 22) & 0x3f;
+    }
+    else
+    { return 0; }
+
+    return dscp >> 4;
+} /* -- sr_egress_class -- */
+
+/* -- release a frame taken off (or never put on) a queue -- */
+static void sr_egress_free(struct sr_egress_pkt* pkt)
+{
+    sr_pbuf_put(pkt->pb);
+    free(pkt);
+} /* -- sr_egress_free -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_egress_attach(..)
+ * Scope:  Global
+ *
+ * Give every interface that has none its queues, sized by
+ * sr->egress_limit.  Called from sr_init and again when VNS interfaces
+ * arrive.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_egress_attach(struct sr_instance* sr)
+{
+    struct sr_if* iface;
+    struct sr_egress_if* eg;
+    struct sr_egress_pacer* p;
+    int i;
+
+    if (!sr->egress_pacer)
+    {
+        if ((p = (struct sr_egress_pacer*)calloc(1, sizeof(*p))) == 0)
+        {
+            fprintf(stderr, "Error: out of memory (sr_egress_attach)\n");
+            exit(1);
+        }
+        pthread_mutex_init(&p->lock, 0);
+        p->use_locks = (sr->loop_mode == SR_LOOP_THREADS ||
+                        sr->netdev_conf.queues > 1);
+        if ((p->tfd = timerfd_create(CLOCK_MONOTONIC,
+                                     TFD_NONBLOCK | TFD_CLOEXEC)) < 0)
+        {
+            perror("timerfd_create(..):sr_egress.c::sr_egress_attach");
+            exit(1);
+        }
+        sr->egress_pacer = p;
+    }
+
+    for (iface = sr->if_list; iface; iface = iface->next)
+    {
+        if (iface->egress)
+        { continue; }
+        if ((eg = (struct sr_egress_if*)calloc(1, sizeof(*eg))) == 0)
+        {
+            fprintf(stderr, "Error: out of memory (sr_egress_attach)\n");
+            exit(1);
+        }
+        pthread_mutex_init(&eg->lock, 0);
+        eg->use_locks = (sr->loop_mode == SR_LOOP_THREADS ||
+                         sr->netdev_conf.queues > 1);
+        for (i = 0; i < SR_EGRESS_QUEUES; i++)
+        {
+            eg->q[i].limit = sr->egress_limit;
+            eg->q[i].quantum = SR_EGRESS_QUANTUM * (i + 1);
+            if (i != SR_EGRESS_CONTROL)
+            { sr_codel_init(&eg->q[i].codel, SR_CODEL_TARGET, SR_CODEL_INTERVAL); }
+        }
+        sr_egress_shape(eg, sr->egress_rate ? sr->egress_rate : iface->speed,
+                        0, sr_now_ns());
+        iface->egress = eg;
+    }
+} /* -- sr_egress_attach -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_egress_destroy(..)
+ * Scope:  Global
+ *
+ * Drop whatever is still queued and free the queues and the timer.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_egress_destroy(struct sr_instance* sr)
+{
+    struct sr_if* iface;
+    struct sr_egress_pkt* pkt;
+    int i;
+
+    for (iface = sr->if_list; iface; iface = iface->next)
+    {
+        if (!iface->egress)
+        { continue; }
+        for (i = 0; i < SR_EGRESS_QUEUES; i++)
+        {
+            while ((pkt = iface->egress->q[i].head) != 0)
+            {
+                iface->egress->q[i].head = pkt->next;
+                sr_egress_free(pkt);
+            }
+        }
+        pthread_mutex_destroy(&iface->egress->lock);
+        free(iface->egress);
+        iface->egress = 0;
+    }
+    if (sr->egress_pacer)
+    {
+        close(sr->egress_pacer->tfd);
+        pthread_mutex_destroy(&sr->egress_pacer->lock);
+        free(sr->egress_pacer);
+        sr->egress_pacer = 0;
+    }
+} /* -- sr_egress_destroy -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_egress_enqueue(..)
+ * Scope:  Global
+ *
+ * Queue the frame in pb on out, in the control queue or the data class
+ * of its DSCP.  The queue takes over the caller's reference to pb.
+ * Returns 0, or -1 if the queue was full.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_egress_enqueue(struct sr_instance* sr, struct sr_if* out,
+                      struct sr_pbuf* pb, int control)
+{
+    struct sr_egress_if* eg = out->egress;
+    struct sr_egress_queue* q;
+    struct sr_egress_pkt* pkt;
+    unsigned int len = pb->len;
+    int cls = control ? SR_EGRESS_CONTROL : sr_egress_class(pb->data, len);
+
+    pkt = (struct sr_egress_pkt*)malloc(sizeof(*pkt));
+    if (pkt == 0)
+    {
+        sr_pbuf_put(pb);
+        return -1;
+    }
+    pkt->next = 0;
+    pkt->queued = sr_egress_holds > 0 ? sr_egress_held_at : sr_now_ns();
+    pkt->len = len;
+    pkt->pb = pb;
+
+    SR_EGRESS_LOCK(eg);
+    q = &eg->q[cls];
+    if (q->packets >= q->limit)
+    {
+        q->dropped++;
+        q->dropped_bytes += len;
+        SR_EGRESS_UNLOCK(eg);
+        sr_egress_free(pkt);
+        return -1;
+    }
+    if (q->tail)
+    { q->tail->next = pkt; }
+    else
+    { q->head = pkt; }
+    q->tail = pkt;
+    q->packets++;
+    q->bytes += len;
+    q->enqueued++;
+    if (cls != SR_EGRESS_CONTROL)
+    { eg->data++; }
+    SR_EGRESS_UNLOCK(eg);
+
+    return 0;
+} /* -- sr_egress_enqueue -- */
+
+/* -- how long the head of q has waited -- */
+static uint64_t sr_egress_sojourn(const struct sr_egress_queue* q, uint64_t now)
+{
+    return now > q->head->queued ? now - q->head->queued : 0;
+} /* -- sr_egress_sojourn -- */
+
+static struct sr_egress_pkt* sr_egress_unlink(struct sr_egress_queue* q)
+{
+    struct sr_egress_pkt* pkt = q->head;
+
+    if ((q->head = pkt->next) == 0)
+    { q->tail = 0; }
+    q->packets--;
+    q->bytes -= pkt->len;
+    return pkt;
+} /* -- sr_egress_unlink -- */
+
+static struct sr_egress_pkt* sr_egress_pop(struct sr_egress_if* eg,
+                                           struct sr_egress_queue* q,
+                                           uint64_t now)
+{
+    struct sr_egress_pkt* pkt;
+
+    sr_sojourn_add(&q->sojourn, sr_egress_sojourn(q, now));
+    pkt = sr_egress_unlink(q);
+    q->sent++;
+    q->sent_bytes += pkt->len;
+    if (eg->throttled)
+    {
+        eg->shaped++;
+        eg->shaped_bytes += pkt->len;
+    }
+    return pkt;
+} /* -- sr_egress_pop -- */
+
+/* -- add the tokens earned since stamp, keeping the fraction of a byte -- */
+static void sr_egress_refill(struct sr_egress_if* eg, uint64_t now)
+{
+    uint64_t add;
+
+    if (!eg->rate || now <= eg->stamp)
+    { return; }
+    if (now - eg->stamp >= SR_EGRESS_NS)
+    {
+        eg->tokens = eg->burst;
+        eg->stamp = now;
+        return;
+    }
+    if ((add = (now - eg->stamp) * eg->rate / SR_EGRESS_NS) == 0)
+    { return; }
+    eg->stamp += add * SR_EGRESS_NS / eg->rate;
+    eg->tokens += add;
+    if (eg->tokens > (int64_t)eg->burst)
+    { eg->tokens = eg->burst; }
+} /* -- sr_egress_refill -- */
+
+/* -- take len bytes of tokens, or note when there will be enough -- */
+static int sr_egress_conform(struct sr_egress_if* eg, unsigned int len)
+{
+    if (!eg->rate)
+    { return 1; }
+    if (eg->tokens >= (int64_t)len)
+    {
+        eg->tokens -= len;
+        return 1;
+    }
+    eg->wake = eg->stamp +
+        ((len - eg->tokens) * SR_EGRESS_NS + eg->rate - 1) / eg->rate;
+    if (!eg->throttled)
+    {
+        eg->throttled = 1;
+        eg->throttles++;
+    }
+    return 0;
+} /* -- sr_egress_conform -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_egress_schedule(..)
+ * Scope:  Local
+ *
+ * Take up to SR_EGRESS_BATCH frames off eg in the order they should
+ * go: all control frames first, then the data classes in deficit round
+ * robin.  A class's turn can span batches, and CoDel may drop the
+ * head of a class before it is looked at.  A shaped interface stops
+ * at the first frame the bucket cannot cover, setting eg->wake.
+ * Returns the number taken.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_egress_schedule(struct sr_egress_if* eg,
+                              struct sr_egress_pkt** batch, uint64_t now)
+{
+    struct sr_egress_queue* q;
+    struct sr_egress_pkt* pkt;
+    int n = 0;
+
+    sr_egress_refill(eg, now);
+
+    q = &eg->q[SR_EGRESS_CONTROL];
+    while (n < SR_EGRESS_BATCH && q->head)
+    {
+        if (!sr_egress_conform(eg, q->head->len))
+        { return n; }
+        batch[n++] = sr_egress_pop(eg, q, now);
+    }
+
+    while (n < SR_EGRESS_BATCH && eg->data > 0)
+    {
+        q = &eg->q[eg->round];
+        if (!eg->in_turn)
+        {
+            if (!q->head)
+            {
+                eg->round = (eg->round + 1) % SR_EGRESS_CLASSES;
+                continue;
+            }
+            q->deficit += q->quantum;
+            eg->in_turn = 1;
+        }
+        while (q->head && sr_codel_drop(&q->codel, sr_egress_sojourn(q, now),
+                                        q->bytes, now))
+        {
+            pkt = sr_egress_unlink(q);
+            q->codel_dropped++;
+            q->codel_dropped_bytes += pkt->len;
+            eg->data--;
+            sr_egress_free(pkt);
+        }
+        if (q->head && (int32_t)q->head->len <= q->deficit)
+        {
+            if (!sr_egress_conform(eg, q->head->len))
+            { return n; }
+            q->deficit -= q->head->len;
+            batch[n++] = sr_egress_pop(eg, q, now);
+            eg->data--;
+            continue;
+        }
+        /* -- an emptied class keeps no credit for later -- */
+        if (!q->head)
+        { q->deficit = 0; }
+        eg->in_turn = 0;
+        eg->round = (eg->round + 1) % SR_EGRESS_CLASSES;
+    }
+
+    /* -- caught up, nothing is held back by the shaper any more -- */
+    if (eg->data == 0 && !eg->q[SR_EGRESS_CONTROL].head)
+    { eg->throttled = 0; }
+    return n;
+} /* -- sr_egress_schedule -- */
+
+/* -- have the pacing timer go off at when, unless it will sooner -- */
+static void sr_egress_arm(struct sr_instance* sr, uint64_t when)
+{
+    struct sr_egress_pacer* p = sr->egress_pacer;
+    struct itimerspec its;
+
+    SR_EGRESS_LOCK(p);
+    if (p->deadline == 0 || when < p->deadline)
+    {
+        p->deadline = when;
+        memset(&its, 0, sizeof(its));
+        its.it_value.tv_sec = when / SR_EGRESS_NS;
+        its.it_value.tv_nsec = when % SR_EGRESS_NS;
+        timerfd_settime(p->tfd, TFD_TIMER_ABSTIME, &its, 0);
+    }
+    SR_EGRESS_UNLOCK(p);
+} /* -- sr_egress_arm -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_egress_drain(..)
+ * Scope:  Global
+ *
+ * Send everything queued on out, a batch at a time, or as much as its
+ * shaper lets through, arming the timer for the rest.  If another
+ * thread is already draining out it sends our frames too.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_egress_drain(struct sr_instance* sr, struct sr_if* out)
+{
+    struct sr_egress_if* eg = out->egress;
+    struct sr_egress_pkt* batch[SR_EGRESS_BATCH];
+    const uint8_t* bufs[SR_EGRESS_BATCH];
+    unsigned int lens[SR_EGRESS_BATCH];
+    uint64_t wake;
+    int n, i;
+
+    SR_EGRESS_LOCK(eg);
+    if (eg->draining)
+    {
+        SR_EGRESS_UNLOCK(eg);
+        return;
+    }
+    eg->draining = 1;
+    eg->wake = 0;
+    while ((n = sr_egress_schedule(eg, batch, sr_now_ns())) > 0)
+    {
+        SR_EGRESS_UNLOCK(eg);
+        for (i = 0; i < n; i++)
+        {
+            bufs[i] = batch[i]->pb->data;
+            lens[i] = batch[i]->len;
+        }
+        sr_transmit(sr, bufs, lens, n, out->name);
+        for (i = 0; i < n; i++)
+        { sr_egress_free(batch[i]); }
+        SR_EGRESS_LOCK(eg);
+    }
+    eg->draining = 0;
+    wake = eg->wake;
+    SR_EGRESS_UNLOCK(eg);
+
+    if (wake)
+    { sr_egress_arm(sr, wake); }
+} /* -- sr_egress_drain -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_egress_timer(..)
+ * Scope:  Global
+ *
+ * The pacing timer went off: send what the shapers now let through.
+ * Called by the event loop when sr_egress_timer_fd is readable.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_egress_timer(struct sr_instance* sr)
+{
+    struct sr_egress_pacer* p = sr->egress_pacer;
+    struct sr_if* iface;
+    uint64_t expirations, wake, now;
+
+    if (read(p->tfd, &expirations, sizeof(expirations)) < 0)
+    { /* -- another thread took it -- */ }
+
+    SR_EGRESS_LOCK(p);
+    p->deadline = 0;
+    SR_EGRESS_UNLOCK(p);
+
+    now = sr_now_ns();
+    for (iface = sr->if_list; iface; iface = iface->next)
+    {
+        if (!iface->egress)
+        { continue; }
+        SR_EGRESS_LOCK(iface->egress);
+        wake = iface->egress->wake;
+        SR_EGRESS_UNLOCK(iface->egress);
+        if (!wake)
+        { continue; }
+        if (wake <= now)
+        { sr_egress_drain(sr, iface); }
+        else
+        { sr_egress_arm(sr, wake); }
+    }
+} /* -- sr_egress_timer -- */
+
+/* -- the pacing timer for event loops to watch, -1 without -Q -- */
+int sr_egress_timer_fd(struct sr_instance* sr)
+{
+    return sr->egress_pacer ? sr->egress_pacer->tfd : -1;
+} /* -- sr_egress_timer_fd -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_egress_pacer_thread(..)
+ * Scope:  Global
+ *
+ * Threaded mode has no event loop to watch the pacing timer, so this
+ * thread does.
+ *
+ *---------------------------------------------------------------------*/
+
+void* sr_egress_pacer_thread(void* arg)
+{
+    struct sr_instance* sr = (struct sr_instance*)arg;
+    struct pollfd pfd;
+
+    pfd.fd = sr_egress_timer_fd(sr);
+    pfd.events = POLLIN;
+    while (1)
+    {
+        if (poll(&pfd, 1, -1) > 0)
+        { sr_egress_timer(sr); }
+    }
+    return NULL;
+} /* -- sr_egress_pacer_thread -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_egress_hold(..) / sr_egress_release(..)
+ * Scope:  Global
+ *
+ * Bracket the handling of a receive burst: frames sent in between are
+ * only queued, and the outermost release drains every interface.
+ * They count as queued when the burst began, so their sojourn includes
+ * the time the burst took.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_egress_hold(void)
+{
+    if (sr_egress_holds++ == 0)
+    { sr_egress_held_at = sr_now_ns(); }
+} /* -- sr_egress_hold -- */
+
+void sr_egress_release(struct sr_instance* sr)
+{
+    struct sr_if* iface;
+
+    if (--sr_egress_holds > 0)
+    { return; }
+    for (iface = sr->if_list; iface; iface = iface->next)
+    {
+        if (iface->egress)
+        { sr_egress_drain(sr, iface); }
+    }
+} /* -- sr_egress_release -- */
+
+int sr_egress_held(void)
+{
+    return sr_egress_holds > 0;
+} /* -- sr_egress_held -- */
+
+/* -- DRR quantum of data class cls on every interface -- */
+void sr_egress_set_quantum(struct sr_instance* sr, int cls, uint32_t quantum)
+{
+    struct sr_if* iface;
+
+    assert(cls >= 0 && cls < SR_EGRESS_CLASSES);
+    for (iface = sr->if_list; iface; iface = iface->next)
+    {
+        if (!iface->egress)
+        { continue; }
+        SR_EGRESS_LOCK(iface->egress);
+        iface->egress->q[cls].quantum = quantum;
+        SR_EGRESS_UNLOCK(iface->egress);
+    }
+} /* -- sr_egress_set_quantum -- */
+
+/* -- packets each queue of every interface holds -- */
+void sr_egress_set_limit(struct sr_instance* sr, unsigned int limit)
+{
+    struct sr_if* iface;
+    int i;
+
+    sr->egress_limit = limit;
+    for (iface = sr->if_list; iface; iface = iface->next)
+    {
+        if (!iface->egress)
+        { continue; }
+        SR_EGRESS_LOCK(iface->egress);
+        for (i = 0; i < SR_EGRESS_QUEUES; i++)
+        { iface->egress->q[i].limit = limit; }
+        SR_EGRESS_UNLOCK(iface->egress);
+    }
+} /* -- sr_egress_set_limit -- */
+
+/* -- CoDel target and interval of the data classes of every interface,
+ *    target 0 to turn it off -- */
+void sr_egress_set_codel(struct sr_instance* sr, uint32_t target_us,
+                         uint32_t interval_us)
+{
+    struct sr_if* iface;
+    int i;
+
+    for (iface = sr->if_list; iface; iface = iface->next)
+    {
+        if (!iface->egress)
+        { continue; }
+        SR_EGRESS_LOCK(iface->egress);
+        for (i = 0; i < SR_EGRESS_CLASSES; i++)
+        { sr_codel_init(&iface->egress->q[i].codel, target_us, interval_us); }
+        SR_EGRESS_UNLOCK(iface->egress);
+    }
+} /* -- sr_egress_set_codel -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_egress_set_rate(..)
+ * Scope:  Global
+ *
+ * Shape iface, or every interface if NULL, to mbit Mbit/s with a burst
+ * bytes deep bucket (0 for the default); mbit 0 turns shaping off.
+ * Frames the old rate was holding back are sent as the new one allows.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_egress_set_rate(struct sr_instance* sr, struct sr_if* iface,
+                        uint32_t mbit, uint32_t burst)
+{
+    struct sr_if* walker;
+    uint64_t now = sr_now_ns();
+
+    for (walker = sr->if_list; walker; walker = walker->next)
+    {
+        if (!walker->egress || (iface && walker != iface))
+        { continue; }
+        SR_EGRESS_LOCK(walker->egress);
+        sr_egress_shape(walker->egress, mbit, burst, now);
+        SR_EGRESS_UNLOCK(walker->egress);
+        sr_egress_drain(sr, walker);
+    }
+} /* -- sr_egress_set_rate -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_egress_print(..)
+ * Scope:  Global
+ *
+ * Queue counters of every interface for the control socket.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_egress_print(struct sr_instance* sr, FILE* out)
+{
+    struct sr_if* iface;
+    struct sr_egress_queue* q;
+    int i;
+
+    for (iface = sr->if_list; iface; iface = iface->next)
+    {
+        if (!iface->egress)
+        { continue; }
+        SR_EGRESS_LOCK(iface->egress);
+        if (iface->egress->rate)
+        {
+            fprintf(out, "%s rate %llu Mbit/s burst %u tokens %lld throttled %llu "
+                    "shaped %llu (%llu bytes)\n", iface->name,
+                    (unsigned long long)(iface->egress->rate / 125000),
+                    iface->egress->burst, (long long)iface->egress->tokens,
+                    (unsigned long long)iface->egress->throttles,
+                    (unsigned long long)iface->egress->shaped,
+                    (unsigned long long)iface->egress->shaped_bytes);
+        }
+        else
+        { fprintf(out, "%s not shaped\n", iface->name); }
+        for (i = SR_EGRESS_QUEUES - 1; i >= 0; i--)
+        {
+            q = &iface->egress->q[i];
+            if (i == SR_EGRESS_CONTROL)
+            { fprintf(out, "%s control", iface->name); }
+            else
+            { fprintf(out, "%s class%d quantum %u", iface->name, i, q->quantum); }
+            fprintf(out, " queued %u/%u enqueued %llu sent %llu (%llu bytes) "
+                    "dropped %llu (%llu bytes)",
+                    q->packets, q->limit, (unsigned long long)q->enqueued,
+                    (unsigned long long)q->sent, (unsigned long long)q->sent_bytes,
+                    (unsigned long long)q->dropped,
+                    (unsigned long long)q->dropped_bytes);
+            if (i != SR_EGRESS_CONTROL)
+            {
+                if (q->codel.target)
+                {
+                    fprintf(out, " codel %llu (%llu bytes)",
+                            (unsigned long long)q->codel_dropped,
+                            (unsigned long long)q->codel_dropped_bytes);
+                }
+                else
+                { fprintf(out, " codel off"); }
+            }
+            fprintf(out, " ");
+            sr_sojourn_print(&q->sojourn, out);
+            fprintf(out, "\n");
+        }
+        SR_EGRESS_UNLOCK(iface->egress);
+    }
+} /* -- sr_egress_print -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_egress_print_sojourn(..)
+ * Scope:  Global
+ *
+ * The sojourn histogram of every queue that has sent anything, and the
+ * CoDel settings, for the control socket.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_egress_print_sojourn(struct sr_instance* sr, FILE* out)
+{
+    struct sr_if* iface;
+    struct sr_egress_queue* q;
+    char prefix[sr_IFACE_NAMELEN + 16];
+    int i;
+
+    for (iface = sr->if_list; iface; iface = iface->next)
+    {
+        if (!iface->egress)
+        { continue; }
+        SR_EGRESS_LOCK(iface->egress);
+        q = &iface->egress->q[0];
+        fprintf(out, "%s codel target %llu us interval %llu us\n", iface->name,
+                (unsigned long long)(q->codel.target / 1000),
+                (unsigned long long)(q->codel.interval / 1000));
+        for (i = SR_EGRESS_QUEUES - 1; i >= 0; i--)
+        {
+            q = &iface->egress->q[i];
+            if (i == SR_EGRESS_CONTROL)
+            { snprintf(prefix, sizeof(prefix), "%s control", iface->name); }
+            else
+            { snprintf(prefix, sizeof(prefix), "%s class%d", iface->name, i); }
+            sr_sojourn_print_buckets(&q->sojourn, prefix, out);
+        }
+        SR_EGRESS_UNLOCK(iface->egress);
+    }
+} /* -- sr_egress_print_sojourn -- */
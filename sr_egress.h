@@ -0,0 +1,168 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_egress.h
+ *
+ * Description:
+ *
+ * Egress scheduler (-Q).  Each interface gets a strict priority queue for
+ * the router's own control traffic (ARP, and the ICMP and ICMPv6 it
+ * generates, sent with sr_send_control_packet) and SR_EGRESS_CLASSES
+ * data queues served by deficit round robin, chosen by DSCP:
+ *
+ *   class 0  DSCP  0-15   best effort, CS1, AF1x
+ *   class 1  DSCP 16-31   CS2, AF2x, CS3, AF3x
+ *   class 2  DSCP 32-47   CS4, AF4x, CS5, EF
+ *   class 3  DSCP 48-63   CS6, CS7
+ *
+ * A class's quantum, SR_EGRESS_QUANTUM times one more than its number by
+ * default, is its share of the bytes when all classes are backlogged.
+ * A full queue drops what is sent to it (tail drop).
+ *
+ * A queued frame is a reference to the pbuf holding it (sr_pbuf.h), in
+ * the VNS loops the buffer it was received in, rather than a copy.
+ * Frames sent while a receive burst is handled wait for the end of the
+ * burst; everything queued is then scheduled together and handed to
+ * the transport SR_EGRESS_BATCH frames at a time (netdev send_batch).
+ * Frames sent outside a burst (ARP retries, the control socket) go out
+ * at once.
+ *
+ * An interface with a rate is also shaped by a token bucket: frames
+ * leave only while the bucket holds their length in bytes, so at most
+ * burst bytes go out back to back and the long run average is the rate.
+ * The rate is the link speed (VNS HWSPEED, or a speed line in the -i
+ * file) unless -B sets one for every interface.  When the bucket runs
+ * dry the frames wait in their queues, still in priority and DRR order,
+ * and a timerfd (sr_egress_timer_fd, watched by the event loop or by a
+ * thread of its own in threaded mode) sends them once it has refilled.
+ *
+ * The data classes are managed by CoDel (sr_codel.h): every frame is
+ * stamped when queued, and a class whose frames keep waiting longer than
+ * the target has its head frames dropped when their turn comes, as is
+ * any frame that has waited longer than target + interval.  Every
+ * queue, the control queue included, keeps a histogram of how long its
+ * frames waited.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_EGRESS_H
+#define SR_EGRESS_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#include <stdio.h>
+#include <pthread.h>
+
+#include "sr_codel.h"
+#include "sr_pbuf.h"
+
+#define SR_EGRESS_CLASSES  4
+#define SR_EGRESS_CONTROL  SR_EGRESS_CLASSES     /* queue index */
+#define SR_EGRESS_QUEUES   (SR_EGRESS_CLASSES + 1)
+#define SR_EGRESS_QUANTUM  1514   /* bytes, class 0 */
+#define SR_EGRESS_BATCH    32     /* frames per transport call */
+#define SR_EGRESS_DEFAULT_LIMIT 256 /* packets per queue */
+#define SR_EGRESS_BURST_US 2000   /* default bucket depth, as time at the rate */
+#define SR_EGRESS_BURST_MIN (2 * SR_EGRESS_QUANTUM) /* bytes */
+
+struct sr_instance;
+struct sr_if;
+
+/* -- a queued frame -- */
+struct sr_egress_pkt
+{
+    struct sr_egress_pkt* next;
+    uint64_t queued;        /* ns, sr_now_ns when queued */
+    unsigned int len;
+    struct sr_pbuf* pb;     /* a reference, the frame is pb->data */
+};
+
+struct sr_egress_queue
+{
+    struct sr_egress_pkt* head;
+    struct sr_egress_pkt* tail;
+    unsigned int packets;
+    unsigned int bytes;
+    unsigned int limit;     /* packets, tail drop beyond */
+    uint32_t quantum;       /* DRR bytes per round, data classes */
+    int32_t deficit;
+    uint64_t enqueued;
+    uint64_t dropped;
+    uint64_t dropped_bytes;
+    uint64_t sent;
+    uint64_t sent_bytes;
+    struct sr_codel codel;  /* data classes */
+    uint64_t codel_dropped;
+    uint64_t codel_dropped_bytes;
+    struct sr_sojourn sojourn;
+};
+
+/* ----------------------------------------------------------------------------
+ * struct sr_egress_if
+ *
+ * Queues of one interface.  Any thread may queue; one at a time drains
+ * (draining), the others leave their frames to it.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_egress_if
+{
+    pthread_mutex_t lock;
+    int use_locks;          /* 0 when one thread does all the sending */
+    int draining;
+    unsigned int data;      /* frames in the data classes */
+    int round;              /* DRR: class whose turn it is */
+    int in_turn;            /* its quantum has been added */
+    struct sr_egress_queue q[SR_EGRESS_QUEUES];
+    uint64_t rate;          /* shaping, bytes per second, 0 for none */
+    uint32_t burst;         /* bucket depth, bytes */
+    int64_t tokens;         /* bytes */
+    uint64_t stamp;         /* ns, up to when tokens were added */
+    uint64_t wake;          /* ns the next frame conforms, 0 if none waits */
+    int throttled;          /* the bucket ran dry with frames queued */
+    uint64_t throttles;     /* times it did */
+    uint64_t shaped;        /* frames sent while throttled */
+    uint64_t shaped_bytes;
+};
+
+/* ----------------------------------------------------------------------------
+ * struct sr_egress_pacer
+ *
+ * The shaping timer of a router, armed for the earliest wake of its
+ * interfaces.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_egress_pacer
+{
+    pthread_mutex_t lock;
+    int use_locks;
+    int tfd;                /* timerfd, CLOCK_MONOTONIC */
+    uint64_t deadline;      /* ns it is armed for, 0 when not */
+};
+
+void sr_egress_attach(struct sr_instance* sr);
+void sr_egress_destroy(struct sr_instance* sr);
+int  sr_egress_enqueue(struct sr_instance* sr, struct sr_if* out,
+                       struct sr_pbuf* pb, int control);
+void sr_egress_drain(struct sr_instance* sr, struct sr_if* out);
+void sr_egress_hold(void);
+void sr_egress_release(struct sr_instance* sr);
+int  sr_egress_held(void);
+void sr_egress_set_quantum(struct sr_instance* sr, int cls, uint32_t quantum);
+void sr_egress_set_limit(struct sr_instance* sr, unsigned int limit);
+void sr_egress_set_codel(struct sr_instance* sr, uint32_t target_us,
+                         uint32_t interval_us);
+void sr_egress_set_rate(struct sr_instance* sr, struct sr_if* iface,
+                        uint32_t mbit, uint32_t burst);
+int  sr_egress_timer_fd(struct sr_instance* sr);
+void sr_egress_timer(struct sr_instance* sr);
+void* sr_egress_pacer_thread(void* sr);
+void sr_egress_print(struct sr_instance* sr, FILE* out);
+void sr_egress_print_sojourn(struct sr_instance* sr, FILE* out);
+
+#endif /* SR_EGRESS_H */
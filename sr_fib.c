@@ -0,0 +1,452 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_fib.c
+ *
+ * Description:
+ *
+ * Binary trie forwarding table, see sr_fib.h.
+ *
+ * Nodes exist only on paths to prefixes that have routes: removing the
+ * last route of a prefix frees the nodes below its nearest ancestor that
+ * still has a route or another child.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "sr_rt.h"
+#include "sr_fib.h"
+#include "sr_router.h"
+
+/* -- lookups sr_fib_lookup_burst walks side by side, about the misses
+ *    a core keeps in flight -- */
+#define SR_FIB_GROUP 16
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib_prefix_len(..)
+ * Scope:  Global
+ *
+ * Length of the prefix mask (network byte order) describes, or -1 if
+ * its ones are not contiguous.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_fib_prefix_len(uint32_t mask)
+{
+    uint32_t inv = ~ntohl(mask);
+    int len = 32;
+
+    if ((inv & (inv + 1)) != 0)
+    { return -1; }
+    for (; inv; inv >>= 1)
+    { len--; }
+    return len;
+} /* -- sr_fib_prefix_len -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib_lookup(..)
+ * Scope:  Global
+ *
+ * Leader of the longest prefix covering dst (network byte order), or
+ * NULL if no route does.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_rt* sr_fib_lookup(const struct sr_fib* fib, uint32_t dst)
+{
+    const struct sr_fib_node* node = fib->root;
+    struct sr_rt* best = 0;
+    uint32_t bits = ntohl(dst);
+    int depth;
+
+    for (depth = 0; node; depth++)
+    {
+        if (node->route)
+        { best = node->route; }
+        if (depth == 32)
+        { break; }
+        node = node->child[bits >> 31];
+        bits <<= 1;
+    }
+    return best;
+} /* -- sr_fib_lookup -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib_lookup_burst(..)
+ * Scope:  Global
+ *
+ * sr_fib_lookup of dst[0..n-1] into best[0..n-1].  The walks go down
+ * the trie together, SR_FIB_GROUP at a time, one level per round: each
+ * round prefetches the next node of every walk before the next round
+ * reads any of them, so their cache misses overlap instead of each
+ * walk waiting on its own.  The routes found are prefetched too.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_fib_lookup_burst(const struct sr_fib* fib, const uint32_t* dst,
+                         struct sr_rt** best, unsigned int n)
+{
+    const struct sr_fib_node* node[SR_FIB_GROUP];
+    uint32_t bits[SR_FIB_GROUP];
+    unsigned int base, g, i, active;
+    int depth;
+
+    for (base = 0; base < n; base += g)
+    {
+        g = n - base < SR_FIB_GROUP ? n - base : SR_FIB_GROUP;
+        for (i = 0; i < g; i++)
+        {
+            node[i] = fib->root;
+            bits[i] = ntohl(dst[base + i]);
+            best[base + i] = 0;
+        }
+
+        for (depth = 0, active = g; active > 0; depth++)
+        {
+            for (i = 0, active = 0; i < g; i++)
+            {
+                if (node[i] == 0)
+                { continue; }
+                if (node[i]->route)
+                { best[base + i] = node[i]->route; }
+                node[i] = depth == 32 ? 0 : node[i]->child[bits[i] >> 31];
+                bits[i] <<= 1;
+                if (node[i])
+                {
+                    SR_PREFETCH(node[i]);
+                    active++;
+                }
+            }
+        }
+
+        for (i = 0; i < g; i++)
+        {
+            if (best[base + i])
+            { SR_PREFETCH(best[base + i]); }
+        }
+    }
+} /* -- sr_fib_lookup_burst -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib_walk(..)
+ * Scope:  Local
+ *
+ * Fill path[0..len] with the nodes from the root towards the prefix
+ * dest/len.  Returns the depth reached, len if the prefix's node exists.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_fib_walk(const struct sr_fib* fib, uint32_t dest, int len,
+                       struct sr_fib_node** path)
+{
+    uint32_t bits = ntohl(dest);
+    int depth;
+
+    path[0] = fib->root;
+    for (depth = 0; depth < len; depth++)
+    {
+        if ((path[depth + 1] = path[depth]->child[bits >> 31]) == 0)
+        { break; }
+        bits <<= 1;
+    }
+    return depth;
+} /* -- sr_fib_walk -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib_prune(..)
+ * Scope:  Local
+ *
+ * Free the nodes at the bottom of path[0..depth] that no longer lead to
+ * a route.  The root is kept.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_fib_prune(struct sr_fib* fib, uint32_t dest,
+                         struct sr_fib_node** path, int depth)
+{
+    uint32_t bits = ntohl(dest);
+
+    for (; depth > 0; depth--)
+    {
+        struct sr_fib_node* node = path[depth];
+
+        if (node->route || node->child[0] || node->child[1])
+        { break; }
+        path[depth - 1]->child[(bits >> (32 - depth)) & 1] = 0;
+        free(node);
+        fib->nodes--;
+    }
+} /* -- sr_fib_prune -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib_find(..)
+ * Scope:  Global
+ *
+ * Leader of the routes for exactly dest/mask, or NULL.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_rt* sr_fib_find(const struct sr_fib* fib, uint32_t dest, uint32_t mask)
+{
+    struct sr_fib_node* path[33];
+    int len = sr_fib_prefix_len(mask);
+
+    if (len < 0 || sr_fib_walk(fib, dest, len, path) != len)
+    { return 0; }
+    return path[len]->route;
+} /* -- sr_fib_find -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib_insert(..)
+ * Scope:  Global
+ *
+ * Add rt (allocated by the caller, owned by the FIB on success) to the
+ * end of the list and of its prefix's multipath group.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_fib_insert(struct sr_fib* fib, struct sr_rt* rt)
+{
+    struct sr_fib_node* path[33];
+    struct sr_fib_node* node;
+    struct sr_rt* member;
+    uint32_t bits;
+    int len, depth;
+
+    /* -- REQUIRES -- */
+    assert(fib);
+    assert(rt);
+
+    len = sr_fib_prefix_len(rt->mask.s_addr);
+    if (len < 0 || (rt->dest.s_addr & ~rt->mask.s_addr) != 0)
+    { return SR_FIB_BADPREFIX; }
+
+    depth = sr_fib_walk(fib, rt->dest.s_addr, len, path);
+    if (depth == len)
+    {
+        for (member = path[len]->route; member; member = member->ecmp_next)
+        {
+            if (member->gw.s_addr == rt->gw.s_addr &&
+                strncmp(member->interface, rt->interface, sr_IFACE_NAMELEN) == 0)
+            { return SR_FIB_EXISTS; }
+        }
+    }
+
+    /* -- extend the path down to the prefix -- */
+    bits = ntohl(rt->dest.s_addr) << depth;
+    for (; depth < len; depth++)
+    {
+        if ((node = (struct sr_fib_node*)calloc(1, sizeof(*node))) == 0)
+        {
+            sr_fib_prune(fib, rt->dest.s_addr, path, depth);
+            return SR_FIB_NOMEM;
+        }
+        path[depth]->child[bits >> 31] = node;
+        path[depth + 1] = node;
+        fib->nodes++;
+        bits <<= 1;
+    }
+    node = path[len];
+
+    rt->ecmp_next = 0;
+    rt->ecmp_weight = 0;
+    if (node->route == 0)
+    {
+        node->route = rt;
+        rt->ecmp_weight = rt->weight;
+        fib->prefixes++;
+    }
+    else
+    {
+        for (member = node->route; member->ecmp_next; member = member->ecmp_next)
+        { }
+        member->ecmp_next = rt;
+        node->route->ecmp_weight += rt->weight;
+    }
+
+    rt->next = 0;
+    rt->prev = fib->tail;
+    if (fib->tail)
+    { fib->tail->next = rt; }
+    else
+    { fib->head = rt; }
+    fib->tail = rt;
+
+    fib->routes++;
+    fib->updates++;
+    return SR_FIB_OK;
+} /* -- sr_fib_insert -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib_remove(..)
+ * Scope:  Global
+ *
+ * Unlink rt, a route in fib, and free it.  The next member of its group
+ * takes over as leader if rt led it.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_fib_remove(struct sr_fib* fib, struct sr_rt* rt)
+{
+    struct sr_fib_node* path[33];
+    struct sr_fib_node* node;
+    struct sr_rt* member;
+    int len;
+
+    /* -- REQUIRES -- */
+    assert(fib);
+    assert(rt);
+
+    len = sr_fib_prefix_len(rt->mask.s_addr);
+    if (len < 0 || sr_fib_walk(fib, rt->dest.s_addr, len, path) != len)
+    {
+        assert(0);
+        return;
+    }
+    node = path[len];
+
+    if (node->route == rt)
+    {
+        node->route = rt->ecmp_next;
+        if (node->route)
+        { node->route->ecmp_weight = rt->ecmp_weight - rt->weight; }
+    }
+    else
+    {
+        for (member = node->route; member && member->ecmp_next != rt;
+             member = member->ecmp_next)
+        { }
+        assert(member);
+        if (member)
+        { member->ecmp_next = rt->ecmp_next; }
+        node->route->ecmp_weight -= rt->weight;
+    }
+
+    if (rt->prev)
+    { rt->prev->next = rt->next; }
+    else
+    { fib->head = rt->next; }
+    if (rt->next)
+    { rt->next->prev = rt->prev; }
+    else
+    { fib->tail = rt->prev; }
+
+    if (node->route == 0)
+    {
+        fib->prefixes--;
+        sr_fib_prune(fib, rt->dest.s_addr, path, len);
+    }
+
+    fib->routes--;
+    fib->updates++;
+    free(rt);
+} /* -- sr_fib_remove -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib_create(..)
+ * Scope:  Global
+ *---------------------------------------------------------------------*/
+
+struct sr_fib* sr_fib_create(void)
+{
+    struct sr_fib* fib;
+
+    if ((fib = (struct sr_fib*)calloc(1, sizeof(*fib))) == 0 ||
+        (fib->root = (struct sr_fib_node*)calloc(1, sizeof(struct sr_fib_node))) == 0)
+    {
+        free(fib);
+        return 0;
+    }
+    fib->nodes = 1;
+    return fib;
+} /* -- sr_fib_create -- */
+
+static void sr_fib_free_nodes(struct sr_fib_node* node)
+{
+    if (!node)
+    { return; }
+    sr_fib_free_nodes(node->child[0]);
+    sr_fib_free_nodes(node->child[1]);
+    free(node);
+} /* -- sr_fib_free_nodes -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib_destroy(..)
+ * Scope:  Global
+ *
+ * Free the trie and every route in it.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_fib_destroy(struct sr_fib* fib)
+{
+    struct sr_rt* rt;
+    struct sr_rt* next;
+
+    if (!fib)
+    { return; }
+    sr_fib_free_nodes(fib->root);
+    for (rt = fib->head; rt; rt = next)
+    {
+        next = rt->next;
+        free(rt);
+    }
+    free(fib);
+} /* -- sr_fib_destroy -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib_copy(..)
+ * Scope:  Global
+ *
+ * A private copy of fib, routes and counters included, in the same
+ * order.  Returns NULL if out of memory.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_fib* sr_fib_copy(const struct sr_fib* fib)
+{
+    struct sr_fib* copy;
+    struct sr_rt* rt;
+    struct sr_rt* dup;
+
+    /* -- REQUIRES -- */
+    assert(fib);
+
+    if ((copy = sr_fib_create()) == 0)
+    { return 0; }
+
+    for (rt = fib->head; rt; rt = rt->next)
+    {
+        if ((dup = (struct sr_rt*)malloc(sizeof(*dup))) == 0)
+        {
+            sr_fib_destroy(copy);
+            return 0;
+        }
+        memcpy(dup, rt, sizeof(*dup));
+        if (sr_fib_insert(copy, dup) != SR_FIB_OK)
+        {
+            free(dup);
+            sr_fib_destroy(copy);
+            return 0;
+        }
+    }
+    copy->updates = fib->updates;
+    return copy;
+} /* -- sr_fib_copy -- */
+
+const char* sr_fib_strerror(int err)
+{
+    switch (err)
+    {
+        case SR_FIB_OK:         return "ok";
+        case SR_FIB_NOMEM:      return "out of memory";
+        case SR_FIB_BADPREFIX:  return "bad prefix (address bits outside the mask?)";
+        case SR_FIB_EXISTS:     return "route exists";
+    }
+    return "unknown error";
+} /* -- sr_fib_strerror -- */
@@ -0,0 +1,69 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_fib.h
+ *
+ * Description:
+ *
+ * Forwarding table: the routes of struct sr_rt indexed by a binary trie
+ * on the destination prefix.  A node at depth d stands for a prefix of
+ * length d; its route is the leader of the multipath group for exactly
+ * that prefix (see sr_rt.h).  Lookup, insert and remove each walk one
+ * path of at most 32 nodes, so an update touches only the prefix it
+ * changes and never rebuilds the table.
+ *
+ * The routes also stay on the doubly linked list sr_instance.routing_table
+ * points at, in the order they were added, for printing and iteration.
+ *
+ * The FIB does no locking; sr_rt.c serializes writers against the
+ * forwarding path with sr_instance.rt_lock.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_FIB_H
+#define SR_FIB_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+struct sr_rt;
+
+/* -- sr_fib_insert results -- */
+#define SR_FIB_OK          0
+#define SR_FIB_NOMEM      -1
+#define SR_FIB_BADPREFIX  -2  /* mask not contiguous or address bits outside it */
+#define SR_FIB_EXISTS     -3  /* same prefix, gateway and interface */
+
+struct sr_fib_node
+{
+    struct sr_fib_node* child[2];
+    struct sr_rt* route;        /* group leader for this prefix, or NULL */
+};
+
+struct sr_fib
+{
+    struct sr_fib_node* root;   /* the /0 prefix */
+    struct sr_rt* head;         /* every route, in the order added */
+    struct sr_rt* tail;
+    unsigned int routes;
+    unsigned int prefixes;      /* nodes with a route */
+    unsigned int nodes;
+    uint64_t updates;           /* inserts and removals */
+};
+
+struct sr_fib* sr_fib_create(void);
+void sr_fib_destroy(struct sr_fib* fib);
+struct sr_fib* sr_fib_copy(const struct sr_fib* fib);
+int  sr_fib_prefix_len(uint32_t mask);
+struct sr_rt* sr_fib_lookup(const struct sr_fib* fib, uint32_t dst);
+void sr_fib_lookup_burst(const struct sr_fib* fib, const uint32_t* dst,
+                         struct sr_rt** best, unsigned int n);
+struct sr_rt* sr_fib_find(const struct sr_fib* fib, uint32_t dest, uint32_t mask);
+int  sr_fib_insert(struct sr_fib* fib, struct sr_rt* rt);
+void sr_fib_remove(struct sr_fib* fib, struct sr_rt* rt);
+const char* sr_fib_strerror(int err);
+
+#endif /* -- SR_FIB_H -- */
@@ -0,0 +1,486 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_fib6.c
+ *
+ * Description:
+ *
+ * Tree bitmap IPv6 forwarding table, see sr_fib6.h.
+ *
+ * A prefix of length len lives in the node at depth len / STRIDE, as
+ * internal bit (1 << r) - 1 + v where r = len % STRIDE and v is the
+ * prefix's last r bits: bit 0 is the node's own prefix, bits 1-2 the
+ * prefixes one bit longer and so on, so a longer prefix always has a
+ * higher bit.  As in sr_fib.c, nodes exist only on paths to routes.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "sr_fib.h"
+#include "sr_fib6.h"
+
+#define SR_FIB6_CHUNKS (1 << SR_FIB6_STRIDE)
+#define SR_FIB6_DEPTH  (128 / SR_FIB6_STRIDE + 1)   /* nodes on a path */
+#define SR_FIB6_BELOW(b) ((((uint64_t)1) << (b)) - 1)
+
+#ifdef __GNUC__
+#define SR_FIB6_POPCOUNT(x) __builtin_popcountll(x)
+#define SR_FIB6_TOPBIT(x)   (63 - __builtin_clzll(x))
+#else
+static int SR_FIB6_POPCOUNT(uint64_t x)
+{
+    int n = 0;
+
+    for (; x; x &= x - 1)
+    { n++; }
+    return n;
+}
+static int SR_FIB6_TOPBIT(uint64_t x)
+{
+    int b = -1;
+
+    for (; x; x >>= 1)
+    { b++; }
+    return b;
+}
+#endif
+
+/* -- internal bits of the prefixes a chunk value falls under -- */
+static uint64_t sr_fib6_match[SR_FIB6_CHUNKS];
+
+static void sr_fib6_load(const uint8_t* addr, uint64_t* hi, uint64_t* lo)
+{
+    int i;
+
+    *hi = 0;
+    *lo = 0;
+    for (i = 0; i < 8; i++)
+    {
+        *hi = (*hi << 8) | addr[i];
+        *lo = (*lo << 8) | addr[8 + i];
+    }
+} /* -- sr_fib6_load -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib6_chunk(..)
+ * Scope:  Local
+ *
+ * Bits o to o + STRIDE - 1 of the address hi:lo, zero past bit 127.
+ *
+ *---------------------------------------------------------------------*/
+
+static unsigned int sr_fib6_chunk(uint64_t hi, uint64_t lo, int o)
+{
+    uint64_t v;
+
+    if (o + SR_FIB6_STRIDE <= 64)
+    { v = hi >> (64 - o - SR_FIB6_STRIDE); }
+    else if (o >= 64 && o + SR_FIB6_STRIDE <= 128)
+    { v = lo >> (128 - o - SR_FIB6_STRIDE); }
+    else if (o >= 64)
+    { v = lo << (o + SR_FIB6_STRIDE - 128); }
+    else
+    { v = (hi << (o + SR_FIB6_STRIDE - 64)) | (lo >> (128 - o - SR_FIB6_STRIDE)); }
+    return (unsigned int)(v & (SR_FIB6_CHUNKS - 1));
+} /* -- sr_fib6_chunk -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib6_lookup(..)
+ * Scope:  Global
+ *
+ * Route of the longest prefix covering dst, or NULL if none does.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_rt6* sr_fib6_lookup(const struct sr_fib6* fib, const uint8_t* dst)
+{
+    const struct sr_fib6_node* node = &fib->root;
+    struct sr_rt6* best = 0;
+    uint64_t hi, lo, m;
+    unsigned int c;
+    int o;
+
+    sr_fib6_load(dst, &hi, &lo);
+    for (o = 0; ; o += SR_FIB6_STRIDE)
+    {
+        c = sr_fib6_chunk(hi, lo, o);
+        if ((m = node->internal & sr_fib6_match[c]) != 0)
+        {
+            best = node->routes[SR_FIB6_POPCOUNT(node->internal &
+                                                 SR_FIB6_BELOW(SR_FIB6_TOPBIT(m)))];
+        }
+        if (((node->external >> c) & 1) == 0)
+        { break; }
+        node = &node->children[SR_FIB6_POPCOUNT(node->external & SR_FIB6_BELOW(c))];
+    }
+    return best;
+} /* -- sr_fib6_lookup -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib6_walk(..)
+ * Scope:  Local
+ *
+ * Fill path[] with the nodes from the root towards the node holding
+ * prefix dest/len and chunks[] with the chunk taken below each.  Returns
+ * the depth reached, len / STRIDE if the prefix's node exists.  *bit
+ * gets the prefix's internal bit.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_fib6_walk(const struct sr_fib6* fib, const uint8_t* dest, int len,
+                        struct sr_fib6_node** path, unsigned int* chunks,
+                        int* bit)
+{
+    uint64_t hi, lo;
+    int depth, r;
+
+    sr_fib6_load(dest, &hi, &lo);
+    path[0] = (struct sr_fib6_node*)&fib->root;
+    for (depth = 0; len - depth * SR_FIB6_STRIDE >= SR_FIB6_STRIDE; depth++)
+    {
+        struct sr_fib6_node* node = path[depth];
+
+        chunks[depth] = sr_fib6_chunk(hi, lo, depth * SR_FIB6_STRIDE);
+        if (((node->external >> chunks[depth]) & 1) == 0)
+        { break; }
+        path[depth + 1] = &node->children[SR_FIB6_POPCOUNT(node->external &
+                                          SR_FIB6_BELOW(chunks[depth]))];
+    }
+
+    r = len % SR_FIB6_STRIDE;
+    *bit = (1 << r) - 1 +
+           (r ? sr_fib6_chunk(hi, lo, len - r) >> (SR_FIB6_STRIDE - r) : 0);
+    return depth;
+} /* -- sr_fib6_walk -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib6_prune(..)
+ * Scope:  Local
+ *
+ * Free the nodes at the bottom of path[0..depth] that hold nothing.
+ * The root is kept.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_fib6_prune(struct sr_fib6* fib, struct sr_fib6_node** path,
+                          const unsigned int* chunks, int depth)
+{
+    struct sr_fib6_node* parent;
+    struct sr_fib6_node* kids;
+    int pos, n;
+
+    for (; depth > 0; depth--)
+    {
+        if (path[depth]->internal || path[depth]->external)
+        { break; }
+
+        parent = path[depth - 1];
+        n = SR_FIB6_POPCOUNT(parent->external);
+        pos = SR_FIB6_POPCOUNT(parent->external & SR_FIB6_BELOW(chunks[depth - 1]));
+        memmove(&parent->children[pos], &parent->children[pos + 1],
+                (n - pos - 1) * sizeof(struct sr_fib6_node));
+        parent->external &= ~((uint64_t)1 << chunks[depth - 1]);
+        if (n == 1)
+        {
+            free(parent->children);
+            parent->children = 0;
+        }
+        else if ((kids = (struct sr_fib6_node*)
+                  realloc(parent->children, (n - 1) * sizeof(*kids))) != 0)
+        { parent->children = kids; }
+        fib->nodes--;
+    }
+} /* -- sr_fib6_prune -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib6_find(..)
+ * Scope:  Global
+ *
+ * Route for exactly dest/len, or NULL.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_rt6* sr_fib6_find(const struct sr_fib6* fib, const uint8_t* dest,
+                            int len)
+{
+    struct sr_fib6_node* path[SR_FIB6_DEPTH];
+    unsigned int chunks[SR_FIB6_DEPTH];
+    const struct sr_fib6_node* node;
+    int bit = 0;
+
+    if (len < 0 || len > 128 ||
+        sr_fib6_walk(fib, dest, len, path, chunks, &bit) != len / SR_FIB6_STRIDE)
+    { return 0; }
+    node = path[len / SR_FIB6_STRIDE];
+    if (((node->internal >> bit) & 1) == 0)
+    { return 0; }
+    return node->routes[SR_FIB6_POPCOUNT(node->internal & SR_FIB6_BELOW(bit))];
+} /* -- sr_fib6_find -- */
+
+static int sr_fib6_masked(const uint8_t* dest, int len)
+{
+    int i;
+
+    for (i = len; i < 128; i++)
+    {
+        if (dest[i / 8] & (0x80 >> (i % 8)))
+        { return 0; }
+    }
+    return 1;
+} /* -- sr_fib6_masked -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib6_insert(..)
+ * Scope:  Global
+ *
+ * Add rt (allocated by the caller, owned by the FIB on success) to the
+ * end of the list.  Returns an SR_FIB_* code (sr_fib.h).
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_fib6_insert(struct sr_fib6* fib, struct sr_rt6* rt)
+{
+    struct sr_fib6_node* path[SR_FIB6_DEPTH];
+    unsigned int chunks[SR_FIB6_DEPTH];
+    struct sr_fib6_node* node;
+    struct sr_fib6_node* kids;
+    struct sr_rt6** routes;
+    uint64_t hi, lo;
+    int depth, last, bit = 0, pos, n;
+
+    /* -- REQUIRES -- */
+    assert(fib);
+    assert(rt);
+
+    if (rt->len < 0 || rt->len > 128 || !sr_fib6_masked(rt->dest, rt->len))
+    { return SR_FIB_BADPREFIX; }
+
+    last = rt->len / SR_FIB6_STRIDE;
+    depth = sr_fib6_walk(fib, rt->dest, rt->len, path, chunks, &bit);
+
+    /* -- extend the path down to the prefix's node -- */
+    sr_fib6_load(rt->dest, &hi, &lo);
+    for (; depth < last; depth++)
+    {
+        node = path[depth];
+        chunks[depth] = sr_fib6_chunk(hi, lo, depth * SR_FIB6_STRIDE);
+        n = SR_FIB6_POPCOUNT(node->external);
+        pos = SR_FIB6_POPCOUNT(node->external & SR_FIB6_BELOW(chunks[depth]));
+        if ((kids = (struct sr_fib6_node*)
+             realloc(node->children, (n + 1) * sizeof(*kids))) == 0)
+        {
+            sr_fib6_prune(fib, path, chunks, depth);
+            return SR_FIB_NOMEM;
+        }
+        memmove(&kids[pos + 1], &kids[pos], (n - pos) * sizeof(*kids));
+        memset(&kids[pos], 0, sizeof(*kids));
+        node->children = kids;
+        node->external |= (uint64_t)1 << chunks[depth];
+        path[depth + 1] = &kids[pos];
+        fib->nodes++;
+    }
+    node = path[last];
+
+    if ((node->internal >> bit) & 1)
+    { return SR_FIB_EXISTS; }
+    n = SR_FIB6_POPCOUNT(node->internal);
+    pos = SR_FIB6_POPCOUNT(node->internal & SR_FIB6_BELOW(bit));
+    if ((routes = (struct sr_rt6**)realloc(node->routes, (n + 1) * sizeof(*routes))) == 0)
+    {
+        sr_fib6_prune(fib, path, chunks, last);
+        return SR_FIB_NOMEM;
+    }
+    memmove(&routes[pos + 1], &routes[pos], (n - pos) * sizeof(*routes));
+    routes[pos] = rt;
+    node->routes = routes;
+    node->internal |= (uint64_t)1 << bit;
+
+    rt->next = 0;
+    rt->prev = fib->tail;
+    if (fib->tail)
+    { fib->tail->next = rt; }
+    else
+    { fib->head = rt; }
+    fib->tail = rt;
+
+    fib->routes++;
+    fib->updates++;
+    return SR_FIB_OK;
+} /* -- sr_fib6_insert -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib6_remove(..)
+ * Scope:  Global
+ *
+ * Unlink rt, a route in fib, and free it.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_fib6_remove(struct sr_fib6* fib, struct sr_rt6* rt)
+{
+    struct sr_fib6_node* path[SR_FIB6_DEPTH];
+    unsigned int chunks[SR_FIB6_DEPTH];
+    struct sr_fib6_node* node;
+    struct sr_rt6** routes;
+    int last, bit = 0, pos, n;
+
+    /* -- REQUIRES -- */
+    assert(fib);
+    assert(rt);
+
+    last = rt->len / SR_FIB6_STRIDE;
+    if (sr_fib6_walk(fib, rt->dest, rt->len, path, chunks, &bit) != last ||
+        ((path[last]->internal >> bit) & 1) == 0)
+    {
+        assert(0);
+        return;
+    }
+    node = path[last];
+
+    n = SR_FIB6_POPCOUNT(node->internal);
+    pos = SR_FIB6_POPCOUNT(node->internal & SR_FIB6_BELOW(bit));
+    assert(node->routes[pos] == rt);
+    memmove(&node->routes[pos], &node->routes[pos + 1],
+            (n - pos - 1) * sizeof(*routes));
+    node->internal &= ~((uint64_t)1 << bit);
+    if (n == 1)
+    {
+        free(node->routes);
+        node->routes = 0;
+    }
+    else if ((routes = (struct sr_rt6**)
+              realloc(node->routes, (n - 1) * sizeof(*routes))) != 0)
+    { node->routes = routes; }
+    sr_fib6_prune(fib, path, chunks, last);
+
+    if (rt->prev)
+    { rt->prev->next = rt->next; }
+    else
+    { fib->head = rt->next; }
+    if (rt->next)
+    { rt->next->prev = rt->prev; }
+    else
+    { fib->tail = rt->prev; }
+
+    fib->routes--;
+    fib->updates++;
+    free(rt);
+} /* -- sr_fib6_remove -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib6_create(..)
+ * Scope:  Global
+ *---------------------------------------------------------------------*/
+
+struct sr_fib6* sr_fib6_create(void)
+{
+    struct sr_fib6* fib;
+    unsigned int c;
+    int r;
+
+    /* -- the same values every time, so racing instances do no harm -- */
+    for (c = 0; c < SR_FIB6_CHUNKS; c++)
+    {
+        uint64_t m = 0;
+
+        for (r = 0; r < SR_FIB6_STRIDE; r++)
+        { m |= (uint64_t)1 << ((1 << r) - 1 + (c >> (SR_FIB6_STRIDE - r))); }
+        sr_fib6_match[c] = m;
+    }
+
+    if ((fib = (struct sr_fib6*)calloc(1, sizeof(*fib))) == 0)
+    { return 0; }
+    fib->nodes = 1;
+    return fib;
+} /* -- sr_fib6_create -- */
+
+static void sr_fib6_free_node(struct sr_fib6_node* node)
+{
+    int i, n = SR_FIB6_POPCOUNT(node->external);
+
+    for (i = 0; i < n; i++)
+    { sr_fib6_free_node(&node->children[i]); }
+    free(node->children);
+    free(node->routes);
+} /* -- sr_fib6_free_node -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib6_destroy(..)
+ * Scope:  Global
+ *
+ * Free the tree and every route in it.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_fib6_destroy(struct sr_fib6* fib)
+{
+    struct sr_rt6* rt;
+    struct sr_rt6* next;
+
+    if (!fib)
+    { return; }
+    sr_fib6_free_node(&fib->root);
+    for (rt = fib->head; rt; rt = next)
+    {
+        next = rt->next;
+        free(rt);
+    }
+    free(fib);
+} /* -- sr_fib6_destroy -- */
+
+static size_t sr_fib6_node_memory(const struct sr_fib6_node* node)
+{
+    size_t bytes = SR_FIB6_POPCOUNT(node->external) * sizeof(struct sr_fib6_node) +
+                   SR_FIB6_POPCOUNT(node->internal) * sizeof(struct sr_rt6*);
+    int i, n = SR_FIB6_POPCOUNT(node->external);
+
+    for (i = 0; i < n; i++)
+    { bytes += sr_fib6_node_memory(&node->children[i]); }
+    return bytes;
+} /* -- sr_fib6_node_memory -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib6_memory(..)
+ * Scope:  Global
+ *
+ * Bytes in the tree's nodes and route arrays, without the routes
+ * themselves or allocator overhead.
+ *
+ *---------------------------------------------------------------------*/
+
+size_t sr_fib6_memory(const struct sr_fib6* fib)
+{
+    return sizeof(*fib) + sr_fib6_node_memory(&fib->root);
+} /* -- sr_fib6_memory -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib6_parse(..)
+ * Scope:  Global
+ *
+ * Parse "ADDR/LEN" into dest and *len.  Returns 0, or -1 if malformed.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_fib6_parse(const char* str, uint8_t* dest, int* len)
+{
+    char buf[INET6_ADDRSTRLEN];
+    const char* slash = strchr(str, '/');
+    char* end;
+    long l;
+
+    if (slash == 0 || (size_t)(slash - str) >= sizeof(buf))
+    { return -1; }
+    memcpy(buf, str, slash - str);
+    buf[slash - str] = '\0';
+    l = strtol(slash + 1, &end, 10);
+    if (end == slash + 1 || *end != '\0' || l < 0 || l > 128 ||
+        inet_pton(AF_INET6, buf, dest) != 1)
+    { return -1; }
+    *len = (int)l;
+    return 0;
+} /* -- sr_fib6_parse -- */
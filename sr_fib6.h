@@ -0,0 +1,91 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_fib6.h
+ *
+ * Description:
+ *
+ * IPv6 forwarding table: a tree bitmap (Eatherton, Varghese and Dittia,
+ * "Tree Bitmap: Hardware/Software IP Lookups with Incremental Updates",
+ * 2004) over the 128-bit address.
+ *
+ * Each node stands for a SR_FIB6_STRIDE bit chunk of the address.  Its
+ * internal bitmap marks the prefixes ending inside the chunk (lengths 0
+ * to STRIDE-1 past the node's depth), its external bitmap the chunks
+ * that continue into a child.  Children and routes are kept in packed
+ * arrays indexed by counting the bits below the one wanted, so a node
+ * costs two bitmaps and two pointers however sparse it is, and a lookup
+ * touches one node per STRIDE bits.
+ *
+ * One route per prefix: IPv6 has no multipath groups here.  Lookups run
+ * under the instance's rt_lock like the IPv4 FIB's.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_FIB6_H
+#define SR_FIB6_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#include <stddef.h>
+
+#include "sr_if.h"
+
+/* -- bits per node; the bitmaps are 64 bits, so at most 6 -- */
+#ifndef SR_FIB6_STRIDE
+#define SR_FIB6_STRIDE 6
+#endif
+
+/* ----------------------------------------------------------------------------
+ * struct sr_rt6
+ *
+ * An IPv6 route.  gw is all zero for a directly connected prefix.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_rt6
+{
+    uint8_t dest[16];
+    uint8_t gw[16];
+    int len;
+    char interface[sr_IFACE_NAMELEN];
+    struct sr_rt6* next;       /* in the order added */
+    struct sr_rt6* prev;
+    uint64_t tx_packets;       /* forwarded through this route, added to
+                                  atomically by every forwarding thread */
+    uint64_t tx_bytes;
+};
+
+struct sr_fib6_node
+{
+    uint64_t internal;              /* prefixes ending in this node */
+    uint64_t external;              /* chunks with a child node */
+    struct sr_fib6_node* children;  /* popcount(external) nodes */
+    struct sr_rt6** routes;         /* popcount(internal) routes */
+};
+
+struct sr_fib6
+{
+    struct sr_fib6_node root;
+    struct sr_rt6* head;
+    struct sr_rt6* tail;
+    unsigned int routes;
+    unsigned int nodes;
+    uint64_t updates;
+};
+
+struct sr_fib6* sr_fib6_create(void);
+void   sr_fib6_destroy(struct sr_fib6* fib);
+struct sr_rt6* sr_fib6_lookup(const struct sr_fib6* fib, const uint8_t* dst);
+struct sr_rt6* sr_fib6_find(const struct sr_fib6* fib, const uint8_t* dest,
+                            int len);
+int    sr_fib6_insert(struct sr_fib6* fib, struct sr_rt6* rt);
+void   sr_fib6_remove(struct sr_fib6* fib, struct sr_rt6* rt);
+size_t sr_fib6_memory(const struct sr_fib6* fib);
+int    sr_fib6_parse(const char* str, uint8_t* dest, int* len);
+
+#endif /* -- SR_FIB6_H -- */
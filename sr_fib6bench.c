@@ -0,0 +1,379 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_fib6bench.c
+ *
+ * Description:
+ *
+ * IPv6 forwarding table benchmark (see sr_fib6.h).  It builds a tree
+ * bitmap from a synthetic table shaped like the IPv6 Internet table,
+ * reports its size and memory, times longest prefix match lookups and
+ * checks a sample of them against a linear scan, then removes half the
+ * routes and checks again.
+ *
+ *   sr_fib6bench [-n PREFIXES] [-l LOOKUPS] [-s SEED]
+ *
+ * The synthetic table (200000 prefixes by default) follows the prefix
+ * length shares of a full IPv6 BGP table: about half /48s, 12% /32s,
+ * 8% /44s, 7% /40s and the rest spread from /19 to /64.  Prefixes are
+ * drawn from 2000::/3 under a few hundred /12 - /20 registry blocks,
+ * 40% of them inside an earlier, shorter prefix.
+ *
+ * Half the lookup addresses fall inside a random route, the rest are
+ * random in 2000::/3.  Build with -DSR_FIB6_STRIDE=n to compare strides.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "sr_fib.h"
+#include "sr_fib6.h"
+
+#define BENCH_PREFIXES  200000
+#define BENCH_KEYS      (1 << 20)
+#define BENCH_LOOKUPS   20000000
+#define BENCH_LINEAR    100000000 /* route checks for the verification */
+#define BENCH_NESTED    40        /* % of prefixes inside an earlier one */
+#define BENCH_BLOCKS    512       /* registry blocks prefixes come from */
+
+/* -- prefix length shares of a full IPv6 table, parts per million -- */
+static const int bench_len_ppm[65] =
+{
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 200, 300, 300, 500, 400, 1500, 400, 500, 600, 2500, /* /19 - /28 */
+    30000, 3000, 2000, 120000, 5000, 6000, 5000, 40000,        /* /29 - /36 */
+    4000, 8000, 6000, 70000, 5000, 15000, 5000, 80000,         /* /37 - /44 */
+    10000, 30000, 25000, 513300, 0, 0, 0, 0,                   /* /45 - /52 */
+    0, 0, 0, 3000, 0, 0, 0, 0, 0, 0, 0, 7500                   /* /53 - /64 */
+};
+
+struct bench_pfx
+{
+    uint8_t addr[16];
+    int len;
+};
+
+static uint64_t bench_state = 88172645463325252ULL;
+
+static double bench_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+} /* -- bench_now -- */
+
+/* -- xorshift64, so runs repeat for a seed -- */
+static uint32_t bench_rand(void)
+{
+    bench_state ^= bench_state << 13;
+    bench_state ^= bench_state >> 7;
+    bench_state ^= bench_state << 17;
+    return (uint32_t)(bench_state >> 32);
+} /* -- bench_rand -- */
+
+static int bench_pick_len(void)
+{
+    int x = bench_rand() % 1000000, len;
+
+    for (len = 0; len < 64; len++)
+    {
+        if ((x -= bench_len_ppm[len]) < 0)
+        { break; }
+    }
+    return len;
+} /* -- bench_pick_len -- */
+
+static void bench_random(uint8_t* addr)
+{
+    int i;
+
+    for (i = 0; i < 16; i++)
+    { addr[i] = (uint8_t)bench_rand(); }
+    addr[0] = 0x20 | (addr[0] & 0x1f);
+} /* -- bench_random -- */
+
+/* -- keep the first len bits of a, the rest from b -- */
+static void bench_merge(uint8_t* dst, const uint8_t* a, const uint8_t* b, int len)
+{
+    int i;
+
+    for (i = 0; i < 16; i++, len -= 8)
+    {
+        if (len >= 8)
+        { dst[i] = a[i]; }
+        else if (len > 0)
+        { dst[i] = (a[i] & (0xff << (8 - len))) | (b[i] & (0xff >> len)); }
+        else
+        { dst[i] = b[i]; }
+    }
+} /* -- bench_merge -- */
+
+static void bench_mask(uint8_t* addr, int len)
+{
+    static const uint8_t zero[16];
+
+    bench_merge(addr, addr, zero, len);
+} /* -- bench_mask -- */
+
+static int bench_covers(const uint8_t* pfx, int len, const uint8_t* addr)
+{
+    int i;
+
+    for (i = 0; len >= 8; i++, len -= 8)
+    {
+        if (pfx[i] != addr[i])
+        { return 0; }
+    }
+    return len == 0 || ((pfx[i] ^ addr[i]) & (0xff << (8 - len))) == 0;
+} /* -- bench_covers -- */
+
+/*---------------------------------------------------------------------
+ * Method: bench_table(..)
+ * Scope:  Local
+ *
+ * Generate n prefixes, shortest first so longer ones can nest in them.
+ * Duplicates are left for the FIB to refuse.
+ *
+ *---------------------------------------------------------------------*/
+
+static void bench_table(struct bench_pfx* pfx, uint32_t n)
+{
+    struct bench_pfx blocks[BENCH_BLOCKS];
+    uint32_t count[65], have = 0, i, c;
+    uint8_t addr[16];
+    int len;
+
+    for (i = 0; i < BENCH_BLOCKS; i++)
+    {
+        bench_random(blocks[i].addr);
+        blocks[i].len = 12 + bench_rand() % 9;
+    }
+
+    memset(count, 0, sizeof(count));
+    for (i = 0; i < n; i++)
+    { count[bench_pick_len()]++; }
+
+    for (len = 0; len <= 64; len++)
+    {
+        for (i = 0; i < count[len]; i++)
+        {
+            const struct bench_pfx* up = &blocks[bench_rand() % BENCH_BLOCKS];
+            struct bench_pfx* p = &pfx[have];
+
+            if (have > 0 && (int)(bench_rand() % 100) < BENCH_NESTED &&
+                pfx[(c = bench_rand() % have)].len < len)
+            { up = &pfx[c]; }
+            have++;
+
+            bench_random(addr);
+            bench_merge(p->addr, up->addr, addr, up->len < len ? up->len : len);
+            bench_mask(p->addr, len);
+            p->len = len;
+        }
+    }
+} /* -- bench_table -- */
+
+static struct sr_fib6* bench_build(const struct bench_pfx* pfx, uint32_t n)
+{
+    struct sr_fib6* fib;
+    struct sr_rt6* rt;
+    uint32_t i;
+
+    if ((fib = sr_fib6_create()) == 0)
+    { return 0; }
+    for (i = 0; i < n; i++)
+    {
+        if ((rt = (struct sr_rt6*)calloc(1, sizeof(*rt))) == 0)
+        {
+            sr_fib6_destroy(fib);
+            return 0;
+        }
+        memcpy(rt->dest, pfx[i].addr, 16);
+        rt->len = pfx[i].len;
+        rt->gw[0] = 0xfe;
+        rt->gw[1] = 0x80;
+        rt->gw[15] = 1 + i % 16;
+        strcpy(rt->interface, "eth0");
+        if (sr_fib6_insert(fib, rt) != SR_FIB_OK)
+        { free(rt); }
+    }
+    return fib;
+} /* -- bench_build -- */
+
+/* -- longest route covering dst, by brute force -- */
+static const struct sr_rt6* bench_linear(const struct sr_fib6* fib,
+                                         const uint8_t* dst)
+{
+    const struct sr_rt6* rt;
+    const struct sr_rt6* best = 0;
+
+    for (rt = fib->head; rt; rt = rt->next)
+    {
+        if (bench_covers(rt->dest, rt->len, dst) && (!best || rt->len > best->len))
+        { best = rt; }
+    }
+    return best;
+} /* -- bench_linear -- */
+
+static uint8_t* bench_keys(const struct sr_fib6* fib)
+{
+    const struct sr_rt6** routes;
+    const struct sr_rt6* rt;
+    uint8_t* keys;
+    unsigned long i, n;
+
+    routes = (const struct sr_rt6**)malloc((fib->routes + 1) * sizeof(*routes));
+    keys = (uint8_t*)malloc(BENCH_KEYS * 16);
+    if (!routes || !keys)
+    {
+        fprintf(stderr, "sr_fib6bench: out of memory\n");
+        exit(1);
+    }
+    for (n = 0, rt = fib->head; rt; rt = rt->next)
+    { routes[n++] = rt; }
+
+    for (i = 0; i < BENCH_KEYS; i++)
+    {
+        bench_random(keys + i * 16);
+        if (n > 0 && (i & 1))
+        {
+            rt = routes[bench_rand() % n];
+            bench_merge(keys + i * 16, rt->dest, keys + i * 16, rt->len);
+        }
+    }
+    free(routes);
+    return keys;
+} /* -- bench_keys -- */
+
+/* -- lookups of a sample of keys that disagree with the linear scan -- */
+static unsigned long bench_verify(const struct sr_fib6* fib, const uint8_t* keys)
+{
+    unsigned long i, nverify, bad = 0;
+
+    nverify = fib->routes ? BENCH_LINEAR / fib->routes : BENCH_KEYS;
+    if (nverify > BENCH_KEYS)
+    { nverify = BENCH_KEYS; }
+    for (i = 0; i < nverify; i++)
+    {
+        if (sr_fib6_lookup(fib, keys + i * 16) != bench_linear(fib, keys + i * 16))
+        { bad++; }
+    }
+    printf("verified %lu lookups against a linear scan, %lu wrong\n",
+           nverify, bad);
+    return bad;
+} /* -- bench_verify -- */
+
+static void bench_size(const struct sr_fib6* fib)
+{
+    size_t mem = sr_fib6_memory(fib);
+
+    printf("routes %u nodes %u (%.2f routes/node)\n", fib->routes, fib->nodes,
+           fib->nodes ? (double)fib->routes / fib->nodes : 0.0);
+    printf("memory %.2f MB tree (%u B/node, %.1f B/route) + %.1f MB routes\n",
+           mem / 1048576.0, (unsigned)sizeof(struct sr_fib6_node),
+           fib->routes ? (double)mem / fib->routes : 0.0,
+           (double)fib->routes * sizeof(struct sr_rt6) / 1048576.0);
+} /* -- bench_size -- */
+
+static void usage(const char* argv0)
+{
+    fprintf(stderr, "Usage: %s [-n prefixes] [-l lookups] [-s seed]\n", argv0);
+} /* -- usage -- */
+
+int main(int argc, char** argv)
+{
+    uint32_t n = BENCH_PREFIXES;
+    unsigned long lookups = BENCH_LOOKUPS;
+    unsigned long i, matched = 0, acc = 0, removed = 0;
+    volatile unsigned long sink = 0;
+    struct bench_pfx* pfx;
+    struct sr_fib6* fib;
+    struct sr_rt6* rt;
+    struct sr_rt6* next;
+    uint8_t* keys;
+    double t0, t;
+    int c;
+
+    while ((c = getopt(argc, argv, "hn:l:s:")) != EOF)
+    {
+        switch (c)
+        {
+            case 'n':
+                n = strtoul(optarg, 0, 10);
+                break;
+            case 'l':
+                lookups = strtoul(optarg, 0, 10);
+                break;
+            case 's':
+                bench_state = strtoull(optarg, 0, 10) | 1;
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (n == 0 || (pfx = (struct bench_pfx*)malloc(n * sizeof(*pfx))) == 0)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+    bench_table(pfx, n);
+
+    t0 = bench_now();
+    fib = bench_build(pfx, n);
+    t = bench_now() - t0;
+    free(pfx);
+    if (fib == 0)
+    {
+        fprintf(stderr, "sr_fib6bench: out of memory\n");
+        return 1;
+    }
+
+    printf("stride %d, %u of %u prefixes distinct\n", SR_FIB6_STRIDE,
+           fib->routes, n);
+    bench_size(fib);
+    printf("build %.3f s (%.0f ns/route)\n", t,
+           fib->routes ? t * 1e9 / fib->routes : 0.0);
+
+    keys = bench_keys(fib);
+
+    /* -- warm up, then time -- */
+    for (i = 0; i < BENCH_KEYS; i++)
+    { matched += (sr_fib6_lookup(fib, keys + i * 16) != 0); }
+    t0 = bench_now();
+    for (i = 0; i < lookups; i++)
+    { acc += (unsigned long)sr_fib6_lookup(fib, keys + (i & (BENCH_KEYS - 1)) * 16); }
+    t = bench_now() - t0;
+    sink += acc;
+    printf("lookup %.1f ns (%.2f M/s), %.1f%% matched\n",
+           lookups ? t * 1e9 / lookups : 0.0, lookups ? lookups / t / 1e6 : 0.0,
+           100.0 * matched / BENCH_KEYS);
+    if (bench_verify(fib, keys) != 0)
+    { return 2; }
+
+    /* -- every other route out, the tree must shrink and still agree -- */
+    t0 = bench_now();
+    for (rt = fib->head; rt; rt = next)
+    {
+        next = rt->next ? rt->next->next : 0;
+        sr_fib6_remove(fib, rt);
+        removed++;
+    }
+    t = bench_now() - t0;
+    printf("removed %lu routes in %.3f s (%.0f ns/route)\n", removed, t,
+           removed ? t * 1e9 / removed : 0.0);
+    bench_size(fib);
+    if (bench_verify(fib, keys) != 0)
+    { return 2; }
+
+    free(keys);
+    sr_fib6_destroy(fib);
+    return 0;
+} /* -- main -- */
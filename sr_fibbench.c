@@ -0,0 +1,552 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_fibbench.c
+ *
+ * Description:
+ *
+ * Forwarding table benchmark (see sr_fib.h).  It builds a FIB from a
+ * synthetic table shaped like the IPv4 Internet table, or from an MRT
+ * table dump, reports its size, memory and prefix length distribution,
+ * then times longest prefix match lookups and checks a sample of them
+ * against a linear scan.
+ *
+ *   sr_fibbench [-n PREFIXES] [-l LOOKUPS] [-s SEED] [-o OUT_MRT]
+ *               [-f MRT_FILE [-m MAP_FILE]] [-z]
+ *
+ * The synthetic table (900000 prefixes by default) follows the prefix
+ * length shares of a full BGP table: about 62% /24s, 10% /23s, 12% /22s
+ * and the rest spread down to /8.  Prefixes are drawn from the unicast
+ * space, 40% of them inside an earlier, shorter prefix (half of those
+ * with the covering prefix's next hop), with 16 next hops in 192.0.2.0/24
+ * used with a skew.  -o writes it as an MRT TABLE_DUMP_V2 file, which
+ * -f reads back through the importer.  Without -m every next hop is its
+ * own gateway on eth0.
+ *
+ * Half the lookup addresses fall inside a random route, the rest are
+ * random.
+ *
+ * -z also compresses the table with ORTC (sr_ortc.h), checks that it
+ * forwards every address like the original and reports it the same way,
+ * timing lookups of the same addresses.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "sr_rt.h"
+#include "sr_fib.h"
+#include "sr_mrt.h"
+#include "sr_ortc.h"
+
+#define BENCH_PREFIXES  900000
+#define BENCH_KEYS      (1 << 20)
+#define BENCH_LOOKUPS   20000000
+#define BENCH_BURST     32        /* keys per sr_fib_lookup_burst */
+#define BENCH_LINEAR    400000000 /* route checks for the verification */
+#define BENCH_NEXTHOPS  16
+#define BENCH_NESTED    40        /* % of prefixes inside an earlier one */
+#define BENCH_NEXTHOP_NET 0xc0000200u /* 192.0.2.0/24 */
+
+/* -- prefix length shares of a full IPv4 table, parts per million -- */
+static const int bench_len_ppm[33] =
+{
+    0, 0, 0, 0, 0, 0, 0, 0,
+    16, 13, 37, 105, 300, 600, 1200, 2100,            /* /8 - /15 */
+    14000, 8500, 14500, 27000, 44000, 52000, 118000,  /* /16 - /22 */
+    100000, 617629,                                   /* /23, /24 */
+    0, 0, 0, 0, 0, 0, 0, 0
+};
+
+struct bench_pfx
+{
+    uint32_t addr;   /* host byte order, masked */
+    uint8_t  len;
+    uint8_t  nh;     /* next hop index */
+    uint16_t as;     /* origin AS - 64512 */
+};
+
+static uint64_t bench_state = 88172645463325252ULL;
+
+static double bench_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+} /* -- bench_now -- */
+
+/* -- xorshift64, so runs repeat for a seed -- */
+static uint32_t bench_rand(void)
+{
+    bench_state ^= bench_state << 13;
+    bench_state ^= bench_state >> 7;
+    bench_state ^= bench_state << 17;
+    return (uint32_t)(bench_state >> 32);
+} /* -- bench_rand -- */
+
+static uint32_t bench_mask(int bits)
+{
+    return bits ? 0xffffffffu << (32 - bits) : 0;
+} /* -- bench_mask -- */
+
+static int bench_pick_len(void)
+{
+    int x = bench_rand() % 1000000, len;
+
+    for (len = 0; len < 32; len++)
+    {
+        if ((x -= bench_len_ppm[len]) < 0)
+        { break; }
+    }
+    return len;
+} /* -- bench_pick_len -- */
+
+/* -- low next hops are picked more often, like a few big upstreams -- */
+static int bench_pick_nh(void)
+{
+    int a = bench_rand() % BENCH_NEXTHOPS, b = bench_rand() % BENCH_NEXTHOPS;
+
+    return a < b ? a : b;
+} /* -- bench_pick_nh -- */
+
+static uint32_t bench_unicast(void)
+{
+    uint32_t a;
+
+    do
+    { a = bench_rand(); }
+    while ((a >> 24) == 0 || (a >> 24) == 10 || (a >> 24) == 127 ||
+           (a >> 24) >= 224);
+    return a;
+} /* -- bench_unicast -- */
+
+static int bench_pfx_cmp(const void* a, const void* b)
+{
+    const struct bench_pfx* pa = (const struct bench_pfx*)a;
+    const struct bench_pfx* pb = (const struct bench_pfx*)b;
+
+    if (pa->addr != pb->addr)
+    { return pa->addr < pb->addr ? -1 : 1; }
+    return (int)pa->len - (int)pb->len;
+} /* -- bench_pfx_cmp -- */
+
+/*---------------------------------------------------------------------
+ * Method: bench_table(..)
+ * Scope:  Local
+ *
+ * Generate n distinct prefixes, shortest first so longer ones can nest
+ * in them, then sort them by address as in a table dump.
+ *
+ *---------------------------------------------------------------------*/
+
+static void bench_table(struct bench_pfx* pfx, uint32_t n)
+{
+    uint32_t count[33], have = 0, i, cap, slot;
+    uint64_t* seen;
+    int len;
+
+    /* -- open addressing set of addr/len already generated -- */
+    for (cap = 1; cap < 2 * n; cap <<= 1)
+    { }
+    if ((seen = (uint64_t*)calloc(cap, sizeof(*seen))) == 0)
+    {
+        fprintf(stderr, "sr_fibbench: out of memory\n");
+        exit(1);
+    }
+
+    memset(count, 0, sizeof(count));
+    for (i = 0; i < n; i++)
+    { count[bench_pick_len()]++; }
+
+    for (len = 0; len <= 32; len++)
+    {
+        for (i = 0; i < count[len]; i++)
+        {
+            struct bench_pfx* p = &pfx[have];
+            uint64_t key;
+
+            do
+            {
+                p->len = len;
+                p->nh = bench_pick_nh();
+                p->addr = bench_unicast();
+                if (have > 0 && (int)(bench_rand() % 100) < BENCH_NESTED)
+                {
+                    const struct bench_pfx* up = &pfx[bench_rand() % have];
+
+                    if (up->len < len)
+                    {
+                        p->addr = up->addr | (p->addr & ~bench_mask(up->len));
+                        if (bench_rand() & 1)
+                        { p->nh = up->nh; }
+                    }
+                }
+                p->addr &= bench_mask(len);
+
+                key = ((uint64_t)p->addr << 6 | len) + 1;
+                for (slot = (uint32_t)((key * 0x9e3779b97f4a7c15ULL) >> 32) & (cap - 1);
+                     seen[slot] && seen[slot] != key; slot = (slot + 1) & (cap - 1))
+                { }
+            } while (seen[slot]);
+
+            seen[slot] = key;
+            p->as = bench_rand() % 1000;
+            have++;
+        }
+    }
+
+    free(seen);
+    qsort(pfx, n, sizeof(*pfx), bench_pfx_cmp);
+} /* -- bench_table -- */
+
+/*---------------------------------------------------------------------
+ * Method: bench_build(..)
+ * Scope:  Local
+ *---------------------------------------------------------------------*/
+
+static struct sr_fib* bench_build(const struct bench_pfx* pfx, uint32_t n)
+{
+    struct sr_fib* fib;
+    struct sr_rt* rt;
+    uint32_t i;
+
+    if ((fib = sr_fib_create()) == 0)
+    { return 0; }
+    for (i = 0; i < n; i++)
+    {
+        if ((rt = (struct sr_rt*)calloc(1, sizeof(*rt))) == 0)
+        {
+            sr_fib_destroy(fib);
+            return 0;
+        }
+        rt->dest.s_addr = htonl(pfx[i].addr);
+        rt->mask.s_addr = htonl(bench_mask(pfx[i].len));
+        rt->gw.s_addr = htonl(BENCH_NEXTHOP_NET | (pfx[i].nh + 1));
+        strcpy(rt->interface, "eth0");
+        rt->weight = SR_RT_DEFAULT_WEIGHT;
+        if (sr_fib_insert(fib, rt) != SR_FIB_OK)
+        { free(rt); }
+    }
+    return fib;
+} /* -- bench_build -- */
+
+static int bench_write(const char* path, const struct bench_pfx* pfx, uint32_t n)
+{
+    FILE* out;
+    uint32_t i;
+    int ret = 0;
+
+    if ((out = fopen(path, "wb")) == 0)
+    {
+        perror(path);
+        return -1;
+    }
+    ret |= sr_mrt_write_peers(out, htonl(BENCH_NEXTHOP_NET | 254),
+                              htonl(BENCH_NEXTHOP_NET | 254), 64511);
+    for (i = 0; i < n && ret == 0; i++)
+    {
+        ret |= sr_mrt_write_rib(out, i, htonl(pfx[i].addr), pfx[i].len,
+                                htonl(BENCH_NEXTHOP_NET | (pfx[i].nh + 1)),
+                                64512 + pfx[i].as);
+    }
+    if (fclose(out) != 0 || ret != 0)
+    {
+        perror(path);
+        return -1;
+    }
+    printf("wrote %u prefixes to %s\n", n, path);
+    return 0;
+} /* -- bench_write -- */
+
+/* -- longest route covering dst, by brute force -- */
+static const struct sr_rt* bench_linear(const struct sr_fib* fib, uint32_t dst)
+{
+    const struct sr_rt* rt;
+    const struct sr_rt* best = 0;
+
+    for (rt = fib->head; rt; rt = rt->next)
+    {
+        if ((dst & rt->mask.s_addr) == rt->dest.s_addr &&
+            (!best || ntohl(rt->mask.s_addr) > ntohl(best->mask.s_addr)))
+        { best = rt; }
+    }
+    return best;
+} /* -- bench_linear -- */
+
+/*---------------------------------------------------------------------
+ * Method: bench_keys(..)
+ * Scope:  Local
+ *
+ * BENCH_KEYS lookup addresses (network byte order), every other one
+ * inside a random route of fib.
+ *
+ *---------------------------------------------------------------------*/
+
+static uint32_t* bench_keys(const struct sr_fib* fib)
+{
+    const struct sr_rt** routes;
+    const struct sr_rt* rt;
+    uint32_t* keys;
+    unsigned long i, n;
+
+    routes = (const struct sr_rt**)malloc((fib->routes + 1) * sizeof(*routes));
+    keys = (uint32_t*)malloc(BENCH_KEYS * sizeof(*keys));
+    if (!routes || !keys)
+    {
+        fprintf(stderr, "sr_fibbench: out of memory\n");
+        exit(1);
+    }
+    for (n = 0, rt = fib->head; rt; rt = rt->next)
+    { routes[n++] = rt; }
+
+    for (i = 0; i < BENCH_KEYS; i++)
+    {
+        keys[i] = htonl(bench_rand());
+        if (n > 0 && (i & 1))
+        {
+            rt = routes[bench_rand() % n];
+            keys[i] = rt->dest.s_addr | (keys[i] & ~rt->mask.s_addr);
+        }
+    }
+    free(routes);
+    return keys;
+} /* -- bench_keys -- */
+
+/*---------------------------------------------------------------------
+ * Method: bench_report(..)
+ * Scope:  Local
+ *
+ * Print size and memory, time lookups of keys and verify a sample.  Returns
+ * the number of addresses resolved differently from the linear scan.
+ *
+ *---------------------------------------------------------------------*/
+
+static unsigned long bench_report(const struct sr_fib* fib, double build,
+                                  unsigned long lookups, const uint32_t* keys)
+{
+    const struct sr_rt* rt;
+    struct sr_rt* routes[BENCH_BURST];
+    unsigned long hist[33], i, j, n, nverify, matched = 0, bad = 0;
+    size_t mem;
+    volatile unsigned long sink = 0;
+    unsigned long acc = 0;
+    double t0, t;
+    int len;
+
+    mem = sizeof(*fib) + (size_t)fib->nodes * sizeof(struct sr_fib_node) +
+          (size_t)fib->routes * sizeof(struct sr_rt);
+    printf("routes %u prefixes %u nodes %u\n", fib->routes, fib->prefixes,
+           fib->nodes);
+    printf("memory %.1f MB (%u B/node, %u B/route, %.1f B/prefix)\n",
+           mem / 1048576.0, (unsigned)sizeof(struct sr_fib_node),
+           (unsigned)sizeof(struct sr_rt),
+           fib->prefixes ? (double)mem / fib->prefixes : 0.0);
+    printf("build %.3f s (%.0f ns/route)\n", build,
+           fib->routes ? build * 1e9 / fib->routes : 0.0);
+
+    memset(hist, 0, sizeof(hist));
+    for (n = 0, rt = fib->head; rt; rt = rt->next, n++)
+    { hist[sr_fib_prefix_len(rt->mask.s_addr)]++; }
+    printf("prefix lengths:");
+    for (len = 0; len <= 32; len++)
+    {
+        if (hist[len])
+        { printf(" /%d %.1f%%", len, 100.0 * hist[len] / n); }
+    }
+    printf("\n");
+
+    /* -- warm up, then time -- */
+    for (i = 0; i < BENCH_KEYS; i++)
+    { matched += (sr_fib_lookup(fib, keys[i]) != 0); }
+    t0 = bench_now();
+    for (i = 0; i < lookups; i++)
+    { acc += (unsigned long)sr_fib_lookup(fib, keys[i & (BENCH_KEYS - 1)]); }
+    t = bench_now() - t0;
+    sink += acc;
+    printf("lookup %.1f ns (%.2f M/s), %.1f%% matched\n",
+           lookups ? t * 1e9 / lookups : 0.0, lookups ? lookups / t / 1e6 : 0.0,
+           100.0 * matched / BENCH_KEYS);
+
+    /* -- the same a burst at a time, as sr_handlepacket_burst does -- */
+    t0 = bench_now();
+    for (i = 0; i + BENCH_BURST <= lookups; i += BENCH_BURST)
+    {
+        sr_fib_lookup_burst(fib, keys + (i & (BENCH_KEYS - 1)), routes,
+                            BENCH_BURST);
+        acc += (unsigned long)routes[0];
+    }
+    t = bench_now() - t0;
+    sink += acc;
+    printf("burst lookup %.1f ns (%.2f M/s)\n",
+           i ? t * 1e9 / i : 0.0, i ? i / t / 1e6 : 0.0);
+    for (i = 0; i < BENCH_KEYS; i += BENCH_BURST)
+    {
+        sr_fib_lookup_burst(fib, keys + i, routes, BENCH_BURST);
+        for (j = 0; j < BENCH_BURST; j++)
+        { bad += (routes[j] != sr_fib_lookup(fib, keys[i + j])); }
+    }
+
+    nverify = n ? BENCH_LINEAR / n : BENCH_KEYS;
+    if (nverify > BENCH_KEYS)
+    { nverify = BENCH_KEYS; }
+    for (i = 0; i < nverify; i++)
+    {
+        const struct sr_rt* a = sr_fib_lookup(fib, keys[i]);
+        const struct sr_rt* b = bench_linear(fib, keys[i]);
+
+        if ((a == 0) != (b == 0) ||
+            (a && (a->dest.s_addr != b->dest.s_addr ||
+                   a->mask.s_addr != b->mask.s_addr)))
+        { bad++; }
+    }
+    printf("verified %lu lookups against a linear scan and %d bursts against "
+           "single lookups, %lu wrong\n", nverify, BENCH_KEYS / BENCH_BURST,
+           bad);
+    return bad;
+} /* -- bench_report -- */
+
+static void usage(const char* argv0)
+{
+    fprintf(stderr, "Usage: %s [-n prefixes] [-l lookups] [-s seed] "
+            "[-o out.mrt] [-f table.mrt [-m map]] [-z]\n", argv0);
+} /* -- usage -- */
+
+int main(int argc, char** argv)
+{
+    uint32_t n = BENCH_PREFIXES;
+    unsigned long lookups = BENCH_LOOKUPS;
+    const char* out = 0;
+    const char* file = 0;
+    const char* mapfile = 0;
+    struct sr_fib* fib;
+    uint32_t* keys;
+    double t0, build;
+    int compress = 0;
+    int c;
+
+    while ((c = getopt(argc, argv, "hn:l:s:o:f:m:z")) != EOF)
+    {
+        switch (c)
+        {
+            case 'n':
+                n = strtoul(optarg, 0, 10);
+                break;
+            case 'l':
+                lookups = strtoul(optarg, 0, 10);
+                break;
+            case 's':
+                bench_state = strtoull(optarg, 0, 10) | 1;
+                break;
+            case 'o':
+                out = optarg;
+                break;
+            case 'f':
+                file = optarg;
+                break;
+            case 'm':
+                mapfile = optarg;
+                break;
+            case 'z':
+                compress = 1;
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (file)
+    {
+        struct sr_mrt_map map;
+        struct sr_mrt_map_entry any;
+        struct sr_mrt_stats st;
+
+        memset(&map, 0, sizeof(map));
+        memset(&any, 0, sizeof(any));
+        memset(&st, 0, sizeof(st));
+        if (mapfile)
+        {
+            if (sr_mrt_map_load(mapfile, &map, stderr) != 0)
+            { return 1; }
+        }
+        else
+        {
+            any.gw_is_nh = 1;
+            strcpy(any.iface, "eth0");
+            map.entries = &any;
+            map.n = 1;
+            map.peer = -1;
+        }
+
+        if ((fib = sr_fib_create()) == 0)
+        { return 1; }
+        t0 = bench_now();
+        if (sr_mrt_import(fib, file, &map, &st, stderr) != 0)
+        { return 1; }
+        build = bench_now() - t0;
+        sr_mrt_print_stats(&st, stdout);
+        if (mapfile)
+        { sr_mrt_map_free(&map); }
+    }
+    else
+    {
+        struct bench_pfx* pfx;
+
+        if (n == 0 || (pfx = (struct bench_pfx*)malloc(n * sizeof(*pfx))) == 0)
+        {
+            usage(argv[0]);
+            return 1;
+        }
+        bench_table(pfx, n);
+        if (out && bench_write(out, pfx, n) != 0)
+        { return 1; }
+
+        t0 = bench_now();
+        fib = bench_build(pfx, n);
+        build = bench_now() - t0;
+        free(pfx);
+        if (fib == 0)
+        {
+            fprintf(stderr, "sr_fibbench: out of memory\n");
+            return 1;
+        }
+    }
+
+    keys = bench_keys(fib);
+    if (bench_report(fib, build, lookups, keys) != 0)
+    { return 2; }
+
+    if (compress)
+    {
+        struct sr_ortc_stats st;
+        struct sr_fib* small;
+        unsigned long diff, checked;
+
+        printf("-- ORTC --\n");
+        if ((small = sr_ortc_compress(fib, &st)) == 0)
+        {
+            fprintf(stderr, "sr_fibbench: out of memory or more than %d "
+                    "next hop groups\n", SR_ORTC_MAX_LABELS);
+            return 1;
+        }
+        printf("compressed %u prefixes to %u (%.1f%%), %u next hop groups\n",
+               st.prefixes_in, st.prefixes_out,
+               st.prefixes_in ? 100.0 * st.prefixes_out / st.prefixes_in : 0.0,
+               st.labels);
+        diff = sr_ortc_diff(fib, small, &checked);
+        printf("compared %lu address intervals (all addresses), %lu differ\n",
+               checked, diff);
+        if (bench_report(small, st.seconds, lookups, keys) != 0 || diff != 0)
+        { return 2; }
+        sr_fib_destroy(small);
+    }
+    free(keys);
+    sr_fib_destroy(fib);
+    return 0;
+} /* -- main -- */
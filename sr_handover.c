@@ -0,0 +1,490 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_handover.c
+ *
+ * Description:
+ *
+ * Hot restart, both sides of the handover, see sr_handover.h.  Each
+ * step is one SOCK_SEQPACKET message, a text line with the descriptors
+ * it passes attached as SCM_RIGHTS:
+ *
+ *   state VERSION SEED    interfaces, routes
+ *   take
+ *   go LEN                VNS socket, ARP cache; LEN bytes of VNS stream
+ *                         follow the line
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+
+#include "sr_router.h"
+#include "sr_rt.h"
+#include "sr_netdev.h"
+#include "sr_arpcache.h"
+#include "sr_egress.h"
+#include "sr_handover.h"
+#include "sr_common.h"
+
+#define SR_HANDOVER_MAX_FDS 2
+#define SR_HANDOVER_LINE    64    /* room for the text line of a message */
+
+/*---------------------------------------------------------------------
+ * Method: sr_handover_send(..)
+ * Scope:  Local
+ *
+ * Send one message of len bytes, passing nfds descriptors with it.
+ * Returns 0 or -1.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_handover_send(int fd, const void* buf, size_t len,
+                            const int* fds, int nfds)
+{
+    struct msghdr msg;
+    struct iovec iov;
+    struct cmsghdr* cmsg;
+    char control[CMSG_SPACE(SR_HANDOVER_MAX_FDS * sizeof(int))];
+
+    assert(nfds <= SR_HANDOVER_MAX_FDS);
+
+    memset(&msg, 0, sizeof(msg));
+    iov.iov_base = (void*)buf;
+    iov.iov_len = len;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    if (nfds > 0)
+    {
+        memset(control, 0, sizeof(control));
+        msg.msg_control = control;
+        msg.msg_controllen = CMSG_SPACE(nfds * sizeof(int));
+        cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(nfds * sizeof(int));
+        memcpy(CMSG_DATA(cmsg), fds, nfds * sizeof(int));
+    }
+    if (sendmsg(fd, &msg, MSG_NOSIGNAL) != (ssize_t)len)
+    {
+        perror("sendmsg(..):sr_handover.c::sr_handover_send");
+        return -1;
+    }
+    return 0;
+} /* -- sr_handover_send -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_handover_recv(..)
+ * Scope:  Local
+ *
+ * Receive one message into buf, NUL terminated, and the descriptors
+ * passed with it, exactly nfds of them.  Returns its length, or -1 if
+ * the peer went away or sent something else.
+ *
+ *---------------------------------------------------------------------*/
+
+static ssize_t sr_handover_recv(int fd, char* buf, size_t size, int* fds,
+                                int nfds)
+{
+    struct msghdr msg;
+    struct iovec iov;
+    struct cmsghdr* cmsg;
+    char control[CMSG_SPACE(SR_HANDOVER_MAX_FDS * sizeof(int))];
+    int got = 0, i;
+    ssize_t n;
+
+    memset(&msg, 0, sizeof(msg));
+    iov.iov_base = buf;
+    iov.iov_len = size - 1;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    while ((n = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC)) < 0 && errno == EINTR)
+    { }
+    if (n <= 0)
+    {
+        if (n < 0)
+        { perror("recvmsg(..):sr_handover.c::sr_handover_recv"); }
+        return -1;
+    }
+    buf[n] = '\0';
+
+    for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+    {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+        { continue; }
+        got = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        if (got > nfds)
+        {
+            for (i = 0; i < got; i++)
+            { close(((int*)CMSG_DATA(cmsg))[i]); }
+            got = -1;
+            break;
+        }
+        memcpy(fds, CMSG_DATA(cmsg), got * sizeof(int));
+    }
+    if ((msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) || got != nfds)
+    {
+        for (i = 0; i < got; i++)
+        { close(fds[i]); }
+        fprintf(stderr, "Hot restart: unexpected message\n");
+        return -1;
+    }
+    return n;
+} /* -- sr_handover_recv -- */
+
+/* -- an anonymous file to pass, written through *out; -1 on error -- */
+static int sr_handover_memfile(const char* name, FILE** out)
+{
+    int fd, wfd;
+
+    if ((fd = memfd_create(name, MFD_CLOEXEC)) < 0)
+    {
+        perror("memfd_create(..):sr_handover.c::sr_handover_memfile");
+        return -1;
+    }
+    if ((wfd = dup(fd)) < 0 || (*out = fdopen(wfd, "w")) == 0)
+    {
+        perror("fdopen(..):sr_handover.c::sr_handover_memfile");
+        if (wfd >= 0)
+        { close(wfd); }
+        close(fd);
+        return -1;
+    }
+    return fd;
+} /* -- sr_handover_memfile -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_handover_begin(..)
+ * Scope:  Global
+ *
+ * New router, before sr_init: connect to the router at
+ * sr->handover_path and load the interfaces and routes it sends.
+ * Returns 0 with sr->handover set, or -1 if no router is listening
+ * there and this one should start cold.  Exits if the state it sent
+ * cannot be loaded.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_handover_begin(struct sr_instance* sr)
+{
+    struct sockaddr_un addr;
+    struct timeval tv;
+    struct sr_handover* ho;
+    char line[SR_HANDOVER_LINE];
+    char path[64];
+    int fd, fds[2];
+    unsigned int version, seed;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+
+    if (strlen(sr->handover_path) >= sizeof(addr.sun_path))
+    {
+        fprintf(stderr, "Hot restart socket path too long: %s\n",
+                sr->handover_path);
+        exit(1);
+    }
+    if ((fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0)) < 0)
+    {
+        perror("socket(..):sr_handover.c::sr_handover_begin");
+        exit(1);
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, sr->handover_path, sizeof(addr.sun_path) - 1);
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0)
+    {
+        printf("Hot restart: no router at %s, starting cold\n",
+               sr->handover_path);
+        close(fd);
+        return -1;
+    }
+    tv.tv_sec = SR_HANDOVER_TIMEOUT;
+    tv.tv_usec = 0;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    if (sr_handover_recv(fd, line, sizeof(line), fds, 2) < 0 ||
+        sscanf(line, "state %u %u", &version, &seed) != 2 ||
+        version != SR_HANDOVER_VERSION)
+    {
+        fprintf(stderr, "Hot restart: no state from the router at %s\n",
+                sr->handover_path);
+        exit(1);
+    }
+
+    /* -- the loaders read files; the memfds are files of this process -- */
+    snprintf(path, sizeof(path), "/proc/self/fd/%d", fds[0]);
+    if (sr_netdev_load_ifaces(sr, path) != 0)
+    {
+        fprintf(stderr, "Hot restart: cannot load the interfaces handed over\n");
+        exit(1);
+    }
+    snprintf(path, sizeof(path), "/proc/self/fd/%d", fds[1]);
+    if (sr_load_rt(sr, path) != 0 || sr_rt6_load(sr, path) != 0)
+    {
+        fprintf(stderr, "Hot restart: cannot load the routes handed over\n");
+        exit(1);
+    }
+    close(fds[0]);
+    close(fds[1]);
+    sr_print_routing_table(sr);
+
+    if ((ho = (struct sr_handover*)calloc(1, sizeof(*ho))) == 0)
+    {
+        fprintf(stderr, "Error: out of memory (sr_handover_begin)\n");
+        exit(1);
+    }
+    ho->fd = fd;
+    ho->ecmp_seed = seed;
+    sr->handover = ho;
+
+    printf("Hot restart: taking over from the router at %s\n",
+           sr->handover_path);
+    return 0;
+} /* -- sr_handover_begin -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_handover_finish(..)
+ * Scope:  Global
+ *
+ * New router, ready to run: ask for the session and adopt it, the VNS
+ * socket into sr->sockfd and the bytes the old router had read of the
+ * command it was receiving into rxbuf (size bytes, *fill set).  Returns
+ * 0, or -1 if it never came.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_handover_finish(struct sr_instance* sr, uint8_t* rxbuf,
+                       unsigned int size, unsigned int* fill)
+{
+    struct sr_handover* ho = sr->handover;
+    char* msg;
+    char* data;
+    char path[64];
+    int fds[2], adopted;
+    unsigned int len;
+    socklen_t addrlen;
+    uint64_t start;
+    ssize_t n;
+
+    /* -- REQUIRES -- */
+    assert(ho);
+
+    if ((msg = (char*)malloc(size + SR_HANDOVER_LINE)) == 0)
+    {
+        fprintf(stderr, "Error: out of memory (sr_handover_finish)\n");
+        return -1;
+    }
+
+    start = sr_now_ns();
+    if (sr_handover_send(ho->fd, "take\n", 5, 0, 0) != 0 ||
+        (n = sr_handover_recv(ho->fd, msg, size + SR_HANDOVER_LINE, fds, 2)) < 0)
+    {
+        fprintf(stderr, "Hot restart: the router at %s did not hand over\n",
+                sr->handover_path);
+        free(msg);
+        return -1;
+    }
+    if (sscanf(msg, "go %u", &len) != 1 || len > size ||
+        (data = memchr(msg, '\n', n)) == 0 || (msg + n) - (data + 1) != len)
+    {
+        fprintf(stderr, "Hot restart: bad go message\n");
+        close(fds[0]);
+        close(fds[1]);
+        free(msg);
+        return -1;
+    }
+    memcpy(rxbuf, data + 1, len);
+    *fill = len;
+    free(msg);
+
+    sr->sockfd = fds[0];
+    sr->ecmp_seed = ho->ecmp_seed;
+    /* -- where to reconnect should the session be lost -- */
+    addrlen = sizeof(sr->sr_addr);
+    getpeername(sr->sockfd, (struct sockaddr*)&(sr->sr_addr), &addrlen);
+    close(ho->fd);
+    free(ho);
+    sr->handover = 0;
+
+    snprintf(path, sizeof(path), "/proc/self/fd/%d", fds[1]);
+    adopted = sr_arpcache_adopt(sr, path);
+    close(fds[1]);
+
+    printf("Hot restart: took over the VNS session, %d ARP entries, "
+           "forwarding stopped for %llu us\n", adopted,
+           (unsigned long long)((sr_now_ns() - start) / 1000));
+    return 0;
+} /* -- sr_handover_finish -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_handover_listen(..)
+ * Scope:  Global
+ *
+ * Listen for the next router at sr->handover_path, replacing a stale
+ * socket file.  Returns the non-blocking descriptor or -1.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_handover_listen(struct sr_instance* sr)
+{
+    struct sockaddr_un addr;
+    int fd;
+
+    if (strlen(sr->handover_path) >= sizeof(addr.sun_path))
+    {
+        fprintf(stderr, "Hot restart socket path too long: %s\n",
+                sr->handover_path);
+        return -1;
+    }
+    if ((fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0)) < 0)
+    {
+        perror("socket(..):sr_handover.c::sr_handover_listen");
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, sr->handover_path, sizeof(addr.sun_path) - 1);
+    unlink(sr->handover_path);
+
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+        listen(fd, 1) < 0)
+    {
+        perror("bind/listen(..):sr_handover.c::sr_handover_listen");
+        close(fd);
+        return -1;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    return fd;
+} /* -- sr_handover_listen -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_handover_offer(..)
+ * Scope:  Global
+ *
+ * Running router, lfd readable: accept the new router and send it the
+ * state.  Returns the connection, to watch for take, or -1.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_handover_offer(struct sr_instance* sr, int lfd)
+{
+    char line[SR_HANDOVER_LINE];
+    FILE* ifs = 0;
+    FILE* routes = 0;
+    int fd, fds[2] = { -1, -1 }, err;
+
+    if ((fd = accept4(lfd, 0, 0, SOCK_CLOEXEC)) < 0)
+    { return -1; }
+
+    if ((fds[0] = sr_handover_memfile("sr-ifaces", &ifs)) < 0 ||
+        (fds[1] = sr_handover_memfile("sr-routes", &routes)) < 0)
+    { goto fail; }
+    err = sr_netdev_save_ifaces(sr, ifs);
+    err |= fclose(ifs);
+    ifs = 0;
+    err |= sr_rt_save(sr, routes);
+    err |= fclose(routes);
+    routes = 0;
+    if (err)
+    { goto fail; }
+
+    snprintf(line, sizeof(line), "state %d %u\n", SR_HANDOVER_VERSION,
+             sr->ecmp_seed);
+    if (sr_handover_send(fd, line, strlen(line), fds, 2) != 0)
+    { goto fail; }
+    close(fds[0]);
+    close(fds[1]);
+
+    printf("Hot restart: a new router is taking over\n");
+    return fd;
+
+fail:
+    fprintf(stderr, "Hot restart: cannot send the state\n");
+    if (ifs)
+    { fclose(ifs); }
+    if (routes)
+    { fclose(routes); }
+    if (fds[0] >= 0)
+    { close(fds[0]); }
+    if (fds[1] >= 0)
+    { close(fds[1]); }
+    close(fd);
+    return -1;
+} /* -- sr_handover_offer -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_handover_give(..)
+ * Scope:  Global
+ *
+ * Running router, cfd readable: on take, send what is queued, then the
+ * VNS socket, the ARP cache and the fill bytes of rxbuf not yet
+ * consumed.  Returns 0 once handed over, when the router should stop
+ * without touching the session again, or -1 if the new router went
+ * away (cfd is closed either way).
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_handover_give(struct sr_instance* sr, int cfd, const uint8_t* rxbuf,
+                     unsigned int fill)
+{
+    char line[SR_HANDOVER_LINE];
+    char* msg;
+    FILE* arp;
+    uint64_t start = sr_now_ns();
+    int fds[2], hlen, ret = -1;
+
+    if (sr_handover_recv(cfd, line, sizeof(line), 0, 0) < 0 ||
+        strcmp(line, "take\n") != 0)
+    {
+        fprintf(stderr, "Hot restart: the new router went away\n");
+        close(cfd);
+        return -1;
+    }
+
+    /* -- unshaped, so nothing waits for the timer -- */
+    if (sr->egress_limit)
+    { sr_egress_set_rate(sr, 0, 0, 0); }
+
+    if ((fds[1] = sr_handover_memfile("sr-arp", &arp)) < 0)
+    {
+        close(cfd);
+        return -1;
+    }
+    if (sr_arpcache_write(&(sr->cache), arp) != 0 || fclose(arp) != 0)
+    {
+        fprintf(stderr, "Hot restart: cannot write the ARP cache\n");
+        close(fds[1]);
+        close(cfd);
+        return -1;
+    }
+    fds[0] = sr->sockfd;
+
+    if ((msg = (char*)malloc(fill + SR_HANDOVER_LINE)) != 0)
+    {
+        hlen = snprintf(msg, SR_HANDOVER_LINE, "go %u\n", fill);
+        memcpy(msg + hlen, rxbuf, fill);
+        ret = sr_handover_send(cfd, msg, hlen + fill, fds, 2);
+        free(msg);
+    }
+    close(fds[1]);
+    close(cfd);
+
+    if (ret == 0)
+    {
+        printf("Hot restart: handed the VNS session over in %llu us\n",
+               (unsigned long long)((sr_now_ns() - start) / 1000));
+    }
+    return ret;
+} /* -- sr_handover_give -- */
@@ -0,0 +1,59 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_handover.h
+ *
+ * Description:
+ *
+ * Hot restart (-H path).  A router started with -H listens on the unix
+ * socket path; a new one started with the same -H, a new binary say,
+ * finds it there and takes over its VNS session instead of opening one:
+ *
+ *   state  the running router sends its interfaces and routes (in the
+ *          -i and rtable formats, as memfds) and its ECMP seed, and goes
+ *          on forwarding while the new one loads them and sets up;
+ *   take   the new one, about to enter its event loop, asks for the
+ *          session;
+ *   go     the running router stops reading the VNS socket, sends what
+ *          its egress queues hold, and passes the socket, its ARP cache
+ *          and the part of a VNS command it had read so far, then exits.
+ *
+ * Forwarding stops only between take and go.  Without a router at path
+ * the new one connects to the server as usual, and listens on path for
+ * the next.  Pending ARP requests and their packets, the IPv6 neighbor
+ * cache and NAT mappings are not handed over.
+ *
+ * Only the epoll event loop (-E) with the VNS transport hands over.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_HANDOVER_H
+#define SR_HANDOVER_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#define SR_HANDOVER_VERSION 1
+#define SR_HANDOVER_TIMEOUT 5     /* seconds to wait for the running router */
+
+struct sr_instance;
+
+/* -- the new router's side, from state until go -- */
+struct sr_handover
+{
+    int fd;                 /* SOCK_SEQPACKET to the running router */
+    uint32_t ecmp_seed;     /* its flow hash seed, so flows keep their paths */
+};
+
+int sr_handover_begin(struct sr_instance* sr);
+int sr_handover_finish(struct sr_instance* sr, uint8_t* rxbuf,
+                       unsigned int size, unsigned int* fill);
+int sr_handover_listen(struct sr_instance* sr);
+int sr_handover_offer(struct sr_instance* sr, int lfd);
+int sr_handover_give(struct sr_instance* sr, int cfd, const uint8_t* rxbuf,
+                     unsigned int fill);
+
+#endif /* SR_HANDOVER_H */
@@ -54,6 +54,32 @@ struct sr_if* sr_get_interface(struct sr_instance* sr, const char* name)
     return 0;
 } /* -- sr_get_interface -- */
 
+/*---------------------------------------------------------------------
+ * Method: sr_get_interface_ip6
+ * Scope: Global
+ *
+ * The interface with the given global or link-local IPv6 address, or 0.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_if* sr_get_interface_ip6(struct sr_instance* sr, const uint8_t* ip6)
+{
+    struct sr_if* if_walker;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+    assert(ip6);
+
+    for(if_walker = sr->if_list; if_walker; if_walker = if_walker->next)
+    {
+        if(memcmp(if_walker->ip6_ll, ip6, 16) == 0 ||
+           (if_walker->ip6_plen && memcmp(if_walker->ip6, ip6, 16) == 0))
+        { return if_walker; }
+    }
+
+    return 0;
+} /* -- sr_get_interface_ip6 -- */
+
 /*--------------------------------------------------------------------- 
  * Method: sr_add_interface(..)
  * Scope: Global
@@ -73,7 +99,7 @@ void sr_add_interface(struct sr_instance* sr, const char* name)
     /* -- empty list special case -- */
     if(sr->if_list == 0)
     {
-        sr->if_list = (struct sr_if*)malloc(sizeof(struct sr_if));
+        sr->if_list = (struct sr_if*)calloc(1, sizeof(struct sr_if));
         assert(sr->if_list);
         sr->if_list->next = 0;
         strncpy(sr->if_list->name,name,sr_IFACE_NAMELEN);
@@ -85,13 +111,45 @@ void sr_add_interface(struct sr_instance* sr, const char* name)
     while(if_walker->next)
     {if_walker = if_walker->next; }
 
-    if_walker->next = (struct sr_if*)malloc(sizeof(struct sr_if));
+    if_walker->next = (struct sr_if*)calloc(1, sizeof(struct sr_if));
     assert(if_walker->next);
     if_walker = if_walker->next;
     strncpy(if_walker->name,name,sr_IFACE_NAMELEN);
     if_walker->next = 0;
 } /* -- sr_add_interface -- */ 
 
+/*---------------------------------------------------------------------
+ * Method: sr_if_set_ether_addr(..)
+ * Scope: Global
+ *
+ * set the ethernet address of iface, and the link-local IPv6 address
+ * made from it
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_if_set_ether_addr(struct sr_if* iface, const unsigned char* addr)
+{
+    /* -- REQUIRES -- */
+    assert(iface);
+
+    /* -- copy address -- */
+    memcpy(iface->addr,addr,6);
+
+    /* -- fe80::/64 with the modified EUI-64 interface identifier -- */
+    memset(iface->ip6_ll, 0, 16);
+    iface->ip6_ll[0] = 0xfe;
+    iface->ip6_ll[1] = 0x80;
+    iface->ip6_ll[8] = addr[0] ^ 0x02;
+    iface->ip6_ll[9] = addr[1];
+    iface->ip6_ll[10] = addr[2];
+    iface->ip6_ll[11] = 0xff;
+    iface->ip6_ll[12] = 0xfe;
+    iface->ip6_ll[13] = addr[3];
+    iface->ip6_ll[14] = addr[4];
+    iface->ip6_ll[15] = addr[5];
+
+} /* -- sr_if_set_ether_addr -- */
+
 /*--------------------------------------------------------------------- 
  * Method: sr_sat_ether_addr(..)
  * Scope: Global
@@ -111,8 +169,7 @@ void sr_set_ether_addr(struct sr_instance* sr, const unsigned char* addr)
     while(if_walker->next)
     {if_walker = if_walker->next; }
 
-    /* -- copy address -- */
-    memcpy(if_walker->addr,addr,6);
+    sr_if_set_ether_addr(if_walker, addr);
 
 } /* -- sr_set_ether_addr -- */
 
@@ -140,6 +197,29 @@ void sr_set_ether_ip(struct sr_instance* sr, uint32_t ip_nbo)
 
 } /* -- sr_set_ether_ip -- */
 
+/*--------------------------------------------------------------------- 
+ * Method: sr_set_ether_speed(..)
+ * Scope: Global
+ *
+ * set the link speed (Mbit/s) of the LAST interface in the interface list
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_set_ether_speed(struct sr_instance* sr, uint32_t mbit)
+{
+    struct sr_if* if_walker = 0;
+
+    /* -- REQUIRES -- */
+    assert(sr->if_list);
+    
+    if_walker = sr->if_list;
+    while(if_walker->next)
+    {if_walker = if_walker->next; }
+
+    if_walker->speed = mbit;
+
+} /* -- sr_set_ether_speed -- */
+
 /*--------------------------------------------------------------------- 
  * Method: sr_print_if_list(..)
  * Scope: Global
@@ -180,6 +260,7 @@ void sr_print_if_list(struct sr_instance* sr)
 void sr_print_if(struct sr_if* iface)
 {
     struct in_addr ip_addr;
+    char ip6_str[INET6_ADDRSTRLEN];
 
     /* -- REQUIRES --*/
     assert(iface);
@@ -191,4 +272,14 @@ void sr_print_if(struct sr_if* iface)
     DebugMAC(iface->addr);
     Debug("\n");
     Debug("\tinet addr %s\n",inet_ntoa(ip_addr));
+    if(iface->speed)
+    { Debug("\tspeed %u Mbit/s\n",iface->speed); }
+    Debug("\tinet6 addr %s/64 (link)\n",
+          inet_ntop(AF_INET6, iface->ip6_ll, ip6_str, sizeof(ip6_str)));
+    if(iface->ip6_plen)
+    {
+        Debug("\tinet6 addr %s/%d\n",
+              inet_ntop(AF_INET6, iface->ip6, ip6_str, sizeof(ip6_str)),
+              iface->ip6_plen);
+    }
 } /* -- sr_print_if -- */
@@ -27,6 +27,7 @@
 #include "sr_protocol.h"
 
 struct sr_instance;
+struct sr_egress_if;
 
 /* ----------------------------------------------------------------------------
  * struct sr_if
@@ -35,19 +36,39 @@ struct sr_instance;
  *
  * -------------------------------------------------------------------------- */
 
+/* -- packet sampling state of an interface, see sr_sflow.h -- */
+struct sr_if_sflow
+{
+  uint32_t rate_in;       /* 1 in N frames received, 0 for off */
+  uint32_t rate_out;      /* 1 in N frames sent */
+  uint32_t skip_out;      /* frames to send until the next sample */
+  uint64_t pool_in;       /* frames received, estimated */
+  uint64_t pool_out;      /* frames sent while sampling */
+  uint64_t samples_in;
+  uint64_t samples_out;
+};
+
 struct sr_if
 {
   char name[sr_IFACE_NAMELEN];
   unsigned char addr[ETHER_ADDR_LEN];
   uint32_t ip;
-  uint32_t speed;
+  uint32_t speed;      /* link speed, Mbit/s, 0 if unknown */
+  uint8_t ip6[16];    /* global IPv6 address */
+  int ip6_plen;       /* its prefix length, 0 for no address */
+  uint8_t ip6_ll[16]; /* link-local address, derived from addr (EUI-64) */
+  struct sr_if_sflow sflow;
+  struct sr_egress_if* egress; /* -Q queues, see sr_egress.h, or NULL */
   struct sr_if* next;
 };
 
 struct sr_if* sr_get_interface(struct sr_instance* sr, const char* name);
+struct sr_if* sr_get_interface_ip6(struct sr_instance* sr, const uint8_t* ip6);
 void sr_add_interface(struct sr_instance*, const char*);
 void sr_set_ether_addr(struct sr_instance*, const unsigned char*);
+void sr_if_set_ether_addr(struct sr_if*, const unsigned char*);
 void sr_set_ether_ip(struct sr_instance*, uint32_t ip_nbo);
+void sr_set_ether_speed(struct sr_instance*, uint32_t mbit);
 void sr_print_if_list(struct sr_instance*);
 void sr_print_if(struct sr_if*);
 
@@ -0,0 +1,590 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_ip6.c
+ *
+ * Description:
+ *
+ * IPv6 forwarding plane, see sr_ip6.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <time.h>
+
+#include "sr_if.h"
+#include "sr_router.h"
+#include "sr_protocol.h"
+#include "sr_cksum.h"
+#include "sr_fib6.h"
+#include "sr_ndcache.h"
+#include "sr_ip6.h"
+
+#define SR_IP6_HLIM    64   /* hop limit of packets the router originates */
+#define SR_IP6_ND_HLIM 255  /* neighbor discovery never crosses a router */
+
+#define SR_IP6_HDRS (sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip6_hdr_t))
+#define SR_IP6_ND_LEN (sizeof(sr_nd_hdr_t) + sizeof(sr_nd_opt_lla_t))
+
+static const uint8_t sr_ip6_all_nodes[16] =
+{ 0xff, 0x02, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x01 };
+
+static int sr_ip6_is_unspec(const uint8_t* a)
+{
+    static const uint8_t zero[16];
+
+    return memcmp(a, zero, 16) == 0;
+} /* -- sr_ip6_is_unspec -- */
+
+static int sr_ip6_is_ll(const uint8_t* a)
+{
+    return a[0] == 0xfe && (a[1] & 0xc0) == 0x80;
+} /* -- sr_ip6_is_ll -- */
+
+/* -- ff02::1:ffXX:XXXX, the solicited-node group of addr -- */
+static void sr_ip6_solicited(const uint8_t* addr, uint8_t* group)
+{
+    memset(group, 0, 16);
+    group[0] = 0xff;
+    group[1] = 0x02;
+    group[11] = 0x01;
+    group[12] = 0xff;
+    memcpy(group + 13, addr + 13, 3);
+} /* -- sr_ip6_solicited -- */
+
+/* -- source address for what the router sends out iface -- */
+static const uint8_t* sr_ip6_source(const struct sr_if* iface)
+{
+    return iface->ip6_plen ? iface->ip6 : iface->ip6_ll;
+} /* -- sr_ip6_source -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ip6_cksum(..)
+ * Scope:  Local
+ *
+ * Upper layer checksum over the pseudo header of ip6 and plen bytes of
+ * payload, as stored in the packet.  Over a payload that carries its
+ * checksum the result is 0 if it is right.
+ *
+ *---------------------------------------------------------------------*/
+
+static uint16_t sr_ip6_cksum(const sr_ip6_hdr_t* ip6, const uint8_t* payload,
+                             unsigned int plen)
+{
+    uint32_t pseudo[2];
+    uint32_t sum;
+
+    pseudo[0] = htonl(plen);
+    pseudo[1] = htonl(ip6->ip6_nxt);
+    sum = (uint32_t)sr_cksum_sum(ip6->ip6_src, 32) +
+          sr_cksum_sum(pseudo, sizeof(pseudo)) +
+          sr_cksum_sum(payload, plen);
+    sum = (sum & 0xffff) + (sum >> 16);
+    sum = (sum & 0xffff) + (sum >> 16);
+    return (uint16_t)~sum;
+} /* -- sr_ip6_cksum -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ip6_build(..)
+ * Scope:  Local
+ *
+ * Allocate a frame with an IPv6 header and room for plen bytes of
+ * ICMPv6 behind it.  Returns NULL if out of memory.
+ *
+ *---------------------------------------------------------------------*/
+
+static uint8_t* sr_ip6_build(const unsigned char* dhost, const struct sr_if* out,
+                             const uint8_t* src, const uint8_t* dst,
+                             unsigned int plen, uint8_t hlim)
+{
+    uint8_t* buf = (uint8_t*)calloc(1, SR_IP6_HDRS + plen);
+    sr_ethernet_hdr_t* eth = (sr_ethernet_hdr_t*)buf;
+    sr_ip6_hdr_t* ip6 = (sr_ip6_hdr_t*)(buf + sizeof(sr_ethernet_hdr_t));
+
+    if (buf == 0)
+    { return 0; }
+    memcpy(eth->ether_dhost, dhost, ETHER_ADDR_LEN);
+    memcpy(eth->ether_shost, out->addr, ETHER_ADDR_LEN);
+    eth->ether_type = htons(ethertype_ip6);
+    ip6->ip6_flow = htonl(6 << 28);
+    ip6->ip6_plen = htons(plen);
+    ip6->ip6_nxt = ip_protocol_icmp6;
+    ip6->ip6_hlim = hlim;
+    memcpy(ip6->ip6_src, src, 16);
+    memcpy(ip6->ip6_dst, dst, 16);
+    return buf;
+} /* -- sr_ip6_build -- */
+
+/* -- checksum the ICMPv6 message of a frame from sr_ip6_build and send it -- */
+static void sr_ip6_send(struct sr_instance* sr, uint8_t* buf, unsigned int plen,
+                        const char* iface)
+{
+    sr_ip6_hdr_t* ip6 = (sr_ip6_hdr_t*)(buf + sizeof(sr_ethernet_hdr_t));
+    sr_icmp6_hdr_t* icmp6 = (sr_icmp6_hdr_t*)(buf + SR_IP6_HDRS);
+
+    icmp6->icmp6_sum = 0;
+    icmp6->icmp6_sum = sr_ip6_cksum(ip6, (uint8_t*)icmp6, plen);
+    sr_send_control_packet(sr, buf, SR_IP6_HDRS + plen, iface);
+    free(buf);
+} /* -- sr_ip6_send -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ip6_send_error(..)
+ * Scope:  Local
+ *
+ * Send an ICMPv6 error about packet back out in_if, where it came from.
+ * As much of the packet is quoted as fits in the minimum MTU.  Never
+ * about an error, or a packet from or to a multicast or unspecified
+ * address (RFC 4443 2.4).
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_ip6_send_error(struct sr_instance* sr, const uint8_t* packet,
+                              unsigned int len, const struct sr_if* in_if,
+                              int type, int code)
+{
+    const sr_ethernet_hdr_t* eth = (const sr_ethernet_hdr_t*)packet;
+    const sr_ip6_hdr_t* ip6 = (const sr_ip6_hdr_t*)(packet + sizeof(sr_ethernet_hdr_t));
+    sr_icmp6_hdr_t* icmp6;
+    unsigned int quote = len - sizeof(sr_ethernet_hdr_t);
+    uint8_t* buf;
+
+    if (in_if == 0 || ip6->ip6_src[0] == 0xff || ip6->ip6_dst[0] == 0xff ||
+        sr_ip6_is_unspec(ip6->ip6_src))
+    { return; }
+    if (ip6->ip6_nxt == ip_protocol_icmp6 && len > SR_IP6_HDRS &&
+        packet[SR_IP6_HDRS] < icmp6_type_echo_request)
+    { return; }
+
+    if (quote > IP6_MIN_MTU - sizeof(sr_ip6_hdr_t) - sizeof(sr_icmp6_hdr_t))
+    { quote = IP6_MIN_MTU - sizeof(sr_ip6_hdr_t) - sizeof(sr_icmp6_hdr_t); }
+
+    if ((buf = sr_ip6_build(eth->ether_shost, in_if, sr_ip6_source(in_if),
+                            ip6->ip6_src, sizeof(*icmp6) + quote,
+                            SR_IP6_HLIM)) == 0)
+    { return; }
+    icmp6 = (sr_icmp6_hdr_t*)(buf + SR_IP6_HDRS);
+    icmp6->icmp6_type = type;
+    icmp6->icmp6_code = code;
+    memcpy(icmp6 + 1, ip6, quote);
+    sr_ip6_send(sr, buf, sizeof(*icmp6) + quote, in_if->name);
+} /* -- sr_ip6_send_error -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ip6_nd_lla(..)
+ * Scope:  Local
+ *
+ * The MAC in the link-layer address option of the given type among the
+ * ND options opts[0..len), or NULL.  Malformed options count as absent.
+ *
+ *---------------------------------------------------------------------*/
+
+static const uint8_t* sr_ip6_nd_lla(const uint8_t* opts, unsigned int len,
+                                    int type)
+{
+    const sr_nd_opt_lla_t* opt;
+    unsigned int n;
+
+    while (len >= sizeof(*opt))
+    {
+        opt = (const sr_nd_opt_lla_t*)opts;
+        n = opt->opt_len * 8;
+        if (n == 0 || n > len)
+        { return 0; }
+        if (opt->opt_type == type && n == sizeof(*opt))
+        { return opt->opt_mac; }
+        opts += n;
+        len -= n;
+    }
+    return 0;
+} /* -- sr_ip6_nd_lla -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ip6_send_ns(..)
+ * Scope:  Local
+ *
+ * Multicast a neighbor solicitation for req's address out its
+ * interface.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_ip6_send_ns(struct sr_instance* sr, const struct sr_ndreq* req)
+{
+    struct sr_if* out = sr_get_interface(sr, req->iface);
+    unsigned char dhost[ETHER_ADDR_LEN];
+    uint8_t group[16];
+    sr_nd_hdr_t* ns;
+    sr_nd_opt_lla_t* opt;
+    uint8_t* buf;
+
+    if (out == 0)
+    { return; }
+    sr_ip6_solicited(req->ip, group);
+    dhost[0] = 0x33;
+    dhost[1] = 0x33;
+    memcpy(dhost + 2, group + 12, 4);
+
+    if ((buf = sr_ip6_build(dhost, out, sr_ip6_source(out), group,
+                            SR_IP6_ND_LEN, SR_IP6_ND_HLIM)) == 0)
+    { return; }
+    ns = (sr_nd_hdr_t*)(buf + SR_IP6_HDRS);
+    ns->nd_type = icmp6_type_neighbor_solicit;
+    memcpy(ns->nd_target, req->ip, 16);
+    opt = (sr_nd_opt_lla_t*)(ns + 1);
+    opt->opt_type = nd_opt_source_lla;
+    opt->opt_len = 1;
+    memcpy(opt->opt_mac, out->addr, ETHER_ADDR_LEN);
+    sr_ip6_send(sr, buf, SR_IP6_ND_LEN, out->name);
+} /* -- sr_ip6_send_ns -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ip6_flush(..)
+ * Scope:  Local
+ *
+ * Forward the packets that waited on req to mac, now resolved, and
+ * destroy req.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_ip6_flush(struct sr_instance* sr, struct sr_ndreq* req,
+                         const unsigned char* mac)
+{
+    struct sr_if* out = sr_get_interface(sr, req->iface);
+    struct sr_packet* pkt;
+    sr_ethernet_hdr_t* eth;
+    sr_ip6_hdr_t* ip6;
+
+    for (pkt = req->packets; out && pkt; pkt = pkt->next)
+    {
+        eth = (sr_ethernet_hdr_t*)pkt->buf;
+        ip6 = (sr_ip6_hdr_t*)(pkt->buf + sizeof(sr_ethernet_hdr_t));
+        memcpy(eth->ether_dhost, mac, ETHER_ADDR_LEN);
+        memcpy(eth->ether_shost, out->addr, ETHER_ADDR_LEN);
+        ip6->ip6_hlim--;
+        sr_send_pbuf(sr, pkt->pb, out->name);
+    }
+    sr_ndreq_destroy(&(sr->nd), req);
+} /* -- sr_ip6_flush -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ip6_handle_ndreq(..)
+ * Scope:  Global
+ *
+ * Solicit at most once a second; after 5 unanswered solicitations tell
+ * the sources of the waiting packets the address is unreachable and
+ * drop the request.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_ip6_handle_ndreq(struct sr_instance* sr, struct sr_ndreq* req)
+{
+    struct sr_packet* pkt;
+    time_t now = time(0);
+
+    SR_NDCACHE_LOCK(&(sr->nd));
+
+    if (difftime(now, req->sent) > 1.0)
+    {
+        if (req->times_sent >= 5)
+        {
+            for (pkt = req->packets; pkt; pkt = pkt->next)
+            {
+                sr_ip6_send_error(sr, pkt->buf, pkt->len,
+                                  sr_get_interface(sr, pkt->iface),
+                                  icmp6_type_unreach, icmp6_unreach_addr);
+            }
+            sr_ndreq_destroy(&(sr->nd), req);
+        }
+        else
+        {
+            sr_ip6_send_ns(sr, req);
+            req->sent = now;
+            req->times_sent++;
+        }
+    }
+
+    SR_NDCACHE_UNLOCK(&(sr->nd));
+} /* -- sr_ip6_handle_ndreq -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ip6_solicit_in(..)
+ * Scope:  Local
+ *
+ * A neighbor solicitation received on in_if: learn the sender and
+ * advertise ourselves if one of in_if's addresses is the target.
+ * Duplicate address detection (unspecified source) is not answered.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_ip6_solicit_in(struct sr_instance* sr, const uint8_t* packet,
+                              unsigned int plen, struct sr_if* in_if)
+{
+    const sr_ethernet_hdr_t* eth = (const sr_ethernet_hdr_t*)packet;
+    const sr_ip6_hdr_t* ip6 = (const sr_ip6_hdr_t*)(packet + sizeof(sr_ethernet_hdr_t));
+    const sr_nd_hdr_t* ns = (const sr_nd_hdr_t*)(packet + SR_IP6_HDRS);
+    const uint8_t* slla;
+    struct sr_ndreq* req;
+    sr_nd_hdr_t* na;
+    sr_nd_opt_lla_t* opt;
+    uint8_t* buf;
+
+    if (sr_get_interface_ip6(sr, ns->nd_target) != in_if ||
+        sr_ip6_is_unspec(ip6->ip6_src))
+    { return; }
+
+    slla = sr_ip6_nd_lla((const uint8_t*)(ns + 1), plen - sizeof(*ns),
+                         nd_opt_source_lla);
+    if (slla && (req = sr_ndcache_insert(&(sr->nd), slla, ip6->ip6_src)) != 0)
+    { sr_ip6_flush(sr, req, slla); }
+
+    if ((buf = sr_ip6_build(slla ? slla : eth->ether_shost, in_if,
+                            ns->nd_target, ip6->ip6_src, SR_IP6_ND_LEN,
+                            SR_IP6_ND_HLIM)) == 0)
+    { return; }
+    na = (sr_nd_hdr_t*)(buf + SR_IP6_HDRS);
+    na->nd_type = icmp6_type_neighbor_advert;
+    na->nd_flags = htonl(ND_NA_ROUTER | ND_NA_SOLICITED | ND_NA_OVERRIDE);
+    memcpy(na->nd_target, ns->nd_target, 16);
+    opt = (sr_nd_opt_lla_t*)(na + 1);
+    opt->opt_type = nd_opt_target_lla;
+    opt->opt_len = 1;
+    memcpy(opt->opt_mac, in_if->addr, ETHER_ADDR_LEN);
+    sr_ip6_send(sr, buf, SR_IP6_ND_LEN, in_if->name);
+} /* -- sr_ip6_solicit_in -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ip6_advert_in(..)
+ * Scope:  Local
+ *
+ * A neighbor advertisement: map its target to the advertised MAC (the
+ * frame's source if there is no option) and send what waited on it.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_ip6_advert_in(struct sr_instance* sr, const uint8_t* packet,
+                             unsigned int plen)
+{
+    const sr_ethernet_hdr_t* eth = (const sr_ethernet_hdr_t*)packet;
+    const sr_nd_hdr_t* na = (const sr_nd_hdr_t*)(packet + SR_IP6_HDRS);
+    const uint8_t* tlla;
+    struct sr_ndreq* req;
+
+    if (na->nd_target[0] == 0xff)
+    { return; }
+    tlla = sr_ip6_nd_lla((const uint8_t*)(na + 1), plen - sizeof(*na),
+                         nd_opt_target_lla);
+    if (tlla == 0)
+    { tlla = eth->ether_shost; }
+
+    if ((req = sr_ndcache_insert(&(sr->nd), tlla, na->nd_target)) != 0)
+    { sr_ip6_flush(sr, req, tlla); }
+} /* -- sr_ip6_advert_in -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ip6_echo(..)
+ * Scope:  Local
+ *
+ * Answer an echo request received on in_if, from the address it was
+ * sent to if that is ours (to_if), else from in_if's.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_ip6_echo(struct sr_instance* sr, const uint8_t* packet,
+                        unsigned int plen, struct sr_if* in_if,
+                        const struct sr_if* to_if)
+{
+    const sr_ethernet_hdr_t* eth = (const sr_ethernet_hdr_t*)packet;
+    const sr_ip6_hdr_t* ip6 = (const sr_ip6_hdr_t*)(packet + sizeof(sr_ethernet_hdr_t));
+    sr_icmp6_hdr_t* icmp6;
+    uint8_t* buf;
+
+    if (ip6->ip6_src[0] == 0xff || sr_ip6_is_unspec(ip6->ip6_src))
+    { return; }
+    if ((buf = sr_ip6_build(eth->ether_shost, in_if,
+                            to_if ? ip6->ip6_dst : sr_ip6_source(in_if),
+                            ip6->ip6_src, plen, SR_IP6_HLIM)) == 0)
+    { return; }
+    memcpy(buf + SR_IP6_HDRS, packet + SR_IP6_HDRS, plen);
+    icmp6 = (sr_icmp6_hdr_t*)(buf + SR_IP6_HDRS);
+    icmp6->icmp6_type = icmp6_type_echo_reply;
+    icmp6->icmp6_code = 0;
+    sr_ip6_send(sr, buf, plen, in_if->name);
+} /* -- sr_ip6_echo -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ip6_icmp_in(..)
+ * Scope:  Local
+ *
+ * An ICMPv6 message for the router.  ND messages must come with hop
+ * limit 255, so from the link itself (RFC 4861 7.1).
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_ip6_icmp_in(struct sr_instance* sr, const uint8_t* packet,
+                           unsigned int plen, struct sr_if* in_if,
+                           const struct sr_if* to_if)
+{
+    const sr_ip6_hdr_t* ip6 = (const sr_ip6_hdr_t*)(packet + sizeof(sr_ethernet_hdr_t));
+    const sr_icmp6_hdr_t* icmp6 = (const sr_icmp6_hdr_t*)(packet + SR_IP6_HDRS);
+    int nd;
+
+    if (plen < sizeof(*icmp6) ||
+        sr_ip6_cksum(ip6, (const uint8_t*)icmp6, plen) != 0)
+    { return; }
+
+    nd = (icmp6->icmp6_type == icmp6_type_neighbor_solicit ||
+          icmp6->icmp6_type == icmp6_type_neighbor_advert);
+    if (nd && (ip6->ip6_hlim != SR_IP6_ND_HLIM || icmp6->icmp6_code != 0 ||
+               plen < sizeof(sr_nd_hdr_t)))
+    { return; }
+
+    switch (icmp6->icmp6_type)
+    {
+        case icmp6_type_echo_request:
+            sr_ip6_echo(sr, packet, plen, in_if, to_if);
+            break;
+        case icmp6_type_neighbor_solicit:
+            sr_ip6_solicit_in(sr, packet, plen, in_if);
+            break;
+        case icmp6_type_neighbor_advert:
+            sr_ip6_advert_in(sr, packet, plen);
+            break;
+        default:
+            break;
+    }
+} /* -- sr_ip6_icmp_in -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ip6_classify(..)
+ * Scope:  Global
+ *
+ * The IPv6 half of sr_classify_packet.  Frames to one of the router's
+ * addresses, to all nodes or to the solicited-node group of one of its
+ * addresses are forRouter; other multicast frames are dropped.  The
+ * rest are looked up in fib6.  sr_pkt_parse has checked the header.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_ip6_classify(struct sr_instance* sr, const uint8_t* packet,
+                     unsigned int len, struct sr_lookup* lk)
+{
+    const sr_ip6_hdr_t* ip6 = (const sr_ip6_hdr_t*)(packet + lk->info.l3);
+    struct sr_if* iface;
+    uint8_t group[16];
+
+    lk->drop = 0;
+    lk->forRouter = 0;
+    lk->forwarding = 0;
+    lk->longestInterface = 0;
+    lk->longestRoutingTable = 0;
+    lk->route6 = 0;
+    lk->outIf = 0;
+
+    if (ip6->ip6_dst[0] == 0xff)
+    {
+        lk->forRouter = (memcmp(ip6->ip6_dst, sr_ip6_all_nodes, 16) == 0);
+        for (iface = sr->if_list; iface && !lk->forRouter; iface = iface->next)
+        {
+            sr_ip6_solicited(iface->ip6_ll, group);
+            lk->forRouter = (memcmp(ip6->ip6_dst, group, 16) == 0);
+            if (!lk->forRouter && iface->ip6_plen)
+            {
+                sr_ip6_solicited(iface->ip6, group);
+                lk->forRouter = (memcmp(ip6->ip6_dst, group, 16) == 0);
+            }
+        }
+        lk->drop = lk->forRouter ? 0 : SR_DROP_IGNORED;
+        return;
+    }
+
+    if ((lk->longestInterface = sr_get_interface_ip6(sr, ip6->ip6_dst)) != 0)
+    {
+        lk->forRouter = 1;
+        return;
+    }
+
+    if (sr->fib6 && (lk->route6 = sr_fib6_lookup(sr->fib6, ip6->ip6_dst)) != 0)
+    {
+        lk->forwarding = 1;
+        lk->outIf = sr_get_interface(sr, lk->route6->interface);
+    }
+} /* -- sr_ip6_classify -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ip6_dispatch(..)
+ * Scope:  Global
+ *
+ * The IPv6 half of sr_dispatch_packet, for a frame sr_ip6_classify
+ * resolved.  Forwarded packets go to their next hop (the route's
+ * gateway, or the destination for a connected route) once the neighbor
+ * cache knows it, waiting on a solicitation until then.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_ip6_dispatch(struct sr_instance* sr, uint8_t* packet, unsigned int len,
+                     const char* interface, const struct sr_lookup* lk)
+{
+    sr_ethernet_hdr_t* eth = (sr_ethernet_hdr_t*)packet;
+    sr_ip6_hdr_t* ip6 = (sr_ip6_hdr_t*)(packet + sizeof(sr_ethernet_hdr_t));
+    struct sr_if* in_if = lk->info.in_if;
+    unsigned int plen = ntohs(ip6->ip6_plen);
+    unsigned char mac[ETHER_ADDR_LEN];
+    const uint8_t* next_hop;
+    struct sr_ndreq* req;
+    struct sr_rt6* rt = lk->route6;
+
+    if (lk->drop || in_if == 0)
+    { return; }
+
+    if (lk->forRouter)
+    {
+        if (ip6->ip6_nxt == ip_protocol_icmp6)
+        { sr_ip6_icmp_in(sr, packet, plen, in_if, lk->longestInterface); }
+        else if (lk->longestInterface && (ip6->ip6_nxt == ip_protocol_udp ||
+                                          ip6->ip6_nxt == ip_protocol_tcp))
+        {
+            sr_ip6_send_error(sr, packet, len, in_if, icmp6_type_unreach,
+                              icmp6_unreach_port);
+        }
+        return;
+    }
+
+    /* -- link-local and multicast sources never leave their link -- */
+    if (ip6->ip6_src[0] == 0xff || sr_ip6_is_ll(ip6->ip6_dst))
+    { return; }
+    if (sr_ip6_is_ll(ip6->ip6_src))
+    {
+        sr_ip6_send_error(sr, packet, len, in_if, icmp6_type_unreach,
+                          icmp6_unreach_beyond_scope);
+        return;
+    }
+
+    if (!lk->forwarding || lk->outIf == 0)
+    {
+        sr_ip6_send_error(sr, packet, len, in_if, icmp6_type_unreach,
+                          icmp6_unreach_no_route);
+        return;
+    }
+    if (ip6->ip6_hlim <= 1)
+    {
+        sr_ip6_send_error(sr, packet, len, in_if, icmp6_type_time_exceeded, 0);
+        return;
+    }
+
+    next_hop = sr_ip6_is_unspec(rt->gw) ? ip6->ip6_dst : rt->gw;
+    /* -- forwarding threads share the route, see sr_handlepacket -- */
+    __atomic_fetch_add(&rt->tx_packets, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&rt->tx_bytes, len, __ATOMIC_RELAXED);
+
+    if (sr_ndcache_lookup(&(sr->nd), next_hop, mac) == 0)
+    {
+        memcpy(eth->ether_dhost, mac, ETHER_ADDR_LEN);
+        memcpy(eth->ether_shost, lk->outIf->addr, ETHER_ADDR_LEN);
+        ip6->ip6_hlim--;
+        sr_send_packet(sr, packet, len, lk->outIf->name);
+    }
+    else if ((req = sr_ndcache_queuereq(&(sr->nd), next_hop, lk->outIf->name,
+                                        packet, len, interface)) != 0)
+    { sr_ip6_handle_ndreq(sr, req); }
+} /* -- sr_ip6_dispatch -- */
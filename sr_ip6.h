@@ -0,0 +1,42 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_ip6.h
+ *
+ * Description:
+ *
+ * IPv6 forwarding plane.  sr_handlepacket_burst hands IPv6 frames to
+ * sr_ip6_classify in its lookup pass and to sr_ip6_dispatch in its send
+ * pass, as it does IPv4 frames to sr_router.c.
+ *
+ * Frames for the router: echo requests are answered, neighbor
+ * solicitations for one of its addresses get an advertisement and
+ * advertisements feed the neighbor cache (sr_ndcache.h); TCP and UDP
+ * get port unreachable.  Other frames are forwarded by longest prefix
+ * match in sr->fib6, with time exceeded, no route and address
+ * unreachable errors as for IPv4.
+ *
+ * Not handled: extension headers (a packet's next header is taken as its
+ * upper layer protocol), path MTU (no packet too big; the IPv4 side
+ * does not fragment either), router advertisements, multipath routes.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_IP6_H
+#define SR_IP6_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+struct sr_instance;
+struct sr_lookup;
+struct sr_ndreq;
+
+void sr_ip6_classify(struct sr_instance* sr, const uint8_t* packet,
+                     unsigned int len, struct sr_lookup* lk);
+void sr_ip6_dispatch(struct sr_instance* sr, uint8_t* packet, unsigned int len,
+                     const char* interface, const struct sr_lookup* lk);
+
+/* -- solicit req's neighbor again or, after 5 tries, give up on it -- */
+void sr_ip6_handle_ndreq(struct sr_instance* sr, struct sr_ndreq* req);
+
+#endif /* -- SR_IP6_H -- */
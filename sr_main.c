@@ -23,6 +23,7 @@
 #include <string.h>
 #include <unistd.h>
 #include <pwd.h>
+#include <time.h>
 #include <sys/types.h>
 
 #ifdef _LINUX_
@@ -32,6 +33,13 @@
 #include "sr_dumper.h"
 #include "sr_router.h"
 #include "sr_rt.h"
+#include "sr_nat.h"
+#include "sr_acl.h"
+#include "sr_fib6.h"
+#include "sr_trace.h"
+#include "sr_sflow.h"
+#include "sr_egress.h"
+#include "sr_handover.h"
 
 extern char* optarg;
 
@@ -46,10 +54,10 @@ extern char* optarg;
 #define DEFAULT_TOPO 0
 
 static void usage(char* );
-static void sr_init_instance(struct sr_instance* );
-static void sr_destroy_instance(struct sr_instance* );
-static void sr_set_user(struct sr_instance* );
-static void sr_load_rt_wrap(struct sr_instance* sr, char* rtable);
+static void sr_load_rt_wrap(struct sr_instance* sr, char* rtable, char* mrt);
+static void sr_stop_handler(int sig);
+
+volatile sig_atomic_t sr_stop_requested = 0;
 
 /*-----------------------------------------------------------------------------
  *---------------------------------------------------------------------------*/
@@ -65,11 +73,30 @@ int main(int argc, char **argv)
     unsigned int port = DEFAULT_PORT;
     unsigned int topo = DEFAULT_TOPO;
     char *logfile = 0;
+    char *ctl_path = 0;
+    char *instances = 0;
+    int loop_mode = -1;
+    int use_uring = 0;
+    char *netdev = 0;
+    char *ifconfig = 0;
+    int queues = 1;
+    char *nat = 0;
+    char *acl = 0;
+    char *mrt = 0;
+    int compress = 0;
+    char *trace = 0;
+    char *sflow = 0;
+    char *arp = 0;
+    char *handover = 0;
+    int retry = SR_VNS_RETRY_DEFAULT;
+    unsigned int egress = 0;
+    uint32_t egress_rate = 0;
+    struct sigaction sa;
     struct sr_instance sr;
 
     printf("Using %s\n", VERSION_INFO);
 
-    while ((c = getopt(argc, argv, "hs:v:p:u:t:r:l:T:")) != EOF)
+    while ((c = getopt(argc, argv, "hs:v:p:u:t:r:l:T:c:f:EMUd:i:q:N:A:b:zL:S:a:Q:B:H:R:")) != EOF)
     {
         switch (c)
         {
@@ -101,16 +128,101 @@ int main(int argc, char **argv)
             case 'T':
                 template = optarg;
                 break;
+            case 'c':
+                ctl_path = optarg;
+                break;
+            case 'f':
+                instances = optarg;
+                break;
+            case 'E':
+                loop_mode = SR_LOOP_EVENT;
+                break;
+            case 'M':
+                loop_mode = SR_LOOP_THREADS;
+                break;
+            case 'U':
+                loop_mode = SR_LOOP_EVENT;
+                use_uring = 1;
+                break;
+            case 'd':
+                netdev = optarg;
+                break;
+            case 'i':
+                ifconfig = optarg;
+                break;
+            case 'q':
+                queues = atoi((char *) optarg);
+                break;
+            case 'N':
+                nat = optarg;
+                break;
+            case 'A':
+                acl = optarg;
+                break;
+            case 'b':
+                mrt = optarg;
+                break;
+            case 'z':
+                compress = 1;
+                break;
+            case 'L':
+                trace = optarg;
+                break;
+            case 'S':
+                sflow = optarg;
+                break;
+            case 'a':
+                arp = optarg;
+                break;
+            case 'Q':
+                egress = strtoul(optarg, 0, 10);
+                break;
+            case 'B':
+                egress_rate = strtoul(optarg, 0, 10);
+                break;
+            case 'H':
+                handover = optarg;
+                break;
+            case 'R':
+                retry = atoi((char *) optarg);
+                break;
         } /* switch */
     } /* -- while -- */
 
+    /* -- seed once for the whole process (ARP cache eviction) -- */
+    srand(time(NULL));
+
+    /* -- binary event trace for all routers: -L file[:level] -- */
+    if(trace)
+    {
+        char* level = strchr(trace, ':');
+        int lvl = SR_TRACE_WARN;
+
+        if(level)
+        {
+            *level++ = '\0';
+            if((lvl = sr_trace_parse_level(level)) < 0)
+            {
+                fprintf(stderr,"Unknown trace level %s\n", level);
+                exit(1);
+            }
+        }
+        if(sr_trace_start(trace, lvl) != 0)
+        { exit(1); }
+    }
+
+    /* -- one router per line of the instance file, each on its own thread -- */
+    if(instances)
+    { return sr_multi_run(instances, user, loop_mode, use_uring, ctl_path); }
+
     /* -- zero out sr instance -- */
     sr_init_instance(&sr);
+    sr.rt_compress = compress;
 
     /* -- set up routing table from file -- */
     if(template == NULL) {
         sr.template[0] = '\0';
-        sr_load_rt_wrap(&sr, rtable);
+        sr_load_rt_wrap(&sr, rtable, mrt);
     }
     else
         strncpy(sr.template, template, 30);
@@ -118,6 +230,83 @@ int main(int argc, char **argv)
     sr.topo_id = topo;
     strncpy(sr.host,host,32);
 
+    /* -- single threaded event loop unless there are cores to spare -- */
+    if(loop_mode < 0)
+    {
+        loop_mode = (sysconf(_SC_NPROCESSORS_ONLN) <= SR_EVENT_LOOP_MAX_CPUS) ?
+                    SR_LOOP_EVENT : SR_LOOP_THREADS;
+    }
+    sr.loop_mode = loop_mode;
+    sr.use_uring = use_uring;
+
+    if(ctl_path)
+    { strncpy(sr.ctl_path, ctl_path, sizeof(sr.ctl_path) - 1); }
+
+    /* -- NAT outside interface and optional table size: -N eth2[:mappings] -- */
+    if(nat)
+    {
+        char* mappings = strchr(nat, ':');
+
+        if(mappings)
+        {
+            *mappings++ = '\0';
+            sr.nat_mappings = strtoul(mappings, 0, 10);
+        }
+        strncpy(sr.nat_if, nat, sizeof(sr.nat_if) - 1);
+    }
+
+    if(acl)
+    { strncpy(sr.acl_path, acl, sizeof(sr.acl_path) - 1); }
+
+    /* -- sample export file and the rate of every interface: -S file[:rate] -- */
+    if(sflow)
+    {
+        char* rate = strchr(sflow, ':');
+
+        sr.sflow_rate = SR_SFLOW_DEFAULT_RATE;
+        if(rate)
+        {
+            *rate++ = '\0';
+            sr.sflow_rate = strtoul(rate, 0, 10);
+        }
+        strncpy(sr.sflow_path, sflow, sizeof(sr.sflow_path) - 1);
+    }
+
+    /* -- egress scheduler, packets each queue holds: -Q limit; shaping
+     *    at -B Mbit/s needs the queues too -- */
+    if(egress_rate && !egress)
+    { egress = SR_EGRESS_DEFAULT_LIMIT; }
+    sr.egress_limit = egress;
+    sr.egress_rate = egress_rate;
+
+    /* -- ARP cache snapshot, also taken on SIGINT and SIGTERM: -a file -- */
+    if(arp)
+    {
+        strncpy(sr.arp_path, arp, sizeof(sr.arp_path) - 1);
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = sr_stop_handler;
+        sa.sa_flags = SA_RESTART;
+        sigemptyset(&sa.sa_mask);
+        sigaction(SIGINT, &sa, 0);
+        sigaction(SIGTERM, &sa, 0);
+    }
+
+    /* -- hot restart socket: -H path, VNS and the epoll loop only -- */
+    if(handover)
+    {
+        if(sr.loop_mode != SR_LOOP_EVENT || sr.use_uring ||
+           (netdev && strcmp(netdev, sr_netdev_vns.name) != 0))
+        {
+            fprintf(stderr,"Hot restart (-H) needs the VNS transport and the "
+                    "event loop (-E)\n");
+            exit(1);
+        }
+        strncpy(sr.handover_path, handover, sizeof(sr.handover_path) - 1);
+    }
+
+    /* -- seconds to try reopening a lost VNS session, 0 to exit -- */
+    sr.vns_retry = retry < 0 ? 0 : retry;
+
     if(! user )
     { sr_set_user(&sr); }
     else
@@ -135,6 +324,54 @@ int main(int argc, char **argv)
         }
     }
 
+    /* -- local devices instead of the VNS tunnel -- */
+    if(netdev && strcmp(netdev, sr_netdev_vns.name) != 0)
+    {
+        char* arg = strchr(netdev, ':');
+
+        if(arg)
+        {
+            *arg++ = '\0';
+            strncpy(sr.netdev_conf.arg, arg, sizeof(sr.netdev_conf.arg) - 1);
+        }
+        if((sr.netdev = sr_netdev_find(netdev)) == 0)
+        {
+            fprintf(stderr,"Unknown netdev backend %s\n", netdev);
+            exit(1);
+        }
+        if(!ifconfig || sr_netdev_load_ifaces(&sr, ifconfig) != 0)
+        {
+            fprintf(stderr,"netdev %s needs an interface file (-i)\n", netdev);
+            exit(1);
+        }
+        if(sr_verify_routing_table(&sr) != 0)
+        {
+            fprintf(stderr,"Routing table not consistent with interfaces\n");
+            exit(1);
+        }
+        if(queues < 1 || queues > SR_NETDEV_MAX_QUEUES)
+        {
+            fprintf(stderr,"Number of queues must be 1..%d\n",
+                    SR_NETDEV_MAX_QUEUES);
+            exit(1);
+        }
+        sr.netdev_conf.queues = queues;
+        /* -- the backend runs the receive threads and the ARP tick -- */
+        sr.loop_mode = SR_LOOP_EVENT;
+        if(sr.netdev->open && sr.netdev->open(&sr) != 0)
+        { exit(1); }
+
+        sr_run_instance(&sr);
+        return 0;
+    }
+
+    /* -- take the session over from the router running at -H -- */
+    if(sr.handover_path[0] != '\0' && sr_handover_begin(&sr) == 0)
+    {
+        sr_run_instance(&sr);
+        return 0;
+    }
+
     Debug("Client %s connecting to Server %s:%d\n", sr.user, server, port);
     if(template)
         Debug("Requesting topology template %s\n", template);
@@ -149,23 +386,43 @@ int main(int argc, char **argv)
 
     if(template != NULL && strcmp(rtable, "rtable.vrhost") == 0) { /* we've recv'd the rtable now, so read it in */
         Debug("Connected to new instantiation of topology template %s\n", template);
-        sr_load_rt_wrap(&sr, "rtable.vrhost");
+        sr_load_rt_wrap(&sr, "rtable.vrhost", mrt);
     }
     else {
       /* Read from specified routing table */
-      sr_load_rt_wrap(&sr, rtable);
+      sr_load_rt_wrap(&sr, rtable, mrt);
     }
 
+    sr_run_instance(&sr);
+
+    return 0;
+}/* -- main -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_run_instance(..)
+ * Scope: Global
+ *
+ * Run a connected router until its session ends, then tear it down.
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_run_instance(struct sr_instance* sr)
+{
+    /* REQUIRES */
+    assert(sr);
+    assert(sr->netdev);
+
     /* call router init (for arp subsystem etc.) */
-    sr_init(&sr);
+    sr_init(sr);
 
     /* -- whizbang main loop ;-) */
-    while( sr_read_from_server(&sr) == 1);
+    sr->netdev->run(sr);
 
-    sr_destroy_instance(&sr);
+    if(sr->netdev->close)
+    { sr->netdev->close(sr); }
 
-    return 0;
-}/* -- main -- */
+    sr_destroy_instance(sr);
+} /* -- sr_run_instance -- */
 
 /*-----------------------------------------------------------------------------
  * Method: usage(..)
@@ -178,14 +435,28 @@ static void usage(char* argv0)
     printf("Format: %s [-h] [-v host] [-s server] [-p port] \n",argv0);
     printf("           [-T template_name] [-u username] \n");
     printf("           [-t topo id] [-r routing table] \n");
-    printf("           [-l log file] \n");
+    printf("           [-l log file] [-c control socket] \n");
+    printf("           [-E (event loop) | -U (io_uring loop) | -M (threads)] \n");
+    printf("           [-f instance file (host topo server port rtable [cpu] [logfile])] \n");
+    printf("           [-d netdev (vns, tap, packet, shm:socket) -i interface file -q queues] \n");
+    printf("           [-N NAT outside interface[:mappings]] \n");
+    printf("           [-A ACL rules file] \n");
+    printf("           [-b MRT table dump:next hop map file] \n");
+    printf("           [-z (compress the forwarding table)] \n");
+    printf("           [-L trace file[:level (error, warn, info, debug)]] \n");
+    printf("           [-S sample export file[:1 in N frames]] \n");
+    printf("           [-a ARP cache snapshot file] \n");
+    printf("           [-Q egress scheduler queue length (packets)] \n");
+    printf("           [-B egress shaping rate (Mbit/s), default the link speed] \n");
+    printf("           [-H hot restart socket, taken over from a running router] \n");
+    printf("           [-R seconds to reconnect a lost VNS session, 0 to exit] \n");
     printf("   defaults server=%s port=%d host=%s  \n",
             DEFAULT_SERVER, DEFAULT_PORT, DEFAULT_HOST );
 } /* -- usage -- */
 
 /*-----------------------------------------------------------------------------
  * Method: sr_set_user(..)
- * Scope: local
+ * Scope: Global
  *---------------------------------------------------------------------------*/
 
 void sr_set_user(struct sr_instance* sr)
@@ -210,12 +481,12 @@ void sr_set_user(struct sr_instance* sr)
 
 /*-----------------------------------------------------------------------------
  * Method: sr_destroy_instance(..)
- * Scope: Local
+ * Scope: Global
  *
  *
  *----------------------------------------------------------------------------*/
 
-static void sr_destroy_instance(struct sr_instance* sr)
+void sr_destroy_instance(struct sr_instance* sr)
 {
     /* REQUIRES */
     assert(sr);
@@ -225,6 +496,64 @@ static void sr_destroy_instance(struct sr_instance* sr)
         sr_dump_close(sr->logfile);
     }
 
+    /* -- the next start reloads what this session learned -- */
+    if(sr->arp_path[0] != '\0')
+    {
+        sr_arpcache_save(&(sr->cache), sr->arp_path);
+    }
+
+    if(sr->rt_shared)
+    {
+        sr_rt_shared_release(sr->fib);
+        sr->fib = 0;
+        sr->routing_table = 0;
+        sr->rt_shared = 0;
+    }
+    else if(sr->fib && sr->loop_mode == SR_LOOP_EVENT)
+    {
+        /* -- threads may still forward against a private table -- */
+        sr_fib_destroy(sr->fib);
+        sr->fib = 0;
+        sr->routing_table = 0;
+    }
+    if(sr->fwd_fib && sr->loop_mode == SR_LOOP_EVENT)
+    {
+        sr_fib_destroy(sr->fwd_fib);
+        sr->fwd_fib = 0;
+    }
+    if(sr->fib6 && sr->loop_mode == SR_LOOP_EVENT)
+    {
+        sr_fib6_destroy(sr->fib6);
+        sr->fib6 = 0;
+    }
+
+    /* -- the ARP thread of threaded mode still ticks the NAT -- */
+    if(sr->nat && sr->loop_mode == SR_LOOP_EVENT)
+    {
+        sr_nat_destroy(sr->nat);
+        sr->nat = 0;
+    }
+
+    /* -- and sample what they forward -- */
+    if(sr->sflow && sr->loop_mode == SR_LOOP_EVENT)
+    {
+        sr_sflow_destroy(sr->sflow);
+        sr->sflow = 0;
+    }
+
+    /* -- and send what is still queued -- */
+    if(sr->egress_limit && sr->loop_mode == SR_LOOP_EVENT)
+    {
+        sr_egress_destroy(sr);
+    }
+
+    /* -- so might the control thread still read the ACL -- */
+    if(sr->acl && sr->loop_mode == SR_LOOP_EVENT)
+    {
+        sr_acl_destroy(sr->acl);
+        sr->acl = 0;
+    }
+
     /*
     fprintf(stderr,"sr_destroy_instance leaking memory\n");
     */
@@ -232,23 +561,64 @@ static void sr_destroy_instance(struct sr_instance* sr)
 
 /*-----------------------------------------------------------------------------
  * Method: sr_init_instance(..)
- * Scope: Local
+ * Scope: Global
  *
  *
  *----------------------------------------------------------------------------*/
 
-static void sr_init_instance(struct sr_instance* sr)
+void sr_init_instance(struct sr_instance* sr)
 {
+    pthread_rwlockattr_t rt_attr;
+
     /* REQUIRES */
     assert(sr);
 
     sr->sockfd = -1;
+    pthread_mutex_init(&(sr->vns_lock), 0);
     sr->user[0] = 0;
     sr->host[0] = 0;
     sr->topo_id = 0;
     sr->if_list = 0;
     sr->routing_table = 0;
+    sr->fib = 0;
+    sr->rt_shared = 0;
+    sr->rt_use_locks = 0;
+    sr->fwd_fib = 0;
+    sr->rt_compress = 0;
+    sr->rt_load = 0;
+    /* -- a stream of route updates must not starve behind the bursts -- */
+    pthread_rwlockattr_init(&rt_attr);
+    pthread_rwlockattr_setkind_np(&rt_attr,
+            PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+    pthread_rwlock_init(&(sr->rt_lock), &rt_attr);
+    pthread_rwlockattr_destroy(&rt_attr);
     sr->logfile = 0;
+    sr->loop_mode = SR_LOOP_THREADS;
+    sr->ctl_path[0] = 0;
+    memset(&(sr->stats), 0, sizeof(sr->stats));
+    sr->use_uring = 0;
+    sr->uring = 0;
+    sr->netdev = &sr_netdev_vns;
+    memset(&(sr->netdev_conf), 0, sizeof(sr->netdev_conf));
+    sr->netdev_conf.queues = 1;
+    sr->netdev_priv = 0;
+    sr->nat_if[0] = 0;
+    sr->nat_mappings = 0;
+    sr->nat = 0;
+    sr->acl_path[0] = 0;
+    sr->acl = 0;
+    sr->burst = 0;
+    sr->sflow_path[0] = 0;
+    sr->sflow_rate = 0;
+    sr->sflow = 0;
+    sr->arp_path[0] = 0;
+    sr->egress_limit = 0;
+    sr->egress_rate = 0;
+    sr->egress_pacer = 0;
+    sr->handover_path[0] = 0;
+    sr->handover = 0;
+    sr->vns_retry = SR_VNS_RETRY_DEFAULT;
+    sr->vns_closed = 0;
 } /* -- sr_init_instance -- */
 
 /*-----------------------------------------------------------------------------
@@ -302,8 +672,11 @@ int sr_verify_routing_table(struct sr_instance* sr)
     return ret;
 } /* -- sr_verify_routing_table -- */
 
-static void sr_load_rt_wrap(struct sr_instance* sr, char* rtable) {
-    if(sr_load_rt(sr, rtable) != 0) {
+static void sr_load_rt_wrap(struct sr_instance* sr, char* rtable, char* mrt) {
+    char mrt_path[256];
+    char* map;
+
+    if(sr_load_rt(sr, rtable) != 0 || sr_rt6_load(sr, rtable) != 0) {
         fprintf(stderr,"Error setting up routing table from file %s\n",
                 rtable);
         exit(1);
@@ -314,4 +687,36 @@ static void sr_load_rt_wrap(struct sr_instance* sr, char* rtable) {
     printf("---------------------------------------------\n");
     sr_print_routing_table(sr);
     printf("---------------------------------------------\n");
+
+    /* -- a full BGP table on top, summarized rather than printed -- */
+    if(mrt) {
+        strncpy(mrt_path, mrt, sizeof(mrt_path) - 1);
+        mrt_path[sizeof(mrt_path) - 1] = '\0';
+        if((map = strchr(mrt_path, ':')) == 0) {
+            fprintf(stderr,"-b needs MRT_FILE:MAP_FILE\n");
+            exit(1);
+        }
+        *map++ = '\0';
+        printf("Loading MRT table dump %s\n", mrt_path);
+        if(sr_rt_load_mrt(sr, mrt_path, map, stdout) != 0) {
+            fprintf(stderr,"Error loading MRT table dump %s\n", mrt_path);
+            exit(1);
+        }
+    }
 }
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_stop_handler(..)
+ * Scope: local
+ *
+ * SIGINT and SIGTERM with -a: only flag the request, sr_arpcache_tick
+ * saves the snapshot within a second and the router then shuts down
+ * as when its session ends.
+ *
+ *---------------------------------------------------------------------------*/
+
+static void sr_stop_handler(int sig)
+{
+    (void)sig;
+    sr_stop_requested = 1;
+} /* -- sr_stop_handler -- */
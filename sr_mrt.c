@@ -0,0 +1,603 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_mrt.c
+ *
+ * Description:
+ *
+ * MRT TABLE_DUMP_V2 reader, writer and FIB import, see sr_mrt.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "sr_rt.h"
+#include "sr_fib.h"
+#include "sr_mrt.h"
+
+/* -- BGP path attributes the reader looks at -- */
+#define SR_MRT_ATTR_EXTLEN    0x10
+#define SR_MRT_ATTR_ORIGIN    1
+#define SR_MRT_ATTR_AS_PATH   2
+#define SR_MRT_ATTR_NEXT_HOP  3
+#define SR_MRT_ATTR_MP_REACH  14
+
+/* -- peer index table entry type bits -- */
+#define SR_MRT_PEER_IPV6 0x1
+#define SR_MRT_PEER_AS4  0x2
+
+static uint16_t sr_mrt_get16(const uint8_t* p)
+{
+    return (uint16_t)((p[0] << 8) | p[1]);
+} /* -- sr_mrt_get16 -- */
+
+static uint32_t sr_mrt_get32(const uint8_t* p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+           ((uint32_t)p[2] << 8) | p[3];
+} /* -- sr_mrt_get32 -- */
+
+static void sr_mrt_put16(uint8_t* p, uint16_t v)
+{
+    p[0] = v >> 8;
+    p[1] = v & 0xff;
+} /* -- sr_mrt_put16 -- */
+
+static void sr_mrt_put32(uint8_t* p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = (v >> 16) & 0xff;
+    p[2] = (v >> 8) & 0xff;
+    p[3] = v & 0xff;
+} /* -- sr_mrt_put32 -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_mrt_nexthop(..)
+ * Scope:  Local
+ *
+ * The IPv4 next hop in a RIB entry's attributes: NEXT_HOP, or the
+ * abbreviated MP_REACH_NLRI TABLE_DUMP_V2 uses (next hop length and
+ * address only).  Returns 0 if found.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_mrt_nexthop(const uint8_t* attr, unsigned int len, uint32_t* nh)
+{
+    unsigned int off = 0, alen, hdr;
+    uint8_t flags, type;
+
+    while (off + 3 <= len)
+    {
+        flags = attr[off];
+        type = attr[off + 1];
+        if (flags & SR_MRT_ATTR_EXTLEN)
+        {
+            if (off + 4 > len)
+            { return -1; }
+            alen = sr_mrt_get16(attr + off + 2);
+            hdr = 4;
+        }
+        else
+        {
+            alen = attr[off + 2];
+            hdr = 3;
+        }
+        if (off + hdr + alen > len)
+        { return -1; }
+
+        if (type == SR_MRT_ATTR_NEXT_HOP && alen == 4)
+        {
+            memcpy(nh, attr + off + hdr, 4);
+            return 0;
+        }
+        if (type == SR_MRT_ATTR_MP_REACH && alen >= 5 && attr[off + hdr] == 4)
+        {
+            memcpy(nh, attr + off + hdr + 1, 4);
+            return 0;
+        }
+        off += hdr + alen;
+    }
+    return -1;
+} /* -- sr_mrt_nexthop -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_mrt_peers(..)
+ * Scope:  Local
+ *
+ * Validate a PEER_INDEX_TABLE body.  Returns the number of peers or -1.
+ *
+ *---------------------------------------------------------------------*/
+
+static long sr_mrt_peers(const uint8_t* p, unsigned int len)
+{
+    unsigned int off, count, i;
+
+    if (len < 8)
+    { return -1; }
+    off = 6 + sr_mrt_get16(p + 4);
+    if (off + 2 > len)
+    { return -1; }
+    count = sr_mrt_get16(p + off);
+    off += 2;
+
+    for (i = 0; i < count; i++)
+    {
+        uint8_t type;
+
+        if (off + 1 > len)
+        { return -1; }
+        type = p[off];
+        off += 1 + 4 + ((type & SR_MRT_PEER_IPV6) ? 16 : 4) +
+               ((type & SR_MRT_PEER_AS4) ? 4 : 2);
+        if (off > len)
+        { return -1; }
+    }
+    return count;
+} /* -- sr_mrt_peers -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_mrt_rib(..)
+ * Scope:  Local
+ *
+ * Pick the entry of one RIB_IPV4_UNICAST record and hand it to cb.
+ * Returns -1 for a malformed record, else what cb returned.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_mrt_rib(const uint8_t* p, unsigned int len, int addpath,
+                      int peer, sr_mrt_rib_cb cb, void* arg,
+                      struct sr_mrt_stats* st)
+{
+    unsigned int off, count, i, plen, alen;
+    uint8_t pfx[4] = { 0, 0, 0, 0 };
+    uint32_t prefix, nh;
+
+    if (len < 5 || (plen = p[4]) > 32)
+    { return -1; }
+    off = 5 + (plen + 7) / 8;
+    if (off + 2 > len)
+    { return -1; }
+    memcpy(pfx, p + 5, (plen + 7) / 8);
+    memcpy(&prefix, pfx, 4);
+    prefix &= plen ? htonl(0xffffffffU << (32 - plen)) : 0;
+    count = sr_mrt_get16(p + off);
+    off += 2;
+
+    st->prefixes++;
+    for (i = 0; i < count; i++)
+    {
+        unsigned int index;
+
+        if (off + 8 + (addpath ? 4 : 0) > len)
+        { return -1; }
+        index = sr_mrt_get16(p + off);
+        off += 6 + (addpath ? 4 : 0);
+        alen = sr_mrt_get16(p + off);
+        off += 2;
+        if (off + alen > len)
+        { return -1; }
+
+        if ((peer < 0 || (unsigned int)peer == index) &&
+            sr_mrt_nexthop(p + off, alen, &nh) == 0)
+        { return cb(arg, prefix, (int)plen, nh); }
+        off += alen;
+    }
+
+    st->no_entry++;
+    return 0;
+} /* -- sr_mrt_rib -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_mrt_read(..)
+ * Scope:  Global
+ *
+ * Stream the IPv4 unicast RIB of an MRT file through cb, one prefix at
+ * a time.  Returns 0 at the end of the file, -1 on an error (reported
+ * to err), or cb's non-zero result.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_mrt_read(const char* path, int peer, sr_mrt_rib_cb cb, void* arg,
+                struct sr_mrt_stats* st, FILE* err)
+{
+    uint8_t hdr[SR_MRT_HDR_LEN];
+    uint8_t* body = 0;
+    size_t cap = 0, got;
+    uint32_t len;
+    uint16_t type, subtype;
+    long peers;
+    FILE* fp;
+    int ret = 0;
+
+    /* -- REQUIRES -- */
+    assert(path);
+    assert(cb);
+    assert(st);
+
+    if ((fp = fopen(path, "rb")) == 0)
+    {
+        fprintf(err, "%s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    while ((got = fread(hdr, 1, sizeof(hdr), fp)) == sizeof(hdr))
+    {
+        type = sr_mrt_get16(hdr + 4);
+        subtype = sr_mrt_get16(hdr + 6);
+        len = sr_mrt_get32(hdr + 8);
+        st->records++;
+
+        if (len > SR_MRT_MAX_RECORD)
+        {
+            fprintf(err, "%s: record %lu too long (%u bytes)\n", path,
+                    st->records, len);
+            ret = -1;
+            break;
+        }
+        if (type != SR_MRT_TABLE_DUMP_V2 ||
+            (subtype != SR_MRT_PEER_INDEX_TABLE &&
+             subtype != SR_MRT_RIB_IPV4_UNICAST &&
+             subtype != SR_MRT_RIB_IPV4_UNICAST_ADDPATH))
+        {
+            st->skipped++;
+            if (fseek(fp, len, SEEK_CUR) != 0)
+            { ret = -1; break; }
+            continue;
+        }
+
+        if (len > cap)
+        {
+            uint8_t* grown = (uint8_t*)realloc(body, len);
+
+            if (grown == 0)
+            {
+                fprintf(err, "%s: out of memory\n", path);
+                ret = -1;
+                break;
+            }
+            body = grown;
+            cap = len;
+        }
+        if (fread(body, 1, len, fp) != len)
+        {
+            fprintf(err, "%s: truncated record %lu\n", path, st->records);
+            ret = -1;
+            break;
+        }
+
+        if (subtype == SR_MRT_PEER_INDEX_TABLE)
+        {
+            if ((peers = sr_mrt_peers(body, len)) < 0)
+            {
+                fprintf(err, "%s: bad peer index table\n", path);
+                ret = -1;
+                break;
+            }
+            st->peers = peers;
+            continue;
+        }
+
+        ret = sr_mrt_rib(body, len, subtype == SR_MRT_RIB_IPV4_UNICAST_ADDPATH,
+                         peer, cb, arg, st);
+        if (ret < 0)
+        { fprintf(err, "%s: bad RIB record %lu\n", path, st->records); }
+        if (ret != 0)
+        { break; }
+    }
+
+    if (ret == 0 && got != 0)
+    {
+        fprintf(err, "%s: truncated header\n", path);
+        ret = -1;
+    }
+
+    free(body);
+    fclose(fp);
+    return ret;
+} /* -- sr_mrt_read -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_mrt_map_load(..)
+ * Scope:  Global
+ *
+ * Parse a next hop map file (see sr_mrt.h).  Returns 0 on success.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_mrt_map_cmp(const void* a, const void* b)
+{
+    uint32_t ma = ntohl(((const struct sr_mrt_map_entry*)a)->mask);
+    uint32_t mb = ntohl(((const struct sr_mrt_map_entry*)b)->mask);
+
+    return (ma < mb) - (ma > mb);
+} /* -- sr_mrt_map_cmp -- */
+
+int sr_mrt_map_load(const char* path, struct sr_mrt_map* map, FILE* err)
+{
+    char line[BUFSIZ];
+    char nh[64], gw[64], iface[64];
+    struct sr_mrt_map_entry* e;
+    unsigned int lineno = 0, cap = 0;
+    char* slash;
+    char* hash;
+    long len;
+    FILE* fp;
+    int fields;
+
+    /* -- REQUIRES -- */
+    assert(path);
+    assert(map);
+
+    memset(map, 0, sizeof(*map));
+    map->peer = -1;
+
+    if ((fp = fopen(path, "r")) == 0)
+    {
+        fprintf(err, "%s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), fp))
+    {
+        lineno++;
+        if ((hash = strchr(line, '#')) != 0)
+        { *hash = '\0'; }
+        fields = sscanf(line, "%63s %63s %63s", nh, gw, iface);
+        if (fields <= 0)
+        { continue; }
+
+        if (fields == 2 && strcmp(nh, "peer") == 0)
+        {
+            map->peer = atoi(gw);
+            continue;
+        }
+        if (fields != 3)
+        { goto bad; }
+
+        if (map->n == cap)
+        {
+            cap = cap ? cap * 2 : 8;
+            e = (struct sr_mrt_map_entry*)realloc(map->entries, cap * sizeof(*e));
+            if (e == 0)
+            { goto bad; }
+            map->entries = e;
+        }
+        e = &map->entries[map->n];
+        memset(e, 0, sizeof(*e));
+
+        len = 32;
+        if ((slash = strchr(nh, '/')) != 0)
+        {
+            *slash++ = '\0';
+            len = strtol(slash, 0, 10);
+        }
+        if (len < 0 || len > 32 || inet_pton(AF_INET, nh, &e->nh) != 1)
+        { goto bad; }
+        e->mask = len ? htonl(0xffffffffU << (32 - len)) : 0;
+        e->nh &= e->mask;
+        e->gw_is_nh = (strcmp(gw, "-") == 0);
+        if (!e->gw_is_nh && inet_pton(AF_INET, gw, &e->gw) != 1)
+        { goto bad; }
+        strncpy(e->iface, iface, sr_IFACE_NAMELEN - 1);
+        map->n++;
+    }
+    fclose(fp);
+
+    /* -- longest next hop prefix first -- */
+    qsort(map->entries, map->n, sizeof(*map->entries), sr_mrt_map_cmp);
+    return 0;
+
+bad:
+    fprintf(err, "%s:%u: expected \"NEXTHOP[/LEN] GATEWAY|- IFACE\" or "
+            "\"peer INDEX\"\n", path, lineno);
+    fclose(fp);
+    sr_mrt_map_free(map);
+    return -1;
+} /* -- sr_mrt_map_load -- */
+
+void sr_mrt_map_free(struct sr_mrt_map* map)
+{
+    free(map->entries);
+    map->entries = 0;
+    map->n = 0;
+} /* -- sr_mrt_map_free -- */
+
+const struct sr_mrt_map_entry* sr_mrt_map_lookup(const struct sr_mrt_map* map,
+                                                 uint32_t nexthop)
+{
+    unsigned int i;
+
+    for (i = 0; i < map->n; i++)
+    {
+        if ((nexthop & map->entries[i].mask) == map->entries[i].nh)
+        { return &map->entries[i]; }
+    }
+    return 0;
+} /* -- sr_mrt_map_lookup -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_mrt_import(..)
+ * Scope:  Global
+ *
+ * Add the routes of an MRT file to fib, next hops mapped through map.
+ * Returns 0 on success; on error the routes read so far stay in fib.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_mrt_import_arg
+{
+    struct sr_fib* fib;
+    const struct sr_mrt_map* map;
+    struct sr_mrt_stats* st;
+    uint32_t last_nh;                        /* dumps repeat next hops */
+    const struct sr_mrt_map_entry* last;
+};
+
+static int sr_mrt_import_rib(void* varg, uint32_t prefix, int len,
+                             uint32_t nexthop)
+{
+    struct sr_mrt_import_arg* arg = (struct sr_mrt_import_arg*)varg;
+    const struct sr_mrt_map_entry* e;
+    struct sr_rt* rt;
+    int ret;
+
+    if (arg->last == 0 || nexthop != arg->last_nh)
+    {
+        arg->last = sr_mrt_map_lookup(arg->map, nexthop);
+        arg->last_nh = nexthop;
+    }
+    if ((e = arg->last) == 0)
+    {
+        arg->st->unmapped++;
+        return 0;
+    }
+
+    if ((rt = (struct sr_rt*)calloc(1, sizeof(*rt))) == 0)
+    { return -1; }
+    rt->dest.s_addr = prefix;
+    rt->mask.s_addr = len ? htonl(0xffffffffU << (32 - len)) : 0;
+    rt->gw.s_addr = e->gw_is_nh ? nexthop : e->gw.s_addr;
+    memcpy(rt->interface, e->iface, sr_IFACE_NAMELEN);
+    rt->weight = SR_RT_DEFAULT_WEIGHT;
+
+    if ((ret = sr_fib_insert(arg->fib, rt)) != SR_FIB_OK)
+    {
+        free(rt);
+        if (ret == SR_FIB_NOMEM)
+        { return -1; }
+        arg->st->rejected++;
+        return 0;
+    }
+    arg->st->loaded++;
+    return 0;
+} /* -- sr_mrt_import_rib -- */
+
+int sr_mrt_import(struct sr_fib* fib, const char* path,
+                  const struct sr_mrt_map* map, struct sr_mrt_stats* st,
+                  FILE* err)
+{
+    struct sr_mrt_import_arg arg;
+
+    /* -- REQUIRES -- */
+    assert(fib);
+    assert(map);
+    assert(st);
+
+    memset(&arg, 0, sizeof(arg));
+    arg.fib = fib;
+    arg.map = map;
+    arg.st = st;
+
+    if (sr_mrt_read(path, map->peer, sr_mrt_import_rib, &arg, st, err) != 0)
+    {
+        fprintf(err, "%s: import stopped after %lu routes\n", path, st->loaded);
+        return -1;
+    }
+    return 0;
+} /* -- sr_mrt_import -- */
+
+void sr_mrt_print_stats(const struct sr_mrt_stats* st, FILE* out)
+{
+    fprintf(out, "records %lu peers %lu prefixes %lu loaded %lu no_entry %lu "
+            "unmapped %lu rejected %lu skipped %lu\n", st->records, st->peers,
+            st->prefixes, st->loaded, st->no_entry, st->unmapped,
+            st->rejected, st->skipped);
+} /* -- sr_mrt_print_stats -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_mrt_write_record(..)
+ * Scope:  Local
+ *---------------------------------------------------------------------*/
+
+static int sr_mrt_write_record(FILE* out, uint16_t subtype,
+                               const uint8_t* body, uint32_t len)
+{
+    uint8_t hdr[SR_MRT_HDR_LEN];
+
+    sr_mrt_put32(hdr, (uint32_t)time(NULL));
+    sr_mrt_put16(hdr + 4, SR_MRT_TABLE_DUMP_V2);
+    sr_mrt_put16(hdr + 6, subtype);
+    sr_mrt_put32(hdr + 8, len);
+    if (fwrite(hdr, 1, sizeof(hdr), out) != sizeof(hdr) ||
+        fwrite(body, 1, len, out) != len)
+    { return -1; }
+    return 0;
+} /* -- sr_mrt_write_record -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_mrt_write_peers(..)
+ * Scope:  Global
+ *
+ * Write a peer index table with a single IPv4, 4-byte AS peer (index
+ * 0).  Addresses in network byte order.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_mrt_write_peers(FILE* out, uint32_t collector, uint32_t peer_ip,
+                       uint32_t peer_as)
+{
+    uint8_t body[4 + 2 + 2 + 1 + 4 + 4 + 4];
+
+    memcpy(body, &collector, 4);
+    sr_mrt_put16(body + 4, 0);                  /* no view name */
+    sr_mrt_put16(body + 6, 1);
+    body[8] = SR_MRT_PEER_AS4;
+    memcpy(body + 9, &peer_ip, 4);              /* BGP identifier */
+    memcpy(body + 13, &peer_ip, 4);
+    sr_mrt_put32(body + 17, peer_as);
+    return sr_mrt_write_record(out, SR_MRT_PEER_INDEX_TABLE, body, sizeof(body));
+} /* -- sr_mrt_write_peers -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_mrt_write_rib(..)
+ * Scope:  Global
+ *
+ * Write a RIB_IPV4_UNICAST record with one entry from peer 0 carrying
+ * ORIGIN, a one-AS AS_PATH and NEXT_HOP.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_mrt_write_rib(FILE* out, uint32_t seq, uint32_t prefix, int len,
+                     uint32_t nexthop, uint32_t origin_as)
+{
+    uint8_t body[4 + 1 + 4 + 2 + 8 + 20];
+    unsigned int off, nbytes = (len + 7) / 8;
+
+    /* -- REQUIRES -- */
+    assert(len >= 0 && len <= 32);
+
+    sr_mrt_put32(body, seq);
+    body[4] = (uint8_t)len;
+    memcpy(body + 5, &prefix, nbytes);
+    off = 5 + nbytes;
+    sr_mrt_put16(body + off, 1);                /* entry count */
+    sr_mrt_put16(body + off + 2, 0);            /* peer index */
+    sr_mrt_put32(body + off + 4, (uint32_t)time(NULL));
+    sr_mrt_put16(body + off + 8, 20);           /* attribute length */
+    off += 10;
+
+    body[off++] = 0x40;                         /* ORIGIN IGP */
+    body[off++] = SR_MRT_ATTR_ORIGIN;
+    body[off++] = 1;
+    body[off++] = 0;
+    body[off++] = 0x40;                         /* AS_PATH, one AS_SEQUENCE */
+    body[off++] = SR_MRT_ATTR_AS_PATH;
+    body[off++] = 6;
+    body[off++] = 2;
+    body[off++] = 1;
+    sr_mrt_put32(body + off, origin_as);
+    off += 4;
+    body[off++] = 0x40;                         /* NEXT_HOP */
+    body[off++] = SR_MRT_ATTR_NEXT_HOP;
+    body[off++] = 4;
+    memcpy(body + off, &nexthop, 4);
+    off += 4;
+
+    return sr_mrt_write_record(out, SR_MRT_RIB_IPV4_UNICAST, body, off);
+} /* -- sr_mrt_write_rib -- */
@@ -0,0 +1,105 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_mrt.h
+ *
+ * Description:
+ *
+ * Import of BGP routing tables from MRT TABLE_DUMP_V2 files (RFC 6396),
+ * the format RouteViews and RIPE RIS publish their RIB snapshots in
+ * (e.g. rib.20240101.0000.bz2 once decompressed).
+ *
+ * The file is read one record at a time.  For every IPv4 unicast prefix
+ * one RIB entry is used, the first or the one of a chosen peer, and its
+ * BGP next hop is mapped to a gateway and interface by a map file:
+ *
+ *   # next hop prefix   gateway       interface
+ *   peer 3                                        # use peer index 3 only
+ *   192.0.2.0/24        -             eth3        # gateway = the next hop
+ *   0.0.0.0/0           172.64.3.10   eth2
+ *
+ * The longest next hop prefix wins; prefixes whose next hop matches no
+ * line are left out.  IPv6, multicast and other record types are
+ * skipped.
+ *
+ * The writer side produces the same subset of the format, so synthetic
+ * tables (sr_fibbench) can be fed back through the importer.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_MRT_H
+#define SR_MRT_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#include <stdio.h>
+#include <netinet/in.h>
+
+#include "sr_if.h"
+
+struct sr_fib;
+
+/* -- RFC 6396 record types and TABLE_DUMP_V2 subtypes -- */
+#define SR_MRT_TABLE_DUMP_V2         13
+#define SR_MRT_PEER_INDEX_TABLE       1
+#define SR_MRT_RIB_IPV4_UNICAST       2
+#define SR_MRT_RIB_IPV4_UNICAST_ADDPATH 8
+
+#define SR_MRT_HDR_LEN   12
+#define SR_MRT_MAX_RECORD (16 * 1024 * 1024)
+
+struct sr_mrt_map_entry
+{
+    uint32_t nh;                      /* network byte order, masked */
+    uint32_t mask;
+    struct in_addr gw;
+    int gw_is_nh;                     /* "-": route via the next hop itself */
+    char iface[sr_IFACE_NAMELEN];
+};
+
+struct sr_mrt_map
+{
+    struct sr_mrt_map_entry* entries;
+    unsigned int n;
+    int peer;                         /* peer index to use, -1 for the first entry */
+};
+
+struct sr_mrt_stats
+{
+    unsigned long records;
+    unsigned long peers;              /* in the peer index table */
+    unsigned long prefixes;           /* IPv4 unicast RIB records */
+    unsigned long loaded;             /* routes added to the FIB */
+    unsigned long no_entry;           /* no usable entry (peer, next hop) */
+    unsigned long unmapped;           /* next hop not in the map */
+    unsigned long rejected;           /* refused by sr_fib_insert */
+    unsigned long skipped;            /* other record types */
+};
+
+/* -- one IPv4 prefix and the next hop of its chosen entry, all network
+ *    byte order; a non-zero return stops the read -- */
+typedef int (*sr_mrt_rib_cb)(void* arg, uint32_t prefix, int len,
+                             uint32_t nexthop);
+
+int  sr_mrt_map_load(const char* path, struct sr_mrt_map* map, FILE* err);
+void sr_mrt_map_free(struct sr_mrt_map* map);
+const struct sr_mrt_map_entry* sr_mrt_map_lookup(const struct sr_mrt_map* map,
+                                                 uint32_t nexthop);
+
+int  sr_mrt_read(const char* path, int peer, sr_mrt_rib_cb cb, void* arg,
+                 struct sr_mrt_stats* st, FILE* err);
+int  sr_mrt_import(struct sr_fib* fib, const char* path,
+                   const struct sr_mrt_map* map, struct sr_mrt_stats* st,
+                   FILE* err);
+void sr_mrt_print_stats(const struct sr_mrt_stats* st, FILE* out);
+
+int  sr_mrt_write_peers(FILE* out, uint32_t collector, uint32_t peer_ip,
+                        uint32_t peer_as);
+int  sr_mrt_write_rib(FILE* out, uint32_t seq, uint32_t prefix, int len,
+                      uint32_t nexthop, uint32_t origin_as);
+
+#endif /* -- SR_MRT_H -- */
@@ -0,0 +1,334 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_multi.c
+ *
+ * Description:
+ *
+ * Several independent routers in one process, one thread per router.
+ * The instance file has one router per line:
+ *
+ *   # host   topo  server     port  rtable        [cpu] [logfile]
+ *   vrhost   101   localhost  8888  rtable.101    0     r101.dump
+ *   vrhost   102   localhost  8888  rtable.102    1
+ *
+ * cpu is the core the router thread is pinned to (-1 or missing for no
+ * pinning) and logfile the packet dump ("-" or missing for none).
+ *
+ * Each router has its own socket, ARP cache, interfaces and counters and
+ * by default runs the single threaded event loop on its core.  Routing
+ * tables loaded from the same file are shared read-only between routers
+ * (sr_rt_shared_acquire).  The per-router instance is allocated by its
+ * own thread after pinning, so its memory is local to that core.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/time.h>
+
+#include "sr_router.h"
+#include "sr_rt.h"
+#include "sr_dumper.h"
+
+#define SR_MULTI_MAX 256
+
+struct sr_multi_inst
+{
+    int index;
+    char host[32];
+    unsigned short topo;
+    char server[64];
+    unsigned int port;
+    char rtable[256];
+    int cpu;
+    char logfile[256];
+
+    /* -- shared settings from the command line -- */
+    const char* user;
+    int loop_mode;
+    int use_uring;
+    const char* ctl_path;
+
+    pthread_t thread;
+    int started;
+    int ret;
+    struct sr_stats stats; /* final counters of the router */
+};
+
+/*---------------------------------------------------------------------
+ * Method: sr_multi_parse(..)
+ * Scope:  Local
+ *
+ * Read the instance file.  Returns the number of routers or -1 on error.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_multi_parse(const char* conf, struct sr_multi_inst* insts,
+                          int max)
+{
+    FILE* fp;
+    char line[BUFSIZ];
+    char logfile[256];
+    unsigned int topo;
+    int n = 0, lineno = 0, fields;
+    struct sr_multi_inst* in;
+
+    if ((fp = fopen(conf, "r")) == 0)
+    {
+        perror("fopen(..):sr_multi.c::sr_multi_parse");
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), fp) != 0)
+    {
+        lineno++;
+        if (line[strspn(line, " \t\r\n")] == '\0' ||
+            line[strspn(line, " \t")] == '#')
+        { continue; }
+
+        if (n == max)
+        {
+            fprintf(stderr, "%s:%d: more than %d instances\n", conf, lineno, max);
+            fclose(fp);
+            return -1;
+        }
+
+        in = &insts[n];
+        memset(in, 0, sizeof(*in));
+        in->cpu = -1;
+        logfile[0] = '\0';
+
+        fields = sscanf(line, "%31s %u %63s %u %255s %d %255s", in->host, &topo,
+                        in->server, &in->port, in->rtable, &in->cpu, logfile);
+        if (fields < 5)
+        {
+            fprintf(stderr, "%s:%d: expected host topo server port rtable "
+                    "[cpu] [logfile]\n", conf, lineno);
+            fclose(fp);
+            return -1;
+        }
+        in->topo = topo;
+        if (strcmp(logfile, "-") != 0)
+        { strcpy(in->logfile, logfile); }
+        in->index = n++;
+    }
+
+    fclose(fp);
+    return n;
+} /* -- sr_multi_parse -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_multi_pin(..)
+ * Scope:  Local
+ *---------------------------------------------------------------------*/
+
+static void sr_multi_pin(struct sr_multi_inst* in)
+{
+#ifdef _LINUX_
+    cpu_set_t set;
+    int err;
+
+    if (in->cpu < 0)
+    { return; }
+
+    CPU_ZERO(&set);
+    CPU_SET(in->cpu, &set);
+    if ((err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set)) != 0)
+    {
+        fprintf(stderr, "[%d] cannot pin to cpu %d: %s\n", in->index, in->cpu,
+                strerror(err));
+    }
+#endif /* _LINUX_ */
+} /* -- sr_multi_pin -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_multi_thread(..)
+ * Scope:  Local
+ *
+ * Body of one router thread: set up the instance, connect and run it.
+ *
+ *---------------------------------------------------------------------*/
+
+static void* sr_multi_thread(void* arg)
+{
+    struct sr_multi_inst* in = arg;
+    struct sr_instance* sr;
+
+    sr_multi_pin(in);
+
+    /* -- allocated here rather than by main so it is local to the core -- */
+    if ((sr = (struct sr_instance*)calloc(1, sizeof(*sr))) == 0)
+    {
+        fprintf(stderr, "[%d] Error: out of memory\n", in->index);
+        in->ret = -1;
+        return NULL;
+    }
+    sr_init_instance(sr);
+
+    strncpy(sr->host, in->host, sizeof(sr->host) - 1);
+    sr->topo_id = in->topo;
+    sr->template[0] = '\0';
+    sr->loop_mode = in->loop_mode;
+    sr->use_uring = in->use_uring;
+
+    if (in->user)
+    { strncpy(sr->user, in->user, sizeof(sr->user) - 1); }
+    else
+    { sr_set_user(sr); }
+
+    if (in->ctl_path)
+    {
+        snprintf(sr->ctl_path, sizeof(sr->ctl_path), "%s.%d", in->ctl_path,
+                 in->index);
+    }
+
+    if ((sr->fib = sr_rt_shared_acquire(in->rtable)) == 0)
+    {
+        fprintf(stderr, "[%d] Error setting up routing table from file %s\n",
+                in->index, in->rtable);
+        free(sr);
+        in->ret = -1;
+        return NULL;
+    }
+    sr->routing_table = sr->fib->head;
+    sr->rt_shared = 1;
+
+    /* -- IPv6 routes are few and kept per router -- */
+    if (sr_rt6_load(sr, in->rtable) != 0)
+    {
+        fprintf(stderr, "[%d] Error setting up IPv6 routes from file %s\n",
+                in->index, in->rtable);
+        sr_destroy_instance(sr);
+        free(sr);
+        in->ret = -1;
+        return NULL;
+    }
+
+    if (in->logfile[0] != '\0' &&
+        (sr->logfile = sr_dump_open(in->logfile, 0, PACKET_DUMP_SIZE)) == 0)
+    {
+        fprintf(stderr, "[%d] Error opening up dump file %s\n", in->index,
+                in->logfile);
+    }
+
+    if (sr_connect_to_server(sr, in->port, in->server) == -1)
+    {
+        fprintf(stderr, "[%d] cannot connect to %s:%u\n", in->index,
+                in->server, in->port);
+        sr_destroy_instance(sr);
+        free(sr);
+        in->ret = -1;
+        return NULL;
+    }
+
+    /* -- the ARP cleanup thread of threaded mode never exits, so that
+     *    router and its routing table stay allocated until the end -- */
+    if (sr->loop_mode == SR_LOOP_THREADS)
+    { sr_rt_shared_acquire(in->rtable); }
+
+    sr_run_instance(sr);
+
+    in->stats = sr->stats;
+    in->ret = 0;
+    if (sr->loop_mode == SR_LOOP_EVENT)
+    { free(sr); }
+
+    return NULL;
+} /* -- sr_multi_thread -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_multi_run(..)
+ * Scope:  Global
+ *
+ * Start one router per line of conf and wait for all of them to end.
+ * Prints per-router and aggregate counters on the way out.
+ *
+ * RETURN VALUES: 0 if every router ran, 1 otherwise (exit status)
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_multi_run(const char* conf, const char* user, int loop_mode,
+                 int use_uring, const char* ctl_path)
+{
+    struct sr_multi_inst* insts;
+    struct sr_stats total;
+    struct timeval start, end;
+    double secs;
+    int i, n, err, failed = 0;
+
+    /* -- REQUIRES -- */
+    assert(conf);
+
+    if ((insts = calloc(SR_MULTI_MAX, sizeof(*insts))) == 0)
+    {
+        fprintf(stderr, "Error: out of memory (sr_multi_run)\n");
+        return 1;
+    }
+
+    if ((n = sr_multi_parse(conf, insts, SR_MULTI_MAX)) <= 0)
+    {
+        if (n == 0)
+        { fprintf(stderr, "%s: no instances\n", conf); }
+        free(insts);
+        return 1;
+    }
+
+    gettimeofday(&start, 0);
+
+    for (i = 0; i < n; i++)
+    {
+        insts[i].user = user;
+        insts[i].loop_mode = loop_mode < 0 ? SR_LOOP_EVENT : loop_mode;
+        insts[i].use_uring = use_uring;
+        insts[i].ctl_path = ctl_path;
+
+        if ((err = pthread_create(&insts[i].thread, 0, sr_multi_thread,
+                                  &insts[i])) != 0)
+        {
+            fprintf(stderr, "[%d] pthread_create: %s\n", i, strerror(err));
+            continue;
+        }
+        insts[i].started = 1;
+    }
+
+    memset(&total, 0, sizeof(total));
+    for (i = 0; i < n; i++)
+    {
+        if (!insts[i].started)
+        {
+            failed++;
+            continue;
+        }
+        pthread_join(insts[i].thread, 0);
+        if (insts[i].ret != 0)
+        { failed++; }
+
+        total.rx_packets += insts[i].stats.rx_packets;
+        total.rx_bytes   += insts[i].stats.rx_bytes;
+        total.tx_packets += insts[i].stats.tx_packets;
+        total.tx_bytes   += insts[i].stats.tx_bytes;
+        total.tx_errors  += insts[i].stats.tx_errors;
+    }
+
+    gettimeofday(&end, 0);
+    secs = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1e6;
+
+    for (i = 0; i < n; i++)
+    {
+        printf("[%d] %s topo %u cpu %d: rx %llu tx %llu packets\n", i,
+               insts[i].host, insts[i].topo, insts[i].cpu,
+               (unsigned long long)insts[i].stats.rx_packets,
+               (unsigned long long)insts[i].stats.tx_packets);
+    }
+    printf("%d instances, %.1f s: rx %llu tx %llu packets, %.0f pkt/s forwarded\n",
+           n, secs, (unsigned long long)total.rx_packets,
+           (unsigned long long)total.tx_packets,
+           secs > 0 ? total.tx_packets / secs : 0.0);
+
+    free(insts);
+    return failed ? 1 : 0;
+} /* -- sr_multi_run -- */
@@ -0,0 +1,680 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_nat.c
+ *
+ * Description:
+ *
+ * Network address and port translation, see sr_nat.h.
+ *
+ * Each shard has two linear probing tables of entry indices, one keyed
+ * by the inside 5-tuple and one by (protocol, outside port, peer).  They
+ * are sized to at least twice the shard's entries so probes stay short
+ * and an empty slot always exists; removal shifts the following cluster
+ * back instead of leaving tombstones.
+ *
+ * Expiry is a 256 bucket wheel of one second slots.  A packet only moves
+ * the entry's deadline; when the entry's bucket comes round it is either
+ * freed or put in the bucket of its new deadline, so an entry is looked
+ * at no later than one revolution after it went idle.
+ *
+ * Checksums are fixed up incrementally (RFC 1624), never recomputed.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <stddef.h>
+#include <time.h>
+
+#include "sr_router.h"
+#include "sr_if.h"
+#include "sr_protocol.h"
+#include "sr_cksum.h"
+#include "sr_utils.h"
+#include "sr_nat.h"
+#include "sr_common.h"
+
+#define SR_NAT_IN  0
+#define SR_NAT_OUT 1
+
+#define SR_NAT_LOCK(nat, sh) \
+    do { if ((nat)->use_locks) pthread_mutex_lock(&((sh)->lock)); } while (0)
+#define SR_NAT_UNLOCK(nat, sh) \
+    do { if ((nat)->use_locks) pthread_mutex_unlock(&((sh)->lock)); } while (0)
+
+/* ----------------------------------------------------------------------------
+ * struct sr_nat_pkt
+ *
+ * The fields of a parsed packet translation touches.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_nat_pkt
+{
+    sr_ip_hdr_t* ip;
+    uint8_t* port;     /* translated port: source outbound, destination inbound */
+    uint16_t peer;     /* the other end's port, 0 for ICMP */
+    uint8_t* sum;      /* transport checksum */
+    int pseudo;        /* transport checksum covers the addresses */
+    uint8_t flags;     /* TCP flags */
+};
+
+/* -- header fields may be unaligned: go through memcpy -- */
+#define SR_NAT_FIELD(hdr, type, member) ((uint8_t*)(hdr) + offsetof(type, member))
+
+static uint16_t sr_nat_get16(const uint8_t* p)
+{
+    uint16_t v;
+
+    memcpy(&v, p, sizeof(v));
+    return v;
+} /* -- sr_nat_get16 -- */
+
+static uint32_t sr_nat_hash(const struct sr_nat_entry* e, int which)
+{
+    if (which == SR_NAT_IN)
+    {
+        return sr_hash_mix(e->int_ip ^ sr_hash_mix(e->peer_ip ^
+               sr_hash_mix(((uint32_t)e->int_port << 16 | e->peer_port) ^ e->proto)));
+    }
+    return sr_hash_mix(e->peer_ip ^
+           sr_hash_mix(((uint32_t)e->ext_port << 16 | e->peer_port) ^ e->proto));
+} /* -- sr_nat_hash -- */
+
+static int sr_nat_match(const struct sr_nat_entry* e,
+                        const struct sr_nat_entry* key, int which)
+{
+    if (e->proto != key->proto || e->peer_ip != key->peer_ip ||
+        e->peer_port != key->peer_port)
+    { return 0; }
+    if (which == SR_NAT_IN)
+    { return e->int_ip == key->int_ip && e->int_port == key->int_port; }
+    return e->ext_port == key->ext_port;
+} /* -- sr_nat_match -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_nat_lookup(..)
+ * Scope:  Local
+ *
+ * Find key in one of the shard's tables.  Returns the entry index + 1,
+ * or 0 with *slot set to where it would be inserted.
+ *
+ *---------------------------------------------------------------------*/
+
+static uint32_t sr_nat_lookup(struct sr_nat_shard* sh, int which,
+                              const struct sr_nat_entry* key, uint32_t hash,
+                              uint32_t* slot)
+{
+    uint32_t* tab = (which == SR_NAT_IN) ? sh->in_tab : sh->out_tab;
+    uint32_t i = hash & sh->tab_mask;
+
+    while (tab[i] != 0)
+    {
+        if (sr_nat_match(&sh->entries[tab[i] - 1], key, which))
+        {
+            *slot = i;
+            return tab[i];
+        }
+        i = (i + 1) & sh->tab_mask;
+    }
+    *slot = i;
+    return 0;
+} /* -- sr_nat_lookup -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_nat_unlink(..)
+ * Scope:  Local
+ *
+ * Remove entry idx from a table, shifting later members of its probe
+ * cluster back into the hole when their home slot allows it.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_nat_unlink(struct sr_nat_shard* sh, int which, uint32_t idx)
+{
+    uint32_t* tab = (which == SR_NAT_IN) ? sh->in_tab : sh->out_tab;
+    uint32_t mask = sh->tab_mask;
+    uint32_t i, j, home;
+
+    i = sr_nat_hash(&sh->entries[idx - 1], which) & mask;
+    while (tab[i] != idx)
+    { i = (i + 1) & mask; }
+
+    tab[i] = 0;
+    for (j = (i + 1) & mask; tab[j] != 0; j = (j + 1) & mask)
+    {
+        home = sr_nat_hash(&sh->entries[tab[j] - 1], which) & mask;
+
+        /* -- leave it if its home lies cyclically in (i, j] -- */
+        if ((i <= j) ? (i < home && home <= j) : (i < home || home <= j))
+        { continue; }
+
+        tab[i] = tab[j];
+        tab[j] = 0;
+        i = j;
+    }
+} /* -- sr_nat_unlink -- */
+
+static uint32_t sr_nat_timeout(const struct sr_nat_entry* e)
+{
+    if (e->proto == ip_protocol_tcp)
+    { return e->state == SR_NAT_TCP_EST ? SR_NAT_TCP_EST_TO : SR_NAT_TCP_TRANS_TO; }
+    if (e->proto == ip_protocol_udp)
+    { return SR_NAT_UDP_TO; }
+    return SR_NAT_ICMP_TO;
+} /* -- sr_nat_timeout -- */
+
+static uint32_t sr_nat_now(void)
+{
+    return (uint32_t)(sr_now_ns() / SR_NS_PER_SEC);
+} /* -- sr_nat_now -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_nat_alloc(..)
+ * Scope:  Local
+ *
+ * New mapping for key, whose inside lookup missed at in_slot.  Takes the
+ * next port of the shard's slice that is free towards this peer, giving
+ * up after SR_NAT_PORT_TRIES so a peer whose ports are used up costs a
+ * bounded search rather than a walk of the whole slice.
+ * Returns the entry index + 1, 0 if the shard is out of entries or ports.
+ *
+ *---------------------------------------------------------------------*/
+
+static uint32_t sr_nat_alloc(struct sr_nat* nat, struct sr_nat_shard* sh,
+                             struct sr_nat_entry* key, uint32_t in_slot)
+{
+    struct sr_nat_entry* e;
+    uint32_t tries, nports, out_slot, idx;
+    uint16_t port;
+
+    if (sh->free_list == 0)
+    {
+        sh->stats.full++;
+        return 0;
+    }
+
+    nports = (uint32_t)sh->port_hi - sh->port_lo + 1;
+    if (nports > SR_NAT_PORT_TRIES)
+    { nports = SR_NAT_PORT_TRIES; }
+    for (tries = 0; tries < nports; tries++)
+    {
+        port = sh->port_next;
+        sh->port_next = (port == sh->port_hi) ? sh->port_lo : port + 1;
+        key->ext_port = htons(port);
+        if (sr_nat_lookup(sh, SR_NAT_OUT, key, sr_nat_hash(key, SR_NAT_OUT),
+                          &out_slot) == 0)
+        { break; }
+    }
+    if (tries == nports)
+    {
+        sh->stats.full++;
+        return 0;
+    }
+
+    idx = sh->free_list;
+    e = &sh->entries[idx - 1];
+    sh->free_list = e->next;
+
+    *e = *key;
+    e->state = SR_NAT_TCP_NEW;
+    e->expires = nat->now + sr_nat_timeout(e);
+    e->next = sh->wheel[e->expires & (SR_NAT_WHEEL - 1)];
+    sh->wheel[e->expires & (SR_NAT_WHEEL - 1)] = idx;
+
+    sh->in_tab[in_slot] = idx;
+    sh->out_tab[out_slot] = idx;
+    sh->used++;
+    sh->stats.created++;
+
+    return idx;
+} /* -- sr_nat_alloc -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_nat_parse(..)
+ * Scope:  Local
+ *
+ * Locate the fields to translate in an IPv4 frame.  Fragments, other
+ * protocols, ICMP other than echo request (outbound) or reply (inbound)
+ * and truncated headers are refused with -1.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_nat_parse(uint8_t* packet, unsigned int len, int inbound,
+                        struct sr_nat_pkt* p)
+{
+    unsigned int hl, room;
+    uint8_t* l4;
+
+    if (len < sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t))
+    { return -1; }
+
+    p->ip = (sr_ip_hdr_t*)(packet + sizeof(sr_ethernet_hdr_t));
+    hl = p->ip->ip_hl * 4;
+    if (hl < sizeof(sr_ip_hdr_t) || len < sizeof(sr_ethernet_hdr_t) + hl ||
+        (ntohs(p->ip->ip_off) & (IP_MF | IP_OFFMASK)) != 0)
+    { return -1; }
+
+    l4 = (uint8_t*)p->ip + hl;
+    room = len - sizeof(sr_ethernet_hdr_t) - hl;
+    p->flags = 0;
+
+    if (p->ip->ip_p == ip_protocol_tcp && room >= sizeof(sr_tcp_hdr_t))
+    {
+        sr_tcp_hdr_t* tcp = (sr_tcp_hdr_t*)l4;
+
+        p->port = inbound ? SR_NAT_FIELD(tcp, sr_tcp_hdr_t, tcp_dport) :
+                            SR_NAT_FIELD(tcp, sr_tcp_hdr_t, tcp_sport);
+        p->peer = inbound ? tcp->tcp_sport : tcp->tcp_dport;
+        p->sum = SR_NAT_FIELD(tcp, sr_tcp_hdr_t, tcp_sum);
+        p->pseudo = 1;
+        p->flags = tcp->tcp_flags;
+        return 0;
+    }
+    if (p->ip->ip_p == ip_protocol_udp && room >= sizeof(sr_udp_hdr_t))
+    {
+        sr_udp_hdr_t* udp = (sr_udp_hdr_t*)l4;
+
+        p->port = inbound ? SR_NAT_FIELD(udp, sr_udp_hdr_t, udp_dport) :
+                            SR_NAT_FIELD(udp, sr_udp_hdr_t, udp_sport);
+        p->peer = inbound ? udp->udp_sport : udp->udp_dport;
+        p->sum = SR_NAT_FIELD(udp, sr_udp_hdr_t, udp_sum);
+        p->pseudo = 1;
+        return 0;
+    }
+    if (p->ip->ip_p == ip_protocol_icmp && room >= sizeof(sr_icmp_echo_hdr_t))
+    {
+        sr_icmp_echo_hdr_t* icmp = (sr_icmp_echo_hdr_t*)l4;
+
+        if (icmp->icmp_type != (inbound ? icmp_type_echo_reply : icmp_type_echo_request))
+        { return -1; }
+        p->port = SR_NAT_FIELD(icmp, sr_icmp_echo_hdr_t, icmp_id);
+        p->peer = 0;
+        p->sum = SR_NAT_FIELD(icmp, sr_icmp_echo_hdr_t, icmp_sum);
+        p->pseudo = 0;
+        return 0;
+    }
+    return -1;
+} /* -- sr_nat_parse -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_nat_rewrite(..)
+ * Scope:  Local
+ *
+ * Replace the address at addr (ip_src or ip_dst) and the translated port,
+ * fixing the IP and transport checksums.  A UDP checksum of zero means
+ * none was sent and stays zero.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_nat_rewrite(struct sr_nat_pkt* p, uint8_t* addr,
+                           uint32_t new_addr, uint16_t new_port)
+{
+    uint32_t old_addr;
+    uint16_t sum;
+
+    memcpy(&old_addr, addr, sizeof(old_addr));
+    p->ip->ip_sum = sr_cksum_update32(p->ip->ip_sum, old_addr, new_addr);
+
+    sum = sr_nat_get16(p->sum);
+    if (!(p->ip->ip_p == ip_protocol_udp && sum == 0))
+    {
+        if (p->pseudo)
+        { sum = sr_cksum_update32(sum, old_addr, new_addr); }
+        sum = sr_cksum_update16(sum, sr_nat_get16(p->port), new_port);
+        if (p->ip->ip_p == ip_protocol_udp && sum == 0)
+        { sum = 0xffff; }
+        memcpy(p->sum, &sum, sizeof(sum));
+    }
+
+    memcpy(addr, &new_addr, sizeof(new_addr));
+    memcpy(p->port, &new_port, sizeof(new_port));
+} /* -- sr_nat_rewrite -- */
+
+static void sr_nat_tcp_state(struct sr_nat_entry* e, uint8_t flags, int inbound)
+{
+    if (flags & (TCP_FIN | TCP_RST))
+    { e->state = SR_NAT_TCP_CLOSING; }
+    else if (inbound && e->state == SR_NAT_TCP_NEW)
+    { e->state = SR_NAT_TCP_EST; }
+} /* -- sr_nat_tcp_state -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_nat_outbound(..)
+ * Scope:  Global
+ *
+ * Translate the source of a packet received on iface and routed out of
+ * out_if, if out_if is the outside interface and iface is not.  Returns
+ * 0 when the packet may be sent on, -1 when it must be dropped.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_nat_outbound(struct sr_instance* sr, uint8_t* packet, unsigned int len,
+                    const char* iface, struct sr_if* out_if)
+{
+    struct sr_nat* nat = sr->nat;
+    struct sr_nat_shard* sh;
+    struct sr_nat_entry key, *e;
+    struct sr_nat_pkt p;
+    uint32_t hash, slot, idx;
+    uint16_t ext_port;
+
+    if (!nat || out_if != nat->ext_if ||
+        strncmp(iface, nat->ext_if->name, sr_IFACE_NAMELEN) == 0)
+    { return 0; }
+
+    if (sr_nat_parse(packet, len, 0, &p) != 0)
+    {
+        __sync_fetch_and_add(&nat->unsupported, 1);
+        return -1;
+    }
+
+    memset(&key, 0, sizeof(key));
+    key.proto = p.ip->ip_p;
+    key.int_ip = p.ip->ip_src;
+    key.int_port = sr_nat_get16(p.port);
+    key.peer_ip = p.ip->ip_dst;
+    key.peer_port = p.peer;
+
+    hash = sr_nat_hash(&key, SR_NAT_IN);
+    sh = &nat->shards[((uint64_t)hash * nat->nshards) >> 32];
+
+    SR_NAT_LOCK(nat, sh);
+    if ((idx = sr_nat_lookup(sh, SR_NAT_IN, &key, hash, &slot)) == 0 &&
+        (idx = sr_nat_alloc(nat, sh, &key, slot)) == 0)
+    {
+        SR_NAT_UNLOCK(nat, sh);
+        return -1;
+    }
+    e = &sh->entries[idx - 1];
+    if (e->proto == ip_protocol_tcp)
+    { sr_nat_tcp_state(e, p.flags, 0); }
+    e->expires = nat->now + sr_nat_timeout(e);
+    ext_port = e->ext_port;
+    sh->stats.out++;
+    SR_NAT_UNLOCK(nat, sh);
+
+    sr_nat_rewrite(&p, SR_NAT_FIELD(p.ip, sr_ip_hdr_t, ip_src), nat->ext_ip, ext_port);
+    return 0;
+} /* -- sr_nat_outbound -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_nat_inbound(..)
+ * Scope:  Global
+ *
+ * Translate the destination of a packet received on the outside
+ * interface for a known mapping, before it is routed.  Returns 1 if it
+ * was translated; anything else is left for the router itself.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_nat_inbound(struct sr_instance* sr, uint8_t* packet, unsigned int len,
+                   const char* iface)
+{
+    struct sr_nat* nat = sr->nat;
+    struct sr_nat_shard* sh;
+    struct sr_nat_entry key, *e;
+    struct sr_nat_pkt p;
+    uint32_t slot, idx, int_ip, s, slice;
+    uint16_t int_port, port;
+
+    if (!nat || len < sizeof(sr_ethernet_hdr_t) ||
+        ethertype(packet) != ethertype_ip ||
+        strncmp(iface, nat->ext_if->name, sr_IFACE_NAMELEN) != 0 ||
+        sr_nat_parse(packet, len, 1, &p) != 0 ||
+        p.ip->ip_dst != nat->ext_ip)
+    { return 0; }
+
+    port = ntohs(sr_nat_get16(p.port));
+    if (port < SR_NAT_PORT_MIN)
+    { return 0; }
+
+    slice = (65536 - SR_NAT_PORT_MIN) / nat->nshards;
+    s = (port - SR_NAT_PORT_MIN) / slice;
+    if (s >= (uint32_t)nat->nshards)
+    { s = nat->nshards - 1; }
+    sh = &nat->shards[s];
+
+    memset(&key, 0, sizeof(key));
+    key.proto = p.ip->ip_p;
+    key.ext_port = sr_nat_get16(p.port);
+    key.peer_ip = p.ip->ip_src;
+    key.peer_port = p.peer;
+
+    SR_NAT_LOCK(nat, sh);
+    if ((idx = sr_nat_lookup(sh, SR_NAT_OUT, &key, sr_nat_hash(&key, SR_NAT_OUT),
+                             &slot)) == 0)
+    {
+        SR_NAT_UNLOCK(nat, sh);
+        return 0;
+    }
+    e = &sh->entries[idx - 1];
+    if (e->proto == ip_protocol_tcp)
+    { sr_nat_tcp_state(e, p.flags, 1); }
+    e->expires = nat->now + sr_nat_timeout(e);
+    int_ip = e->int_ip;
+    int_port = e->int_port;
+    sh->stats.in++;
+    SR_NAT_UNLOCK(nat, sh);
+
+    sr_nat_rewrite(&p, SR_NAT_FIELD(p.ip, sr_ip_hdr_t, ip_dst), int_ip, int_port);
+    return 1;
+} /* -- sr_nat_inbound -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_nat_expire_bucket(..)
+ * Scope:  Local
+ *---------------------------------------------------------------------*/
+
+static void sr_nat_expire_bucket(struct sr_nat_shard* sh, uint32_t bucket,
+                                 uint32_t now)
+{
+    struct sr_nat_entry* e;
+    uint32_t idx, next, b;
+
+    idx = sh->wheel[bucket];
+    sh->wheel[bucket] = 0;
+
+    for (; idx != 0; idx = next)
+    {
+        e = &sh->entries[idx - 1];
+        next = e->next;
+
+        if ((int32_t)(e->expires - now) <= 0)
+        {
+            sr_nat_unlink(sh, SR_NAT_IN, idx);
+            sr_nat_unlink(sh, SR_NAT_OUT, idx);
+            e->next = sh->free_list;
+            sh->free_list = idx;
+            sh->used--;
+            sh->stats.expired++;
+        }
+        else
+        {
+            /* -- refreshed since: file it under its new deadline -- */
+            b = e->expires & (SR_NAT_WHEEL - 1);
+            e->next = sh->wheel[b];
+            sh->wheel[b] = idx;
+        }
+    }
+} /* -- sr_nat_expire_bucket -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_nat_tick(..)
+ * Scope:  Global
+ *
+ * Advance the clock and expire the wheel buckets it passed.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_nat_tick(struct sr_nat* nat)
+{
+    uint32_t now, t, steps;
+    int i;
+
+    /* -- REQUIRES -- */
+    assert(nat);
+
+    now = sr_nat_now();
+    steps = now - nat->last_tick;
+    if (steps > SR_NAT_WHEEL)
+    { steps = SR_NAT_WHEEL; }
+    nat->now = now;
+
+    for (i = 0; i < nat->nshards; i++)
+    {
+        struct sr_nat_shard* sh = &nat->shards[i];
+
+        SR_NAT_LOCK(nat, sh);
+        for (t = now - steps + 1; t != now + 1; t++)
+        { sr_nat_expire_bucket(sh, t & (SR_NAT_WHEEL - 1), now); }
+        SR_NAT_UNLOCK(nat, sh);
+    }
+    nat->last_tick = now;
+} /* -- sr_nat_tick -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_nat_create(..)
+ * Scope:  Global
+ *
+ * NAT towards ext_iface for up to mappings flows (0 for the default),
+ * split over nshards shards.  Returns NULL on error.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_nat* sr_nat_create(struct sr_instance* sr, const char* ext_iface,
+                             unsigned int mappings, int nshards)
+{
+    struct sr_nat* nat;
+    struct sr_if* ext_if;
+    uint32_t per_shard, tab_size, slice, i;
+    struct in_addr ip_addr;
+    void* mem;
+    int s;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+    assert(ext_iface);
+
+    if ((ext_if = sr_get_interface(sr, ext_iface)) == 0)
+    {
+        fprintf(stderr, "NAT: no interface %s\n", ext_iface);
+        return 0;
+    }
+    if (mappings == 0)
+    { mappings = SR_NAT_DEFAULT_MAPPINGS; }
+    if (nshards < 1)
+    { nshards = 1; }
+    if (nshards > SR_NAT_MAX_SHARDS)
+    { nshards = SR_NAT_MAX_SHARDS; }
+
+    if (posix_memalign(&mem, 64, sizeof(struct sr_nat)) != 0)
+    {
+        fprintf(stderr, "Error: out of memory (sr_nat_create)\n");
+        return 0;
+    }
+    nat = (struct sr_nat*)mem;
+    memset(nat, 0, sizeof(*nat));
+    nat->ext_if = ext_if;
+    nat->ext_ip = ext_if->ip;
+    nat->nshards = nshards;
+    nat->use_locks = (sr->loop_mode == SR_LOOP_THREADS ||
+                      sr->netdev_conf.queues > 1);
+    nat->now = nat->last_tick = sr_nat_now();
+
+    per_shard = (mappings + nshards - 1) / nshards;
+    for (tab_size = 64; tab_size < 2 * per_shard; tab_size <<= 1)
+    { }
+    slice = (65536 - SR_NAT_PORT_MIN) / nshards;
+
+    for (s = 0; s < nshards; s++)
+    {
+        struct sr_nat_shard* sh = &nat->shards[s];
+
+        pthread_mutex_init(&sh->lock, 0);
+        sh->capacity = per_shard;
+        sh->tab_mask = tab_size - 1;
+        sh->entries = (struct sr_nat_entry*)calloc(per_shard, sizeof(struct sr_nat_entry));
+        sh->in_tab = (uint32_t*)calloc(tab_size, sizeof(uint32_t));
+        sh->out_tab = (uint32_t*)calloc(tab_size, sizeof(uint32_t));
+        if (!sh->entries || !sh->in_tab || !sh->out_tab)
+        {
+            fprintf(stderr, "Error: out of memory (sr_nat_create)\n");
+            nat->nshards = s + 1;
+            sr_nat_destroy(nat);
+            return 0;
+        }
+        for (i = 0; i < per_shard; i++)
+        { sh->entries[i].next = (i + 1 < per_shard) ? i + 2 : 0; }
+        sh->free_list = 1;
+
+        sh->port_lo = SR_NAT_PORT_MIN + s * slice;
+        sh->port_hi = (s == nshards - 1) ? 65535 : sh->port_lo + slice - 1;
+        sh->port_next = sh->port_lo;
+    }
+
+    ip_addr.s_addr = nat->ext_ip;
+    printf("NAT on %s (%s), %u mappings in %d shard(s)\n", ext_if->name,
+           inet_ntoa(ip_addr), per_shard * nshards, nshards);
+    return nat;
+} /* -- sr_nat_create -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_nat_destroy(..)
+ * Scope:  Global
+ *---------------------------------------------------------------------*/
+
+void sr_nat_destroy(struct sr_nat* nat)
+{
+    int s;
+
+    if (!nat)
+    { return; }
+
+    for (s = 0; s < nat->nshards; s++)
+    {
+        free(nat->shards[s].entries);
+        free(nat->shards[s].in_tab);
+        free(nat->shards[s].out_tab);
+        pthread_mutex_destroy(&nat->shards[s].lock);
+    }
+    free(nat);
+} /* -- sr_nat_destroy -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_nat_print_stats(..)
+ * Scope:  Global
+ *---------------------------------------------------------------------*/
+
+void sr_nat_print_stats(struct sr_nat* nat, FILE* out)
+{
+    struct sr_nat_stats sum;
+    uint64_t used = 0, capacity = 0;
+    int s;
+
+    memset(&sum, 0, sizeof(sum));
+    for (s = 0; s < nat->nshards; s++)
+    {
+        struct sr_nat_shard* sh = &nat->shards[s];
+
+        SR_NAT_LOCK(nat, sh);
+        used += sh->used;
+        capacity += sh->capacity;
+        sum.created += sh->stats.created;
+        sum.expired += sh->stats.expired;
+        sum.out += sh->stats.out;
+        sum.in += sh->stats.in;
+        sum.full += sh->stats.full;
+        SR_NAT_UNLOCK(nat, sh);
+    }
+
+    fprintf(out, "nat_mappings %llu\n", (unsigned long long)used);
+    fprintf(out, "nat_capacity %llu\n", (unsigned long long)capacity);
+    fprintf(out, "nat_created %llu\n", (unsigned long long)sum.created);
+    fprintf(out, "nat_expired %llu\n", (unsigned long long)sum.expired);
+    fprintf(out, "nat_out %llu\n", (unsigned long long)sum.out);
+    fprintf(out, "nat_in %llu\n", (unsigned long long)sum.in);
+    fprintf(out, "nat_full %llu\n", (unsigned long long)sum.full);
+    fprintf(out, "nat_unsupported %llu\n", (unsigned long long)nat->unsupported);
+} /* -- sr_nat_print_stats -- */
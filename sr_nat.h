@@ -0,0 +1,129 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_nat.h
+ *
+ * Description:
+ *
+ * Network address and port translation (-N outside_iface[:mappings]).
+ * Packets routed out of the outside interface from any other interface
+ * get the outside interface's address and a port from the NAT; replies
+ * to that address and port are translated back before routing.  TCP,
+ * UDP and ICMP echo (by identifier) are translated, anything else that
+ * would leave through the outside interface is dropped.
+ *
+ * Mappings are kept per 5-tuple (endpoint dependent), so an outside port
+ * is reused across destinations and the table is not limited to 64K
+ * flows per address.  The table is split into shards, one per receive
+ * thread.  A shard owns a slice of the port space and has its own lock,
+ * open addressing hash tables, port cursor and expiry wheel:
+ *
+ *   outbound  shard = hash(inside 5-tuple)
+ *   inbound   shard = slice the destination port falls in
+ *
+ * so threads only meet on a lock when their flows hash to the same
+ * shard.  Expiry runs from sr_arpcache_tick once a second.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_NAT_H
+#define SR_NAT_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#include <stdio.h>
+#include <pthread.h>
+
+#define SR_NAT_DEFAULT_MAPPINGS (1 << 16)
+#define SR_NAT_MAX_SHARDS 16
+#define SR_NAT_WHEEL      256   /* one second buckets, power of two */
+#define SR_NAT_PORT_MIN   1024
+#define SR_NAT_PORT_TRIES 256   /* ports tried per new mapping */
+
+/* -- idle timeouts in seconds (RFC 5382, RFC 4787, RFC 5508) -- */
+#define SR_NAT_TCP_EST_TO   7440
+#define SR_NAT_TCP_TRANS_TO 240
+#define SR_NAT_UDP_TO       300
+#define SR_NAT_ICMP_TO      60
+
+/* -- TCP mapping states -- */
+#define SR_NAT_TCP_NEW     0   /* only seen from inside */
+#define SR_NAT_TCP_EST     1   /* seen from both sides */
+#define SR_NAT_TCP_CLOSING 2   /* FIN or RST seen */
+
+struct sr_instance;
+struct sr_if;
+
+/* ----------------------------------------------------------------------------
+ * struct sr_nat_entry
+ *
+ * One mapping.  Entries are referenced by index + 1 so 0 can mean none.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_nat_entry
+{
+    uint32_t int_ip;     /* inside host, network byte order */
+    uint32_t peer_ip;    /* outside host */
+    uint16_t int_port;   /* port or echo identifier, network byte order */
+    uint16_t peer_port;  /* 0 for ICMP */
+    uint16_t ext_port;   /* our port on the outside address */
+    uint8_t  proto;
+    uint8_t  state;      /* SR_NAT_TCP_* for TCP */
+    uint32_t expires;    /* sr_nat.now seconds */
+    uint32_t next;       /* wheel bucket or free list */
+};
+
+struct sr_nat_stats
+{
+    uint64_t created;
+    uint64_t expired;
+    uint64_t out;          /* packets translated outbound */
+    uint64_t in;           /* packets translated inbound */
+    uint64_t full;         /* no free entry or port */
+};
+
+struct sr_nat_shard
+{
+    pthread_mutex_t lock;
+    struct sr_nat_entry* entries;
+    uint32_t capacity;
+    uint32_t used;
+    uint32_t free_list;
+    uint32_t* in_tab;      /* inside 5-tuple -> entry */
+    uint32_t* out_tab;     /* outside port and peer -> entry */
+    uint32_t tab_mask;
+    uint32_t wheel[SR_NAT_WHEEL];
+    uint16_t port_lo;      /* host byte order, inclusive */
+    uint16_t port_hi;
+    uint16_t port_next;
+    struct sr_nat_stats stats;
+} __attribute__ ((aligned (64)));
+
+struct sr_nat
+{
+    struct sr_if* ext_if;  /* outside interface */
+    uint32_t ext_ip;
+    int use_locks;
+    int nshards;
+    volatile uint32_t now; /* seconds, advanced by sr_nat_tick */
+    uint32_t last_tick;
+    uint64_t unsupported;  /* dropped: protocol, fragment or truncated */
+    struct sr_nat_shard shards[SR_NAT_MAX_SHARDS];
+};
+
+struct sr_nat* sr_nat_create(struct sr_instance* sr, const char* ext_iface,
+                             unsigned int mappings, int nshards);
+void sr_nat_destroy(struct sr_nat* nat);
+int  sr_nat_inbound(struct sr_instance* sr, uint8_t* packet, unsigned int len,
+                    const char* iface);
+int  sr_nat_outbound(struct sr_instance* sr, uint8_t* packet, unsigned int len,
+                     const char* iface, struct sr_if* out_if);
+void sr_nat_tick(struct sr_nat* nat);
+void sr_nat_print_stats(struct sr_nat* nat, FILE* out);
+
+#endif /* -- SR_NAT_H -- */
@@ -0,0 +1,353 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_ndcache.c
+ *
+ * Description:
+ *
+ * IPv6 neighbor cache, see sr_ndcache.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "sr_ndcache.h"
+#include "sr_router.h"
+#include "sr_ip6.h"
+
+/*---------------------------------------------------------------------
+ * Method: sr_ndcache_init(..)
+ * Scope:  Global
+ *
+ * Empty table and queue, locking on.  Returns 0 on success.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_ndcache_init(struct sr_ndcache* cache)
+{
+    memset(cache->entries, 0, sizeof(cache->entries));
+    cache->requests = 0;
+
+    pthread_mutexattr_init(&(cache->attr));
+    pthread_mutexattr_settype(&(cache->attr), PTHREAD_MUTEX_RECURSIVE);
+    cache->use_locks = 1;
+    return pthread_mutex_init(&(cache->lock), &(cache->attr));
+} /* -- sr_ndcache_init -- */
+
+int sr_ndcache_destroy(struct sr_ndcache* cache)
+{
+    while (cache->requests)
+    { sr_ndreq_destroy(cache, cache->requests); }
+    return pthread_mutex_destroy(&(cache->lock)) &&
+           pthread_mutexattr_destroy(&(cache->attr));
+} /* -- sr_ndcache_destroy -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ndcache_lookup(..)
+ * Scope:  Global
+ *
+ * Copy out rather than hand back the entry: another thread may change
+ * the table once the lock is dropped.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_ndcache_lookup(struct sr_ndcache* cache, const uint8_t* ip,
+                      unsigned char* mac)
+{
+    int i, found = -1;
+
+    SR_NDCACHE_LOCK(cache);
+    for (i = 0; i < SR_NDCACHE_SZ; i++)
+    {
+        if (cache->entries[i].valid && memcmp(cache->entries[i].ip, ip, 16) == 0)
+        {
+            memcpy(mac, cache->entries[i].mac, 6);
+            found = 0;
+            break;
+        }
+    }
+    SR_NDCACHE_UNLOCK(cache);
+
+    return found;
+} /* -- sr_ndcache_lookup -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ndcache_queuereq(..)
+ * Scope:  Global
+ *
+ * The request stays owned by the cache; the caller may pass it to
+ * sr_ip6_handle_ndreq while it is queued.  Returns NULL if out of
+ * memory.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_ndreq* sr_ndcache_queuereq(struct sr_ndcache* cache,
+                                     const uint8_t* ip, const char* out_iface,
+                                     const uint8_t* packet, unsigned int len,
+                                     const char* in_iface)
+{
+    struct sr_ndreq* req;
+    struct sr_packet* pkt;
+    struct sr_packet** tail;
+
+    SR_NDCACHE_LOCK(cache);
+
+    for (req = cache->requests; req; req = req->next)
+    {
+        if (memcmp(req->ip, ip, 16) == 0 &&
+            strncmp(req->iface, out_iface, sr_IFACE_NAMELEN) == 0)
+        { break; }
+    }
+
+    if (req == 0)
+    {
+        if ((req = (struct sr_ndreq*)calloc(1, sizeof(*req))) == 0)
+        {
+            SR_NDCACHE_UNLOCK(cache);
+            return 0;
+        }
+        memcpy(req->ip, ip, 16);
+        strncpy(req->iface, out_iface, sr_IFACE_NAMELEN - 1);
+        req->next = cache->requests;
+        cache->requests = req;
+    }
+
+    if (packet && len && in_iface &&
+        (pkt = (struct sr_packet*)calloc(1, sizeof(*pkt))) != 0)
+    {
+        if ((pkt->pb = sr_pbuf_hold(packet, len)) == 0)
+        { free(pkt); }
+        else
+        {
+            pkt->buf = pkt->pb->data;
+            pkt->len = len;
+            strncpy(pkt->iface, in_iface, sr_IFACE_NAMELEN - 1);
+
+            /* -- kept in arrival order, to be sent in it -- */
+            for (tail = &req->packets; *tail; tail = &(*tail)->next)
+            { }
+            *tail = pkt;
+        }
+    }
+
+    SR_NDCACHE_UNLOCK(cache);
+
+    return req;
+} /* -- sr_ndcache_queuereq -- */
+
+static void sr_ndcache_unlink(struct sr_ndcache* cache, struct sr_ndreq* req)
+{
+    struct sr_ndreq** pp;
+
+    for (pp = &cache->requests; *pp; pp = &(*pp)->next)
+    {
+        if (*pp == req)
+        {
+            *pp = req->next;
+            req->next = 0;
+            break;
+        }
+    }
+} /* -- sr_ndcache_unlink -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ndcache_insert(..)
+ * Scope:  Global
+ *
+ * A static entry for ip wins over what the network says.  If the table
+ * is full the mapping is not kept, as in the ARP cache.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_ndreq* sr_ndcache_insert(struct sr_ndcache* cache,
+                                   const unsigned char* mac, const uint8_t* ip)
+{
+    struct sr_ndreq* req;
+    struct sr_ndentry* ent;
+    int i, slot = -1;
+
+    SR_NDCACHE_LOCK(cache);
+
+    /* -- one request per interface: hand back the first, the rest are
+     *    found again on the next advertisement or time out -- */
+    for (req = cache->requests; req; req = req->next)
+    {
+        if (memcmp(req->ip, ip, 16) == 0)
+        { break; }
+    }
+    if (req)
+    { sr_ndcache_unlink(cache, req); }
+
+    for (i = 0; i < SR_NDCACHE_SZ; i++)
+    {
+        ent = &(cache->entries[i]);
+        if (ent->valid && memcmp(ent->ip, ip, 16) == 0)
+        {
+            slot = ent->is_static ? SR_NDCACHE_SZ : i;
+            break;
+        }
+        if (slot < 0 && !ent->valid)
+        { slot = i; }
+    }
+
+    if (slot >= 0 && slot < SR_NDCACHE_SZ)
+    {
+        ent = &(cache->entries[slot]);
+        memcpy(ent->mac, mac, 6);
+        memcpy(ent->ip, ip, 16);
+        ent->added = time(0);
+        ent->valid = 1;
+        ent->is_static = 0;
+    }
+
+    SR_NDCACHE_UNLOCK(cache);
+
+    return req;
+} /* -- sr_ndcache_insert -- */
+
+void sr_ndreq_destroy(struct sr_ndcache* cache, struct sr_ndreq* req)
+{
+    struct sr_packet* pkt;
+    struct sr_packet* next;
+
+    if (req == 0)
+    { return; }
+
+    SR_NDCACHE_LOCK(cache);
+    sr_ndcache_unlink(cache, req);
+    SR_NDCACHE_UNLOCK(cache);
+
+    for (pkt = req->packets; pkt; pkt = next)
+    {
+        next = pkt->next;
+        sr_pbuf_put(pkt->pb);
+        free(pkt);
+    }
+    free(req);
+} /* -- sr_ndreq_destroy -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ndcache_add_static(..)
+ * Scope:  Global
+ *
+ * Add or overwrite a permanent mapping, dropping any request queued for
+ * ip.  Returns 0, or -1 if the table is full.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_ndcache_add_static(struct sr_ndcache* cache, const unsigned char* mac,
+                          const uint8_t* ip)
+{
+    struct sr_ndreq* req;
+    struct sr_ndreq* next;
+    struct sr_ndentry* ent;
+    int i, slot = -1;
+
+    SR_NDCACHE_LOCK(cache);
+
+    for (req = cache->requests; req; req = next)
+    {
+        next = req->next;
+        if (memcmp(req->ip, ip, 16) == 0)
+        { sr_ndreq_destroy(cache, req); }
+    }
+
+    for (i = 0; i < SR_NDCACHE_SZ; i++)
+    {
+        if (cache->entries[i].valid && memcmp(cache->entries[i].ip, ip, 16) == 0)
+        {
+            slot = i;
+            break;
+        }
+        if (slot < 0 && !cache->entries[i].valid)
+        { slot = i; }
+    }
+
+    if (slot >= 0)
+    {
+        ent = &(cache->entries[slot]);
+        memcpy(ent->mac, mac, 6);
+        memcpy(ent->ip, ip, 16);
+        ent->added = time(0);
+        ent->valid = 1;
+        ent->is_static = 1;
+    }
+
+    SR_NDCACHE_UNLOCK(cache);
+
+    return (slot >= 0) ? 0 : -1;
+} /* -- sr_ndcache_add_static -- */
+
+int sr_ndcache_remove(struct sr_ndcache* cache, const uint8_t* ip)
+{
+    int i, found = -1;
+
+    SR_NDCACHE_LOCK(cache);
+    for (i = 0; i < SR_NDCACHE_SZ; i++)
+    {
+        if (cache->entries[i].valid && memcmp(cache->entries[i].ip, ip, 16) == 0)
+        {
+            cache->entries[i].valid = 0;
+            cache->entries[i].is_static = 0;
+            found = 0;
+        }
+    }
+    SR_NDCACHE_UNLOCK(cache);
+
+    return found;
+} /* -- sr_ndcache_remove -- */
+
+int sr_ndcache_flush(struct sr_ndcache* cache)
+{
+    int i, n = 0;
+
+    SR_NDCACHE_LOCK(cache);
+    for (i = 0; i < SR_NDCACHE_SZ; i++)
+    {
+        if (cache->entries[i].valid && !cache->entries[i].is_static)
+        {
+            cache->entries[i].valid = 0;
+            n++;
+        }
+    }
+    SR_NDCACHE_UNLOCK(cache);
+
+    return n;
+} /* -- sr_ndcache_flush -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ndcache_tick(..)
+ * Scope:  Global
+ *
+ * Invalidate entries older than SR_NDCACHE_TO seconds and give every
+ * queued request to sr_ip6_handle_ndreq.  Runs once a second.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_ndcache_tick(struct sr_instance* sr)
+{
+    struct sr_ndcache* cache = &(sr->nd);
+    struct sr_ndreq* req;
+    struct sr_ndreq* next;
+    time_t now = time(0);
+    int i;
+
+    SR_NDCACHE_LOCK(cache);
+
+    for (i = 0; i < SR_NDCACHE_SZ; i++)
+    {
+        if (cache->entries[i].valid && !cache->entries[i].is_static &&
+            difftime(now, cache->entries[i].added) > SR_NDCACHE_TO)
+        { cache->entries[i].valid = 0; }
+    }
+
+    /* -- handling may destroy the request -- */
+    for (req = cache->requests; req; req = next)
+    {
+        next = req->next;
+        sr_ip6_handle_ndreq(sr, req);
+    }
+
+    SR_NDCACHE_UNLOCK(cache);
+} /* -- sr_ndcache_tick -- */
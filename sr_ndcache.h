@@ -0,0 +1,98 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_ndcache.h
+ *
+ * Description:
+ *
+ * IPv6 neighbor cache (RFC 4861), the counterpart of sr_arpcache.h: a
+ * table of IPv6 -> MAC mappings that time out after SR_NDCACHE_TO
+ * seconds, and a queue of neighbor solicitations with the packets
+ * waiting on them.  sr_ip6.c sends the solicitations (every second, up
+ * to 5 times, then address unreachable to every waiting packet) and
+ * fills the table from the advertisements.
+ *
+ * A request keeps the interface its solicitations go out on; each of
+ * its packets keeps the interface it came in on, where an error about
+ * it is sent back.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_NDCACHE_H
+#define SR_NDCACHE_H
+
+#include <inttypes.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "sr_if.h"
+#include "sr_arpcache.h"
+
+struct sr_instance;
+
+#define SR_NDCACHE_SZ 100
+#define SR_NDCACHE_TO 15.0
+
+struct sr_ndentry
+{
+    unsigned char mac[6];
+    uint8_t ip[16];
+    time_t added;
+    int valid;
+    int is_static;              /* set over the control socket, never expires */
+};
+
+struct sr_ndreq
+{
+    uint8_t ip[16];             /* neighbor solicited */
+    char iface[sr_IFACE_NAMELEN]; /* to solicit it on */
+    time_t sent;                /* last solicitation, 0 for none yet */
+    uint32_t times_sent;
+    struct sr_packet* packets;  /* waiting, iface is where each came in */
+    struct sr_ndreq* next;
+};
+
+struct sr_ndcache
+{
+    struct sr_ndentry entries[SR_NDCACHE_SZ];
+    struct sr_ndreq* requests;
+    pthread_mutex_t lock;
+    pthread_mutexattr_t attr;
+    int use_locks;              /* as for struct sr_arpcache */
+};
+
+#define SR_NDCACHE_LOCK(cache) \
+    do { if ((cache)->use_locks) pthread_mutex_lock(&((cache)->lock)); } while (0)
+#define SR_NDCACHE_UNLOCK(cache) \
+    do { if ((cache)->use_locks) pthread_mutex_unlock(&((cache)->lock)); } while (0)
+
+int  sr_ndcache_init(struct sr_ndcache* cache);
+int  sr_ndcache_destroy(struct sr_ndcache* cache);
+
+/* -- copy the MAC for ip into mac; 0 if found, else -1 -- */
+int  sr_ndcache_lookup(struct sr_ndcache* cache, const uint8_t* ip,
+                       unsigned char* mac);
+
+/* -- queue a copy of packet (received on in_iface) on the request for ip
+ *    out of out_iface, creating the request if there is none -- */
+struct sr_ndreq* sr_ndcache_queuereq(struct sr_ndcache* cache,
+                                     const uint8_t* ip, const char* out_iface,
+                                     const uint8_t* packet, unsigned int len,
+                                     const char* in_iface);
+
+/* -- learn ip -> mac; returns the request for ip taken off the queue, for
+ *    the caller to send its packets and destroy, or NULL -- */
+struct sr_ndreq* sr_ndcache_insert(struct sr_ndcache* cache,
+                                   const unsigned char* mac, const uint8_t* ip);
+
+/* -- free req and its packets, unlinking it if still queued -- */
+void sr_ndreq_destroy(struct sr_ndcache* cache, struct sr_ndreq* req);
+
+/* -- control socket: as the sr_arpcache_* calls of the same names -- */
+int  sr_ndcache_add_static(struct sr_ndcache* cache, const unsigned char* mac,
+                           const uint8_t* ip);
+int  sr_ndcache_remove(struct sr_ndcache* cache, const uint8_t* ip);
+int  sr_ndcache_flush(struct sr_ndcache* cache);
+
+/* -- expire entries and sweep the requests, from sr_arpcache_tick -- */
+void sr_ndcache_tick(struct sr_instance* sr);
+
+#endif /* -- SR_NDCACHE_H -- */
@@ -0,0 +1,252 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_netdev.c
+ *
+ * Description:
+ *
+ * Netdev backend registry and the local interface file shared by the
+ * backends that do not get VNSHWINFO from a server.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "sr_router.h"
+#include "sr_netdev.h"
+#include "sr_if.h"
+
+static const struct sr_netdev_ops* sr_netdev_backends[] =
+{
+    &sr_netdev_vns,
+    &sr_netdev_tap,
+    &sr_netdev_afpacket,
+    &sr_netdev_shm,
+    0
+};
+
+/*---------------------------------------------------------------------
+ * Method: sr_netdev_find(..)
+ * Scope:  Global
+ *
+ * Look up a backend by name, NULL if there is none.
+ *
+ *---------------------------------------------------------------------*/
+
+const struct sr_netdev_ops* sr_netdev_find(const char* name)
+{
+    int i;
+
+    /* -- REQUIRES -- */
+    assert(name);
+
+    for (i = 0; sr_netdev_backends[i]; i++)
+    {
+        if (strcmp(sr_netdev_backends[i]->name, name) == 0)
+        { return sr_netdev_backends[i]; }
+    }
+    return 0;
+} /* -- sr_netdev_find -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_netdev_set_ip6(..)
+ * Scope:  Local
+ *
+ * Give interface name the IPv6 address addr ("ADDR/LEN").  Returns 0,
+ * or -1 if either is bad.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_netdev_set_ip6(struct sr_instance* sr, const char* name,
+                             char* addr)
+{
+    struct sr_if* iface = sr_get_interface(sr, name);
+    char* slash = strchr(addr, '/');
+    char* end;
+    long len;
+
+    if (iface == 0 || slash == 0)
+    { return -1; }
+    *slash = '\0';
+    len = strtol(slash + 1, &end, 10);
+    if (*end != '\0' || end == slash + 1 || len < 1 || len > 128 ||
+        inet_pton(AF_INET6, addr, iface->ip6) != 1)
+    { return -1; }
+    iface->ip6_plen = (int)len;
+    return 0;
+} /* -- sr_netdev_set_ip6 -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_netdev_load_ifaces(..)
+ * Scope:  Global
+ *
+ * Build sr->if_list and sr->netdev_conf from a local interface file
+ * (format in sr_netdev.h).  Returns 0 on success.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_netdev_load_ifaces(struct sr_instance* sr, const char* filename)
+{
+    struct sr_netdev_conf* conf = &(sr->netdev_conf);
+    struct sr_netdev_if* nif;
+    FILE* fp;
+    char line[BUFSIZ];
+    char name[32], mac[32], ip[32], device[32], ip6[64];
+    unsigned int m[ETHER_ADDR_LEN];
+    unsigned char addr[ETHER_ADDR_LEN];
+    struct in_addr ip_addr;
+    int lineno = 0, fields, i;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+    assert(filename);
+
+    if ((fp = fopen(filename, "r")) == 0)
+    {
+        perror("fopen(..):sr_netdev.c::sr_netdev_load_ifaces");
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), fp) != 0)
+    {
+        lineno++;
+        if (line[strspn(line, " \t\r\n")] == '\0' ||
+            line[strspn(line, " \t")] == '#')
+        { continue; }
+
+        /* -- speed NAME MBIT gives an interface its link speed -- */
+        if (sscanf(line, "%31s %31s %31s", name, mac, ip) == 3 &&
+            strcmp(name, "speed") == 0)
+        {
+            if ((nif = sr_netdev_find_if(sr, mac)) == 0)
+            {
+                fprintf(stderr, "%s:%d: expected speed name Mbit/s "
+                        "of a listed interface\n", filename, lineno);
+                fclose(fp);
+                return -1;
+            }
+            nif->iface->speed = strtoul(ip, 0, 10);
+            continue;
+        }
+
+        /* -- inet6 NAME ADDR/LEN gives an interface an IPv6 address -- */
+        if (sscanf(line, "%31s %31s %63s", name, mac, ip6) == 3 &&
+            strcmp(name, "inet6") == 0)
+        {
+            if (sr_netdev_set_ip6(sr, mac, ip6) != 0)
+            {
+                fprintf(stderr, "%s:%d: expected inet6 name address/length "
+                        "of a listed interface\n", filename, lineno);
+                fclose(fp);
+                return -1;
+            }
+            continue;
+        }
+
+        fields = sscanf(line, "%31s %31s %31s %31s", name, mac, ip, device);
+        if (fields < 3 ||
+            sscanf(mac, "%x:%x:%x:%x:%x:%x", &m[0], &m[1], &m[2], &m[3],
+                   &m[4], &m[5]) != ETHER_ADDR_LEN ||
+            inet_aton(ip, &ip_addr) == 0)
+        {
+            fprintf(stderr, "%s:%d: expected name mac ip [device]\n",
+                    filename, lineno);
+            fclose(fp);
+            return -1;
+        }
+        if (conf->nifs == SR_NETDEV_MAX_IFACES ||
+            strlen(name) >= sr_IFACE_NAMELEN ||
+            (fields == 4 && strlen(device) >= sr_IFACE_NAMELEN))
+        {
+            fprintf(stderr, "%s:%d: too many interfaces or name too long\n",
+                    filename, lineno);
+            fclose(fp);
+            return -1;
+        }
+
+        for (i = 0; i < ETHER_ADDR_LEN; i++)
+        { addr[i] = (unsigned char)m[i]; }
+
+        sr_add_interface(sr, name);
+        sr_set_ether_addr(sr, addr);
+        sr_set_ether_ip(sr, ip_addr.s_addr);
+
+        nif = &(conf->ifs[conf->nifs++]);
+        strcpy(nif->name, name);
+        strcpy(nif->device, fields == 4 ? device : name);
+        nif->iface = sr_get_interface(sr, name);
+        nif->iface->speed = 0;
+    }
+
+    fclose(fp);
+
+    if (conf->nifs == 0)
+    {
+        fprintf(stderr, "%s: no interfaces\n", filename);
+        return -1;
+    }
+
+    printf("Router interfaces:\n");
+    sr_print_if_list(sr);
+
+    return 0;
+} /* -- sr_netdev_load_ifaces -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_netdev_save_ifaces(..)
+ * Scope:  Global
+ *
+ * Write sr->if_list to out in the format sr_netdev_load_ifaces reads,
+ * whichever backend the interfaces came from.  Returns 0, or -1 on a
+ * write error.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_netdev_save_ifaces(struct sr_instance* sr, FILE* out)
+{
+    struct sr_if* iface;
+    struct sr_netdev_if* nif;
+    struct in_addr ip_addr;
+    char ip6[INET6_ADDRSTRLEN];
+
+    for (iface = sr->if_list; iface; iface = iface->next)
+    {
+        ip_addr.s_addr = iface->ip;
+        nif = sr_netdev_find_if(sr, iface->name);
+        fprintf(out, "%s %02x:%02x:%02x:%02x:%02x:%02x %s %s\n", iface->name,
+                iface->addr[0], iface->addr[1], iface->addr[2],
+                iface->addr[3], iface->addr[4], iface->addr[5],
+                inet_ntoa(ip_addr), nif ? nif->device : iface->name);
+        if (iface->ip6_plen)
+        {
+            inet_ntop(AF_INET6, iface->ip6, ip6, sizeof(ip6));
+            fprintf(out, "inet6 %s %s/%d\n", iface->name, ip6, iface->ip6_plen);
+        }
+        if (iface->speed)
+        { fprintf(out, "speed %s %u\n", iface->name, iface->speed); }
+    }
+    return ferror(out) ? -1 : 0;
+} /* -- sr_netdev_save_ifaces -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_netdev_find_if(..)
+ * Scope:  Global
+ *---------------------------------------------------------------------*/
+
+struct sr_netdev_if* sr_netdev_find_if(struct sr_instance* sr,
+                                       const char* name)
+{
+    struct sr_netdev_conf* conf = &(sr->netdev_conf);
+    int i;
+
+    for (i = 0; i < conf->nifs; i++)
+    {
+        if (strncmp(conf->ifs[i].name, name, sr_IFACE_NAMELEN) == 0)
+        { return &(conf->ifs[i]); }
+    }
+    return 0;
+} /* -- sr_netdev_find_if -- */
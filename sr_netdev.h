@@ -0,0 +1,123 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_netdev.h
+ *
+ * Description:
+ *
+ * Pluggable frame transport under sr_send_packet.  The original VNS
+ * tunnel is one backend; others attach the router directly to local
+ * devices.  A backend owns the receive loop (run) and hands every frame
+ * to sr_handlepacket_burst; sr_send_packet does the common checks and
+ * logging and then calls the backend's send.
+ *
+ * Backends without a VNS session take their interfaces from a local
+ * file instead of VNSHWINFO, one interface per line:
+ *
+ *   # name  mac                ip            [device]
+ *   eth1    0a:00:00:00:01:01  192.168.2.1   tap-eth1
+ *
+ * device is the backend's device name and defaults to the interface name.
+ * A line after an interface's may give it an IPv6 address; every
+ * interface also has a link-local one made from its MAC:
+ *
+ *   inet6   eth1  2001:db8:1::1/64
+ *
+ * and its link speed in Mbit/s, which -Q shapes the interface to:
+ *
+ *   speed   eth1  100
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_NETDEV_H
+#define SR_NETDEV_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#include <stdio.h>
+
+#include "sr_if.h"
+
+#define SR_NETDEV_MAX_IFACES 16
+#define SR_NETDEV_MAX_QUEUES 16
+
+struct sr_instance;
+
+/* ----------------------------------------------------------------------------
+ * struct sr_netdev_ops
+ *
+ * open:  set up devices for sr->if_list, called once before sr_init
+ *        (NULL when the transport is connected elsewhere, as for VNS)
+ * run:   receive loop, returns when the router should exit (0 ok, -1 error)
+ * send:  transmit one ethernet frame out of iface
+ * close: release what open set up (may be NULL)
+ * send_batch: transmit n frames out of iface, returning how many went
+ *        (may be NULL, send is then called for each)
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_netdev_ops
+{
+    const char* name;
+    int  (*open)(struct sr_instance* sr);
+    int  (*run)(struct sr_instance* sr);
+    int  (*send)(struct sr_instance* sr, const uint8_t* buf, unsigned int len,
+                 const char* iface);
+    void (*close)(struct sr_instance* sr);
+    int  (*send_batch)(struct sr_instance* sr, const uint8_t** bufs,
+                       const unsigned int* lens, int n, const char* iface);
+};
+
+/* ----------------------------------------------------------------------------
+ * struct sr_netdev_if
+ *
+ * Local interface configuration entry, see sr_netdev_load_ifaces.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_netdev_if
+{
+    char name[sr_IFACE_NAMELEN];   /* router interface */
+    char device[sr_IFACE_NAMELEN]; /* backend device */
+    struct sr_if* iface;
+};
+
+/* ----------------------------------------------------------------------------
+ * struct sr_netdev_conf
+ *
+ * Backend settings carried in sr_instance.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_netdev_conf
+{
+    struct sr_netdev_if ifs[SR_NETDEV_MAX_IFACES];
+    int nifs;
+    int queues;  /* queues per device, one receive thread each */
+    char arg[108]; /* backend argument, from -d name:arg */
+};
+
+/* -- sr_vns_comm.c -- */
+extern const struct sr_netdev_ops sr_netdev_vns;
+
+/* -- sr_tap.c -- */
+extern const struct sr_netdev_ops sr_netdev_tap;
+
+/* -- sr_afpacket.c -- */
+extern const struct sr_netdev_ops sr_netdev_afpacket;
+
+/* -- sr_shm.c -- */
+extern const struct sr_netdev_ops sr_netdev_shm;
+
+/* -- sr_netdev.c -- */
+const struct sr_netdev_ops* sr_netdev_find(const char* name);
+int sr_netdev_load_ifaces(struct sr_instance* sr, const char* filename);
+int sr_netdev_save_ifaces(struct sr_instance* sr, FILE* out);
+struct sr_netdev_if* sr_netdev_find_if(struct sr_instance* sr,
+                                       const char* name);
+
+#endif /* -- SR_NETDEV_H -- */
@@ -0,0 +1,839 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_netgen.c
+ *
+ * Description:
+ *
+ * Traffic source for the VNS, TAP and AF_PACKET transports, the
+ * counterpart of sr_shmgen.  It takes the router's interfaces from an
+ * interface file (see sr_netdev.h), answers the router's ARP requests,
+ * sends UDP frames in on the first interface and counts what the router
+ * forwards out of the others.
+ *
+ *   sr_netgen -i IFS -d DST_IP (-v PORT | -k DEV[,DEV..]) [-n COUNT]
+ *             [-l LEN] [-w WINDOW] [-c CTL]
+ *
+ *   -v  be the VNS server: listen on PORT for the router (started with
+ *       -s 127.0.0.1 -p PORT -r RTABLE), announce the interfaces of IFS
+ *       in VNSHWINFO and exchange frames as VNSPACKET commands
+ *   -k  exchange frames over raw sockets on the devices facing the
+ *       router's, one per interface of IFS in order: the peer end of each
+ *       veth (-d packet) or the TAP device itself (-d tap)
+ *   -w  frames in flight; a full window that does not move for a while
+ *       is counted lost, since a raw socket has no back pressure
+ *   -c  read the router's counters from its control socket before and
+ *       after the run and report its system calls per forwarded frame
+ *
+ * The first frame is sent and forwarded before the clock starts, so the
+ * ARP exchange is not part of the rate.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#ifdef _LINUX_
+#include <linux/if_packet.h>
+#include <linux/if_ether.h>
+#endif
+
+#include "sr_protocol.h"
+#include "vnscommand.h"
+
+#define GEN_BURST     32
+#define GEN_UDP       17
+#define GEN_IFACES    16
+#define GEN_FRAME_MAX 2048
+#define GEN_LEN_MAX   1514        /* -l: largest frame, no jumbo */
+#define GEN_WINDOW    1024        /* frames in flight by default */
+#define GEN_LOSS      0.05        /* seconds a full window may stand still */
+#define GEN_DRAIN     1.0         /* seconds to wait for stragglers */
+#define GEN_WARM      0.1         /* seconds between frames until one is forwarded */
+#define GEN_WARM_MAX  5.0         /* ... and at most, the router's ARP retries */
+#define GEN_VNS_OUT   (1 << 20)   /* VNSPACKET commands not yet sent */
+#define GEN_VNS_IN    (256 * 1024)
+#define GEN_CTL_MAX   8192
+#define GEN_SOCKBUF   (8 << 20)   /* -k: socket buffers */
+
+static const uint8_t gen_mac[ETHER_ADDR_LEN] = { 0x02, 0x4e, 0x47, 0x45, 0x4e, 0x01 };
+
+struct gen_if
+{
+    char name[sr_IFACE_NAMELEN];
+    uint8_t mac[ETHER_ADDR_LEN];
+    uint32_t ip;
+    char dev[IFNAMSIZ];
+    int fd;                 /* -k: raw socket on dev */
+};
+
+struct gen
+{
+    struct gen_if ifs[GEN_IFACES];
+    int nifs;
+    int vns;                /* -v: connection to the router, or -1 */
+    uint8_t* out;           /* -v: commands to send */
+    size_t out_len;
+    size_t out_off;
+    uint8_t* in;            /* -v: partial command */
+    size_t in_len;
+    int closed;             /* the router went away */
+    unsigned long forwarded;
+    unsigned long arps;
+    unsigned long other;
+    unsigned long syscalls;
+};
+
+/* -- router counters read over -c -- */
+struct gen_stats
+{
+    unsigned long long syscalls;
+    unsigned long long rx_packets;
+    unsigned long long tx_packets;
+};
+
+static double gen_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+} /* -- gen_now -- */
+
+static uint16_t gen_cksum(const void* data, int len)
+{
+    const uint8_t* p = data;
+    uint32_t sum = 0;
+
+    for (; len > 1; len -= 2, p += 2)
+    { sum += (p[0] << 8) | p[1]; }
+    if (len)
+    { sum += p[0] << 8; }
+    while (sum >> 16)
+    { sum = (sum & 0xffff) + (sum >> 16); }
+    return htons(~sum & 0xffff);
+} /* -- gen_cksum -- */
+
+/*---------------------------------------------------------------------
+ * Method: gen_load_ifs(..)
+ *
+ * Read the name, MAC and address of every interface in an interface
+ * file; the device column is ignored, -k names the devices facing them.
+ *
+ *---------------------------------------------------------------------*/
+
+static int gen_load_ifs(struct gen* g, const char* path)
+{
+    char line[256], name[64], mac[64], addr[64];
+    unsigned int m[ETHER_ADDR_LEN];
+    struct in_addr ia;
+    FILE* fp;
+    int k;
+
+    if ((fp = fopen(path, "r")) == 0)
+    {
+        perror(path);
+        return -1;
+    }
+    while (fgets(line, sizeof(line), fp))
+    {
+        if (sscanf(line, "%63s %63s %63s", name, mac, addr) != 3 ||
+            name[0] == '#' || strcmp(name, "inet6") == 0 ||
+            strcmp(name, "speed") == 0)
+        { continue; }
+        if (g->nifs == GEN_IFACES ||
+            sscanf(mac, "%x:%x:%x:%x:%x:%x", &m[0], &m[1], &m[2], &m[3],
+                   &m[4], &m[5]) != 6 ||
+            inet_aton(addr, &ia) == 0)
+        {
+            fprintf(stderr, "sr_netgen: %s: bad interface line: %s", path, line);
+            fclose(fp);
+            return -1;
+        }
+        strncpy(g->ifs[g->nifs].name, name, sr_IFACE_NAMELEN - 1);
+        for (k = 0; k < ETHER_ADDR_LEN; k++)
+        { g->ifs[g->nifs].mac[k] = (uint8_t)m[k]; }
+        g->ifs[g->nifs].ip = ia.s_addr;
+        g->ifs[g->nifs].fd = -1;
+        g->nifs++;
+    }
+    fclose(fp);
+    if (g->nifs < 2)
+    {
+        fprintf(stderr, "sr_netgen: %s: need two interfaces\n", path);
+        return -1;
+    }
+    return 0;
+} /* -- gen_load_ifs -- */
+
+/* -- -v: one whole command, blocking, for the handshake -- */
+static int gen_vns_write(struct gen* g, const void* buf, size_t len)
+{
+    const uint8_t* p = buf;
+    ssize_t n;
+
+    while (len > 0)
+    {
+        if ((n = send(g->vns, p, len, 0)) <= 0)
+        {
+            perror("send");
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+} /* -- gen_vns_write -- */
+
+/* -- -v: read one whole command into buf, blocking; returns its type -- */
+static int gen_vns_read(struct gen* g, uint8_t* buf, size_t size)
+{
+    uint32_t len;
+    size_t have = 0, want = 4;
+    ssize_t n;
+
+    while (have < want)
+    {
+        if ((n = recv(g->vns, buf + have, want - have, 0)) <= 0)
+        { return -1; }
+        if ((have += n) == 4)
+        {
+            memcpy(&len, buf, 4);
+            if ((want = ntohl(len)) < 8 || want > size)
+            { return -1; }
+        }
+    }
+    memcpy(&len, buf + 4, 4);
+    return (int)ntohl(len);
+} /* -- gen_vns_read -- */
+
+/*---------------------------------------------------------------------
+ * Method: gen_vns_open(..)
+ *
+ * Wait for the router on port, let it authenticate (any reply is
+ * accepted), answer its VNSOPEN with the interfaces and switch the
+ * connection to non-blocking.
+ *
+ *---------------------------------------------------------------------*/
+
+static int gen_vns_open(struct gen* g, int port)
+{
+    struct sockaddr_in addr;
+    uint8_t buf[4096];
+    c_auth_request req;
+    c_hwinfo hw;
+    uint32_t be;
+    int ls, one = 1, i, k = 0;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if ((ls = socket(AF_INET, SOCK_STREAM, 0)) < 0 ||
+        setsockopt(ls, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) < 0 ||
+        bind(ls, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(ls, 1) < 0)
+    {
+        perror("sr_netgen: listen");
+        return -1;
+    }
+    g->vns = accept(ls, 0, 0);
+    close(ls);
+    if (g->vns < 0)
+    {
+        perror("sr_netgen: accept");
+        return -1;
+    }
+    setsockopt(g->vns, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    /* -- authentication: the salt is not checked by anyone -- */
+    req.mLen = htonl(sizeof(req));
+    req.mType = htonl(VNS_AUTH_REQUEST);
+    if (gen_vns_write(g, &req, sizeof(req)) != 0 ||
+        gen_vns_read(g, buf, sizeof(buf)) != VNS_AUTH_REPLY)
+    {
+        fprintf(stderr, "sr_netgen: no authentication reply\n");
+        return -1;
+    }
+    be = htonl(sizeof(c_auth_status) + 2);
+    memcpy(buf, &be, 4);
+    be = htonl(VNS_AUTH_STATUS);
+    memcpy(buf + 4, &be, 4);
+    memcpy(buf + 8, "\001\n", 2);
+    if (gen_vns_write(g, buf, sizeof(c_auth_status) + 2) != 0 ||
+        gen_vns_read(g, buf, sizeof(buf)) != VNSOPEN)
+    {
+        fprintf(stderr, "sr_netgen: no VNSOPEN\n");
+        return -1;
+    }
+
+    memset(&hw, 0, sizeof(hw));
+    for (i = 0; i < g->nifs; i++)
+    {
+        hw.mHWInfo[k].mKey = htonl(HWINTERFACE);
+        strncpy(hw.mHWInfo[k++].value, g->ifs[i].name, 31);
+        hw.mHWInfo[k].mKey = htonl(HWETHER);
+        memcpy(hw.mHWInfo[k++].value, g->ifs[i].mac, ETHER_ADDR_LEN);
+        hw.mHWInfo[k].mKey = htonl(HWETHIP);
+        memcpy(hw.mHWInfo[k++].value, &g->ifs[i].ip, 4);
+    }
+    hw.mLen = htonl(8 + k * sizeof(c_hw_entry));
+    hw.mType = htonl(VNSHWINFO);
+    if (gen_vns_write(g, &hw, 8 + k * sizeof(c_hw_entry)) != 0)
+    { return -1; }
+
+    fcntl(g->vns, F_SETFL, fcntl(g->vns, F_GETFL) | O_NONBLOCK);
+    if ((g->out = malloc(GEN_VNS_OUT)) == 0 || (g->in = malloc(GEN_VNS_IN)) == 0)
+    { return -1; }
+    return 0;
+} /* -- gen_vns_open -- */
+
+/*---------------------------------------------------------------------
+ * Method: gen_raw_open(..)
+ *
+ * -k: a raw socket on every device of the comma separated list, in the
+ * order of the interfaces.
+ *
+ *---------------------------------------------------------------------*/
+
+static int gen_raw_open(struct gen* g, char* devs)
+{
+    struct sockaddr_ll sll;
+    char* dev;
+    int i, one = 1, buf = GEN_SOCKBUF;
+
+    for (i = 0, dev = strtok(devs, ","); i < g->nifs && dev;
+         i++, dev = strtok(0, ","))
+    {
+        strncpy(g->ifs[i].dev, dev, IFNAMSIZ - 1);
+        memset(&sll, 0, sizeof(sll));
+        sll.sll_family = AF_PACKET;
+        sll.sll_protocol = htons(ETH_P_ALL);
+        if ((sll.sll_ifindex = if_nametoindex(dev)) == 0 ||
+            (g->ifs[i].fd = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL))) < 0 ||
+            bind(g->ifs[i].fd, (struct sockaddr*)&sll, sizeof(sll)) < 0)
+        {
+            perror(dev);
+            return -1;
+        }
+#ifdef PACKET_IGNORE_OUTGOING
+        setsockopt(g->ifs[i].fd, SOL_PACKET, PACKET_IGNORE_OUTGOING, &one, sizeof(one));
+#endif
+        /* -- a window of frames must fit, past the default limit as root -- */
+        if (setsockopt(g->ifs[i].fd, SOL_SOCKET, SO_RCVBUFFORCE, &buf, sizeof(buf)) < 0)
+        { setsockopt(g->ifs[i].fd, SOL_SOCKET, SO_RCVBUF, &buf, sizeof(buf)); }
+        if (setsockopt(g->ifs[i].fd, SOL_SOCKET, SO_SNDBUFFORCE, &buf, sizeof(buf)) < 0)
+        { setsockopt(g->ifs[i].fd, SOL_SOCKET, SO_SNDBUF, &buf, sizeof(buf)); }
+        fcntl(g->ifs[i].fd, F_SETFL, fcntl(g->ifs[i].fd, F_GETFL) | O_NONBLOCK);
+    }
+    if (i < g->nifs)
+    {
+        fprintf(stderr, "sr_netgen: -k needs %d devices\n", g->nifs);
+        return -1;
+    }
+    return 0;
+} /* -- gen_raw_open -- */
+
+/* -- -v: push out what the socket takes -- */
+static void gen_vns_flush(struct gen* g)
+{
+    ssize_t n;
+
+    while (g->out_off < g->out_len)
+    {
+        n = send(g->vns, g->out + g->out_off, g->out_len - g->out_off, MSG_DONTWAIT);
+        g->syscalls++;
+        if (n <= 0)
+        {
+            if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            { g->closed = 1; }
+            break;
+        }
+        g->out_off += n;
+    }
+    if (g->out_off == g->out_len)
+    { g->out_off = g->out_len = 0; }
+    else if (g->out_off > GEN_VNS_OUT / 2)
+    {
+        memmove(g->out, g->out + g->out_off, g->out_len - g->out_off);
+        g->out_len -= g->out_off;
+        g->out_off = 0;
+    }
+} /* -- gen_vns_flush -- */
+
+/*---------------------------------------------------------------------
+ * Method: gen_send(..)
+ *
+ * Send n frames of len bytes out of interface i.  With -v they are
+ * queued as VNSPACKET commands and flushed; returns how many were taken.
+ *
+ *---------------------------------------------------------------------*/
+
+static unsigned int gen_send(struct gen* g, int i, uint8_t** frames,
+                             unsigned int len, unsigned int n)
+{
+    struct mmsghdr msgs[GEN_BURST];
+    struct iovec iov[GEN_BURST];
+    c_packet_header ph;
+    unsigned int k;
+    int ret;
+
+    if (g->vns >= 0)
+    {
+        for (k = 0; k < n && g->out_len + sizeof(ph) + len <= GEN_VNS_OUT; k++)
+        {
+            ph.mLen = htonl(sizeof(ph) + len);
+            ph.mType = htonl(VNSPACKET);
+            memset(ph.mInterfaceName, 0, sizeof(ph.mInterfaceName));
+            strncpy(ph.mInterfaceName, g->ifs[i].name, sizeof(ph.mInterfaceName) - 1);
+            memcpy(g->out + g->out_len, &ph, sizeof(ph));
+            memcpy(g->out + g->out_len + sizeof(ph), frames[k], len);
+            g->out_len += sizeof(ph) + len;
+        }
+        gen_vns_flush(g);
+        return k;
+    }
+
+    memset(msgs, 0, sizeof(msgs[0]) * n);
+    for (k = 0; k < n; k++)
+    {
+        iov[k].iov_base = frames[k];
+        iov[k].iov_len = len;
+        msgs[k].msg_hdr.msg_iov = &iov[k];
+        msgs[k].msg_hdr.msg_iovlen = 1;
+    }
+    ret = sendmmsg(g->ifs[i].fd, msgs, n, MSG_DONTWAIT);
+    g->syscalls++;
+    return ret > 0 ? (unsigned int)ret : 0;
+} /* -- gen_send -- */
+
+/*---------------------------------------------------------------------
+ * Method: gen_frame(..)
+ *
+ * A frame the router sent out of interface i: answer ARP requests with
+ * our MAC, count forwarded UDP.
+ *
+ *---------------------------------------------------------------------*/
+
+static void gen_frame(struct gen* g, int i, uint8_t* frame, unsigned int len)
+{
+    sr_ethernet_hdr_t* eh = (sr_ethernet_hdr_t*)frame;
+    sr_arp_hdr_t* ah = (sr_arp_hdr_t*)(eh + 1);
+    uint8_t reply[sizeof(sr_ethernet_hdr_t) + sizeof(sr_arp_hdr_t)];
+    sr_ethernet_hdr_t* reh = (sr_ethernet_hdr_t*)reply;
+    sr_arp_hdr_t* rah = (sr_arp_hdr_t*)(reh + 1);
+    uint8_t* one = reply;
+
+    if (len < sizeof(*eh))
+    {
+        g->other++;
+        return;
+    }
+    if (ntohs(eh->ether_type) == ethertype_arp && len >= sizeof(*eh) + sizeof(*ah) &&
+        ntohs(ah->ar_op) == arp_op_request && ah->ar_tip != g->ifs[i].ip)
+    {
+        memcpy(reh->ether_dhost, ah->ar_sha, ETHER_ADDR_LEN);
+        memcpy(reh->ether_shost, gen_mac, ETHER_ADDR_LEN);
+        reh->ether_type = htons(ethertype_arp);
+        rah->ar_hrd = htons(arp_hrd_ethernet);
+        rah->ar_pro = htons(ethertype_ip);
+        rah->ar_hln = ETHER_ADDR_LEN;
+        rah->ar_pln = 4;
+        rah->ar_op = htons(arp_op_reply);
+        memcpy(rah->ar_sha, gen_mac, ETHER_ADDR_LEN);
+        rah->ar_sip = ah->ar_tip;
+        memcpy(rah->ar_tha, ah->ar_sha, ETHER_ADDR_LEN);
+        rah->ar_tip = ah->ar_sip;
+        gen_send(g, i, &one, sizeof(reply), 1);
+        g->arps++;
+    }
+    else if (i != 0 && memcmp(eh->ether_dhost, gen_mac, ETHER_ADDR_LEN) == 0 &&
+             ntohs(eh->ether_type) == ethertype_ip &&
+             len >= sizeof(*eh) + sizeof(sr_ip_hdr_t) &&
+             ((sr_ip_hdr_t*)(eh + 1))->ip_p == GEN_UDP)
+    { g->forwarded++; }
+    else
+    { g->other++; }
+} /* -- gen_frame -- */
+
+/* -- -v: frame every complete command received -- */
+static unsigned int gen_vns_recv(struct gen* g)
+{
+    unsigned int frames = 0;
+    uint32_t len, type;
+    size_t off;
+    ssize_t n;
+    int i;
+
+    while (!g->closed)
+    {
+        n = recv(g->vns, g->in + g->in_len, GEN_VNS_IN - g->in_len, MSG_DONTWAIT);
+        g->syscalls++;
+        if (n <= 0)
+        {
+            if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+            { g->closed = 1; }
+            break;
+        }
+        g->in_len += n;
+
+        for (off = 0; g->in_len - off >= 8; off += len)
+        {
+            memcpy(&len, g->in + off, 4);
+            memcpy(&type, g->in + off + 4, 4);
+            len = ntohl(len);
+            if (len < 8 || len > GEN_VNS_IN)
+            {
+                g->closed = 1;
+                return frames;
+            }
+            if (g->in_len - off < len)
+            { break; }
+            if (ntohl(type) == VNSPACKET && len > sizeof(c_packet_header))
+            {
+                c_packet_header* ph = (c_packet_header*)(g->in + off);
+
+                for (i = 0; i < g->nifs; i++)
+                {
+                    if (strncmp(ph->mInterfaceName, g->ifs[i].name,
+                                sizeof(ph->mInterfaceName)) == 0)
+                    {
+                        gen_frame(g, i, (uint8_t*)(ph + 1), len - sizeof(*ph));
+                        break;
+                    }
+                }
+                frames++;
+            }
+            else if (ntohl(type) == VNSCLOSE)
+            { g->closed = 1; }
+        }
+        memmove(g->in, g->in + off, g->in_len - off);
+        g->in_len -= off;
+    }
+    return frames;
+} /* -- gen_vns_recv -- */
+
+/* -- -k: read every interface dry -- */
+static unsigned int gen_raw_recv(struct gen* g)
+{
+    static uint8_t bufs[GEN_BURST][GEN_FRAME_MAX];
+    struct mmsghdr msgs[GEN_BURST];
+    struct iovec iov[GEN_BURST];
+    struct sockaddr_ll from[GEN_BURST];
+    unsigned int frames = 0;
+    int i, k, n;
+
+    for (i = 0; i < g->nifs; i++)
+    {
+        do
+        {
+            memset(msgs, 0, sizeof(msgs));
+            for (k = 0; k < GEN_BURST; k++)
+            {
+                iov[k].iov_base = bufs[k];
+                iov[k].iov_len = GEN_FRAME_MAX;
+                msgs[k].msg_hdr.msg_iov = &iov[k];
+                msgs[k].msg_hdr.msg_iovlen = 1;
+                msgs[k].msg_hdr.msg_name = &from[k];
+                msgs[k].msg_hdr.msg_namelen = sizeof(from[k]);
+            }
+            n = recvmmsg(g->ifs[i].fd, msgs, GEN_BURST, MSG_DONTWAIT, 0);
+            g->syscalls++;
+            for (k = 0; k < n; k++)
+            {
+                /* -- our own frames, where PACKET_IGNORE_OUTGOING is missing -- */
+                if (from[k].sll_pkttype == PACKET_OUTGOING)
+                { continue; }
+                gen_frame(g, i, bufs[k], msgs[k].msg_len);
+                frames++;
+            }
+        } while (n == GEN_BURST);
+    }
+    return frames;
+} /* -- gen_raw_recv -- */
+
+/*---------------------------------------------------------------------
+ * Method: gen_io(..)
+ *
+ * Take in everything the router sent; if there was nothing, wait up to
+ * timeout_ms for it.  Returns the number of frames.
+ *
+ *---------------------------------------------------------------------*/
+
+static unsigned int gen_io(struct gen* g, int timeout_ms)
+{
+    struct pollfd pfd[GEN_IFACES];
+    unsigned int n;
+    int i, nfds = 0;
+
+    if (g->vns >= 0 && g->out_len > 0)
+    { gen_vns_flush(g); }
+    n = (g->vns >= 0) ? gen_vns_recv(g) : gen_raw_recv(g);
+    if (n > 0 || timeout_ms == 0 || g->closed)
+    { return n; }
+
+    if (g->vns >= 0)
+    {
+        pfd[0].fd = g->vns;
+        pfd[0].events = POLLIN | (g->out_len > 0 ? POLLOUT : 0);
+        nfds = 1;
+    }
+    else
+    {
+        for (i = 0; i < g->nifs; i++, nfds++)
+        {
+            pfd[i].fd = g->ifs[i].fd;
+            pfd[i].events = POLLIN;
+        }
+    }
+    g->syscalls++;
+    if (poll(pfd, nfds, timeout_ms) <= 0)
+    { return 0; }
+    if (g->vns >= 0 && g->out_len > 0)
+    { gen_vns_flush(g); }
+    return (g->vns >= 0) ? gen_vns_recv(g) : gen_raw_recv(g);
+} /* -- gen_io -- */
+
+/*---------------------------------------------------------------------
+ * Method: gen_ctl_stats(..)
+ *
+ * -c: the router's "stats" counters.
+ *
+ *---------------------------------------------------------------------*/
+
+static int gen_ctl_stats(const char* path, struct gen_stats* st)
+{
+    struct sockaddr_un addr;
+    char buf[GEN_CTL_MAX], *p;
+    size_t have = 0;
+    ssize_t n;
+    int fd;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0 ||
+        connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+        write(fd, "stats\n", 6) != 6)
+    {
+        perror(path);
+        if (fd >= 0)
+        { close(fd); }
+        return -1;
+    }
+    while (have < sizeof(buf) - 1 && (n = read(fd, buf + have, sizeof(buf) - 1 - have)) > 0)
+    { have += n; }
+    close(fd);
+    buf[have] = '\0';
+
+    memset(st, 0, sizeof(*st));
+    for (p = strtok(buf, "\n"); p; p = strtok(0, "\n"))
+    {
+        sscanf(p, "syscalls %llu", &st->syscalls);
+        sscanf(p, "rx_packets %llu", &st->rx_packets);
+        sscanf(p, "tx_packets %llu", &st->tx_packets);
+    }
+    return 0;
+} /* -- gen_ctl_stats -- */
+
+static void usage(const char* argv0)
+{
+    fprintf(stderr, "Usage: %s -i iface file -d dst_ip (-v port | -k dev[,dev..]) "
+            "[-n count] [-l frame length] [-w window] [-c ctl socket]\n", argv0);
+} /* -- usage -- */
+
+int main(int argc, char** argv)
+{
+    struct gen g;
+    struct gen_stats before, after;
+    uint8_t tmpl[GEN_FRAME_MAX];
+    uint8_t* frames[GEN_BURST];
+    sr_ethernet_hdr_t* eh = (sr_ethernet_hdr_t*)tmpl;
+    sr_ip_hdr_t* ip = (sr_ip_hdr_t*)(eh + 1);
+    uint16_t* udp = (uint16_t*)(ip + 1);
+    const char *ifs = 0, *ctl = 0;
+    char* devs = 0;
+    struct in_addr dst, src;
+    unsigned long count = 1000000, window = GEN_WINDOW, sent = 0, lost = 0;
+    unsigned long inflight, last;
+    unsigned int len = 64, n, k;
+    double start, end, still, drain;
+    int c, port = 0;
+
+    memset(&g, 0, sizeof(g));
+    g.vns = -1;
+    dst.s_addr = 0;
+    while ((c = getopt(argc, argv, "hi:d:v:k:n:l:w:c:")) != EOF)
+    {
+        switch (c)
+        {
+            case 'i': ifs = optarg; break;
+            case 'v': port = atoi(optarg); break;
+            case 'k': devs = optarg; break;
+            case 'n': count = strtoul(optarg, 0, 10); break;
+            case 'l': len = atoi(optarg); break;
+            case 'w': window = strtoul(optarg, 0, 10); break;
+            case 'c': ctl = optarg; break;
+            case 'd':
+                if (inet_aton(optarg, &dst) == 0)
+                { usage(argv[0]); return 1; }
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if (!ifs || dst.s_addr == 0 || (port == 0) == (devs == 0) || count == 0 ||
+        window < GEN_BURST)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+    if (len < sizeof(*eh) + sizeof(*ip) + 8)
+    { len = sizeof(*eh) + sizeof(*ip) + 8; }
+    if (len > GEN_LEN_MAX)
+    { len = GEN_LEN_MAX; }
+
+    if (gen_load_ifs(&g, ifs) != 0 ||
+        (port ? gen_vns_open(&g, port) : gen_raw_open(&g, devs)) != 0)
+    { return 1; }
+
+    /* -- frame template: UDP from the next address after the router's
+     *    first interface to dst; the router rewrites only its copy -- */
+    src.s_addr = htonl(ntohl(g.ifs[0].ip) + 1);
+    memset(tmpl, 0, sizeof(tmpl));
+    memcpy(eh->ether_dhost, g.ifs[0].mac, ETHER_ADDR_LEN);
+    memcpy(eh->ether_shost, gen_mac, ETHER_ADDR_LEN);
+    eh->ether_type = htons(ethertype_ip);
+    ip->ip_v = 4;
+    ip->ip_hl = 5;
+    ip->ip_len = htons(len - sizeof(*eh));
+    ip->ip_ttl = 64;
+    ip->ip_p = GEN_UDP;
+    ip->ip_src = src.s_addr;
+    ip->ip_dst = dst.s_addr;
+    ip->ip_sum = gen_cksum(ip, sizeof(*ip));
+    udp[0] = htons(1024);
+    udp[1] = htons(9);
+    udp[2] = htons(len - sizeof(*eh) - sizeof(*ip));
+    udp[3] = 0;
+    for (k = 0; k < GEN_BURST; k++)
+    { frames[k] = tmpl; }
+
+    printf("sr_netgen: %lu x %u byte frames into %s over %s, %s -> ",
+           count, len, g.ifs[0].name, port ? "VNS" : g.ifs[0].dev, inet_ntoa(src));
+    printf("%s\n", inet_ntoa(dst));
+
+    /* -- one frame through, so the router has resolved dst; a frame
+     *    queued behind an ARP request nobody answered yet (the router
+     *    asks for its next hops at start) may be dropped, so keep
+     *    offering one until it gets through -- */
+    start = still = gen_now() - GEN_WARM;
+    while (g.forwarded == 0 && !g.closed && gen_now() - start < GEN_WARM_MAX)
+    {
+        if (gen_now() - still >= GEN_WARM)
+        {
+            gen_send(&g, 0, frames, len, 1);
+            still = gen_now();
+        }
+        gen_io(&g, 10);
+    }
+    /* -- and the stragglers of the above, before counting starts -- */
+    drain = gen_now();
+    while (!g.closed && gen_now() - drain < GEN_WARM)
+    { gen_io(&g, 10); }
+    if (g.forwarded == 0)
+    {
+        fprintf(stderr, "sr_netgen: nothing forwarded to %s\n", inet_ntoa(dst));
+        return 1;
+    }
+    if (ctl && gen_ctl_stats(ctl, &before) != 0)
+    { return 1; }
+
+    sent = g.forwarded = g.syscalls = 0;
+    start = still = gen_now();
+    last = 0;
+    while (sent < count && !g.closed)
+    {
+        inflight = sent - g.forwarded - lost;
+        n = 0;
+        if (inflight < window)
+        {
+            n = GEN_BURST;
+            if (n > count - sent)
+            { n = count - sent; }
+            if (n > window - inflight)
+            { n = window - inflight; }
+            n = gen_send(&g, 0, frames, len, n);
+            sent += n;
+        }
+        gen_io(&g, n > 0 ? 0 : 1);
+
+        /* -- a full window that stands still lost its frames -- */
+        if (g.forwarded != last || n > 0)
+        {
+            last = g.forwarded;
+            still = gen_now();
+        }
+        else if (gen_now() - still > GEN_LOSS)
+        {
+            lost = sent - g.forwarded;
+            still = gen_now();
+        }
+    }
+
+    /* -- wait for the router to catch up -- */
+    drain = gen_now();
+    last = g.forwarded;
+    while (g.forwarded + lost < sent && !g.closed && gen_now() - drain < GEN_DRAIN)
+    {
+        gen_io(&g, 10);
+        if (g.forwarded != last)
+        {
+            last = g.forwarded;
+            drain = gen_now();
+        }
+    }
+    end = drain;
+    if (g.forwarded > sent)
+    { g.forwarded = sent; }
+
+    printf("sent %lu, forwarded %lu, arp %lu, other %lu in %.3f s, "
+           "%.2f generator syscalls per frame\n", sent, g.forwarded, g.arps,
+           g.other, end - start, sent ? (double)g.syscalls / sent : 0.0);
+    if (ctl && gen_ctl_stats(ctl, &after) == 0 && after.tx_packets > before.tx_packets)
+    {
+        printf("router: %llu syscalls for %llu frames in, %llu out, "
+               "%.3f per frame forwarded\n",
+               after.syscalls - before.syscalls, after.rx_packets - before.rx_packets,
+               after.tx_packets - before.tx_packets,
+               (double)(after.syscalls - before.syscalls) /
+               (after.tx_packets - before.tx_packets));
+    }
+    printf("%.3f Mpps offered, %.3f Mpps forwarded\n",
+           sent / (end - start) / 1e6, g.forwarded / (end - start) / 1e6);
+
+    if (g.vns >= 0)
+    {
+        c_close cl;
+
+        memset(&cl, 0, sizeof(cl));
+        cl.mLen = htonl(sizeof(cl));
+        cl.mType = htonl(VNSCLOSE);
+        strcpy(cl.mErrorMessage, "sr_netgen done");
+        fcntl(g.vns, F_SETFL, fcntl(g.vns, F_GETFL) & ~O_NONBLOCK);
+        gen_vns_write(&g, &cl, sizeof(cl));
+        close(g.vns);
+    }
+    return g.forwarded == sent ? 0 : 2;
+} /* -- main -- */
@@ -0,0 +1,412 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_ortc.c
+ *
+ * Description:
+ *
+ * ORTC FIB compression, see sr_ortc.h.
+ *
+ * The FIB's trie is mirrored into one array (node i's next hop set lives
+ * at sets[i * words]) and worked on in the paper's passes:
+ *
+ *   1. label every prefix with its next hop group; a missing child stands
+ *      for a leaf holding the next hop it inherits (the normalization)
+ *   2. bottom up, the set of a node is the intersection of its children's
+ *      sets, or their union if that is empty
+ *   3. top down, a node whose set holds the next hop it inherits from the
+ *      routes emitted above it needs no route; otherwise it gets one with
+ *      any next hop of its set
+ *
+ * A node with unrouted addresses below it is kept out of 2 and 3 and
+ * never gets a route, since a covering route would capture them.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <time.h>
+
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "sr_rt.h"
+#include "sr_fib.h"
+#include "sr_ortc.h"
+#include "sr_common.h"
+
+#define SR_ORTC_WORDS ((SR_ORTC_MAX_LABELS + 63) / 64)
+#define SR_ORTC_HASH  (SR_ORTC_MAX_LABELS * 4)   /* power of 2 */
+
+struct sr_ortc_node
+{
+    uint32_t child[2];          /* index, 0 for none (0 is the root) */
+    int label;                  /* group of the prefix's own routes, -1 none */
+    int hasnull;                /* unrouted addresses below */
+};
+
+struct sr_ortc
+{
+    struct sr_ortc_node* nodes;
+    uint32_t n;
+    uint32_t cap;
+    const struct sr_rt* labels[SR_ORTC_MAX_LABELS];  /* group leaders */
+    unsigned int nlabels;
+    int index[SR_ORTC_HASH];                         /* label + 1, 0 empty */
+    uint64_t* sets;
+    unsigned int words;
+    struct sr_fib* out;
+    int err;
+};
+
+/*---------------------------------------------------------------------
+ * Method: sr_ortc_group_eq(..)
+ * Scope:  Global
+ *
+ * Whether two group leaders forward the same way: the same gateways,
+ * interfaces and weights in the same order.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_ortc_group_eq(const struct sr_rt* a, const struct sr_rt* b)
+{
+    for (; a && b; a = a->ecmp_next, b = b->ecmp_next)
+    {
+        if (a->gw.s_addr != b->gw.s_addr || a->weight != b->weight ||
+            strncmp(a->interface, b->interface, sr_IFACE_NAMELEN) != 0)
+        { return 0; }
+    }
+    return a == b;
+} /* -- sr_ortc_group_eq -- */
+
+static uint32_t sr_ortc_group_hash(const struct sr_rt* rt)
+{
+    uint32_t h = 2166136261u;
+    int i;
+
+    for (; rt; rt = rt->ecmp_next)
+    {
+        h = (h ^ rt->gw.s_addr) * 16777619u;
+        h = (h ^ rt->weight) * 16777619u;
+        for (i = 0; i < sr_IFACE_NAMELEN && rt->interface[i]; i++)
+        { h = (h ^ (unsigned char)rt->interface[i]) * 16777619u; }
+    }
+    return h ^ (h >> 16);
+} /* -- sr_ortc_group_hash -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ortc_label(..)
+ * Scope:  Local
+ *
+ * Label of the group led by rt, added if new.  -1 if there are more
+ * than SR_ORTC_MAX_LABELS groups.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_ortc_label(struct sr_ortc* o, const struct sr_rt* rt)
+{
+    uint32_t slot = sr_ortc_group_hash(rt) & (SR_ORTC_HASH - 1);
+
+    for (; o->index[slot]; slot = (slot + 1) & (SR_ORTC_HASH - 1))
+    {
+        if (sr_ortc_group_eq(o->labels[o->index[slot] - 1], rt))
+        { return o->index[slot] - 1; }
+    }
+    if (o->nlabels == SR_ORTC_MAX_LABELS)
+    { return -1; }
+    o->labels[o->nlabels] = rt;
+    o->index[slot] = ++o->nlabels;
+    return o->nlabels - 1;
+} /* -- sr_ortc_label -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ortc_build(..)
+ * Scope:  Local
+ *
+ * Pass 1: mirror the subtrie at fn, returning its index.  Sets o->err
+ * if there are too many groups.
+ *
+ *---------------------------------------------------------------------*/
+
+static uint32_t sr_ortc_build(struct sr_ortc* o, const struct sr_fib_node* fn)
+{
+    uint32_t i = o->n++;
+    int side;
+
+    assert(i < o->cap);
+    o->nodes[i].label = -1;
+    o->nodes[i].hasnull = 0;
+    if (fn->route && (o->nodes[i].label = sr_ortc_label(o, fn->route)) < 0)
+    { o->err = SR_FIB_NOMEM; }
+
+    for (side = 0; side < 2; side++)
+    {
+        o->nodes[i].child[side] = 0;
+        if (fn->child[side] && !o->err)
+        { o->nodes[i].child[side] = sr_ortc_build(o, fn->child[side]); }
+    }
+    return i;
+} /* -- sr_ortc_build -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ortc_sets(..)
+ * Scope:  Local
+ *
+ * Pass 2 for the subtree at i, whose prefix inherits the next hop
+ * label inherited (-1 for none) from the routes above it.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_ortc_sets(struct sr_ortc* o, uint32_t i, int inherited)
+{
+    struct sr_ortc_node* node = &o->nodes[i];
+    uint64_t* set = o->sets + (size_t)i * o->words;
+    uint64_t leaf[SR_ORTC_WORDS];
+    const uint64_t* cs[2];
+    uint64_t any = 0;
+    int label = node->label >= 0 ? node->label : inherited;
+    unsigned int w;
+    int side;
+
+    memset(leaf, 0, sizeof(leaf));
+    if (label >= 0)
+    { leaf[label / 64] = (uint64_t)1 << (label % 64); }
+
+    if (!node->child[0] && !node->child[1])
+    {
+        node->hasnull = label < 0;
+        memcpy(set, leaf, o->words * sizeof(uint64_t));
+        return;
+    }
+
+    for (side = 0; side < 2; side++)
+    {
+        if (node->child[side])
+        {
+            sr_ortc_sets(o, node->child[side], label);
+            cs[side] = o->sets + (size_t)node->child[side] * o->words;
+            node->hasnull |= o->nodes[node->child[side]].hasnull;
+        }
+        else
+        {
+            cs[side] = leaf;
+            node->hasnull |= label < 0;
+        }
+    }
+    if (node->hasnull)
+    { return; }
+
+    for (w = 0; w < o->words; w++)
+    { any |= (set[w] = cs[0][w] & cs[1][w]); }
+    if (!any)
+    {
+        for (w = 0; w < o->words; w++)
+        { set[w] = cs[0][w] | cs[1][w]; }
+    }
+} /* -- sr_ortc_sets -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ortc_emit(..)
+ * Scope:  Local
+ *
+ * Add routes for prefix/len (host byte order) copying group label.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_ortc_emit(struct sr_ortc* o, uint32_t prefix, int len, int label)
+{
+    const struct sr_rt* member;
+    struct sr_rt* rt;
+
+    for (member = o->labels[label]; member && !o->err; member = member->ecmp_next)
+    {
+        if ((rt = (struct sr_rt*)calloc(1, sizeof(*rt))) == 0)
+        {
+            o->err = SR_FIB_NOMEM;
+            return;
+        }
+        rt->dest.s_addr = htonl(prefix);
+        rt->mask.s_addr = len ? htonl(0xffffffffu << (32 - len)) : 0;
+        rt->gw = member->gw;
+        memcpy(rt->interface, member->interface, sr_IFACE_NAMELEN);
+        rt->weight = member->weight;
+        if ((o->err = sr_fib_insert(o->out, rt)) != SR_FIB_OK)
+        { free(rt); }
+    }
+} /* -- sr_ortc_emit -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ortc_assign(..)
+ * Scope:  Local
+ *
+ * Pass 3 for the subtree at i, prefix/len.  orig is the label the
+ * prefix inherits in the input, out the one it inherits from the
+ * routes emitted so far.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_ortc_assign(struct sr_ortc* o, uint32_t i, uint32_t prefix,
+                           int len, int orig, int out)
+{
+    struct sr_ortc_node* node = &o->nodes[i];
+    const uint64_t* set = o->sets + (size_t)i * o->words;
+    int label = node->label >= 0 ? node->label : orig;
+    unsigned int w;
+    int side;
+
+    if (node->hasnull)
+    { out = -1; }
+    else if (out < 0 || !(set[out / 64] & ((uint64_t)1 << (out % 64))))
+    {
+        for (w = 0; !set[w]; w++)
+        { }
+        for (out = w * 64; !(set[w] & ((uint64_t)1 << (out % 64))); out++)
+        { }
+        sr_ortc_emit(o, prefix, len, out);
+    }
+
+    if (!node->child[0] && !node->child[1])
+    { return; }
+
+    for (side = 0; side < 2 && !o->err; side++)
+    {
+        uint32_t sub = prefix | ((uint32_t)side << (31 - len));
+
+        if (node->child[side])
+        { sr_ortc_assign(o, node->child[side], sub, len + 1, label, out); }
+        else if (label >= 0 && label != out)
+        { sr_ortc_emit(o, sub, len + 1, label); }
+    }
+} /* -- sr_ortc_assign -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ortc_compress(..)
+ * Scope:  Global
+ *
+ * A new FIB forwarding like fib with the fewest prefixes ORTC finds, or
+ * NULL if out of memory or fib has more than SR_ORTC_MAX_LABELS next hop
+ * groups.  fib is only read.  st, if given, is filled in.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_fib* sr_ortc_compress(const struct sr_fib* fib, struct sr_ortc_stats* st)
+{
+    struct sr_ortc* o;
+    struct sr_fib* out = 0;
+    uint64_t t0, t1;
+
+    /* -- REQUIRES -- */
+    assert(fib);
+
+    t0 = sr_now_ns();
+    if ((o = (struct sr_ortc*)calloc(1, sizeof(*o))) == 0)
+    { return 0; }
+    o->cap = fib->nodes;
+    if ((o->nodes = (struct sr_ortc_node*)
+         malloc(o->cap * sizeof(struct sr_ortc_node))) == 0)
+    { goto done; }
+
+    sr_ortc_build(o, fib->root);
+    if (o->err)
+    { goto done; }
+
+    o->words = o->nlabels ? (o->nlabels + 63) / 64 : 1;
+    if ((o->sets = (uint64_t*)malloc((size_t)o->n * o->words *
+                                     sizeof(uint64_t))) == 0 ||
+        (o->out = sr_fib_create()) == 0)
+    { goto done; }
+
+    sr_ortc_sets(o, 0, -1);
+    sr_ortc_assign(o, 0, 0, 0, -1, -1);
+    if (o->err)
+    {
+        sr_fib_destroy(o->out);
+        goto done;
+    }
+    out = o->out;
+
+done:
+    t1 = sr_now_ns();
+    if (st)
+    {
+        st->labels = o->nlabels;
+        st->routes_in = fib->routes;
+        st->prefixes_in = fib->prefixes;
+        st->routes_out = out ? out->routes : 0;
+        st->prefixes_out = out ? out->prefixes : 0;
+        st->seconds = (t1 - t0) / 1e9;
+    }
+    free(o->sets);
+    free(o->nodes);
+    free(o);
+    return out;
+} /* -- sr_ortc_compress -- */
+
+static int sr_ortc_cmp(const void* a, const void* b)
+{
+    uint32_t x = *(const uint32_t*)a;
+    uint32_t y = *(const uint32_t*)b;
+
+    return x < y ? -1 : x > y;
+} /* -- sr_ortc_cmp -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ortc_diff(..)
+ * Scope:  Global
+ *
+ * Compare the forwarding of a and b over the whole address space.  A
+ * longest prefix match can only change where some prefix of either
+ * table starts or ends, so one lookup per interval between those
+ * boundaries covers every address.  Returns the intervals where the
+ * groups found differ (or ~0ul if out of memory); *checked gets the
+ * number of intervals.
+ *
+ *---------------------------------------------------------------------*/
+
+unsigned long sr_ortc_diff(const struct sr_fib* a, const struct sr_fib* b,
+                           unsigned long* checked)
+{
+    const struct sr_fib* fibs[2];
+    const struct sr_rt* rt;
+    struct sr_rt* ra;
+    struct sr_rt* rb;
+    uint32_t* points;
+    unsigned long n = 0, i, diff = 0, intervals = 0;
+    int f;
+
+    fibs[0] = a;
+    fibs[1] = b;
+    if ((points = (uint32_t*)malloc((2 * ((size_t)a->routes + b->routes) + 1) *
+                                    sizeof(uint32_t))) == 0)
+    { return ~0ul; }
+
+    points[n++] = 0;
+    for (f = 0; f < 2; f++)
+    {
+        for (rt = fibs[f]->head; rt; rt = rt->next)
+        {
+            uint32_t start = ntohl(rt->dest.s_addr);
+            uint32_t end = start | ~ntohl(rt->mask.s_addr);
+
+            points[n++] = start;
+            if (end != 0xffffffffu)
+            { points[n++] = end + 1; }
+        }
+    }
+    qsort(points, n, sizeof(uint32_t), sr_ortc_cmp);
+
+    for (i = 0; i < n; i++)
+    {
+        if (i && points[i] == points[i - 1])
+        { continue; }
+        intervals++;
+        ra = sr_fib_lookup(a, htonl(points[i]));
+        rb = sr_fib_lookup(b, htonl(points[i]));
+        if (ra != rb && (!ra || !rb || !sr_ortc_group_eq(ra, rb)))
+        { diff++; }
+    }
+    free(points);
+    if (checked)
+    { *checked = intervals; }
+    return diff;
+} /* -- sr_ortc_diff -- */
@@ -0,0 +1,58 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_ortc.h
+ *
+ * Description:
+ *
+ * FIB compression with ORTC (Draves et al., "Constructing Optimal IP
+ * Routing Tables", INFOCOM 1999).  Given a FIB it builds another with
+ * as few prefixes as possible that forwards every address the same way:
+ * more-specifics repeating their covering route's next hop disappear and
+ * siblings with a common next hop merge into their parent.
+ *
+ * A next hop here is the whole multipath group of a prefix (gateways,
+ * interfaces and weights in order), so flows still pick the same member.
+ * Addresses without a route have no way to be written as a route; a
+ * subtree holding any of them keeps its routes below the unrouted
+ * space rather than gaining a covering one.  With a default route the
+ * result is optimal.
+ *
+ * The compressed FIB is for lookups only: its routes are copies, and an
+ * update to the original makes it stale (see sr_rt_compress).
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_ORTC_H
+#define SR_ORTC_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+struct sr_fib;
+struct sr_rt;
+
+/* -- distinct next hop groups a table may have; the sets ORTC keeps per
+ *    trie node are bitmaps of this many bits -- */
+#define SR_ORTC_MAX_LABELS 256
+
+struct sr_ortc_stats
+{
+    unsigned int labels;        /* distinct next hop groups */
+    unsigned int routes_in;
+    unsigned int prefixes_in;
+    unsigned int routes_out;
+    unsigned int prefixes_out;
+    double seconds;
+};
+
+struct sr_fib* sr_ortc_compress(const struct sr_fib* fib,
+                                struct sr_ortc_stats* st);
+int  sr_ortc_group_eq(const struct sr_rt* a, const struct sr_rt* b);
+unsigned long sr_ortc_diff(const struct sr_fib* a, const struct sr_fib* b,
+                           unsigned long* checked);
+
+#endif /* -- SR_ORTC_H -- */
@@ -0,0 +1,190 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_pbuf.c
+ *
+ * Description:
+ *
+ * Reference counted packet buffers, see sr_pbuf.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sr_pbuf.h"
+
+struct sr_pbuf_stats sr_pbuf_stats;
+
+/* -- the receive buffer whose frames this thread is handling -- */
+static __thread struct sr_pbuf* sr_pbuf_rx;
+
+/*---------------------------------------------------------------------
+ * Method: sr_pbuf_alloc(..)
+ * Scope:  Global
+ *
+ * A buffer for size bytes after the headroom, with one reference.  Its
+ * frame starts at data and is len = size bytes until the caller says
+ * otherwise.  Returns NULL if out of memory.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_pbuf* sr_pbuf_alloc(unsigned int size)
+{
+    struct sr_pbuf* pb;
+
+    pb = (struct sr_pbuf*)malloc(sizeof(*pb) + SR_PBUF_HEADROOM + size);
+    if (pb == 0)
+    { return 0; }
+    pb->refs = 1;
+    pb->views = 0;
+    pb->base = 0;
+    pb->data = pb->mem + SR_PBUF_HEADROOM;
+    pb->len = size;
+    pb->size = SR_PBUF_HEADROOM + size;
+    __sync_fetch_and_add(&sr_pbuf_stats.allocs, 1);
+    __sync_fetch_and_add(&sr_pbuf_stats.bytes, pb->size);
+    return pb;
+} /* -- sr_pbuf_alloc -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_pbuf_hold(..)
+ * Scope:  Global
+ *
+ * A buffer holding the len byte frame, for a caller that was only lent
+ * it: a view if the frame lies in this thread's receive buffer and the
+ * buffer is pinned already or fits under SR_PBUF_PIN_MAX, else a copy.
+ * The caller owns the one reference.  Returns NULL if out of memory.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_pbuf* sr_pbuf_hold(const uint8_t* frame, unsigned int len)
+{
+    struct sr_pbuf* rx = sr_pbuf_rx;
+    struct sr_pbuf* pb;
+
+    if (rx && frame >= rx->data && frame + len <= rx->mem + rx->size &&
+        (__atomic_load_n(&rx->views, __ATOMIC_RELAXED) > 0 ||
+         __atomic_load_n(&sr_pbuf_stats.pinned, __ATOMIC_RELAXED) + rx->size <=
+         SR_PBUF_PIN_MAX))
+    {
+        if ((pb = (struct sr_pbuf*)calloc(1, sizeof(*pb))) == 0)
+        { return 0; }
+        pb->refs = 1;
+        pb->base = rx;
+        pb->data = (uint8_t*)frame;
+        pb->len = len;
+        sr_pbuf_get(rx);
+        /* -- only the reader adds views, the last may go on any thread -- */
+        if (__sync_fetch_and_add(&rx->views, 1) == 0)
+        { __sync_fetch_and_add(&sr_pbuf_stats.pinned, rx->size); }
+        __sync_fetch_and_add(&sr_pbuf_stats.views, 1);
+        return pb;
+    }
+
+    if ((pb = sr_pbuf_alloc(len)) == 0)
+    { return 0; }
+    memcpy(pb->data, frame, len);
+    sr_pbuf_copied(len);
+    return pb;
+} /* -- sr_pbuf_hold -- */
+
+void sr_pbuf_get(struct sr_pbuf* pb)
+{
+    __sync_fetch_and_add(&pb->refs, 1);
+} /* -- sr_pbuf_get -- */
+
+/* -- drop a reference, freeing the buffer (or the view) with the last -- */
+void sr_pbuf_put(struct sr_pbuf* pb)
+{
+    if (pb == 0 || __sync_sub_and_fetch(&pb->refs, 1) > 0)
+    { return; }
+    if (pb->base)
+    {
+        if (__sync_sub_and_fetch(&pb->base->views, 1) == 0)
+        { __sync_fetch_and_sub(&sr_pbuf_stats.pinned, pb->base->size); }
+        sr_pbuf_put(pb->base);
+    }
+    else
+    {
+        __sync_fetch_and_add(&sr_pbuf_stats.frees, 1);
+        __sync_fetch_and_sub(&sr_pbuf_stats.bytes, pb->size);
+    }
+    free(pb);
+} /* -- sr_pbuf_put -- */
+
+/* -- does anyone but the caller hold pb -- */
+int sr_pbuf_shared(struct sr_pbuf* pb)
+{
+    return __atomic_load_n(&pb->refs, __ATOMIC_ACQUIRE) > 1;
+} /* -- sr_pbuf_shared -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_pbuf_rx_set(..)
+ * Scope:  Global
+ *
+ * Make rx (0 for none) the receive buffer of the calling thread, whose
+ * frames sr_pbuf_hold takes views of.  Returns the one it replaces.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_pbuf* sr_pbuf_rx_set(struct sr_pbuf* rx)
+{
+    struct sr_pbuf* prev = sr_pbuf_rx;
+
+    sr_pbuf_rx = rx;
+    return prev;
+} /* -- sr_pbuf_rx_set -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_pbuf_rx_renew(..)
+ * Scope:  Global
+ *
+ * A reader is done with the frames in rx: move the len bytes at keep
+ * (a partial command) to the front of the buffer it receives into
+ * next.  That is rx unless views of its frames are still held, in which
+ * case rx is left to them and a new buffer of the same size takes its
+ * place.  Returns the buffer, or NULL if out of memory (rx is then
+ * still the caller's).
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_pbuf* sr_pbuf_rx_renew(struct sr_pbuf* rx, unsigned int keep,
+                                 unsigned int len)
+{
+    struct sr_pbuf* next;
+
+    if (!sr_pbuf_shared(rx))
+    {
+        if (keep > 0 && len > 0)
+        { memmove(rx->data, rx->data + keep, len); }
+        return rx;
+    }
+
+    if ((next = sr_pbuf_alloc(rx->size - SR_PBUF_HEADROOM)) == 0)
+    { return 0; }
+    memcpy(next->data, rx->data + keep, len);
+    __sync_fetch_and_add(&sr_pbuf_stats.rx_replaced, 1);
+    sr_pbuf_put(rx);
+    return next;
+} /* -- sr_pbuf_rx_renew -- */
+
+/* -- count a frame copied outside sr_pbuf_hold -- */
+void sr_pbuf_copied(unsigned int len)
+{
+    __sync_fetch_and_add(&sr_pbuf_stats.copies, 1);
+    __sync_fetch_and_add(&sr_pbuf_stats.copied_bytes, len);
+} /* -- sr_pbuf_copied -- */
+
+void sr_pbuf_print(FILE* out)
+{
+    struct sr_pbuf_stats s = sr_pbuf_stats;
+
+    fprintf(out, "pbuf_live %llu\n", (unsigned long long)(s.allocs - s.frees));
+    fprintf(out, "pbuf_bytes %llu\n", (unsigned long long)s.bytes);
+    fprintf(out, "pbuf_pinned %llu\n", (unsigned long long)s.pinned);
+    fprintf(out, "pbuf_allocs %llu\n", (unsigned long long)s.allocs);
+    fprintf(out, "pbuf_views %llu\n", (unsigned long long)s.views);
+    fprintf(out, "pbuf_copies %llu\n", (unsigned long long)s.copies);
+    fprintf(out, "pbuf_copied_bytes %llu\n", (unsigned long long)s.copied_bytes);
+    fprintf(out, "pbuf_rx_replaced %llu\n", (unsigned long long)s.rx_replaced);
+} /* -- sr_pbuf_print -- */
@@ -0,0 +1,82 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_pbuf.h
+ *
+ * Description:
+ *
+ * Reference counted packet buffers.  A frame that has to outlive the
+ * call it was lent to (queued behind ARP or neighbor discovery, or in
+ * an egress queue) is kept in a struct sr_pbuf, and whatever else keeps
+ * it takes a reference rather than a copy.  The last sr_pbuf_put frees
+ * the buffer.
+ *
+ * The VNS readers receive into pbufs and mark theirs as the thread's
+ * receive buffer while the frames in it are handled (sr_pbuf_rx_set).
+ * Holding one of those frames (sr_pbuf_hold) makes a view: a reference
+ * on the receive buffer, which the reader then leaves to its holders
+ * and replaces instead of reusing.  Any other frame is copied once, as
+ * is every frame whose view would take the receive buffers views keep
+ * alive (sr_pbuf_stats.pinned, each buffer counted once however many
+ * views it has) past SR_PBUF_PIN_MAX bytes.  The copies are counted in
+ * sr_pbuf_stats.
+ *
+ * Every buffer has at least SR_PBUF_HEADROOM bytes ahead of its frame,
+ * room for a transport to put its own header in front without moving
+ * the frame.  A frame received over VNS has its VNSPACKET header there.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_PBUF_H
+#define SR_PBUF_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#include <stdio.h>
+
+#define SR_PBUF_HEADROOM 64                 /* bytes, VNSPACKET header is 24 */
+#define SR_PBUF_PIN_MAX  (8 * 1024 * 1024)  /* bytes of receive buffers views
+                                               may keep */
+
+struct sr_pbuf
+{
+    int refs;
+    int views;              /* views of this buffer alive */
+    struct sr_pbuf* base;   /* the buffer a view's frame lies in, 0 if none */
+    uint8_t* data;          /* the frame */
+    unsigned int len;
+    unsigned int size;      /* bytes at mem, 0 for a view */
+    uint8_t mem[1];
+};
+
+/* -- process wide, all routers -- */
+struct sr_pbuf_stats
+{
+    uint64_t allocs;
+    uint64_t frees;
+    uint64_t bytes;         /* in buffers alive now */
+    uint64_t pinned;        /* in receive buffers views keep alive */
+    uint64_t views;         /* frames held without a copy */
+    uint64_t copies;        /* frames copied, by sr_pbuf_hold or a transport */
+    uint64_t copied_bytes;
+    uint64_t rx_replaced;   /* receive buffers left to their views */
+};
+
+extern struct sr_pbuf_stats sr_pbuf_stats;
+
+struct sr_pbuf* sr_pbuf_alloc(unsigned int size);
+struct sr_pbuf* sr_pbuf_hold(const uint8_t* frame, unsigned int len);
+void sr_pbuf_get(struct sr_pbuf* pb);
+void sr_pbuf_put(struct sr_pbuf* pb);
+int  sr_pbuf_shared(struct sr_pbuf* pb);
+struct sr_pbuf* sr_pbuf_rx_set(struct sr_pbuf* rx);
+struct sr_pbuf* sr_pbuf_rx_renew(struct sr_pbuf* rx, unsigned int keep,
+                                 unsigned int len);
+void sr_pbuf_copied(unsigned int len);
+void sr_pbuf_print(FILE* out);
+
+#endif /* SR_PBUF_H */
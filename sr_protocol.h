@@ -88,6 +88,50 @@ struct sr_icmp_t11_hdr {
 } __attribute__ ((packed)) ;
 typedef struct sr_icmp_t11_hdr sr_icmp_t11_hdr_t;
 
+/* Structure of an ICMP echo request/reply header
+ */
+struct sr_icmp_echo_hdr {
+  uint8_t icmp_type;
+  uint8_t icmp_code;
+  uint16_t icmp_sum;
+  uint16_t icmp_id;
+  uint16_t icmp_seq;
+} __attribute__ ((packed)) ;
+typedef struct sr_icmp_echo_hdr sr_icmp_echo_hdr_t;
+
+/*
+ * Structure of a TCP header, naked of options.
+ */
+struct sr_tcp_hdr
+  {
+    uint16_t tcp_sport;			/* source port */
+    uint16_t tcp_dport;			/* destination port */
+    uint32_t tcp_seq;			/* sequence number */
+    uint32_t tcp_ack;			/* acknowledgement number */
+    uint8_t tcp_off;			/* data offset, upper 4 bits */
+    uint8_t tcp_flags;			/* control bits */
+#define	TCP_FIN 0x01
+#define	TCP_SYN 0x02
+#define	TCP_RST 0x04
+#define	TCP_ACK 0x10
+    uint16_t tcp_win;			/* window */
+    uint16_t tcp_sum;			/* checksum */
+    uint16_t tcp_urp;			/* urgent pointer */
+  } __attribute__ ((packed)) ;
+typedef struct sr_tcp_hdr sr_tcp_hdr_t;
+
+/*
+ * Structure of a UDP header.
+ */
+struct sr_udp_hdr
+  {
+    uint16_t udp_sport;			/* source port */
+    uint16_t udp_dport;			/* destination port */
+    uint16_t udp_len;			/* length */
+    uint16_t udp_sum;			/* checksum, 0 if none */
+  } __attribute__ ((packed)) ;
+typedef struct sr_udp_hdr sr_udp_hdr_t;
+
 /*
  * Structure of an internet header, naked of options.
  */
@@ -117,6 +161,61 @@ struct sr_ip_hdr
   } __attribute__ ((packed)) ;
 typedef struct sr_ip_hdr sr_ip_hdr_t;
 
+/*
+ * Structure of an IPv6 header (RFC 8200), naked of extension headers.
+ */
+struct sr_ip6_hdr
+  {
+    uint32_t ip6_flow;			/* version, traffic class, flow label */
+    uint16_t ip6_plen;			/* payload length */
+    uint8_t ip6_nxt;			/* next header */
+    uint8_t ip6_hlim;			/* hop limit */
+    uint8_t ip6_src[16];		/* source address */
+    uint8_t ip6_dst[16];		/* destination address */
+  } __attribute__ ((packed)) ;
+typedef struct sr_ip6_hdr sr_ip6_hdr_t;
+
+#define IP6_VERSION(h) ((ntohl((h)->ip6_flow) >> 28) & 0xf)
+#define IP6_MIN_MTU 1280		/* ICMPv6 errors must fit in it */
+
+/*
+ * Structure of an ICMPv6 header (RFC 4443); errors carry a 32-bit field
+ * (MTU, pointer or unused) and echo messages an id and sequence number.
+ */
+struct sr_icmp6_hdr
+  {
+    uint8_t icmp6_type;
+    uint8_t icmp6_code;
+    uint16_t icmp6_sum;
+    uint32_t icmp6_data;
+  } __attribute__ ((packed)) ;
+typedef struct sr_icmp6_hdr sr_icmp6_hdr_t;
+
+/*
+ * Neighbor solicitation and advertisement (RFC 4861), followed by
+ * options; the only one used is the link-layer address option.
+ */
+struct sr_nd_hdr
+  {
+    uint8_t nd_type;
+    uint8_t nd_code;
+    uint16_t nd_sum;
+    uint32_t nd_flags;			/* NA: router, solicited, override */
+#define ND_NA_ROUTER    0x80000000
+#define ND_NA_SOLICITED 0x40000000
+#define ND_NA_OVERRIDE  0x20000000
+    uint8_t nd_target[16];
+  } __attribute__ ((packed)) ;
+typedef struct sr_nd_hdr sr_nd_hdr_t;
+
+struct sr_nd_opt_lla
+  {
+    uint8_t opt_type;			/* source or target link-layer address */
+    uint8_t opt_len;			/* in units of 8 bytes */
+    uint8_t opt_mac[6];
+  } __attribute__ ((packed)) ;
+typedef struct sr_nd_opt_lla sr_nd_opt_lla_t;
+
 /* 
  *  Ethernet packet header prototype.  Too many O/S's define this differently.
  *  Easy enough to solve that and define it here.
@@ -136,13 +235,45 @@ typedef struct sr_ethernet_hdr sr_ethernet_hdr_t;
 
 enum sr_ip_protocol {
   ip_protocol_icmp = 0x0001,
-  /*ip_protocol_udp = 17,
-  ip_protocol_tcp = 6,*/
+  ip_protocol_tcp = 6,
+  ip_protocol_udp = 17,
+  ip_protocol_icmp6 = 58,
+};
+
+enum sr_icmp_type {
+  icmp_type_echo_reply = 0,
+  icmp_type_echo_request = 8,
+};
+
+enum sr_icmp6_type {
+  icmp6_type_unreach = 1,
+  icmp6_type_too_big = 2,
+  icmp6_type_time_exceeded = 3,
+  icmp6_type_param_problem = 4,
+  icmp6_type_echo_request = 128,
+  icmp6_type_echo_reply = 129,
+  icmp6_type_router_solicit = 133,
+  icmp6_type_router_advert = 134,
+  icmp6_type_neighbor_solicit = 135,
+  icmp6_type_neighbor_advert = 136,
+};
+
+enum sr_icmp6_unreach_code {
+  icmp6_unreach_no_route = 0,
+  icmp6_unreach_beyond_scope = 2,
+  icmp6_unreach_addr = 3,
+  icmp6_unreach_port = 4,
+};
+
+enum sr_nd_opt_type {
+  nd_opt_source_lla = 1,
+  nd_opt_target_lla = 2,
 };
 
 enum sr_ethertype {
   ethertype_arp = 0x0806,
   ethertype_ip = 0x0800,
+  ethertype_ip6 = 0x86dd,
 };
 
 
@@ -172,4 +303,30 @@ typedef struct sr_arp_hdr sr_arp_hdr_t;
 
 #define sr_IFACE_NAMELEN 32
 
+/*
+ * What a received frame carries, parsed and checked once at ingress by
+ * sr_pkt_parse (sr_router.c) and handed with the frame to every stage
+ * after it, the ARP queue included.  Offsets count from the start of the
+ * frame so they hold for a copy of it too.
+ */
+
+#define SR_PKT_L3_OK     0x01 /* complete ARP, IPv4 or IPv6 header at l3 */
+#define SR_PKT_CKSUM_OK  0x02 /* IPv4 header checksum verified */
+#define SR_PKT_L4_OK     0x04 /* ports, or ICMP type and code, at l4 */
+#define SR_PKT_FRAGMENT  0x08 /* IPv4 fragment, first or later */
+#define SR_PKT_ARP_OTHER 0x10 /* ARP request for another host's address */
+
+struct sr_if;
+
+struct sr_pktinfo
+{
+    uint16_t ethertype;   /* host byte order */
+    uint16_t l3;          /* network header offset */
+    uint16_t l4;          /* transport header offset, 0 for none */
+    uint8_t  proto;       /* IPv4 protocol or IPv6 next header */
+    uint8_t  flags;       /* SR_PKT_* */
+    struct sr_if* in_if;  /* ingress interface */
+    uint64_t received;    /* ns, sr_now_ns() when received */
+};
+
 #endif /* -- SR_PROTOCOL_H -- */
@@ -0,0 +1,288 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_reactor.c
+ *
+ * Description:
+ *
+ * Single threaded event loop.  The VNS socket (non-blocking, framed
+ * incrementally by sr_vns_consume), a one second timerfd that drives
+ * sr_arpcache_tick, and the control socket are multiplexed with epoll.
+ * Nothing else touches the router state, so the ARP cache runs without
+ * its lock in this mode.  With -H the loop also hands the session over to
+ * a new router, or takes it over from the running one, see sr_handover.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/socket.h>
+
+#include "sr_router.h"
+#include "sr_arpcache.h"
+#include "sr_egress.h"
+#include "sr_handover.h"
+#include "sr_pbuf.h"
+
+/* room for several maximum sized (10000 byte) commands per recv */
+#define SR_REACTOR_RXBUF (64 * 1024)
+#define SR_REACTOR_EVENTS 16
+
+/* epoll user data for the fixed descriptors; control clients use the fd */
+#define SR_EV_VNS   -1
+#define SR_EV_TIMER -2
+#define SR_EV_CTL   -3
+#define SR_EV_PACER -4
+#define SR_EV_HANDOVER  -5    /* -H listener */
+#define SR_EV_SUCCESSOR -6    /* the new router taking over */
+
+/*---------------------------------------------------------------------
+ * Method: sr_reactor_add(..)
+ * Scope:  Local
+ *---------------------------------------------------------------------*/
+
+static int sr_reactor_add(int epfd, int fd, int tag)
+{
+    struct epoll_event ev;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.u64 = 0;
+    ev.data.fd = tag;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0)
+    {
+        perror("epoll_ctl(..):sr_reactor.c::sr_reactor_add(..)");
+        return -1;
+    }
+    return 0;
+} /* -- sr_reactor_add -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_reactor_read_vns(..)
+ * Scope:  Local
+ *
+ * Drain the VNS socket, handing every complete command to
+ * sr_vns_consume.  Partial commands stay at the front of *rx, which is
+ * replaced when frames in it are still held (sr_pbuf_rx_renew).
+ *
+ * RETURN VALUES: 1 keep going, 0 session closed, -1 error
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_reactor_read_vns(struct sr_instance* sr, struct sr_pbuf** rx,
+                               unsigned int* fill)
+{
+    struct sr_pbuf *prev, *next;
+    unsigned int consumed;
+    ssize_t n;
+    int ret;
+
+    while (1)
+    {
+        n = recv(sr->sockfd, (*rx)->data + *fill, SR_REACTOR_RXBUF - *fill, 0);
+        sr->stats.syscalls++;
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            { continue; }
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            { return 1; }
+            perror("recv(..):sr_reactor.c::sr_reactor_read_vns");
+            return -1;
+        }
+        if (n == 0)
+        {
+            fprintf(stderr, "VNS server closed connection.\n");
+            return 0;
+        }
+
+        *fill += n;
+        prev = sr_pbuf_rx_set(*rx);
+        ret = sr_vns_consume(sr, (*rx)->data, *fill, &consumed);
+        sr_pbuf_rx_set(prev);
+        if ((next = sr_pbuf_rx_renew(*rx, consumed, *fill - consumed)) == 0)
+        {
+            fprintf(stderr, "Error: out of memory (sr_reactor_read_vns)\n");
+            return -1;
+        }
+        *rx = next;
+        *fill -= consumed;
+
+        if (ret != 1)
+        { return ret; }
+    }
+} /* -- sr_reactor_read_vns -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_reactor_run(..)
+ * Scope:  Global
+ *
+ * Run the router until the server closes the session or an error occurs.
+ * Takes over the role of the sr_read_from_server loop and the ARP thread.
+ *
+ * RETURN VALUES: 0 on orderly shutdown, -1 on error
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_reactor_run(struct sr_instance* sr)
+{
+    struct epoll_event events[SR_REACTOR_EVENTS];
+    struct itimerspec its;
+    struct sr_pbuf* rx;
+    unsigned int fill = 0;
+    int epfd, tfd, cfd = -1, hfd = -1, sfd = -1;
+    int i, n, ret = 1, handed = 0;
+    uint64_t expirations;
+
+    /* REQUIRES */
+    assert(sr);
+    assert(sr->loop_mode == SR_LOOP_EVENT);
+
+    if ((rx = sr_pbuf_alloc(SR_REACTOR_RXBUF)) == 0)
+    {
+        fprintf(stderr, "Error: out of memory (sr_reactor_run)\n");
+        return -1;
+    }
+
+    if ((epfd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+    {
+        perror("epoll_create1(..):sr_reactor.c::sr_reactor_run");
+        sr_pbuf_put(rx);
+        return -1;
+    }
+
+    /* -- hot restart: the VNS socket comes from the running router -- */
+    if (sr->handover &&
+        sr_handover_finish(sr, rx->data, SR_REACTOR_RXBUF, &fill) != 0)
+    {
+        close(epfd);
+        sr_pbuf_put(rx);
+        return -1;
+    }
+
+    /* -- VNS socket -- */
+    fcntl(sr->sockfd, F_SETFL, fcntl(sr->sockfd, F_GETFL) | O_NONBLOCK);
+    sr_reactor_add(epfd, sr->sockfd, SR_EV_VNS);
+
+    /* -- ARP cache timer, replaces sr_arpcache_timeout -- */
+    tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (tfd < 0)
+    {
+        perror("timerfd_create(..):sr_reactor.c::sr_reactor_run");
+        close(epfd);
+        sr_pbuf_put(rx);
+        return -1;
+    }
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec = 1;
+    its.it_interval.tv_sec = 1;
+    timerfd_settime(tfd, 0, &its, 0);
+    sr_reactor_add(epfd, tfd, SR_EV_TIMER);
+
+    /* -- egress shaping timer -- */
+    if (sr_egress_timer_fd(sr) >= 0)
+    { sr_reactor_add(epfd, sr_egress_timer_fd(sr), SR_EV_PACER); }
+
+    /* -- control socket -- */
+    if (sr->ctl_path[0] != '\0' && (cfd = sr_ctl_listen(sr->ctl_path)) >= 0)
+    { sr_reactor_add(epfd, cfd, SR_EV_CTL); }
+
+    /* -- and the next router -- */
+    if (sr->handover_path[0] != '\0' && (hfd = sr_handover_listen(sr)) >= 0)
+    { sr_reactor_add(epfd, hfd, SR_EV_HANDOVER); }
+
+    while (ret == 1)
+    {
+        n = epoll_wait(epfd, events, SR_REACTOR_EVENTS, -1);
+        sr->stats.syscalls++;
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            { continue; }
+            perror("epoll_wait(..):sr_reactor.c::sr_reactor_run");
+            ret = -1;
+            break;
+        }
+
+        for (i = 0; i < n && ret == 1; i++)
+        {
+            int tag = events[i].data.fd;
+
+            if (tag == SR_EV_VNS)
+            {
+                ret = sr_reactor_read_vns(sr, &rx, &fill);
+            }
+            else if (tag == SR_EV_TIMER)
+            {
+                if (read(tfd, &expirations, sizeof(expirations)) > 0 &&
+                    sr_arpcache_tick(sr))
+                { ret = 0; }
+            }
+            else if (tag == SR_EV_PACER)
+            {
+                sr_egress_timer(sr);
+            }
+            else if (tag == SR_EV_HANDOVER)
+            {
+                /* -- one at a time -- */
+                if (sfd < 0 && (sfd = sr_handover_offer(sr, hfd)) >= 0 &&
+                    sr_reactor_add(epfd, sfd, SR_EV_SUCCESSOR) < 0)
+                {
+                    close(sfd);
+                    sfd = -1;
+                }
+            }
+            else if (tag == SR_EV_SUCCESSOR)
+            {
+                /* -- sr_handover_give closes sfd -- */
+                epoll_ctl(epfd, EPOLL_CTL_DEL, sfd, 0);
+                if (sr_handover_give(sr, sfd, rx->data, fill) == 0)
+                {
+                    handed = 1;
+                    sr->vns_closed = 1;
+                    ret = 0;
+                }
+                sfd = -1;
+            }
+            else if (tag == SR_EV_CTL)
+            {
+                int fd = sr_ctl_accept(sr, cfd);
+                if (fd >= 0 && sr_reactor_add(epfd, fd, fd) < 0)
+                { sr_ctl_close(fd); }
+            }
+            else
+            {
+                /* -- control client -- */
+                sr_ctl_serve_epoll(sr, epfd, tag, events[i].data.u64);
+            }
+        }
+    }
+
+    /* -- after a handover the paths are the new router's -- */
+    if (cfd >= 0)
+    {
+        sr_ctl_disconnect(sr);
+        close(cfd);
+        if (!handed)
+        { unlink(sr->ctl_path); }
+    }
+    if (sfd >= 0)
+    { close(sfd); }
+    if (hfd >= 0)
+    {
+        close(hfd);
+        if (!handed)
+        { unlink(sr->handover_path); }
+    }
+    close(tfd);
+    close(epfd);
+    sr_pbuf_put(rx);
+
+    return ret == 0 ? 0 : -1;
+} /* -- sr_reactor_run -- */
@@ -22,6 +22,14 @@
 #include "sr_protocol.h"
 #include "sr_arpcache.h"
 #include "sr_utils.h"
+#include "sr_nat.h"
+#include "sr_acl.h"
+#include "sr_ip6.h"
+#include "sr_trace.h"
+#include "sr_sflow.h"
+#include "sr_egress.h"
+#include "sr_codel.h"
+#include "sr_common.h"
 
 /*---------------------------------------------------------------------
  * Method: sr_init(void)
@@ -33,11 +41,75 @@
 
 void sr_init(struct sr_instance* sr)
 {
+    const char* burst = getenv("SR_BURST");
+
     /* REQUIRES */
     assert(sr);
 
+    /* burst size for benchmarks (sr_bench.sh), the backends' own otherwise */
+    if(burst)
+    {
+        sr->burst = strtoul(burst, 0, 10);
+        if(sr->burst > SR_BURST_MAX)
+            sr->burst = SR_BURST_MAX;
+    }
+
     /* Initialize cache and cache cleanup thread */
     sr_arpcache_init(&(sr->cache));
+    sr_ndcache_init(&(sr->nd));
+
+    /* routers in a row must not all hash flows onto the same member */
+    sr->ecmp_seed = (uint32_t) rand();
+
+    /* one NAT shard per receive thread; the interfaces are known by now */
+    if(sr->nat_if[0] != '\0')
+    {
+        sr->nat = sr_nat_create(sr, sr->nat_if, sr->nat_mappings,
+                                sr->netdev_conf.queues);
+        if(sr->nat == NULL)
+        { exit(1); }
+    }
+
+    /* every interface samples both ways at the -S rate until told otherwise */
+    if(sr->sflow_path[0] != '\0')
+    {
+        struct sr_if* iface;
+
+        if((sr->sflow = sr_sflow_create(sr->sflow_path)) == NULL)
+        { exit(1); }
+        for(iface = sr->if_list; iface; iface = iface->next)
+        {
+            sr_sflow_set_rate(sr, iface, SR_SFLOW_IN, sr->sflow_rate);
+            sr_sflow_set_rate(sr, iface, SR_SFLOW_OUT, sr->sflow_rate);
+        }
+    }
+
+    /* route updates come from the control socket; lock unless that runs
+     * on the only forwarding thread */
+    sr->rt_use_locks = (sr->loop_mode == SR_LOOP_THREADS ||
+                        sr->netdev_conf.queues > 1);
+
+    /* readers on other threads than the control socket need the swap protocol */
+    if(sr->acl_path[0] != '\0')
+    {
+        sr->acl = sr_acl_create(sr->loop_mode == SR_LOOP_THREADS ||
+                                sr->netdev_conf.queues > 1);
+        if(sr->acl == NULL || sr_acl_load(sr->acl, sr->acl_path, stderr) != 0)
+        { exit(1); }
+    }
+
+    /* local interfaces are known by now, VNS ones once hwinfo arrives */
+    if(sr->egress_limit)
+    { sr_egress_attach(sr); }
+    sr_arpcache_warm(sr);
+
+    if(sr->loop_mode == SR_LOOP_EVENT)
+    {
+        /* the event loop runs sr_arpcache_tick itself, on its only thread */
+        sr->cache.use_locks = 0;
+        sr->nd.use_locks = 0;
+        return;
+    }
 
     pthread_attr_init(&(sr->attr));
     pthread_attr_setdetachstate(&(sr->attr), PTHREAD_CREATE_JOINABLE);
@@ -47,25 +119,19 @@ void sr_init(struct sr_instance* sr)
 
     pthread_create(&thread, &(sr->attr), sr_arpcache_timeout, sr);
 
+    /* threaded mode has no event loop to watch the shaping timer */
+    if(sr->egress_pacer)
+    { pthread_create(&thread, &(sr->attr), sr_egress_pacer_thread, sr); }
+
+    if(sr->ctl_path[0] != '\0')
+    {
+        sr_ctl_start(sr);
+    }
+
     /* Add initialization code here! */
 
 } /* -- sr_init -- */
 
-/*---------------------------------------------------------------------
- * Method: sr_handlepacket(uint8_t* p,char* interface)
- * Scope:  Global
- *
- * This method is called each time the router receives a packet on the
- * interface.  The packet buffer, the packet length and the receiving
- * interface are passed in as parameters. The packet is complete with
- * ethernet headers.
- *
- * Note: Both the packet buffer and the character's memory are handled
- * by sr_vns_comm.c that means do NOT delete either.  Make a copy of the
- * packet instead if you intend to keep it around beyond the scope of
- * the method call.
- *
- *---------------------------------------------------------------------*/
 int count_prefix( struct in_addr* mask)
 {
   int count = 0;
@@ -77,269 +143,388 @@ int count_prefix( struct in_addr* mask)
   return count;
 
 }
-void sr_handlepacket(struct sr_instance* sr,
-        uint8_t * packet/* lent (full packet that contain the ethernet header as well)*/,
-        unsigned int len,
-        char* interface/* lent (name of the receiving interface of the router's)*/)
-{
-  /* REQUIRES */
-  assert(sr);
-  assert(packet);
-  assert(interface);
 
-  /*printf("\n\n*** -> Received packet of length %d \n",len);*/
+/*---------------------------------------------------------------------
+ * Method: sr_flow_hash(..)
+ * Scope:  Local
+ *
+ * Hash of an IP packet's addresses, protocol and, for unfragmented TCP
+ * and UDP, ports.  Fragments hash on the addresses and protocol only so
+ * all pieces of a datagram take the same path.
+ *
+ *---------------------------------------------------------------------*/
+
+static uint32_t sr_flow_hash(const uint8_t * packet, const struct sr_pktinfo * info,
+                             uint32_t seed)
+{
+  const sr_ip_hdr_t * ip_hdr = (const sr_ip_hdr_t *) (packet + info->l3);
+  uint32_t h = seed;
+  uint32_t ports = 0;
 
-  /* fill in code here */
-  /*check the longest prefix to see where it is destined to*/
-  int forRouter = 0;
-  int forwarding = 0;
-  struct sr_if * longestInterface = NULL;
-  struct sr_rt * longestRoutingTable = NULL;
-  if( ethertype(packet) == ethertype_arp ) /*arp packet is only handled by the router*/
+  if( (info->proto == ip_protocol_tcp || info->proto == ip_protocol_udp) &&
+      (info->flags & (SR_PKT_L4_OK | SR_PKT_FRAGMENT)) == SR_PKT_L4_OK )
   {
-        /*get the arp_hdr*/
- 	uint8_t * arpHeader_tmp = packet + sizeof(struct sr_ethernet_hdr);
-  	sr_arp_hdr_t * arp_hdr_tmp = (sr_arp_hdr_t *) arpHeader_tmp;
+      memcpy(&ports, packet + info->l4, sizeof(ports));
+  }
 
-        /*check against each router's interface*/
-        struct sr_if * currIf = sr->if_list;
-        while( currIf != NULL )
-        {
-            if(currIf->ip == arp_hdr_tmp->ar_tip)
-            {
-              forRouter = 1;
-              longestInterface = currIf;
-              break;
-            }
-            currIf = currIf->next;
-        }
+  h = sr_hash_mix(h ^ ip_hdr->ip_src);
+  h = sr_hash_mix(h ^ ip_hdr->ip_dst);
+  h = sr_hash_mix(h ^ ports ^ ((uint32_t) info->proto << 24));
+  return h;
+}
 
+/*---------------------------------------------------------------------
+ * Method: sr_pkt_parse(..)
+ * Scope:  Global
+ *
+ * Parse and check the headers of a frame received on iface at now (the
+ * sr_now_ns() clock) into info, once for every stage after.  Returns
+ * 0 for a frame the router handles, -1 for one it drops: too short for
+ * its headers, an IPv4 header with a bad version or checksum, an ARP
+ * request for another host, an unknown interface or ethertype.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_pkt_parse(struct sr_instance* sr,
+        const uint8_t * packet/* lent */,
+        unsigned int len,
+        const char* iface/* lent */,
+        uint64_t now,
+        struct sr_pktinfo * info)
+{
+  const sr_arp_hdr_t * arp_hdr;
+  const sr_ip_hdr_t * ip_hdr;
+  const sr_ip6_hdr_t * ip6_hdr;
+  unsigned int hl;
+  uint16_t off;
+
+  memset(info, 0, sizeof(*info));
+  info->received = now;
+  info->in_if = sr_get_interface(sr, iface);
+  if( len < sizeof(sr_ethernet_hdr_t) || info->in_if == NULL )
+      return -1;
+
+  info->ethertype = ethertype((uint8_t *) packet);
+  info->l3 = sizeof(sr_ethernet_hdr_t);
+  SR_TRACE(SR_TRACE_DEBUG, SR_EV_RX_FRAME, info->ethertype, len, 0, 0);
+
+  if( info->ethertype == ethertype_arp )
+  {
+      if( len < info->l3 + sizeof(sr_arp_hdr_t) )
+          return -1;
+      info->flags |= SR_PKT_L3_OK;
+
+      /*the link carries requests for every host on it*/
+      arp_hdr = (const sr_arp_hdr_t *) (packet + info->l3);
+      if( ntohs(arp_hdr->ar_op) == arp_op_request && arp_hdr->ar_tip != info->in_if->ip )
+      {
+          info->flags |= SR_PKT_ARP_OTHER;
+          return -1;
+      }
+      return 0;
   }
-  else if( ethertype(packet) == ethertype_ip) /*ip packet can be for router, servers, or client*/
+
+  if( info->ethertype == ethertype_ip6 )
   {
-    uint8_t * ipHeader_tmp = packet + sizeof(sr_ethernet_hdr_t);
-    sr_ip_hdr_t * ip_hdr_tmp = (sr_ip_hdr_t *) ipHeader_tmp;
+      ip6_hdr = (const sr_ip6_hdr_t *) (packet + info->l3);
+      if( len < info->l3 + sizeof(sr_ip6_hdr_t) || IP6_VERSION(ip6_hdr) != 6 ||
+          ntohs(ip6_hdr->ip6_plen) > len - info->l3 - sizeof(sr_ip6_hdr_t) )
+          return -1;
+      info->flags |= SR_PKT_L3_OK;
+      info->proto = ip6_hdr->ip6_nxt;
+      if( len >= info->l3 + sizeof(sr_ip6_hdr_t) + 4 )
+      {
+          info->l4 = info->l3 + sizeof(sr_ip6_hdr_t);
+          info->flags |= SR_PKT_L4_OK;
+      }
+      return 0;
+  }
 
-    uint32_t ip_dst = ip_hdr_tmp->ip_dst;
+  if( info->ethertype != ethertype_ip || len < info->l3 + sizeof(sr_ip_hdr_t) )
+      return -1;
 
+  ip_hdr = (const sr_ip_hdr_t *) (packet + info->l3);
+  hl = ip_hdr->ip_hl * 4;
+  if( ip_hdr->ip_v != 4 )
+  {
+      SR_TRACE(SR_TRACE_WARN, SR_EV_IP_BAD_VERSION, ip_hdr->ip_src, ip_hdr->ip_dst, ip_hdr->ip_v, 0);
+      return -1;
+  }
+  if( hl < sizeof(sr_ip_hdr_t) || len < info->l3 + hl )
+  {
+      SR_TRACE(SR_TRACE_WARN, SR_EV_IP_BAD_LEN, ip_hdr->ip_src, ip_hdr->ip_dst, len, info->l3 + hl);
+      return -1;
+  }
+  info->flags |= SR_PKT_L3_OK;
+  if( !cksum_verify(ip_hdr, hl) )
+  {
+      SR_TRACE(SR_TRACE_WARN, SR_EV_IP_BAD_CKSUM, ip_hdr->ip_src, ip_hdr->ip_dst, ntohs(ip_hdr->ip_sum), 0);
+      return -1;
+  }
+  info->flags |= SR_PKT_CKSUM_OK;
+  info->proto = ip_hdr->ip_p;
+
+  /*the first fragment carries the transport header, the others only data*/
+  off = ntohs(ip_hdr->ip_off);
+  if( off & (IP_MF | IP_OFFMASK) )
+      info->flags |= SR_PKT_FRAGMENT;
+  if( (off & IP_OFFMASK) == 0 && len >= info->l3 + hl + 4 )
+  {
+      info->l4 = info->l3 + hl;
+      info->flags |= SR_PKT_L4_OK;
+  }
+  return 0;
+}
 
-    /*check against each router's interface*/
-    struct sr_if * currIf = sr->if_list;
-    while( currIf != NULL )
-    {
-        if(currIf->ip == ip_dst)
-        {
-          forRouter = 1;
-          longestInterface = currIf;
-          break;
-        }
-        currIf = currIf->next;
-    }
+/*---------------------------------------------------------------------
+ * Method: sr_classify_packet(..)
+ * Scope:  Local
+ *
+ * Resolve where a parsed frame goes, up to the route: to one of the
+ * router's interfaces (forRouter) or, for IPv4, on to the longest prefix
+ * match of *dst.  Returns 1 when the frame needs that lookup, which
+ * sr_handlepacket_burst does for the whole burst together and hands to
+ * sr_classify_route.
+ *
+ *---------------------------------------------------------------------*/
 
-    /*check against the entries in the routing table by using longest prefix match*/
-    if(!forRouter)
-    {
-        int longest = 0;
-        struct sr_rt * currRoutingTable = sr->routing_table;
-        uint32_t subnet = 0;
+static int sr_classify_packet(struct sr_instance* sr,
+        uint8_t * packet/* lent */,
+        unsigned int len,
+        struct sr_lookup * lk,
+        uint32_t * dst)
+{
+  struct sr_if * currIf;
 
-        while( currRoutingTable != NULL )
-        {
-            subnet = currRoutingTable->mask.s_addr & ip_dst;
-
-          	if( subnet == currRoutingTable->dest.s_addr )
-          	{
-                   int newLongest = count_prefix(&currRoutingTable->mask);
-                  /*int newLongest = longestPrefixMatch(ip_dst, (uint32_t)currRoutingTable->dest.s_addr);*/
-                   if( longest < newLongest )
-                   {
-                     	forwarding = 1;
-          		longest = newLongest;
-          		longestRoutingTable = currRoutingTable;
-                   }
-          	}
-          	currRoutingTable = currRoutingTable->next;
-        }
-    }
+  lk->forRouter = 0;
+  lk->forwarding = 0;
+  lk->longestInterface = NULL;
+  lk->longestRoutingTable = NULL;
+  lk->route6 = NULL;
+  lk->outIf = NULL;
 
+  if( lk->info.ethertype == ethertype_ip6 )
+  {
+      sr_ip6_classify(sr, packet, len, lk);
+      return 0;
   }
 
+  /*arp packet is only handled by the router, ip packet can be for router, servers, or client*/
+  if( lk->info.ethertype == ethertype_arp )
+      *dst = ((sr_arp_hdr_t *) (packet + lk->info.l3))->ar_tip;
+  else
+      *dst = ((sr_ip_hdr_t *) (packet + lk->info.l3))->ip_dst;
 
-  /*printf("forRouter: %d", forRouter);
-  printf("forwarding: %d", forwarding);*/
-  if(forRouter == 0 && forwarding == 0) /*ip_dst has no match in the routing table entries*/
+  /*check against each router's interface*/
+  for( currIf = sr->if_list; currIf != NULL; currIf = currIf->next )
   {
-      /* pointer to the Eth Header */
-      sr_ethernet_hdr_t * eth_hdr = (sr_ethernet_hdr_t *) packet;
-      /* pointer to the Arp Header */
-      sr_ip_hdr_t * ip_hdr = (sr_ip_hdr_t *) (packet + sizeof(sr_ethernet_hdr_t));
+      if(currIf->ip == *dst)
+      {
+        lk->forRouter = 1;
+        lk->longestInterface = currIf;
+        return 0;
+      }
+  }
 
-      /*handle ICMP response (destination net unreachable - Type: 3, Code: 0)*/
+  return lk->info.ethertype == ethertype_ip;
+}
 
-      handle_ICMP_response( sr, packet, len, 3, 0, eth_hdr, ip_hdr, interface, NULL);
-  }
-  else if(forRouter && longestInterface != NULL) /*1) destined to one of router's ip*/
-  {
+/*---------------------------------------------------------------------
+ * Method: sr_classify_route(..)
+ * Scope:  Local
+ *
+ * Finish sr_classify_packet with the longest prefix match rt, or NULL
+ * when no route covers the destination: pick the multipath member for
+ * the flow and resolve its egress interface.
+ *
+ *---------------------------------------------------------------------*/
 
+static void sr_classify_route(struct sr_instance* sr,
+        uint8_t * packet/* lent */,
+        struct sr_lookup * lk,
+        struct sr_rt * rt)
+{
+  if( rt == NULL )
+      return;
 
-	uint16_t etherType= ethertype(packet);
+  /*several routes for the prefix: keep each flow on one of them*/
+  if( rt->ecmp_next != NULL )
+      rt = sr_rt_ecmp_select(rt, sr_flow_hash(packet, &(lk->info), sr->ecmp_seed));
 
-  	if(etherType == ethertype_arp)/*handle ARP packet*/
-  	{
-		/* pointer to the Eth Header */
-       		sr_ethernet_hdr_t * eth_hdr = (sr_ethernet_hdr_t *) packet;
-		/* pointer to the Arp Header */
-  		sr_arp_hdr_t * arp_hdr = (sr_arp_hdr_t *) (packet + sizeof(sr_ethernet_hdr_t));
+  lk->forwarding = 1;
+  lk->longestRoutingTable = rt;
+  lk->outIf = sr_get_interface(sr, rt->interface);
+}
 
-		/*printf("ALERT: THIS IS ARP\n\n");*/
-  		if(ntohs(arp_hdr->ar_op) == arp_op_request)
-  		{
-			/*printf("ALERT: THIS IS ARP REQUEST\n\n");*/
-			/*add en entry to the ARP cache with <IP Address, MAC address> if entry does not exit*/
-			struct sr_arpentry * mapping = sr_arpcache_lookup(&(sr->cache), arp_hdr->ar_sip);
-		
-			if(mapping == NULL)
-			{
+/*---------------------------------------------------------------------
+ * Method: sr_dispatch_packet(..)
+ * Scope:  Local
+ *
+ * Act on a classified frame: answer ARP/ICMP addressed to the router,
+ * or rewrite and send (or queue behind ARP) a forwarded packet.
+ *
+ *---------------------------------------------------------------------*/
 
-				struct sr_arpreq * arp_req = sr_arpcache_insert(&(sr->cache), eth_hdr->ether_shost, arp_hdr->ar_sip);
-				if(arp_req != NULL)
-				{
-					/*printf("\n\n~~~~~ARP REQ DESTROYED~~~~~~~~\n\n");*/
-					sr_arpreq_destroy(&(sr->cache), arp_req);
-				}
-			}
-			else
-			{
+static void sr_dispatch_packet(struct sr_instance* sr,
+        uint8_t * packet/* lent */,
+        unsigned int len,
+        char* interface/* lent */,
+        const struct sr_lookup * lk)
+{
+  const struct sr_pktinfo * info = &(lk->info);
+  struct sr_if * longestInterface = lk->longestInterface;
+  struct sr_rt * longestRoutingTable = lk->longestRoutingTable;
+  sr_ethernet_hdr_t * eth_hdr = (sr_ethernet_hdr_t *) packet;
+  sr_arp_hdr_t * arp_hdr;
+  sr_ip_hdr_t * ip_hdr;
+
+  if( lk->drop )
+  {
+      return;
+  }
 
-				/*free the mapping*/
-				free(mapping);
-			}
+  if( info->ethertype == ethertype_ip6 )
+  {
+      sr_ip6_dispatch(sr, packet, len, interface, lk);
+      return;
+  }
 
-			handle_ARP_send_reply(sr, len, eth_hdr, arp_hdr,interface);
-  		}
-		else if(ntohs(arp_hdr->ar_op) == arp_op_reply)
-		{
-			/*printf("ALERT: THIS IS ARP REPLY\n\n");*/
-			handle_ARP_process_reply(sr, packet, len, interface);
-		}
+  if( info->ethertype == ethertype_arp )/*handle ARP packet*/
+  {
+	arp_hdr = (sr_arp_hdr_t *) (packet + info->l3);
 
- 	}
-	else if(etherType == ethertype_ip)/*handle IP packet*/
-  	{
-		/*printf("this is an IP packet\n\n");*/
-		/* pointer to the Eth Header */
-      		sr_ethernet_hdr_t * eth_hdr = (sr_ethernet_hdr_t *) packet;
-		/* pointer to the Ip Header */
-  		sr_ip_hdr_t * ip_hdr = (sr_ip_hdr_t *) (packet + sizeof(sr_ethernet_hdr_t));
+	/*a reply for some other host's request*/
+	if( !lk->forRouter || longestInterface == NULL )
+	{
+		return;
+	}
 
+	/*printf("ALERT: THIS IS ARP\n\n");*/
+	if(ntohs(arp_hdr->ar_op) == arp_op_request)
+	{
+		/*printf("ALERT: THIS IS ARP REQUEST\n\n");*/
+		/*add en entry to the ARP cache with <IP Address, MAC address> if entry does not exit,
+		  or confirm one reloaded from the snapshot*/
+		struct sr_arpentry * mapping = sr_arpcache_lookup(&(sr->cache), arp_hdr->ar_sip);
 
-		/*check ip version in ip*/
-		if(ip_hdr->ip_v != 4)
+		if(mapping != NULL && mapping->tentative)
 		{
-			fprintf(stderr, "ERROR: IP VERSION IS NOT IP_V4");
+			free(mapping);
+			mapping = NULL;
 		}
-
-   		/*check checksum in ip*/
-    		uint16_t ip_sum_ori = ip_hdr->ip_sum;
-    		ip_hdr->ip_sum = 0;
-    		uint16_t ip_sum_recalculate = cksum(ip_hdr, sizeof(sr_ip_hdr_t) );
-    		if( ip_sum_ori != ip_sum_recalculate )
-    		{
-      			fprintf(stderr, "ERROR: Checksum is invalid");
-   		}
-		
-		if(ip_hdr->ip_p == ip_protocol_icmp)/*handle ICMP response (PING - Type:0)*/
+		if(mapping == NULL)
 		{
 
-			/*check len of the entire packet*/
-			if( len < sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t) + sizeof(sr_icmp_t11_hdr_t) + ICMP_DATA_SIZE )
+			struct sr_arpreq * arp_req = sr_arpcache_insert(&(sr->cache), eth_hdr->ether_shost, arp_hdr->ar_sip, interface);
+			if(arp_req != NULL)
 			{
-				fprintf(stderr, "ERROR: LEN PACKET IS INCORRECT");
+				/*printf("\n\n~~~~~ARP REQ DESTROYED~~~~~~~~\n\n");*/
+				sr_arpreq_destroy(&(sr->cache), arp_req);
 			}
-			/*printf("\n\nthis is an ICMP echo(ping) message\n\n");*/
-			handle_ICMP_response(sr,packet,len, 0, -1, eth_hdr, ip_hdr, interface, longestInterface->name);
-
 		}
-		else if(ip_hdr->ip_p == 17 || ip_hdr->ip_p == 6 ) /*handle ICMP response(IP without ICMP) (TRACEROUTE - Type: 3, Code: 3)*/
+		else
 		{
-			/*check len of the entire packet*/
-			if( len < sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t) )
-			{
-				fprintf(stderr, "ERROR: LEN PACKET IS INCORRECT");
-			}
-			/*printf("this is TRACEROUTING packet");*/
-			handle_ICMP_response(sr, packet, len + sizeof(sr_icmp_t11_hdr_t) + ICMP_DATA_SIZE, 3, 3, eth_hdr, ip_hdr, interface, longestInterface->name);
 
+			/*free the mapping*/
+			free(mapping);
 		}
-        }
+
+		handle_ARP_send_reply(sr, len, eth_hdr, arp_hdr,interface);
+	}
+	else if(ntohs(arp_hdr->ar_op) == arp_op_reply)
+	{
+		/*printf("ALERT: THIS IS ARP REPLY\n\n");*/
+		handle_ARP_process_reply(sr, packet, len, interface);
+	}
+	return;
+  }
+
+  /*IPv4 from here on, its header checked by sr_pkt_parse*/
+  ip_hdr = (sr_ip_hdr_t *) (packet + info->l3);
+
+  /*printf("forRouter: %d", forRouter);
+  printf("forwarding: %d", forwarding);*/
+  if(lk->forRouter == 0 && lk->forwarding == 0) /*ip_dst has no match in the routing table entries*/
+  {
+      /*handle ICMP response (destination net unreachable - Type: 3, Code: 0)*/
+
+      handle_ICMP_response( sr, packet, len, info, 3, 0, NULL);
+  }
+  else if(lk->forRouter && longestInterface != NULL) /*1) destined to one of router's ip*/
+  {
+	/*printf("this is an IP packet\n\n");*/
+	if(info->proto == ip_protocol_icmp)/*handle ICMP response (PING - Type:0)*/
+	{
+
+		/*check len of the entire packet*/
+		if( len < info->l3 + ip_hdr->ip_hl * 4 + sizeof(sr_icmp_t11_hdr_t) + ICMP_DATA_SIZE )
+		{
+			SR_TRACE(SR_TRACE_WARN, SR_EV_IP_BAD_LEN, ip_hdr->ip_src, ip_hdr->ip_dst, len,
+			         info->l3 + ip_hdr->ip_hl * 4 + sizeof(sr_icmp_t11_hdr_t) + ICMP_DATA_SIZE);
+		}
+		/*printf("\n\nthis is an ICMP echo(ping) message\n\n");*/
+		handle_ICMP_response(sr,packet,len, info, 0, -1, longestInterface);
+
+	}
+	else if(info->proto == ip_protocol_udp || info->proto == ip_protocol_tcp ) /*handle ICMP response(IP without ICMP) (TRACEROUTE - Type: 3, Code: 3)*/
+	{
+		/*printf("this is TRACEROUTING packet");*/
+		handle_ICMP_response(sr, packet, len + sizeof(sr_icmp_t11_hdr_t) + ICMP_DATA_SIZE, info, 3, 3, longestInterface);
+
+	}
 
    }/*for router*/
-   else if( forwarding && longestRoutingTable != NULL )
+   else if( lk->forwarding && longestRoutingTable != NULL )
    {
 		/*printf("This is forwarded packet");*/
-		/* pointer to the Eth Header */
-      		sr_ethernet_hdr_t * eth_hdr = (sr_ethernet_hdr_t *) packet;
-		/* pointer to the Ip Header */
-  		sr_ip_hdr_t * ip_hdr = (sr_ip_hdr_t *) (packet + sizeof(sr_ethernet_hdr_t));
-
-
-   		/*check checksum in ip*/
-    		uint16_t ip_sum_ori = ip_hdr->ip_sum;
-    		ip_hdr->ip_sum = 0;
-    		uint16_t ip_sum_recalculate = cksum(ip_hdr, sizeof(sr_ip_hdr_t) );
-    		if( ip_sum_ori != ip_sum_recalculate )
-    		{
-      			fprintf(stderr, "ERROR: Checksum is invalid");
-   		}
-
-		/*check ip version in ip*/
-		if(ip_hdr->ip_v != 4)
-		{
-			fprintf(stderr, "ERROR: IP VERSION IS NOT IP_V4");
-		}
 
 		/*Handle ICMP response (Time exceeded - Type: 11, Code: 0) */
 		if(ip_hdr->ip_ttl-1 == 0)
 		{
 			/*printf("---------------SEND TIME EXCEEDED~~~~~~~~~~~~~~~");*/
-			handle_ICMP_response( sr, packet, len, 11, 0, eth_hdr, ip_hdr, interface, NULL );
+			handle_ICMP_response( sr, packet, len, info, 11, 0, NULL );
 		}
 
 
-		if( ip_hdr->ip_p == ip_protocol_icmp || (ip_hdr->ip_p == 17 || ip_hdr->ip_p == 6) )/*forward ICMP packet (PING - Type:0)*/
+		if( info->proto == ip_protocol_icmp || (info->proto == ip_protocol_udp || info->proto == ip_protocol_tcp) )/*forward ICMP packet (PING - Type:0)*/
 		{
-			if(ip_hdr->ip_p == ip_protocol_icmp)
+			if(info->proto == ip_protocol_icmp)
 			{
 				/*printf("This is a PING FORWARD packet");*/
 				/*check len of the entire packet*/
-				if( len < sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t) + sizeof(sr_icmp_t11_hdr_t) + ICMP_DATA_SIZE )
+				if( len < info->l3 + ip_hdr->ip_hl * 4 + sizeof(sr_icmp_t11_hdr_t) + ICMP_DATA_SIZE )
 				{
-					fprintf(stderr, "ERROR: LEN PACKET IS INCORRECT");
+					SR_TRACE(SR_TRACE_WARN, SR_EV_IP_BAD_LEN, ip_hdr->ip_src, ip_hdr->ip_dst, len,
+					         info->l3 + ip_hdr->ip_hl * 4 + sizeof(sr_icmp_t11_hdr_t) + ICMP_DATA_SIZE);
 				}
 			}
-			else
-			{
-				/*printf("This is a TRACEROUTE FORWARD packet");*/
-				if( len < sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t) )
-				{
-					fprintf(stderr, "ERROR: LEN PACKET IS INCORRECT");
-				}
 
+
+			/*translate the source of packets leaving through the NAT's outside interface*/
+			if( sr->nat && sr_nat_outbound(sr, packet, len, interface, lk->outIf) != 0 )
+			{
+				return;
 			}
 
+			/*the gateway is the next hop, a route without one is directly connected*/
+			uint32_t next_hop = longestRoutingTable->gw.s_addr ? longestRoutingTable->gw.s_addr : ip_hdr->ip_dst;
+
+			/*other receive threads, and routers sharing the table, count on the same route*/
+			__atomic_fetch_add(&(longestRoutingTable->tx_packets), 1, __ATOMIC_RELAXED);
+			__atomic_fetch_add(&(longestRoutingTable->tx_bytes), len, __ATOMIC_RELAXED);
 
 			/*check the ARP cache for the next-hop MAC address corresponding to the next-hop IP*/
-			struct sr_arpentry * mapping = sr_arpcache_lookup(&(sr->cache), (uint32_t) longestRoutingTable->dest.s_addr);
+			struct sr_arpentry * mapping = sr_arpcache_lookup(&(sr->cache), next_hop);
 			if( mapping != NULL )
 			{
 				/*printf("\n\n\nALERT: Mapping EXIST!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!\n\n\n");*/
 				/*decrement the TTL by 1, recompute the packet checksumm over the modified header*/
 				ip_hdr->ip_ttl -= 1;
 				ip_hdr->ip_sum = 0;
-				ip_hdr->ip_sum = cksum(ip_hdr, sizeof(sr_ip_hdr_t));
+				ip_hdr->ip_sum = cksum(ip_hdr, ip_hdr->ip_hl * 4);
 
 				/*get the next_hop_ip->mac address to send the packet*/
-				struct sr_if * outgoing_If = sr_get_interface( sr, longestRoutingTable->interface );
+				struct sr_if * outgoing_If = lk->outIf;
 
 				memcpy(eth_hdr->ether_dhost, mapping->mac, ETHER_ADDR_LEN);
 				memcpy(eth_hdr->ether_shost, outgoing_If->addr , ETHER_ADDR_LEN);
@@ -353,7 +538,7 @@ void sr_handlepacket(struct sr_instance* sr,
 			{
 				/*queue the packet and get the arp request*/
 				/*printf("\n\n\nALERT: Mapping NOT EXITS!!!!\n\n\n");*/
-				struct sr_arpreq * arp_req = sr_arpcache_queuereq(&(sr->cache), (uint32_t) longestRoutingTable->dest.s_addr, packet, len, longestRoutingTable->interface);
+				struct sr_arpreq * arp_req = sr_arpcache_queuereq(&(sr->cache), next_hop, packet, len, info, longestRoutingTable->interface);
 				handle_arpreq(sr, arp_req);
 
 			}
@@ -366,11 +551,163 @@ void sr_handlepacket(struct sr_instance* sr,
    /*printf("\n\n---CHECKING THE ORI PACKET----\n\n");
    print_hdrs(packet,len);*/
 
-}/* end sr_ForwardPacket */
+}/* end sr_dispatch_packet */
+
+/*---------------------------------------------------------------------
+ * Method: sr_handlepacket_burst(..)
+ * Scope:  Global
+ *
+ * Handle a vector of received frames in stages, each over every frame
+ * of the burst before the next, so the memory latency of one packet
+ * overlaps with the work on the others:
+ *
+ *   1) prefetch the ethernet/IP headers of every frame,
+ *   2) parse and check each frame once into its sr_pktinfo, drop frames
+ *      that fail or that the ACL denies, undo NAT on replies, and match
+ *      the destination against the router's own addresses,
+ *   3) look up the routes of all frames left to forward together, the
+ *      trie walks prefetching each other's next node
+ *      (sr_fib_lookup_burst), then pick the multipath member and egress
+ *      interface of each,
+ *   4) prefetch the ARP cache and the egress queues of the interfaces
+ *      the frames leave by,
+ *   5) rewrite and send every frame.
+ *
+ * The ACL sees frames as they arrived, before any translation.  Frames
+ * are handled in order, and the buffers are lent exactly as for
+ * sr_handlepacket.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_handlepacket_burst(struct sr_instance* sr,
+        uint8_t ** packets/* lent */,
+        unsigned int * lens,
+        char ** interfaces/* lent */,
+        unsigned int count)
+{
+  struct sr_lookup lk[SR_BURST_MAX];
+  uint32_t dst[SR_BURST_MAX];
+  struct sr_rt * routes[SR_BURST_MAX];
+  unsigned int which[SR_BURST_MAX];
+  struct sr_acl_set * acl_set;
+  struct sr_fib * fib;
+  unsigned int max = sr->burst ? sr->burst : SR_BURST_MAX;
+  unsigned int base, n, i, m;
+  uint64_t now;
+
+  /* REQUIRES */
+  assert(sr);
+  assert(packets);
+  assert(lens);
+  assert(interfaces);
+
+  /* what the burst sends is scheduled together once it has been handled */
+  sr_egress_hold();
+  now = sr_now_ns();
+  for( base = 0; base < count; base += n )
+  {
+      n = count - base;
+      if( n > max )
+          n = max;
+
+      for( i = 0; i < n; i++ )
+      {
+          SR_PREFETCH(packets[base + i]);
+          SR_PREFETCH(packets[base + i] + sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t));
+      }
+
+      /* routes found here stay valid until the frames are sent */
+      SR_RT_RDLOCK(sr);
+      fib = sr->fwd_fib != NULL ? sr->fwd_fib : sr->fib;
+      acl_set = sr->acl ? sr_acl_acquire(sr->acl) : NULL;
+      for( i = 0, m = 0; i < n; i++ )
+      {
+          assert(packets[base + i]);
+          assert(interfaces[base + i]);
+          lk[i].drop = 0;
+          if( sr_pkt_parse(sr, packets[base + i], lens[base + i],
+                           interfaces[base + i], now, &lk[i].info) != 0 )
+          {
+              lk[i].drop = SR_DROP_IGNORED;
+          }
+          else if( acl_set &&
+              sr_acl_filter(acl_set, packets[base + i], &lk[i].info) == SR_ACL_DENY )
+          {
+              lk[i].drop = SR_DROP_ACL;
+          }
+          if( lk[i].drop )
+              continue;
+          if( sr->nat )
+              sr_nat_inbound(sr, packets[base + i], lens[base + i], interfaces[base + i]);
+          if( sr_classify_packet(sr, packets[base + i], lens[base + i], &lk[i], &dst[m]) &&
+              fib != NULL )
+              which[m++] = i;
+      }
+      if( acl_set )
+          sr_acl_release(sr->acl);
+
+      if( m > 0 )
+      {
+          sr_fib_lookup_burst(fib, dst, routes, m);
+          for( i = 0; i < m; i++ )
+              sr_classify_route(sr, packets[base + which[i]], &lk[which[i]], routes[i]);
+      }
+
+      for( i = 0; i < n; i++ )
+      {
+          /* sampled before dispatch rewrites the frame */
+          if( sr->sflow && SR_SFLOW_IN_DUE(sr->sflow) )
+              sr_sflow_ingress(sr, packets[base + i], lens[base + i], &lk[i]);
+          if( lk[i].outIf != NULL && lk[i].outIf->egress != NULL )
+              SR_PREFETCH(lk[i].outIf->egress);
+      }
+      if( m > 0 )
+          sr_arpcache_prefetch(&(sr->cache));
+
+      for( i = 0; i < n; i++ )
+      {
+          sr_dispatch_packet(sr, packets[base + i], lens[base + i], interfaces[base + i], &lk[i]);
+      }
+      SR_RT_UNLOCK(sr);
+  }
+  sr_egress_release(sr);
+}/* end sr_handlepacket_burst */
+
+/*---------------------------------------------------------------------
+ * Method: sr_handlepacket(uint8_t* p,char* interface)
+ * Scope:  Global
+ *
+ * This method is called each time the router receives a packet on the
+ * interface.  The packet buffer, the packet length and the receiving
+ * interface are passed in as parameters. The packet is complete with
+ * ethernet headers.
+ *
+ * Note: Both the packet buffer and the character's memory are handled
+ * by sr_vns_comm.c that means do NOT delete either.  Make a copy of the
+ * packet instead if you intend to keep it around beyond the scope of
+ * the method call.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_handlepacket(struct sr_instance* sr,
+        uint8_t * packet/* lent (full packet that contain the ethernet header as well)*/,
+        unsigned int len,
+        char* interface/* lent (name of the receiving interface of the router's)*/)
+{
+  /* REQUIRES */
+  assert(sr);
+  assert(packet);
+  assert(interface);
+
+  /*printf("\n\n*** -> Received packet of length %d \n",len);*/
+
+  sr_handlepacket_burst(sr, &packet, &len, &interface, 1);
+}
+
 
 void handle_arpreq( struct sr_instance * sr, struct sr_arpreq * arp_req)
 {
-	pthread_mutex_lock(&(sr->cache.lock));
+	SR_ARPCACHE_LOCK(&(sr->cache));
 
 	/*get the current time*/
 	time_t now;
@@ -382,14 +719,17 @@ void handle_arpreq( struct sr_instance * sr, struct sr_arpreq * arp_req)
 		{
 		        /*printf("\n\n\nICMP SENT TO CLIENT: DESTINATION HOST IS unreachable\n\n\n");*/
 			struct sr_packet * currPkt = arp_req->packets;
+			unsigned int queued = 0;
+
+			for( ; currPkt != NULL; currPkt = currPkt->next )
+				queued++;
+			SR_TRACE(SR_TRACE_INFO, SR_EV_ARP_GAVE_UP, arp_req->ip, queued, 0, 0);
+			currPkt = arp_req->packets;
 
 			while( currPkt != NULL )
 			{
 				/*Handle ICMP response (destination host unreachable - Type: 3, Code: 1)*/
-				uint8_t * packet = currPkt->buf;
-        			sr_ethernet_hdr_t * eth_hdr = (sr_ethernet_hdr_t *) packet;
-				sr_ip_hdr_t * ip_hdr = (sr_ip_hdr_t *) ( packet + sizeof(sr_ethernet_hdr_t) );
-				handle_ICMP_response(sr, packet, currPkt->len, 3,1, eth_hdr, ip_hdr, currPkt->iface, NULL  );
+				handle_ICMP_response(sr, currPkt->buf, currPkt->len, &(currPkt->info), 3, 1, NULL);
 
 				currPkt = currPkt->next;
 			}
@@ -407,7 +747,7 @@ void handle_arpreq( struct sr_instance * sr, struct sr_arpreq * arp_req)
 		}
 	}
 
-	pthread_mutex_unlock(&(sr->cache.lock));
+	SR_ARPCACHE_UNLOCK(&(sr->cache));
 }
 
 void handle_ARP_send_request( struct sr_instance * sr, struct sr_arpreq * arp_req)
@@ -418,9 +758,15 @@ void handle_ARP_send_request( struct sr_instance * sr, struct sr_arpreq * arp_re
 	sr_arp_hdr_t * arp_hdr = (sr_arp_hdr_t *) ( arp_request + sizeof(sr_ethernet_hdr_t) );
 
 	/*create the ethernet header*/
-	/*extract the ip_dst from the packet in the queue of this arp_req*/
-	struct sr_packet * waitingPkt = arp_req->packets;
-	struct sr_if * outgoing_If = sr_get_interface( sr, waitingPkt->iface );
+	/*ask on the interface of the first queued packet, or of the route
+	  for a request made ahead of any packet*/
+	struct sr_if * outgoing_If = sr_get_interface( sr, arp_req->iface );
+
+	if( outgoing_If == NULL )
+	{
+		free(arp_request);
+		return;
+	}
 
 	memset(eth_hdr->ether_dhost, 0xff, ETHER_ADDR_LEN);
 	memcpy(eth_hdr->ether_shost, outgoing_If->addr, ETHER_ADDR_LEN);
@@ -442,7 +788,7 @@ void handle_ARP_send_request( struct sr_instance * sr, struct sr_arpreq * arp_re
 	/*print_hdrs(arp_request, sizeof(sr_ethernet_hdr_t)+ sizeof(sr_arp_hdr_t));*/
 
 	/*send the packet*/
-	sr_send_packet(sr, arp_request, sizeof(sr_ethernet_hdr_t) + sizeof(sr_arp_hdr_t), outgoing_If->name);
+	sr_send_control_packet(sr, arp_request, sizeof(sr_ethernet_hdr_t) + sizeof(sr_arp_hdr_t), outgoing_If->name);
 
 
 }
@@ -455,28 +801,62 @@ void handle_ARP_process_reply(struct sr_instance* sr,
 	sr_ethernet_hdr_t * eth_hdr = (sr_ethernet_hdr_t *) packet;
 	sr_arp_hdr_t * arp_hdr = (sr_arp_hdr_t *) ( packet + sizeof(sr_ethernet_hdr_t) );
 
-	struct sr_arpreq * arp_req = sr_arpcache_insert( &(sr->cache), eth_hdr->ether_shost, arp_hdr->ar_sip );
+	struct sr_arpreq * arp_req = sr_arpcache_insert( &(sr->cache), eth_hdr->ether_shost, arp_hdr->ar_sip, interface );
 
 	if( arp_req != NULL )
+	{
+		handle_ARP_send_pending( sr, arp_req, eth_hdr->ether_shost, interface );
+	}
+
+
+
+}
+
+/*---------------------------------------------------------------------
+ * Method: handle_ARP_send_pending(..)
+ * Scope:  Global
+ *
+ * The MAC of arp_req's address is known, from a reply or set by hand:
+ * send the packets waiting on the request to it out of interface, then
+ * destroy the request.
+ *
+ *---------------------------------------------------------------------*/
+
+void handle_ARP_send_pending(struct sr_instance* sr,
+        struct sr_arpreq * arp_req,
+        const unsigned char * mac,
+        const char* interface)
+{
+	struct sr_if * outgoing_If = sr_get_interface(sr, interface);
+
+	if( outgoing_If != NULL )
 	{
 		/*send all packet on the req->packet linked list*/
 		struct sr_packet * currPacket = arp_req->packets;
 
 		while(currPacket != NULL )
 		{
+			/*drop the ones that waited too long*/
+			if( !sr_arpcache_pending_ok(&(sr->cache), currPacket) )
+			{
+				currPacket = currPacket->next;
+				continue;
+			}
+
 			uint8_t * forward_pkt = currPacket->buf;
 
 			sr_ethernet_hdr_t * eth_hdr_fwd = (sr_ethernet_hdr_t *) forward_pkt;
-			sr_ip_hdr_t * ip_hdr_fwd = (sr_ip_hdr_t *) ( forward_pkt + sizeof(sr_ethernet_hdr_t) );
+			sr_ip_hdr_t * ip_hdr_fwd = (sr_ip_hdr_t *) ( forward_pkt + currPacket->info.l3 );
 
 			/*modify the ethernet header*/
-			memcpy( eth_hdr_fwd->ether_dhost, eth_hdr->ether_shost, ETHER_ADDR_LEN);
-			memcpy( eth_hdr_fwd->ether_shost, eth_hdr->ether_dhost, ETHER_ADDR_LEN);
+			memcpy( eth_hdr_fwd->ether_dhost, mac, ETHER_ADDR_LEN);
+			memcpy( eth_hdr_fwd->ether_shost, outgoing_If->addr, ETHER_ADDR_LEN);
 
 			/*modify the ip header*/
 			/*decrement the TTL by 1, recompute the packet checksumm over the modified header*/
 			ip_hdr_fwd->ip_ttl -= 1;
-			ip_hdr_fwd->ip_sum = cksum(ip_hdr_fwd, sizeof(sr_ip_hdr_t));
+			ip_hdr_fwd->ip_sum = 0;
+			ip_hdr_fwd->ip_sum = cksum(ip_hdr_fwd, ip_hdr_fwd->ip_hl * 4);
 
 
       			/*check the send packet to the server*/
@@ -484,17 +864,14 @@ void handle_ARP_process_reply(struct sr_instance* sr,
       			print_hdrs(forward_pkt, currPacket->len);*/
 
 			/*forward the packet*/
-			sr_send_packet( sr, forward_pkt, currPacket->len, interface );
+			sr_send_pbuf( sr, currPacket->pb, interface );
 
 			currPacket = currPacket->next;
 		}
-
-		/*destroy the arp_req*/
-		sr_arpreq_destroy( &(sr->cache), arp_req );
 	}
 
-
-
+	/*destroy the arp_req*/
+	sr_arpreq_destroy( &(sr->cache), arp_req );
 }
 
 void handle_ARP_send_reply(struct sr_instance * sr, unsigned int len, sr_ethernet_hdr_t * eth_hdr,
@@ -530,7 +907,7 @@ void handle_ARP_send_reply(struct sr_instance * sr, unsigned int len, sr_etherne
 			printf("\n\n---CHECKING THE ORI PACKET----\n\n");
         		print_hdrs(packet,len);*/
 
-        		sr_send_packet(sr, rep_packet, sizeof(sr_ethernet_hdr_t) + sizeof(sr_arp_hdr_t), interface);
+        		sr_send_control_packet(sr, rep_packet, sizeof(sr_ethernet_hdr_t) + sizeof(sr_arp_hdr_t), interface);
 
 
 
@@ -539,16 +916,14 @@ void handle_ARP_send_reply(struct sr_instance * sr, unsigned int len, sr_etherne
 
 }
 
-void handle_ICMP_response(struct sr_instance * sr, uint8_t * packet, unsigned int len, int type, int code,
-			  sr_ethernet_hdr_t * eth_hdr, sr_ip_hdr_t * ip_hdr,
-			  char * interface, char * longestInterface)
+void handle_ICMP_response(struct sr_instance * sr, uint8_t * packet, unsigned int len,
+			  const struct sr_pktinfo * info, int type, int code, struct sr_if * hitIf)
 {
 			/*printf("@@@@@@@@@@@@get into handle_icmp_response");*/
 			/*Create ethernet header*/
-			struct sr_if* recvIf = sr_get_interface(sr, interface);
-			struct sr_if * hitIf = NULL;
-			if( longestInterface != NULL )
-				hitIf = sr_get_interface(sr, longestInterface);
+			struct sr_if* recvIf = info->in_if;
+			sr_ethernet_hdr_t * eth_hdr = (sr_ethernet_hdr_t *) packet;
+			sr_ip_hdr_t * ip_hdr = (sr_ip_hdr_t *) (packet + info->l3);
 
       			sr_ethernet_hdr_t * ethHdr_rep = (sr_ethernet_hdr_t *) malloc(sizeof(sr_ethernet_hdr_t));
       			memcpy(ethHdr_rep->ether_dhost, eth_hdr->ether_shost, ETHER_ADDR_LEN);
@@ -561,6 +936,7 @@ void handle_ICMP_response(struct sr_instance * sr, uint8_t * packet, unsigned in
 			/*Create IP header*/
 			sr_ip_hdr_t * ipHdr_rep = (sr_ip_hdr_t *) malloc(sizeof(sr_ip_hdr_t));
       			memcpy(ipHdr_rep, ip_hdr, sizeof(sr_ip_hdr_t) );
+			ipHdr_rep->ip_hl = sizeof(sr_ip_hdr_t) / 4; /*the options are not copied*/
 			ipHdr_rep->ip_len = htons( sizeof(sr_ip_hdr_t) + sizeof(sr_icmp_t11_hdr_t ) + ICMP_DATA_SIZE);
 			ipHdr_rep->ip_src = recvIf->ip;
 			ipHdr_rep->ip_dst = ip_hdr->ip_src;
@@ -588,7 +964,7 @@ void handle_ICMP_response(struct sr_instance * sr, uint8_t * packet, unsigned in
          
 			if( (type == 0 && code == -1) || (type == 3 && code == 1) )
 			{
-				sr_icmp_t11_hdr_t * icmp_hdr = (sr_icmp_t11_hdr_t *) (packet + sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t));
+				sr_icmp_t11_hdr_t * icmp_hdr = (sr_icmp_t11_hdr_t *) (packet + info->l3 + ip_hdr->ip_hl * 4);
 
 				icmpHdr_rep = (sr_icmp_t11_hdr_t *) malloc( sizeof(sr_icmp_t11_hdr_t) + ICMP_DATA_SIZE );
       				memcpy(icmpHdr_rep, icmp_hdr, sizeof(sr_icmp_t11_hdr_t) + ICMP_DATA_SIZE);
@@ -641,6 +1017,7 @@ void handle_ICMP_response(struct sr_instance * sr, uint8_t * packet, unsigned in
 			printf("\n\nioioio\n\n");*/
 
 			/*send*/
-        		sr_send_packet(sr, rep_packet_icmp, sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t) + sizeof(sr_icmp_t11_hdr_t) + ICMP_DATA_SIZE, interface);
+			SR_TRACE(SR_TRACE_INFO, SR_EV_ICMP_SENT, ipHdr_rep->ip_dst, icmpHdr_rep->icmp_type, icmpHdr_rep->icmp_code, 0);
+        		sr_send_control_packet(sr, rep_packet_icmp, sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t) + sizeof(sr_icmp_t11_hdr_t) + ICMP_DATA_SIZE, recvIf->name);
 
 }
@@ -11,10 +11,13 @@
 
 #include <netinet/in.h>
 #include <sys/time.h>
+#include <signal.h>
 #include <stdio.h>
 
 #include "sr_protocol.h"
 #include "sr_arpcache.h"
+#include "sr_ndcache.h"
+#include "sr_netdev.h"
 
 /* we dont like this debug , but what to do for varargs ? */
 #ifdef _DEBUG_
@@ -30,9 +33,71 @@
 #define INIT_TTL 255
 #define PACKET_DUMP_SIZE 1024
 
+/* most frames sr_handlepacket_burst resolves before acting on them */
+#define SR_BURST_MAX 256
+
+#ifdef __GNUC__
+#define SR_PREFETCH(p) __builtin_prefetch((p))
+#else
+#define SR_PREFETCH(p) do{}while(0)
+#endif
+
+/* how sr_main drives the router once connected */
+#define SR_LOOP_THREADS 0 /* blocking reads + ARP cleanup thread */
+#define SR_LOOP_EVENT   1 /* single threaded epoll loop, no locking */
+
+/* event loop is the default up to this many online CPUs */
+#define SR_EVENT_LOOP_MAX_CPUS 2
+
+/* sr_uring_run: io_uring cannot be used, run sr_reactor_run instead */
+#define SR_URING_UNAVAILABLE -2
+
+/* reopening a lost VNS session: first at once, then backing off from
+ * MIN to MAX milliseconds, for up to -R seconds */
+#define SR_VNS_RETRY_DEFAULT     60
+#define SR_VNS_BACKOFF_MIN       50
+#define SR_VNS_BACKOFF_MAX       5000
+#define SR_VNS_HANDSHAKE_TIMEOUT 5    /* seconds for the server to answer */
+
+/* VNSPACKET commands per writev to the server (two iovecs each) */
+#define SR_VNS_IOV_FRAMES 32
+
 /* forward declare */
 struct sr_if;
 struct sr_rt;
+struct sr_uring;
+struct sr_nat;
+struct sr_acl;
+struct sr_fib;
+struct sr_fib6;
+struct sr_rt6;
+struct sr_sflow;
+struct sr_egress_pacer;
+struct sr_handover;
+struct sr_rt_load;
+
+/* ----------------------------------------------------------------------------
+ * struct sr_stats
+ *
+ * Packet counters, reported over the control socket.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_stats
+{
+    uint64_t rx_packets;
+    uint64_t rx_bytes;
+    uint64_t tx_packets;
+    uint64_t tx_bytes;
+    uint64_t tx_errors;
+    uint64_t syscalls;   /* socket I/O system calls on the VNS path */
+    uint64_t vns_drops;            /* VNS sessions lost, see sr_vns_reconnect */
+    uint64_t vns_reconnects;       /* ... and opened again */
+    uint64_t vns_failed_attempts;  /* connections or handshakes that failed */
+    uint64_t vns_recover_last_us;  /* loss to reopened session, the last one */
+    uint64_t vns_recover_max_us;   /* ... and the longest */
+    uint64_t vns_down_us;          /* ... and all of them */
+};
 
 /* ----------------------------------------------------------------------------
  * struct sr_instance
@@ -43,33 +108,153 @@ struct sr_rt;
 
 struct sr_instance
 {
-    int  sockfd;   /* socket to server */
+    int  sockfd;   /* socket to server, -1 while there is no session */
+    pthread_mutex_t vns_lock; /* sockfd changes vs. senders, see sr_vns_drop */
     char user[32]; /* user name */
     char host[32]; /* host name */ 
     char template[30]; /* template name if any */
     unsigned short topo_id;
     struct sockaddr_in sr_addr; /* address to server */
     struct sr_if* if_list; /* list of interfaces */
-    struct sr_rt* routing_table; /* routing table */
+    struct sr_rt* routing_table; /* routing table, in the order added */
+    struct sr_fib* fib;          /* the same routes indexed for lookup */
+    int rt_shared; /* fib is shared and read-only, see sr_rt.c */
+    pthread_rwlock_t rt_lock;    /* route updates vs. forwarding */
+    int rt_use_locks;            /* 0 when updates run on the forwarding thread */
+    struct sr_fib* fwd_fib; /* ORTC compressed fib used for lookups, or NULL */
+    int rt_compress;        /* compress again after each table load */
+    struct sr_rt_load* rt_load; /* MRT load running, see sr_rt_load_start */
+    struct sr_fib6* fib6;        /* IPv6 routes, NULL for none */
     struct sr_arpcache cache;   /* ARP cache */
+    struct sr_ndcache nd;       /* IPv6 neighbor cache */
     pthread_attr_t attr;
     FILE* logfile;
+    int loop_mode;   /* SR_LOOP_THREADS or SR_LOOP_EVENT */
+    char ctl_path[108]; /* unix control socket, empty for none */
+    struct sr_stats stats;
+    int use_uring;          /* -U: drive the VNS socket with sr_uring.c */
+    struct sr_uring* uring; /* set while sr_uring_run drives the socket */
+    const struct sr_netdev_ops* netdev; /* frame transport, VNS by default */
+    struct sr_netdev_conf netdev_conf;  /* local interfaces for netdev */
+    void* netdev_priv;                  /* backend state */
+    char nat_if[sr_IFACE_NAMELEN]; /* -N: NAT outside interface, empty for none */
+    unsigned int nat_mappings;     /* -N: mapping table size, 0 for default */
+    struct sr_nat* nat;            /* set up by sr_init when nat_if is set */
+    char acl_path[256];            /* -A: ACL rules file, empty for none */
+    struct sr_acl* acl;            /* set up by sr_init when acl_path is set */
+    uint32_t ecmp_seed;            /* flow hash seed, per router against polarization */
+    unsigned int burst;            /* frames per pass of sr_handlepacket_burst,
+                                      and per shm poll when more than its own;
+                                      SR_BURST in the environment, 0 for
+                                      SR_BURST_MAX */
+    char sflow_path[256];          /* -S: sample export file, empty for none */
+    uint32_t sflow_rate;           /* -S: initial rate of every interface */
+    struct sr_sflow* sflow;        /* set up by sr_init when sflow_path is set */
+    char arp_path[256];            /* -a: ARP cache snapshot, empty for none */
+    unsigned int egress_limit;     /* -Q: packets per egress queue, 0 for none */
+    uint32_t egress_rate;          /* -B: Mbit/s shaping every interface, 0 for
+                                      the link speed */
+    struct sr_egress_pacer* egress_pacer; /* set up with the egress queues */
+    char handover_path[108];       /* -H: hot restart socket, empty for none */
+    struct sr_handover* handover;  /* set while taking over from the router
+                                      at handover_path, see sr_handover.h */
+    unsigned int vns_retry;        /* -R: seconds to try reopening a lost VNS
+                                      session, 0 to exit instead */
+    int vns_closed;                /* the session ended on purpose (VNSCLOSE,
+                                      handed over), not to be reopened */
 };
 
+/* -- set by SIGINT and SIGTERM when there is an ARP snapshot to take;
+ *    sr_arpcache_tick saves it and the receive loops return -- */
+extern volatile sig_atomic_t sr_stop_requested;
+
+/* -- a burst holds rt_lock for reading from lookup to send -- */
+#define SR_RT_RDLOCK(sr) \
+    do { if ((sr)->rt_use_locks) pthread_rwlock_rdlock(&((sr)->rt_lock)); } while (0)
+#define SR_RT_WRLOCK(sr) \
+    do { if ((sr)->rt_use_locks) pthread_rwlock_wrlock(&((sr)->rt_lock)); } while (0)
+#define SR_RT_UNLOCK(sr) \
+    do { if ((sr)->rt_use_locks) pthread_rwlock_unlock(&((sr)->rt_lock)); } while (0)
+
+/* ----------------------------------------------------------------------------
+ * struct sr_lookup
+ *
+ * What a received frame is and where it is headed, as resolved by the
+ * parse/lookup pass of sr_handlepacket_burst.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_lookup
+{
+    struct sr_pktinfo info;            /* sr_pkt_parse */
+    int drop;                          /* SR_DROP_*, 0 to handle the frame */
+    int forRouter;                     /* addressed to one of our interfaces */
+    int forwarding;                    /* matched a route */
+    struct sr_if* longestInterface;    /* our interface it is addressed to */
+    struct sr_rt* longestRoutingTable; /* longest matching route, or the
+                                          multipath member for the flow */
+    struct sr_rt6* route6;             /* IPv6: longest matching route */
+    struct sr_if* outIf;               /* egress interface of that route */
+};
+
+/* -- why sr_handlepacket_burst drops a frame -- */
+#define SR_DROP_IGNORED 1  /* malformed or not for the router, e.g. refused
+                              by sr_pkt_parse */
+#define SR_DROP_ACL     2  /* denied by the ACL */
+
 /* -- sr_main.c -- */
 int sr_verify_routing_table(struct sr_instance* sr);
+void sr_init_instance(struct sr_instance* );
+void sr_destroy_instance(struct sr_instance* );
+void sr_set_user(struct sr_instance* );
+void sr_run_instance(struct sr_instance* );
+
+/* -- sr_multi.c -- */
+int sr_multi_run(const char* conf, const char* user, int loop_mode,
+                 int use_uring, const char* ctl_path);
 
 /* -- sr_vns_comm.c -- */
 int sr_send_packet(struct sr_instance* , uint8_t* , unsigned int , const char*);
+int sr_send_control_packet(struct sr_instance* , uint8_t* , unsigned int , const char*);
+int sr_send_pbuf(struct sr_instance* , struct sr_pbuf* , const char*);
+int sr_transmit(struct sr_instance* , const uint8_t** , const unsigned int* , int ,
+                const char* );
 int sr_connect_to_server(struct sr_instance* ,unsigned short , char* );
 int sr_read_from_server(struct sr_instance* );
+void sr_vns_stop(struct sr_instance* );
+int sr_vns_consume(struct sr_instance* , uint8_t* , unsigned int , unsigned int* );
+
+/* -- sr_reactor.c -- */
+int sr_reactor_run(struct sr_instance* );
+
+/* -- sr_uring.c -- */
+int sr_uring_run(struct sr_instance* );
+int sr_uring_send(struct sr_instance* , const uint8_t* , unsigned int , const char* );
+
+/* -- sr_ctl.c -- */
+#define SR_CTL_READ  1  /* sr_ctl_serve: poll the client for reading */
+#define SR_CTL_WRITE 2  /* ... for writing */
+#define SR_CTL_LOAD  3  /* ... not at all, poll sr_ctl_wait_fd for reading */
+#define SR_CTL_CLIENTS 64  /* connected at once, all routers */
+int  sr_ctl_listen(const char* );
+int  sr_ctl_accept(struct sr_instance* , int );
+int  sr_ctl_serve(struct sr_instance* , int );
+void sr_ctl_serve_epoll(struct sr_instance* , int , int , uint64_t );
+int  sr_ctl_wait_fd(int );
+void sr_ctl_close(int );
+void sr_ctl_disconnect(struct sr_instance* );
+int  sr_ctl_start(struct sr_instance* );
 
 /* -- sr_router.c -- */
 void sr_init(struct sr_instance* );
 void sr_handlepacket(struct sr_instance* , uint8_t * , unsigned int , char* );
-void handle_ICMP_response(struct sr_instance * r,uint8_t * packet, unsigned int len, int type, int code,
-			  sr_ethernet_hdr_t * eth_hdr, sr_ip_hdr_t * ip_hdr,
-			  char * interface, char * hitInterface)
+void sr_handlepacket_burst(struct sr_instance* , uint8_t ** , unsigned int * ,
+                           char ** , unsigned int );
+int  sr_pkt_parse(struct sr_instance* , const uint8_t * , unsigned int ,
+                  const char* , uint64_t , struct sr_pktinfo* );
+void handle_ICMP_response(struct sr_instance * r,uint8_t * packet, unsigned int len,
+			  const struct sr_pktinfo * info, int type, int code,
+			  struct sr_if * hitIf)
 ;
 void handle_ARP_process_reply(struct sr_instance* sr,
         uint8_t * packet/* lent (full packet that contain the ethernet header as well)*/,
@@ -81,6 +266,9 @@ void handle_ARP_send_reply(struct sr_instance * sr, unsigned int len, sr_etherne
 
 void handle_ARP_send_request( struct sr_instance * sr, struct sr_arpreq * arp_req);
 
+void handle_ARP_send_pending(struct sr_instance* sr, struct sr_arpreq * arp_req,
+        const unsigned char * mac, const char* interface);
+
 void handle_arpreq( struct sr_instance * sr, struct sr_arpreq * arp_req);
 
 /* -- sr_if.c -- */
@@ -12,7 +12,10 @@
 #include <assert.h>
 #include <string.h>
 #include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
 
+#include <sys/eventfd.h>
 
 #include <sys/socket.h>
 #include <netinet/in.h>
@@ -21,6 +24,15 @@
 
 #include "sr_rt.h"
 #include "sr_router.h"
+#include "sr_mrt.h"
+#include "sr_ortc.h"
+#include "sr_fib6.h"
+
+static int sr_rt_insert_entry(struct sr_fib* fib, struct in_addr dest,
+        struct in_addr gw, struct in_addr mask, const char* if_name,
+        unsigned int weight);
+static void sr_rt_set_fib(struct sr_instance* sr, struct sr_fib* fib, int shared);
+static void sr_rt_stale(struct sr_instance* sr);
 
 /*---------------------------------------------------------------------
  * Method:
@@ -35,9 +47,12 @@ int sr_load_rt(struct sr_instance* sr,const char* filename)
     char  gw[32];
     char  mask[32];
     char  iface[32];
+    unsigned int weight;
+    int fields;
     struct in_addr dest_addr;
     struct in_addr gw_addr;
     struct in_addr mask_addr;
+    struct sr_fib* fib = 0;
     int clear_routing_table = 0;
 
     /* -- REQUIRES -- */
@@ -52,12 +67,18 @@ int sr_load_rt(struct sr_instance* sr,const char* filename)
 
     while( fgets(line,BUFSIZ,fp) != 0)
     {
-        sscanf(line,"%s %s %s %s",dest,gw,mask,iface);
+        /* -- dest gw mask iface [weight]; skip blank lines -- */
+        weight = SR_RT_DEFAULT_WEIGHT;
+        fields = sscanf(line,"%31s %31s %31s %31s %u",dest,gw,mask,iface,&weight);
+        if(fields < 4 || strchr(dest,':'))
+        { continue; } /* -- IPv6 routes are for sr_rt6_load -- */
         if(inet_aton(dest,&dest_addr) == 0)
         { 
             fprintf(stderr,
                     "Error loading routing table, cannot convert %s to valid IP\n",
                     dest);
+            sr_fib_destroy(fib);
+            fclose(fp);
             return -1; 
         }
         if(inet_aton(gw,&gw_addr) == 0)
@@ -65,6 +86,8 @@ int sr_load_rt(struct sr_instance* sr,const char* filename)
             fprintf(stderr,
                     "Error loading routing table, cannot convert %s to valid IP\n",
                     gw);
+            sr_fib_destroy(fib);
+            fclose(fp);
             return -1; 
         }
         if(inet_aton(mask,&mask_addr) == 0)
@@ -72,15 +95,38 @@ int sr_load_rt(struct sr_instance* sr,const char* filename)
             fprintf(stderr,
                     "Error loading routing table, cannot convert %s to valid IP\n",
                     mask);
+            sr_fib_destroy(fib);
+            fclose(fp);
             return -1; 
         }
         if( clear_routing_table == 0 ){
             printf("Loading routing table from server, clear local routing table.\n");
-            sr->routing_table = 0;
             clear_routing_table = 1;
         }
-        sr_add_rt_entry(sr,dest_addr,gw_addr,mask_addr,iface);
+        if(fib == 0 && (fib = sr_fib_create()) == 0)
+        {
+            fprintf(stderr, "Error loading routing table, out of memory\n");
+            fclose(fp);
+            return -1;
+        }
+        if(sr_rt_insert_entry(fib,dest_addr,gw_addr,mask_addr,iface,weight) ==
+           SR_FIB_NOMEM)
+        {
+            fprintf(stderr, "Error loading routing table, out of memory\n");
+            sr_fib_destroy(fib);
+            fclose(fp);
+            return -1;
+        }
     } /* -- while -- */
+    fclose(fp);
+
+    /* -- built aside, so forwarding sees the old table or the new one -- */
+    if(fib)
+    {
+        sr_rt_set_fib(sr, fib, 0);
+        if(sr->rt_compress)
+        { sr_rt_compress(sr, stdout); }
+    }
 
     return 0; /* -- success -- */
 } /* -- sr_load_rt -- */
@@ -88,48 +134,811 @@ int sr_load_rt(struct sr_instance* sr,const char* filename)
 /*---------------------------------------------------------------------
  * Method:
  *
+ * Append a route.  A route for a destination and mask already in the
+ * table joins that entry's multipath group; a duplicate of a route in
+ * the group, or a destination with bits outside the mask (which could
+ * never match), is reported and skipped.
+ *
  *---------------------------------------------------------------------*/
 
 void sr_add_rt_entry(struct sr_instance* sr, struct in_addr dest,
-struct in_addr gw, struct in_addr mask,char* if_name)
+struct in_addr gw, struct in_addr mask,char* if_name, unsigned int weight)
 {
-    struct sr_rt* rt_walker = 0;
+    /* -- REQUIRES -- */
+    assert(if_name);
+    assert(sr);
+
+    sr_rt_add(sr,dest,gw,mask,if_name,weight);
+} /* -- sr_add_entry -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_rt_insert_entry(..)
+ * Scope:  Local
+ *
+ * Allocate a route and insert it into fib, warning about routes that
+ * are skipped.  Returns the SR_FIB_* result.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_rt_insert_entry(struct sr_fib* fib, struct in_addr dest,
+        struct in_addr gw, struct in_addr mask, const char* if_name,
+        unsigned int weight)
+{
+    struct sr_rt* entry;
+    char dst_str[INET_ADDRSTRLEN], mask_str[INET_ADDRSTRLEN];
+    int err;
+
+    if((entry = (struct sr_rt*)calloc(1, sizeof(struct sr_rt))) == 0)
+    { return SR_FIB_NOMEM; }
+    entry->dest = dest;
+    entry->gw   = gw;
+    entry->mask = mask;
+    strncpy(entry->interface,if_name,sr_IFACE_NAMELEN - 1);
+    entry->weight = weight;
+
+    if((err = sr_fib_insert(fib, entry)) != SR_FIB_OK)
+    {
+        inet_ntop(AF_INET, &dest, dst_str, sizeof(dst_str));
+        inet_ntop(AF_INET, &mask, mask_str, sizeof(mask_str));
+        fprintf(stderr, "Skipping route %s %s %s: %s\n", dst_str, mask_str,
+                if_name, sr_fib_strerror(err));
+        free(entry);
+    }
+    return err;
+} /* -- sr_rt_insert_entry -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_rt_set_fib(..)
+ * Scope:  Local
+ *
+ * Make fib the instance's table (shared says whether it came from
+ * sr_rt_shared_acquire) and drop the old one.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_rt_set_fib(struct sr_instance* sr, struct sr_fib* fib, int shared)
+{
+    struct sr_fib* old;
+    int old_shared;
+
+    SR_RT_WRLOCK(sr);
+    old = sr->fib;
+    old_shared = sr->rt_shared;
+    sr->fib = fib;
+    sr->rt_shared = shared;
+    sr->routing_table = fib ? fib->head : 0;
+    sr_rt_stale(sr);
+    SR_RT_UNLOCK(sr);
+
+    if(old_shared)
+    { sr_rt_shared_release(old); }
+    else
+    { sr_fib_destroy(old); }
+} /* -- sr_rt_set_fib -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_rt_stale(..)
+ * Scope:  Local
+ *
+ * Drop the compressed table after a change to fib; lookups go to fib
+ * until sr_rt_compress runs again.  Called with rt_lock held for
+ * writing.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_rt_stale(struct sr_instance* sr)
+{
+    if(sr->fwd_fib)
+    {
+        sr_fib_destroy(sr->fwd_fib);
+        sr->fwd_fib = 0;
+    }
+} /* -- sr_rt_stale -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_rt_writable(..)
+ * Scope:  Local
+ *
+ * The instance's table, ready for an update: created if there is none
+ * yet, copied if it is shared.  Called with rt_lock held for writing,
+ * so the one-off copy of a shared table stalls forwarding while it
+ * runs.  Returns NULL if out of memory.
+ *
+ *---------------------------------------------------------------------*/
+
+static struct sr_fib* sr_rt_writable(struct sr_instance* sr)
+{
+    struct sr_fib* fib;
+
+    if(sr->fib == 0)
+    { return (sr->fib = sr_fib_create()); }
+    if(!sr->rt_shared)
+    { return sr->fib; }
+
+    if((fib = sr_fib_copy(sr->fib)) == 0)
+    { return 0; }
+    sr_rt_shared_release(sr->fib);
+    sr->fib = fib;
+    sr->rt_shared = 0;
+    return fib;
+} /* -- sr_rt_writable -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_rt_add(..)
+ * Scope:  Global
+ *
+ * Add a route, joining the multipath group of its prefix if it has one.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_rt_add(struct sr_instance* sr, struct in_addr dest, struct in_addr gw,
+              struct in_addr mask, const char* if_name, unsigned int weight)
+{
+    struct sr_fib* fib;
+    int err = SR_FIB_NOMEM;
 
     /* -- REQUIRES -- */
+    assert(sr);
     assert(if_name);
+
+    SR_RT_WRLOCK(sr);
+    if((fib = sr_rt_writable(sr)) != 0)
+    {
+        err = sr_rt_insert_entry(fib, dest, gw, mask, if_name, weight);
+        sr->routing_table = fib->head;
+        if(err == SR_FIB_OK)
+        { sr_rt_stale(sr); }
+    }
+    SR_RT_UNLOCK(sr);
+
+    return err;
+} /* -- sr_rt_add -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_rt_del(..)
+ * Scope:  Global
+ *
+ * Remove the routes for dest/mask: all of them if gw is NULL, else the
+ * one through gw and if_name.  Returns how many were removed, or
+ * SR_FIB_NOMEM.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_rt_del(struct sr_instance* sr, struct in_addr dest, struct in_addr mask,
+              const struct in_addr* gw, const char* if_name)
+{
+    struct sr_fib* fib;
+    struct sr_rt* rt;
+    struct sr_rt* next;
+    int n = 0;
+
+    /* -- REQUIRES -- */
     assert(sr);
+    assert(!gw || if_name);
 
-    /* -- empty list special case -- */
-    if(sr->routing_table == 0)
+    SR_RT_WRLOCK(sr);
+    if(sr->fib == 0 || sr_fib_find(sr->fib, dest.s_addr, mask.s_addr) == 0)
+    {
+        SR_RT_UNLOCK(sr);
+        return 0;
+    }
+    if((fib = sr_rt_writable(sr)) == 0)
+    {
+        SR_RT_UNLOCK(sr);
+        return SR_FIB_NOMEM;
+    }
+
+    for(rt = sr_fib_find(fib, dest.s_addr, mask.s_addr); rt; rt = next)
+    {
+        next = rt->ecmp_next;
+        if(gw && (rt->gw.s_addr != gw->s_addr ||
+                  strncmp(rt->interface, if_name, sr_IFACE_NAMELEN) != 0))
+        { continue; }
+        sr_fib_remove(fib, rt);
+        n++;
+    }
+    sr->routing_table = fib->head;
+    if(n > 0)
+    { sr_rt_stale(sr); }
+    SR_RT_UNLOCK(sr);
+
+    return n;
+} /* -- sr_rt_del -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_rt_replace(..)
+ * Scope:  Global
+ *
+ * Make the given route the only one for its prefix.  Forwarding never
+ * sees the prefix without a route.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_rt_replace(struct sr_instance* sr, struct in_addr dest, struct in_addr gw,
+                  struct in_addr mask, const char* if_name, unsigned int weight)
+{
+    struct sr_fib* fib;
+    struct sr_rt* rt;
+    struct sr_rt* next;
+    int err = SR_FIB_NOMEM;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+    assert(if_name);
+
+    /* -- a bad prefix must not cost the old routes -- */
+    if(sr_fib_prefix_len(mask.s_addr) < 0 || (dest.s_addr & ~mask.s_addr) != 0)
+    { return SR_FIB_BADPREFIX; }
+
+    SR_RT_WRLOCK(sr);
+    if((fib = sr_rt_writable(sr)) != 0)
     {
-        sr->routing_table = (struct sr_rt*)malloc(sizeof(struct sr_rt));
-        assert(sr->routing_table);
-        sr->routing_table->next = 0;
-        sr->routing_table->dest = dest;
-        sr->routing_table->gw   = gw;
-        sr->routing_table->mask = mask;
-        strncpy(sr->routing_table->interface,if_name,sr_IFACE_NAMELEN);
+        for(rt = sr_fib_find(fib, dest.s_addr, mask.s_addr); rt; rt = next)
+        {
+            next = rt->ecmp_next;
+            sr_fib_remove(fib, rt);
+        }
+        err = sr_rt_insert_entry(fib, dest, gw, mask, if_name, weight);
+        sr->routing_table = fib->head;
+        sr_rt_stale(sr);
+    }
+    SR_RT_UNLOCK(sr);
+
+    return err;
+} /* -- sr_rt_replace -- */
+
+/*---------------------------------------------------------------------
+ * Loading MRT table dumps
+ *
+ * A full table takes the better part of a second to copy and import,
+ * too long to hold up an event loop that also forwards.  The work runs
+ * on a thread of its own, against a copy of the table it started from;
+ * the thread that updates routes polls the job's eventfd and, once it
+ * is readable, swaps the result in with sr_rt_load_finish.  While a job
+ * runs the table it copies must not change, so route updates are
+ * refused until it is finished (see sr_ctl.c).  The old table is freed
+ * on yet another thread, it takes a while too.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_rt_load
+{
+    struct sr_instance* sr;
+    char mrt_path[256];
+    char map_path[256];
+    int compress;           /* also build the ORTC copy */
+    struct sr_fib* base;    /* sr->fib at the start, NULL for none */
+    struct sr_fib* fib;     /* base plus the dump, NULL on error */
+    struct sr_fib* small;   /* its ORTC copy, NULL for none */
+    struct sr_fib* old;     /* replaced by fib, freed with the job */
+    int old_shared;
+    struct sr_fib* old_small;
+    FILE* out;              /* the worker's messages */
+    char* msg;
+    size_t msg_len;
+    int efd;                /* readable once the worker is done */
+    pthread_t thread;
+};
+
+/* -- the messages sr_rt_compress prints on success -- */
+static void sr_rt_print_ortc(const struct sr_ortc_stats* st, FILE* out)
+{
+    fprintf(out, "compressed %u prefixes (%u routes) to %u (%u routes) "
+            "in %.3f s, %u next hop groups\n", st->prefixes_in, st->routes_in,
+            st->prefixes_out, st->routes_out, st->seconds, st->labels);
+} /* -- sr_rt_print_ortc -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_rt_load_thread(..)
+ * Scope:  Local
+ *
+ * The worker: copy the base table, import the dump into the copy and,
+ * if asked, compress the result.
+ *
+ *---------------------------------------------------------------------*/
+
+static void* sr_rt_load_thread(void* arg)
+{
+    struct sr_rt_load* job = arg;
+    struct sr_mrt_map map;
+    struct sr_mrt_stats st;
+    struct sr_ortc_stats ost;
+    struct sr_fib* fib;
+    uint64_t one = 1;
 
-        return;
+    if(sr_mrt_map_load(job->map_path, &map, job->out) == 0)
+    {
+        fib = job->base ? sr_fib_copy(job->base) : sr_fib_create();
+        memset(&st, 0, sizeof(st));
+        if(fib == 0)
+        { fprintf(job->out, "%s: out of memory\n", job->mrt_path); }
+        else if(sr_mrt_import(fib, job->mrt_path, &map, &st, job->out) != 0)
+        { sr_fib_destroy(fib); }
+        else
+        {
+            sr_mrt_print_stats(&st, job->out);
+            job->fib = fib;
+        }
+        sr_mrt_map_free(&map);
     }
 
-    /* -- find the end of the list -- */
-    rt_walker = sr->routing_table;
-    while(rt_walker->next){
-      rt_walker = rt_walker->next; 
+    if(job->fib && job->compress)
+    {
+        if((job->small = sr_ortc_compress(job->fib, &ost)) != 0)
+        { sr_rt_print_ortc(&ost, job->out); }
+        else
+        {
+            fprintf(job->out, "cannot compress: out of memory or more than "
+                    "%d next hop groups\n", SR_ORTC_MAX_LABELS);
+        }
     }
 
-    rt_walker->next = (struct sr_rt*)malloc(sizeof(struct sr_rt));
-    assert(rt_walker->next);
-    rt_walker = rt_walker->next;
+    fclose(job->out);
+    job->out = 0;
+    if(write(job->efd, &one, sizeof(one)) < 0)
+    { /* -- a full counter is readable anyway -- */ }
+    return NULL;
+} /* -- sr_rt_load_thread -- */
 
-    rt_walker->next = 0;
-    rt_walker->dest = dest;
-    rt_walker->gw   = gw;
-    rt_walker->mask = mask;
-    strncpy(rt_walker->interface,if_name,sr_IFACE_NAMELEN);
+/* -- free what a finished job replaced, off the router's threads -- */
+static void* sr_rt_load_free(void* arg)
+{
+    struct sr_rt_load* job = arg;
 
-} /* -- sr_add_entry -- */
+    if(job->old_shared)
+    { sr_rt_shared_release(job->old); }
+    else
+    { sr_fib_destroy(job->old); }
+    sr_fib_destroy(job->old_small);
+    sr_fib_destroy(job->small);
+    sr_fib_destroy(job->fib);
+    free(job->msg);
+    free(job);
+    return NULL;
+} /* -- sr_rt_load_free -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_rt_load_start(..)
+ * Scope:  Global
+ *
+ * Start adding the routes of an MRT table dump, next hops mapped to
+ * gateways and interfaces by map_path (see sr_mrt.h).  Called on the
+ * thread that updates routes, which then polls sr_rt_load_fd and calls
+ * sr_rt_load_finish; until then sr->rt_load is the job.  Returns NULL,
+ * with the reason written to out, if the job could not be started or
+ * another is still running.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_rt_load* sr_rt_load_start(struct sr_instance* sr, const char* mrt_path,
+                                    const char* map_path, FILE* out)
+{
+    struct sr_rt_load* job;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+    assert(mrt_path);
+    assert(map_path);
+    assert(out);
+
+    if(sr->rt_load)
+    {
+        fprintf(out, "a route load is running already\n");
+        return 0;
+    }
+    if((job = (struct sr_rt_load*)calloc(1, sizeof(*job))) == 0)
+    {
+        fprintf(out, "%s: out of memory\n", mrt_path);
+        return 0;
+    }
+    job->sr = sr;
+    strncpy(job->mrt_path, mrt_path, sizeof(job->mrt_path) - 1);
+    strncpy(job->map_path, map_path, sizeof(job->map_path) - 1);
+    job->compress = sr->rt_compress;
+    job->base = sr->fib;
+
+    if((job->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0)
+    {
+        fprintf(out, "%s: eventfd: %s\n", mrt_path, strerror(errno));
+        free(job);
+        return 0;
+    }
+    if((job->out = open_memstream(&job->msg, &job->msg_len)) == 0)
+    {
+        fprintf(out, "%s: out of memory\n", mrt_path);
+        close(job->efd);
+        free(job);
+        return 0;
+    }
+    if(pthread_create(&job->thread, 0, sr_rt_load_thread, job) != 0)
+    {
+        fprintf(out, "%s: cannot start the loader thread\n", mrt_path);
+        fclose(job->out);
+        close(job->efd);
+        free(job->msg);
+        free(job);
+        return 0;
+    }
+
+    sr->rt_load = job;
+    return job;
+} /* -- sr_rt_load_start -- */
+
+/* -- readable once the job is ready for sr_rt_load_finish -- */
+int sr_rt_load_fd(const struct sr_rt_load* job)
+{
+    return job->efd;
+} /* -- sr_rt_load_fd -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_rt_load_finish(..)
+ * Scope:  Global
+ *
+ * Wait for the job if it is still running, write its messages to out
+ * (unless NULL) and swap its table in.  Frees the job.  Returns 0 on
+ * success, -1 if the routes were left unchanged.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_rt_load_finish(struct sr_instance* sr, struct sr_rt_load* job, FILE* out)
+{
+    pthread_attr_t attr;
+    pthread_t thread;
+    int ret = -1;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+    assert(job);
+    assert(sr->rt_load == job);
+
+    pthread_join(job->thread, 0);
+    close(job->efd);
+    sr->rt_load = 0;
+    if(out && job->msg_len > 0)
+    { fwrite(job->msg, 1, job->msg_len, out); }
+
+    if(job->fib)
+    {
+        /* -- compression may have been turned off meanwhile -- */
+        SR_RT_WRLOCK(sr);
+        job->old = sr->fib;
+        job->old_shared = sr->rt_shared;
+        job->old_small = sr->fwd_fib;
+        sr->fib = job->fib;
+        sr->rt_shared = 0;
+        sr->routing_table = job->fib->head;
+        sr->fwd_fib = sr->rt_compress ? job->small : 0;
+        SR_RT_UNLOCK(sr);
+        job->fib = 0;
+        if(sr->fwd_fib)
+        { job->small = 0; }
+        ret = 0;
+    }
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if(pthread_create(&thread, &attr, sr_rt_load_free, job) != 0)
+    { sr_rt_load_free(job); }
+    pthread_attr_destroy(&attr);
+    return ret;
+} /* -- sr_rt_load_finish -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_rt_load_mrt(..)
+ * Scope:  Global
+ *
+ * Load an MRT table dump and wait for it, see sr_rt_load_start.
+ * Returns 0 on success, leaving the table unchanged on error.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_rt_load_mrt(struct sr_instance* sr, const char* mrt_path,
+                   const char* map_path, FILE* out)
+{
+    struct sr_rt_load* job;
+
+    if((job = sr_rt_load_start(sr, mrt_path, map_path, out)) == 0)
+    { return -1; }
+    return sr_rt_load_finish(sr, job, out);
+} /* -- sr_rt_load_mrt -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_rt_compress(..)
+ * Scope:  Global
+ *
+ * Build the ORTC compressed copy of the table (sr_ortc.h) and forward
+ * with it.  The table itself stays as it is for updates and listing;
+ * any update drops the copy again.  Returns 0 on success, -1 if the
+ * table could not be compressed or changed meanwhile.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_rt_compress(struct sr_instance* sr, FILE* out)
+{
+    struct sr_ortc_stats st;
+    struct sr_fib* fib;
+    struct sr_fib* small = 0;
+    uint64_t updates = 0;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+    assert(out);
+
+    SR_RT_RDLOCK(sr);
+    if((fib = sr->fib) != 0)
+    {
+        updates = fib->updates;
+        small = sr_ortc_compress(fib, &st);
+    }
+    SR_RT_UNLOCK(sr);
+    if(fib == 0)
+    {
+        fprintf(out, "no routing table to compress\n");
+        return -1;
+    }
+    if(small == 0)
+    {
+        fprintf(out, "cannot compress: out of memory or more than %d "
+                "next hop groups\n", SR_ORTC_MAX_LABELS);
+        return -1;
+    }
+
+    SR_RT_WRLOCK(sr);
+    if(sr->fib != fib || fib->updates != updates)
+    {
+        SR_RT_UNLOCK(sr);
+        sr_fib_destroy(small);
+        fprintf(out, "routing table changed while compressing\n");
+        return -1;
+    }
+    sr_rt_stale(sr);
+    sr->fwd_fib = small;
+    SR_RT_UNLOCK(sr);
+
+    sr_rt_print_ortc(&st, out);
+    return 0;
+} /* -- sr_rt_compress -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_rt_uncompress(..)
+ * Scope:  Global
+ *
+ * Forward with the full table again.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_rt_uncompress(struct sr_instance* sr)
+{
+    /* -- REQUIRES -- */
+    assert(sr);
+
+    SR_RT_WRLOCK(sr);
+    sr_rt_stale(sr);
+    SR_RT_UNLOCK(sr);
+} /* -- sr_rt_uncompress -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_rt_ecmp_select(..)
+ * Scope:  Global
+ *
+ * The member of leader's group a flow with the given hash goes to.
+ * Each member gets a share of the hash space proportional to its
+ * weight, so a flow stays on its member while the group is unchanged.
+ * If every weight is 0 the leader is used.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_rt* sr_rt_ecmp_select(struct sr_rt* leader, uint32_t hash)
+{
+    struct sr_rt* member;
+    uint32_t x;
+
+    /* -- REQUIRES -- */
+    assert(leader);
+
+    if(leader->ecmp_next == 0 || leader->ecmp_weight == 0)
+    { return leader; }
+
+    /* -- scale the hash onto [0, total weight) without a division -- */
+    x = (uint32_t)(((uint64_t)hash * leader->ecmp_weight) >> 32);
+    for(member = leader; member->ecmp_next; member = member->ecmp_next)
+    {
+        if(x < member->weight)
+        { break; }
+        x -= member->weight;
+    }
+    return member;
+} /* -- sr_rt_ecmp_select -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_rt6_insert_entry(..)
+ * Scope:  Local
+ *
+ * As sr_rt_insert_entry, for an IPv6 route.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_rt6_insert_entry(struct sr_fib6* fib, const uint8_t* dest,
+        int len, const uint8_t* gw, const char* if_name)
+{
+    struct sr_rt6* entry;
+    char dst_str[INET6_ADDRSTRLEN];
+    int err;
+
+    if((entry = (struct sr_rt6*)calloc(1, sizeof(struct sr_rt6))) == 0)
+    { return SR_FIB_NOMEM; }
+    memcpy(entry->dest, dest, 16);
+    memcpy(entry->gw, gw, 16);
+    entry->len = len;
+    strncpy(entry->interface,if_name,sr_IFACE_NAMELEN - 1);
+
+    if((err = sr_fib6_insert(fib, entry)) != SR_FIB_OK)
+    {
+        inet_ntop(AF_INET6, dest, dst_str, sizeof(dst_str));
+        fprintf(stderr, "Skipping route %s/%d %s: %s\n", dst_str, len,
+                if_name, sr_fib_strerror(err));
+        free(entry);
+    }
+    return err;
+} /* -- sr_rt6_insert_entry -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_rt6_load(..)
+ * Scope:  Global
+ *
+ * Load the IPv6 routes of an rtable file, lines of the form
+ *
+ *   2001:db8:2::/48   fe80::1   eth2
+ *
+ * with gateway :: for a connected prefix, and swap them in for the
+ * instance's IPv6 table if there are any.  Returns 0 on success.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_rt6_load(struct sr_instance* sr, const char* filename)
+{
+    FILE* fp;
+    char  line[BUFSIZ];
+    char  dest[64];
+    char  gw[64];
+    char  iface[32];
+    uint8_t dest_addr[16];
+    uint8_t gw_addr[16];
+    int len;
+    struct sr_fib6* fib = 0;
+    struct sr_fib6* old;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+    assert(filename);
+
+    if((fp = fopen(filename,"r")) == 0)
+    {
+        perror("fopen");
+        return -1;
+    }
+
+    while( fgets(line,BUFSIZ,fp) != 0)
+    {
+        if(sscanf(line,"%63s %63s %31s",dest,gw,iface) < 3 ||
+           strchr(dest,':') == 0)
+        { continue; }
+        if(sr_fib6_parse(dest, dest_addr, &len) != 0 ||
+           inet_pton(AF_INET6, gw, gw_addr) != 1)
+        {
+            fprintf(stderr,
+                    "Error loading routing table, cannot convert %s %s to a "
+                    "valid IPv6 route\n", dest, gw);
+            sr_fib6_destroy(fib);
+            fclose(fp);
+            return -1;
+        }
+        if((fib == 0 && (fib = sr_fib6_create()) == 0) ||
+           sr_rt6_insert_entry(fib,dest_addr,len,gw_addr,iface) == SR_FIB_NOMEM)
+        {
+            fprintf(stderr, "Error loading routing table, out of memory\n");
+            sr_fib6_destroy(fib);
+            fclose(fp);
+            return -1;
+        }
+    } /* -- while -- */
+    fclose(fp);
+
+    if(fib)
+    {
+        SR_RT_WRLOCK(sr);
+        old = sr->fib6;
+        sr->fib6 = fib;
+        SR_RT_UNLOCK(sr);
+        sr_fib6_destroy(old);
+    }
+
+    return 0;
+} /* -- sr_rt6_load -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_rt6_add(..)
+ * Scope:  Global
+ *
+ * Add an IPv6 route.  There is one route per prefix.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_rt6_add(struct sr_instance* sr, const uint8_t* dest, int len,
+               const uint8_t* gw, const char* if_name)
+{
+    int err = SR_FIB_NOMEM;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+    assert(if_name);
+
+    SR_RT_WRLOCK(sr);
+    if(sr->fib6 != 0 || (sr->fib6 = sr_fib6_create()) != 0)
+    { err = sr_rt6_insert_entry(sr->fib6, dest, len, gw, if_name); }
+    SR_RT_UNLOCK(sr);
+
+    return err;
+} /* -- sr_rt6_add -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_rt6_del(..)
+ * Scope:  Global
+ *
+ * Remove the IPv6 route for dest/len.  Returns how many were removed.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_rt6_del(struct sr_instance* sr, const uint8_t* dest, int len)
+{
+    struct sr_rt6* rt = 0;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+
+    SR_RT_WRLOCK(sr);
+    if(sr->fib6 && (rt = sr_fib6_find(sr->fib6, dest, len)) != 0)
+    { sr_fib6_remove(sr->fib6, rt); }
+    SR_RT_UNLOCK(sr);
+
+    return rt != 0;
+} /* -- sr_rt6_del -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_rt_save(..)
+ * Scope:  Global
+ *
+ * Write the IPv4 and IPv6 routes to out in rtable format, in the order
+ * they were added, so that sr_load_rt and sr_rt6_load rebuild the same
+ * tables and multipath groups.  Returns 0, or -1 on a write error.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_rt_save(struct sr_instance* sr, FILE* out)
+{
+    struct sr_rt* rt;
+    struct sr_rt6* rt6;
+    char dest[INET6_ADDRSTRLEN], gw[INET6_ADDRSTRLEN], mask[INET_ADDRSTRLEN];
+
+    SR_RT_RDLOCK(sr);
+    for(rt = sr->routing_table; rt; rt = rt->next)
+    {
+        inet_ntop(AF_INET, &rt->dest, dest, sizeof(dest));
+        inet_ntop(AF_INET, &rt->gw, gw, sizeof(gw));
+        inet_ntop(AF_INET, &rt->mask, mask, sizeof(mask));
+        fprintf(out, "%s %s %s %s %u\n", dest, gw, mask, rt->interface,
+                rt->weight);
+    }
+    for(rt6 = sr->fib6 ? sr->fib6->head : 0; rt6; rt6 = rt6->next)
+    {
+        inet_ntop(AF_INET6, rt6->dest, dest, sizeof(dest));
+        inet_ntop(AF_INET6, rt6->gw, gw, sizeof(gw));
+        fprintf(out, "%s/%d %s %s\n", dest, rt6->len, gw, rt6->interface);
+    }
+    SR_RT_UNLOCK(sr);
+
+    return ferror(out) ? -1 : 0;
+} /* -- sr_rt_save -- */
 
 /*---------------------------------------------------------------------
  * Method:
@@ -139,22 +948,27 @@ struct in_addr gw, struct in_addr mask,char* if_name)
 void sr_print_routing_table(struct sr_instance* sr)
 {
     struct sr_rt* rt_walker = 0;
+    struct sr_rt6* rt6;
+    char dst_str[INET6_ADDRSTRLEN], gw_str[INET6_ADDRSTRLEN];
 
     if(sr->routing_table == 0)
     {
         printf(" *warning* Routing table empty \n");
-        return;
     }
+    else
+    {
+        printf("Destination\tGateway\t\tMask\tIface\tWeight\n");
 
-    printf("Destination\tGateway\t\tMask\tIface\n");
+        for(rt_walker = sr->routing_table; rt_walker; rt_walker = rt_walker->next)
+        { sr_print_routing_entry(rt_walker); }
+    }
 
-    rt_walker = sr->routing_table;
-    
-    sr_print_routing_entry(rt_walker);
-    while(rt_walker->next)
+    for(rt6 = sr->fib6 ? sr->fib6->head : 0; rt6; rt6 = rt6->next)
     {
-        rt_walker = rt_walker->next; 
-        sr_print_routing_entry(rt_walker);
+        printf("%s/%d\t%s\t%s\n",
+               inet_ntop(AF_INET6, rt6->dest, dst_str, sizeof(dst_str)),
+               rt6->len, inet_ntop(AF_INET6, rt6->gw, gw_str, sizeof(gw_str)),
+               rt6->interface);
     }
 
 } /* -- sr_print_routing_table -- */
@@ -173,6 +987,128 @@ void sr_print_routing_entry(struct sr_rt* entry)
     printf("%s\t\t",inet_ntoa(entry->dest));
     printf("%s\t",inet_ntoa(entry->gw));
     printf("%s\t",inet_ntoa(entry->mask));
-    printf("%s\n",entry->interface);
+    printf("%s\t",entry->interface);
+    printf("%u\n",entry->weight);
 
 } /* -- sr_print_routing_entry -- */
+
+/*---------------------------------------------------------------------
+ * Shared routing tables
+ *
+ * Router instances in one process that load the same rtable file share
+ * a single, read-only copy of the table.  Tables are keyed by file name
+ * and freed when the last instance releases them.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_rt_shared
+{
+    char filename[256];
+    struct sr_fib* fib;
+    int refcnt;
+    struct sr_rt_shared* next;
+};
+
+static struct sr_rt_shared* sr_rt_shared_list = 0;
+static pthread_mutex_t sr_rt_shared_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*---------------------------------------------------------------------
+ * Method: sr_free_rt_list(..)
+ * Scope:  Global
+ *---------------------------------------------------------------------*/
+
+void sr_free_rt_list(struct sr_rt* head)
+{
+    struct sr_rt* next;
+
+    for (; head; head = next)
+    {
+        next = head->next;
+        free(head);
+    }
+} /* -- sr_free_rt_list -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_rt_shared_acquire(..)
+ * Scope:  Global
+ *
+ * Return the routing table loaded from filename, loading it on first
+ * use.  The table must not be modified by the caller.  Returns 0 if the
+ * file cannot be loaded.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_fib* sr_rt_shared_acquire(const char* filename)
+{
+    struct sr_rt_shared* ent;
+    struct sr_instance scratch;
+    struct sr_fib* fib = 0;
+
+    /* -- REQUIRES -- */
+    assert(filename);
+
+    pthread_mutex_lock(&sr_rt_shared_lock);
+
+    for (ent = sr_rt_shared_list; ent; ent = ent->next)
+    {
+        if (strcmp(ent->filename, filename) == 0)
+        { break; }
+    }
+
+    if (ent == 0)
+    {
+        memset(&scratch, 0, sizeof(scratch));
+        if (sr_load_rt(&scratch, filename) != 0 ||
+            (ent = (struct sr_rt_shared*)malloc(sizeof(*ent))) == 0)
+        {
+            sr_fib_destroy(scratch.fib);
+            pthread_mutex_unlock(&sr_rt_shared_lock);
+            return 0;
+        }
+        strncpy(ent->filename, filename, sizeof(ent->filename) - 1);
+        ent->filename[sizeof(ent->filename) - 1] = '\0';
+        ent->fib = scratch.fib;
+        ent->refcnt = 0;
+        ent->next = sr_rt_shared_list;
+        sr_rt_shared_list = ent;
+    }
+
+    ent->refcnt++;
+    fib = ent->fib;
+
+    pthread_mutex_unlock(&sr_rt_shared_lock);
+
+    return fib;
+} /* -- sr_rt_shared_acquire -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_rt_shared_release(..)
+ * Scope:  Global
+ *
+ * Drop a reference taken by sr_rt_shared_acquire.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_rt_shared_release(struct sr_fib* fib)
+{
+    struct sr_rt_shared** pp;
+    struct sr_rt_shared* ent;
+
+    pthread_mutex_lock(&sr_rt_shared_lock);
+
+    for (pp = &sr_rt_shared_list; (ent = *pp) != 0; pp = &ent->next)
+    {
+        if (ent->fib != fib)
+        { continue; }
+
+        if (--ent->refcnt == 0)
+        {
+            *pp = ent->next;
+            sr_fib_destroy(ent->fib);
+            free(ent);
+        }
+        break;
+    }
+
+    pthread_mutex_unlock(&sr_rt_shared_lock);
+} /* -- sr_rt_shared_release -- */
@@ -16,15 +16,32 @@
 #include <sys/types.h>
 #endif
 
+#include <stdio.h>
 #include <netinet/in.h>
 
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
 #include "sr_if.h"
+#include "sr_fib.h"
+
+#define SR_RT_DEFAULT_WEIGHT 1
 
 /* ----------------------------------------------------------------------------
  * struct sr_rt
  *
  * Node in the routing table 
  *
+ * Entries with the same destination and mask form an equal cost multipath
+ * group: the first of them in the table leads it, ecmp_next chains the
+ * members in table order, and the leader's ecmp_weight is the sum of the
+ * members' weights.  The longest prefix match finds the leader and
+ * sr_rt_ecmp_select picks the member for a flow.
+ *
+ * The entries are indexed by the trie of sr_fib.h; next/prev keep them
+ * in the order they were added.
+ *
  * -------------------------------------------------------------------------- */
 
 struct sr_rt
@@ -34,14 +51,52 @@ struct sr_rt
     struct in_addr mask;
     char   interface[sr_IFACE_NAMELEN];
     struct sr_rt* next;
+    struct sr_rt* prev;
+    unsigned int weight;       /* share of its group's flows, 0 for none */
+    struct sr_rt* ecmp_next;   /* next member of the group */
+    unsigned int ecmp_weight;  /* on the leader: total weight of the group */
+    uint64_t tx_packets;       /* forwarded through this entry, added to
+                                  atomically by every forwarding thread */
+    uint64_t tx_bytes;
 };
 
 
 int sr_load_rt(struct sr_instance*,const char*);
 void sr_add_rt_entry(struct sr_instance*, struct in_addr,struct in_addr,
-                  struct in_addr, char*);
+                  struct in_addr, char*, unsigned int);
+
+/* -- runtime updates, serialized against forwarding by sr->rt_lock;
+ *    results are SR_FIB_* codes, sr_rt_del returns routes removed -- */
+int sr_rt_add(struct sr_instance*, struct in_addr, struct in_addr,
+              struct in_addr, const char*, unsigned int);
+int sr_rt_del(struct sr_instance*, struct in_addr, struct in_addr,
+              const struct in_addr*, const char*);
+int sr_rt_replace(struct sr_instance*, struct in_addr, struct in_addr,
+                  struct in_addr, const char*, unsigned int);
+int sr_rt_load_mrt(struct sr_instance*, const char*, const char*, FILE*);
+/* -- ... the same on a worker thread; updates wait for sr_rt_load_finish -- */
+struct sr_rt_load;
+struct sr_rt_load* sr_rt_load_start(struct sr_instance*, const char*,
+                                    const char*, FILE*);
+int sr_rt_load_fd(const struct sr_rt_load*);
+int sr_rt_load_finish(struct sr_instance*, struct sr_rt_load*, FILE*);
+int sr_rt_compress(struct sr_instance*, FILE*);
+void sr_rt_uncompress(struct sr_instance*);
+/* -- IPv6 routes, in sr->fib6 under the same lock -- */
+int sr_rt6_load(struct sr_instance*, const char*);
+int sr_rt6_add(struct sr_instance*, const uint8_t*, int, const uint8_t*,
+               const char*);
+int sr_rt6_del(struct sr_instance*, const uint8_t*, int);
+struct sr_rt* sr_rt_ecmp_select(struct sr_rt* leader, uint32_t hash);
+int sr_rt_save(struct sr_instance* sr, FILE* out);
 void sr_print_routing_table(struct sr_instance* sr);
 void sr_print_routing_entry(struct sr_rt* entry);
+void sr_free_rt_list(struct sr_rt* head);
+
+/* -- read-only tables shared between instances, keyed by file name;
+ *    an instance updating its routes first takes a private copy -- */
+struct sr_fib* sr_rt_shared_acquire(const char* filename);
+void sr_rt_shared_release(struct sr_fib* fib);
 
 
 #endif  /* --  sr_RT_H -- */
@@ -0,0 +1,327 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_sflow.c
+ *
+ * Description:
+ *
+ * Packet sampling and the export writer, see sr_sflow.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+
+#include "sr_router.h"
+#include "sr_if.h"
+#include "sr_rt.h"
+#include "sr_protocol.h"
+#include "sr_sflow.h"
+#include "sr_common.h"
+
+/* -- xorshift64; races between receive queues only stir it more -- */
+static uint32_t sr_sflow_rand(struct sr_sflow* sf)
+{
+    uint64_t x = sf->rng;
+
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    sf->rng = x;
+    return (uint32_t)(x >> 32);
+} /* -- sr_sflow_rand -- */
+
+/* -- frames to the next sample, uniform in 1 .. 2 rate - 1 -- */
+static uint32_t sr_sflow_skip(struct sr_sflow* sf, uint32_t rate)
+{
+    if (rate <= 1)
+    { return 1; }
+    return 1 + sr_sflow_rand(sf) % (2 * rate - 1);
+} /* -- sr_sflow_skip -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_sflow_queue(..)
+ * Scope:  Local
+ *
+ * Fill in and queue a sample of packet for the writer.  Drops it if the
+ * ring is full or another thread holds it.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_sflow_queue(struct sr_sflow* sf, const uint8_t* packet,
+                           unsigned int len, int dir, int decision,
+                           const char* iface, const char* out_if,
+                           uint32_t nexthop, uint32_t rate, uint64_t pool)
+{
+    struct sr_sflow_rec* rec;
+
+    if (pthread_mutex_trylock(&sf->lock) != 0)
+    {
+        __sync_fetch_and_add(&sf->lost, 1);
+        return;
+    }
+    if (sf->head - sf->tail >= SR_SFLOW_RING)
+    {
+        sf->dropped++;
+        __sync_fetch_and_add(&sf->lost, 1);
+        pthread_mutex_unlock(&sf->lock);
+        return;
+    }
+
+    rec = &sf->ring[sf->head & (SR_SFLOW_RING - 1)];
+    memset(rec, 0, sizeof(*rec));
+    rec->ts = sr_now_ns();
+    rec->pool = pool;
+    rec->rate = rate;
+    rec->drops = sf->dropped;
+    rec->nexthop = nexthop;
+    rec->frame_len = (len > 0xffff) ? 0xffff : len;
+    rec->dir = dir;
+    rec->decision = decision;
+    rec->hdr_len = (len < SR_SFLOW_HDR) ? len : SR_SFLOW_HDR;
+    strncpy(rec->iface, iface, sizeof(rec->iface) - 1);
+    if (out_if)
+    { strncpy(rec->out_if, out_if, sizeof(rec->out_if) - 1); }
+    memcpy(rec->hdr, packet, rec->hdr_len);
+
+    sf->dropped = 0;
+    sf->samples++;
+    sf->head++;
+    pthread_mutex_unlock(&sf->lock);
+} /* -- sr_sflow_queue -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_sflow_ingress(..)
+ * Scope:  Global
+ *
+ * Called for a received frame once SR_SFLOW_IN_DUE says it is a
+ * candidate, after classification so lk tells what becomes of it.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_sflow_ingress(struct sr_instance* sr, const uint8_t* packet,
+                      unsigned int len, const struct sr_lookup* lk)
+{
+    struct sr_sflow* sf = sr->sflow;
+    struct sr_if* in_if = lk->info.in_if;
+    uint32_t rate = sf->in_rate, nexthop = 0;
+    const char* out_if = 0;
+    int decision;
+
+    sf->in_skip = sr_sflow_skip(sf, rate);
+    if (in_if == 0 || in_if->sflow.rate_in == 0)
+    { return; }
+
+    /* -- the candidate stands for rate frames; keep one in rate_in -- */
+    in_if->sflow.pool_in += rate;
+    if (in_if->sflow.rate_in > rate &&
+        sr_sflow_rand(sf) % in_if->sflow.rate_in >= rate)
+    { return; }
+    in_if->sflow.samples_in++;
+
+    if (lk->drop == SR_DROP_ACL)
+    { decision = SR_SFLOW_DENIED; }
+    else if (lk->drop)
+    { decision = SR_SFLOW_IGNORED; }
+    else if (lk->forRouter)
+    { decision = SR_SFLOW_LOCAL; }
+    else if (lk->forwarding)
+    {
+        decision = SR_SFLOW_FORWARD;
+        if (lk->outIf)
+        { out_if = lk->outIf->name; }
+        if (lk->longestRoutingTable)
+        { nexthop = lk->longestRoutingTable->gw.s_addr; }
+    }
+    else
+    { decision = SR_SFLOW_NOROUTE; }
+
+    sr_sflow_queue(sf, packet, len, SR_SFLOW_IN, decision, in_if->name,
+                   out_if, nexthop, in_if->sflow.rate_in, in_if->sflow.pool_in);
+} /* -- sr_sflow_ingress -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_sflow_egress(..)
+ * Scope:  Global
+ *
+ * Called by sr_send_packet when SR_SFLOW_OUT_DUE picks a frame.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_sflow_egress(struct sr_instance* sr, struct sr_if* iface,
+                     const uint8_t* packet, unsigned int len)
+{
+    struct sr_sflow* sf = sr->sflow;
+
+    iface->sflow.skip_out = sr_sflow_skip(sf, iface->sflow.rate_out);
+    iface->sflow.samples_out++;
+    sr_sflow_queue(sf, packet, len, SR_SFLOW_OUT, SR_SFLOW_SENT, iface->name,
+                   0, 0, iface->sflow.rate_out, iface->sflow.pool_out);
+} /* -- sr_sflow_egress -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_sflow_set_rate(..)
+ * Scope:  Global
+ *
+ * Sample one in rate frames of iface in direction dir, 0 for none.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_sflow_set_rate(struct sr_instance* sr, struct sr_if* iface, int dir,
+                       uint32_t rate)
+{
+    struct sr_sflow* sf = sr->sflow;
+    struct sr_if* i;
+    uint32_t lowest = 0;
+
+    if (dir == SR_SFLOW_OUT)
+    {
+        iface->sflow.rate_out = rate;
+        iface->sflow.skip_out = sr_sflow_skip(sf, rate);
+        return;
+    }
+
+    iface->sflow.rate_in = rate;
+    for (i = sr->if_list; i; i = i->next)
+    {
+        if (i->sflow.rate_in && (lowest == 0 || i->sflow.rate_in < lowest))
+        { lowest = i->sflow.rate_in; }
+    }
+    sf->in_skip = sr_sflow_skip(sf, lowest);
+    sf->in_rate = lowest;
+} /* -- sr_sflow_set_rate -- */
+
+static void sr_sflow_drain(struct sr_sflow* sf)
+{
+    uint32_t n, i;
+
+    pthread_mutex_lock(&sf->lock);
+    n = sf->head - sf->tail;
+    for (i = 0; i < n; i++)
+    { sf->out[i] = sf->ring[(sf->tail + i) & (SR_SFLOW_RING - 1)]; }
+    sf->tail += n;
+    pthread_mutex_unlock(&sf->lock);
+
+    if (n)
+    {
+        fwrite(sf->out, sizeof(struct sr_sflow_rec), n, sf->file);
+        fflush(sf->file);
+        sf->written += n;
+    }
+} /* -- sr_sflow_drain -- */
+
+static void* sr_sflow_writer(void* arg)
+{
+    struct sr_sflow* sf = (struct sr_sflow*)arg;
+    struct timespec ts;
+
+    ts.tv_sec = 0;
+    ts.tv_nsec = SR_SFLOW_FLUSH_MS * 1000000L;
+    while (!sf->stopping)
+    {
+        nanosleep(&ts, 0);
+        sr_sflow_drain(sf);
+    }
+    return 0;
+} /* -- sr_sflow_writer -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_sflow_create(..)
+ * Scope:  Global
+ *
+ * Create the export file and start its writer.  Sampling starts with
+ * sr_sflow_set_rate.  Returns NULL with a message on stderr on failure.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_sflow* sr_sflow_create(const char* path)
+{
+    struct sr_sflow_file_hdr hdr;
+    struct sr_sflow* sf;
+    int err;
+
+    if ((sf = (struct sr_sflow*)calloc(1, sizeof(*sf))) == 0)
+    {
+        fprintf(stderr, "Error: out of memory (sr_sflow_create)\n");
+        return 0;
+    }
+    if ((sf->file = fopen(path, "wb")) == 0)
+    {
+        fprintf(stderr, "sflow: cannot create %s: %s\n", path, strerror(errno));
+        free(sf);
+        return 0;
+    }
+    strncpy(sf->path, path, sizeof(sf->path) - 1);
+    sf->rng = sr_now_ns() | 1;
+    pthread_mutex_init(&sf->lock, 0);
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, SR_SFLOW_MAGIC, sizeof(SR_SFLOW_MAGIC));
+    hdr.version = SR_SFLOW_VERSION;
+    hdr.rec_size = sizeof(struct sr_sflow_rec);
+    hdr.mono_ns = sr_now_ns();
+    hdr.real_ns = sr_clock_ns(CLOCK_REALTIME);
+    fwrite(&hdr, sizeof(hdr), 1, sf->file);
+    fflush(sf->file);
+
+    if ((err = pthread_create(&sf->writer, 0, sr_sflow_writer, sf)) != 0)
+    {
+        fprintf(stderr, "sflow: pthread_create: %s\n", strerror(err));
+        fclose(sf->file);
+        pthread_mutex_destroy(&sf->lock);
+        free(sf);
+        return 0;
+    }
+    return sf;
+} /* -- sr_sflow_create -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_sflow_destroy(..)
+ * Scope:  Global
+ *
+ * Stop the writer, write what is queued and close the file.  No thread
+ * may be sampling any more.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_sflow_destroy(struct sr_sflow* sf)
+{
+    if (!sf)
+    { return; }
+    sf->stopping = 1;
+    pthread_join(sf->writer, 0);
+    sr_sflow_drain(sf);
+    fclose(sf->file);
+    pthread_mutex_destroy(&sf->lock);
+    free(sf);
+} /* -- sr_sflow_destroy -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_sflow_print(..)
+ * Scope:  Global
+ *
+ * Sampler state and per interface counters for the control socket.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_sflow_print(struct sr_instance* sr, FILE* out)
+{
+    struct sr_sflow* sf = sr->sflow;
+    struct sr_if* i;
+
+    fprintf(out, "sflow_file %s\n", sf->path);
+    fprintf(out, "sflow_samples %llu\n", (unsigned long long)sf->samples);
+    fprintf(out, "sflow_lost %llu\n", (unsigned long long)sf->lost);
+    fprintf(out, "sflow_written %llu\n", (unsigned long long)sf->written);
+    for (i = sr->if_list; i; i = i->next)
+    {
+        fprintf(out, "%s in 1/%u pool %llu samples %llu out 1/%u pool %llu samples %llu\n",
+                i->name, i->sflow.rate_in,
+                (unsigned long long)i->sflow.pool_in,
+                (unsigned long long)i->sflow.samples_in, i->sflow.rate_out,
+                (unsigned long long)i->sflow.pool_out,
+                (unsigned long long)i->sflow.samples_out);
+    }
+} /* -- sr_sflow_print -- */
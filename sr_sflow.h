@@ -0,0 +1,151 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_sflow.h
+ *
+ * Description:
+ *
+ * sFlow style packet sampling.  One frame in N, chosen at random, is
+ * copied (its first SR_SFLOW_HDR bytes, with the interface and what the
+ * router decided to do with it) to a ring, and a writer thread appends
+ * the ring to the export file.  sr_sflowdump decodes the file and
+ * scales the samples back up to traffic estimates.
+ *
+ * Each interface has its own rate for each direction (struct sr_if_sflow
+ * in sr_if.h, 0 for off).  Sampling uses a skip count drawn uniformly
+ * from 1 .. 2N - 1, so a frame that is not sampled costs a decrement:
+ *
+ *   egress   sr_send_packet counts down the outgoing interface's skip
+ *            on the sr_if it already looks up
+ *   ingress  the receive path knows the interface only by name, so it
+ *            counts down one skip per router at the lowest ingress rate
+ *            and keeps a sampled frame with probability lowest / rate of
+ *            its interface.  The interface's pool grows by the lowest
+ *            rate on each such frame, an estimate of the frames it saw.
+ *
+ * The counters are not atomic: with several receive queues (tap -q) they
+ * undercount a little, like the rest of struct sr_stats.
+ *
+ * A full ring drops samples, counted in the next sample's drops.
+ *
+ * The file is a struct sr_sflow_file_hdr followed by records, both in
+ * host byte order.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_SFLOW_H
+#define SR_SFLOW_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#include <stdio.h>
+#include <pthread.h>
+
+#define SR_SFLOW_MAGIC     "SRSFLOW"
+#define SR_SFLOW_VERSION   1
+#define SR_SFLOW_HDR       128     /* bytes of each sampled frame kept */
+#define SR_SFLOW_RING      1024    /* samples in flight, power of two */
+#define SR_SFLOW_FLUSH_MS  200
+#define SR_SFLOW_DEFAULT_RATE 1000
+
+/* -- direction -- */
+#define SR_SFLOW_IN  0
+#define SR_SFLOW_OUT 1
+
+/* -- what the router did with an ingress sample -- */
+#define SR_SFLOW_LOCAL   0   /* addressed to the router */
+#define SR_SFLOW_FORWARD 1   /* routed out out_if */
+#define SR_SFLOW_NOROUTE 2   /* neither, answered with unreachable */
+#define SR_SFLOW_DENIED  3   /* dropped by the ACL */
+#define SR_SFLOW_SENT    4   /* egress sample */
+#define SR_SFLOW_IGNORED 5   /* dropped as malformed or not for the router */
+
+struct sr_instance;
+struct sr_if;
+struct sr_lookup;
+
+/* ----------------------------------------------------------------------------
+ * struct sr_sflow_rec
+ *
+ * One sample.  pool is the interface's frame count for the direction
+ * at the time, including the sampled frame.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_sflow_rec
+{
+    uint64_t ts;          /* CLOCK_MONOTONIC, ns */
+    uint64_t pool;        /* frames seen */
+    uint32_t rate;        /* 1 in rate */
+    uint32_t drops;       /* samples lost to a full ring before this one */
+    uint32_t nexthop;     /* IPv4 next hop of a forwarded sample, else 0 */
+    uint16_t frame_len;
+    uint8_t  dir;
+    uint8_t  decision;
+    uint16_t hdr_len;     /* bytes of hdr used */
+    uint16_t pad;
+    char     iface[16];   /* the sampled interface */
+    char     out_if[16];  /* egress of a forwarded ingress sample */
+    uint8_t  hdr[SR_SFLOW_HDR];
+};
+
+struct sr_sflow_file_hdr
+{
+    char     magic[8];
+    uint32_t version;
+    uint32_t rec_size;
+    uint64_t mono_ns;     /* CLOCK_MONOTONIC when the export started */
+    uint64_t real_ns;     /* CLOCK_REALTIME at the same moment */
+};
+
+/* ----------------------------------------------------------------------------
+ * struct sr_sflow
+ *
+ * Per router sampler.  The ring is shared by the router's threads under
+ * lock; a thread that finds it taken drops its sample instead of waiting.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_sflow
+{
+    uint32_t in_rate;     /* lowest ingress rate of any interface, 0 none */
+    uint32_t in_skip;     /* ingress frames until the next candidate */
+    uint64_t rng;         /* xorshift state for the skip counts */
+
+    pthread_mutex_t lock; /* ring */
+    uint32_t head;
+    uint32_t tail;
+    uint32_t dropped;     /* since the last queued sample */
+    struct sr_sflow_rec ring[SR_SFLOW_RING];
+
+    FILE* file;
+    char path[256];
+    pthread_t writer;
+    volatile int stopping;
+    uint64_t samples;     /* queued */
+    uint64_t lost;        /* dropped, ring full or busy */
+    uint64_t written;     /* writer thread only */
+    struct sr_sflow_rec out[SR_SFLOW_RING]; /* writer's copy of the ring */
+};
+
+/* -- ingress: is the next frame a candidate; egress: is the frame going
+ *    out iface a sample -- */
+#define SR_SFLOW_IN_DUE(sf) ((sf)->in_rate && --(sf)->in_skip == 0)
+#define SR_SFLOW_OUT_DUE(i) \
+    ((i)->sflow.rate_out && ((i)->sflow.pool_out++, --(i)->sflow.skip_out == 0))
+
+struct sr_sflow* sr_sflow_create(const char* path);
+void sr_sflow_destroy(struct sr_sflow* sf);
+void sr_sflow_set_rate(struct sr_instance* sr, struct sr_if* iface, int dir,
+                       uint32_t rate);
+void sr_sflow_ingress(struct sr_instance* sr, const uint8_t* packet,
+                      unsigned int len, const struct sr_lookup* lk);
+void sr_sflow_egress(struct sr_instance* sr, struct sr_if* iface,
+                     const uint8_t* packet, unsigned int len);
+void sr_sflow_print(struct sr_instance* sr, FILE* out);
+
+#endif /* SR_SFLOW_H */
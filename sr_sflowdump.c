@@ -0,0 +1,275 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_sflowdump.c
+ *
+ * Description:
+ *
+ * Decoder for the sample files written with sr -S (see sr_sflow.h).
+ * Prints one line per sample:
+ *
+ *   16:10:02.501873214 eth1 in forward eth2 via 10.0.2.1 1/1000 pool 52311
+ *     len 98 10.0.1.100 > 10.0.2.200 icmp
+ *
+ * (on one line), or with -s, estimates of the traffic behind the
+ * samples: each sample stands for rate frames, so the frames per
+ * interface, direction and protocol are the sums of the sampled rates.
+ *
+ *   sr_sflowdump [-s] samplefile
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <arpa/inet.h>
+
+#include "sr_protocol.h"
+#include "sr_sflow.h"
+
+#define DUMP_IFACES 32
+
+static const char* dump_decisions[] =
+{ "local", "forward", "noroute", "denied", "sent", "ignored" };
+#define DUMP_DECISIONS (sizeof(dump_decisions) / sizeof(dump_decisions[0]))
+
+/* -- protocols the summary counts frames of -- */
+enum { P_IP_ICMP, P_IP_TCP, P_IP_UDP, P_IP_OTHER, P_IP6, P_ARP, P_OTHER, P_COUNT };
+static const char* dump_protos[P_COUNT] =
+{ "icmp", "tcp", "udp", "ip_other", "ip6", "arp", "other" };
+
+struct dump_iface
+{
+    char name[16];
+    unsigned long samples[2];
+    uint64_t frames[2];         /* estimated, sum of the rates */
+    uint64_t bytes[2];          /* estimated */
+    uint64_t pool[2];           /* last pool seen */
+};
+
+/*---------------------------------------------------------------------
+ * Method: dump_frame(..)
+ * Scope:  Local
+ *
+ * Describe the sampled header of rec in buf and return its protocol.
+ *
+ *---------------------------------------------------------------------*/
+
+static int dump_frame(const struct sr_sflow_rec* rec, char* buf, int size)
+{
+    const struct sr_ethernet_hdr* eth = (const struct sr_ethernet_hdr*)rec->hdr;
+    const uint8_t* l3 = rec->hdr + sizeof(struct sr_ethernet_hdr);
+    int l3_len = (int)rec->hdr_len - (int)sizeof(struct sr_ethernet_hdr);
+    char src[INET6_ADDRSTRLEN], dst[INET6_ADDRSTRLEN];
+    const struct sr_ip_hdr* ip;
+    const struct sr_ip6_hdr* ip6;
+    const uint8_t* l4;
+    int l4_len, proto;
+
+    if (l3_len < 0)
+    {
+        snprintf(buf, size, "runt");
+        return P_OTHER;
+    }
+
+    switch (ntohs(eth->ether_type))
+    {
+        case ethertype_arp:
+            snprintf(buf, size, "arp");
+            return P_ARP;
+
+        case ethertype_ip6:
+            if (l3_len < (int)sizeof(struct sr_ip6_hdr))
+            { break; }
+            ip6 = (const struct sr_ip6_hdr*)l3;
+            inet_ntop(AF_INET6, ip6->ip6_src, src, sizeof(src));
+            inet_ntop(AF_INET6, ip6->ip6_dst, dst, sizeof(dst));
+            snprintf(buf, size, "%s > %s next %u", src, dst, ip6->ip6_nxt);
+            return P_IP6;
+
+        case ethertype_ip:
+            if (l3_len < (int)sizeof(struct sr_ip_hdr))
+            { break; }
+            ip = (const struct sr_ip_hdr*)l3;
+            inet_ntop(AF_INET, &ip->ip_src, src, sizeof(src));
+            inet_ntop(AF_INET, &ip->ip_dst, dst, sizeof(dst));
+            l4 = l3 + ip->ip_hl * 4;
+            l4_len = l3_len - ip->ip_hl * 4;
+            if (ip->ip_p == ip_protocol_tcp && l4_len >= 4 &&
+                (ntohs(ip->ip_off) & IP_OFFMASK) == 0)
+            {
+                const struct sr_tcp_hdr* tcp = (const struct sr_tcp_hdr*)l4;
+                snprintf(buf, size, "%s:%u > %s:%u tcp", src,
+                         ntohs(tcp->tcp_sport), dst, ntohs(tcp->tcp_dport));
+                return P_IP_TCP;
+            }
+            if (ip->ip_p == ip_protocol_udp && l4_len >= 4 &&
+                (ntohs(ip->ip_off) & IP_OFFMASK) == 0)
+            {
+                const struct sr_udp_hdr* udp = (const struct sr_udp_hdr*)l4;
+                snprintf(buf, size, "%s:%u > %s:%u udp", src,
+                         ntohs(udp->udp_sport), dst, ntohs(udp->udp_dport));
+                return P_IP_UDP;
+            }
+            proto = (ip->ip_p == ip_protocol_icmp) ? P_IP_ICMP :
+                    (ip->ip_p == ip_protocol_tcp) ? P_IP_TCP :
+                    (ip->ip_p == ip_protocol_udp) ? P_IP_UDP : P_IP_OTHER;
+            if (proto == P_IP_OTHER)
+            { snprintf(buf, size, "%s > %s proto %u", src, dst, ip->ip_p); }
+            else
+            { snprintf(buf, size, "%s > %s %s", src, dst, dump_protos[proto]); }
+            return proto;
+
+        default:
+            snprintf(buf, size, "ethertype 0x%04x", ntohs(eth->ether_type));
+            return P_OTHER;
+    }
+    snprintf(buf, size, "truncated");
+    return P_OTHER;
+} /* -- dump_frame -- */
+
+static void usage(const char* argv0)
+{
+    fprintf(stderr, "Usage: %s [-s] samplefile\n", argv0);
+} /* -- usage -- */
+
+int main(int argc, char** argv)
+{
+    struct sr_sflow_file_hdr hdr;
+    struct sr_sflow_rec rec;
+    struct dump_iface ifaces[DUMP_IFACES];
+    uint64_t proto_frames[2][P_COUNT];
+    unsigned long n = 0, drops = 0;
+    int summary = 0, nifaces = 0, c, i, p, d;
+    char line[256], via[64], stamp[32], nexthop[INET_ADDRSTRLEN];
+    uint64_t wall;
+    time_t secs;
+    struct tm tm;
+    FILE* in;
+
+    while ((c = getopt(argc, argv, "hs")) != EOF)
+    {
+        switch (c)
+        {
+            case 's':
+                summary = 1;
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if (optind != argc - 1)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if ((in = fopen(argv[optind], "rb")) == 0)
+    {
+        perror(argv[optind]);
+        return 1;
+    }
+    if (fread(&hdr, sizeof(hdr), 1, in) != 1 ||
+        memcmp(hdr.magic, SR_SFLOW_MAGIC, sizeof(SR_SFLOW_MAGIC)) != 0)
+    {
+        fprintf(stderr, "%s: not a sample file\n", argv[optind]);
+        return 1;
+    }
+    if (hdr.version != SR_SFLOW_VERSION || hdr.rec_size != sizeof(struct sr_sflow_rec))
+    {
+        fprintf(stderr, "%s: sample version %u, record size %u, expected %d and %u\n",
+                argv[optind], hdr.version, hdr.rec_size, SR_SFLOW_VERSION,
+                (unsigned)sizeof(struct sr_sflow_rec));
+        return 1;
+    }
+
+    memset(ifaces, 0, sizeof(ifaces));
+    memset(proto_frames, 0, sizeof(proto_frames));
+    while (fread(&rec, sizeof(rec), 1, in) == 1)
+    {
+        n++;
+        drops += rec.drops;
+        d = rec.dir ? 1 : 0;
+        rec.iface[sizeof(rec.iface) - 1] = '\0';
+        rec.out_if[sizeof(rec.out_if) - 1] = '\0';
+        if (rec.hdr_len > SR_SFLOW_HDR)
+        { rec.hdr_len = SR_SFLOW_HDR; }
+        p = dump_frame(&rec, line, sizeof(line));
+
+        if (summary)
+        {
+            for (i = 0; i < nifaces; i++)
+            {
+                if (strcmp(ifaces[i].name, rec.iface) == 0)
+                { break; }
+            }
+            if (i == nifaces)
+            {
+                if (nifaces == DUMP_IFACES)
+                { continue; }
+                strcpy(ifaces[nifaces++].name, rec.iface);
+            }
+            ifaces[i].samples[d]++;
+            ifaces[i].frames[d] += rec.rate;
+            ifaces[i].bytes[d] += (uint64_t)rec.rate * rec.frame_len;
+            ifaces[i].pool[d] = rec.pool;
+            proto_frames[d][p] += rec.rate;
+            continue;
+        }
+
+        via[0] = '\0';
+        if (rec.decision == SR_SFLOW_FORWARD)
+        {
+            if (rec.nexthop)
+            {
+                inet_ntop(AF_INET, &rec.nexthop, nexthop, sizeof(nexthop));
+                snprintf(via, sizeof(via), " %s via %s", rec.out_if, nexthop);
+            }
+            else
+            { snprintf(via, sizeof(via), " %s", rec.out_if); }
+        }
+
+        wall = hdr.real_ns + (rec.ts - hdr.mono_ns);
+        secs = (time_t)(wall / 1000000000ULL);
+        localtime_r(&secs, &tm);
+        strftime(stamp, sizeof(stamp), "%H:%M:%S", &tm);
+        printf("%s.%09lu %s %s %s%s 1/%u pool %llu len %u %s\n", stamp,
+               (unsigned long)(wall % 1000000000ULL), rec.iface, d ? "out" : "in",
+               rec.decision < DUMP_DECISIONS ? dump_decisions[rec.decision] : "?", via,
+               rec.rate, (unsigned long long)rec.pool, rec.frame_len, line);
+    }
+    fclose(in);
+
+    if (summary)
+    {
+        printf("%-8s %-3s %10s %14s %14s %14s\n", "iface", "dir", "samples",
+               "est_frames", "est_bytes", "pool");
+        for (i = 0; i < nifaces; i++)
+        {
+            for (d = 0; d < 2; d++)
+            {
+                if (ifaces[i].samples[d] == 0)
+                { continue; }
+                printf("%-8s %-3s %10lu %14llu %14llu %14llu\n", ifaces[i].name,
+                       d ? "out" : "in", ifaces[i].samples[d],
+                       (unsigned long long)ifaces[i].frames[d],
+                       (unsigned long long)ifaces[i].bytes[d],
+                       (unsigned long long)ifaces[i].pool[d]);
+            }
+        }
+        for (d = 0; d < 2; d++)
+        {
+            for (p = 0; p < P_COUNT; p++)
+            {
+                if (proto_frames[d][p])
+                {
+                    printf("%-3s %-8s %14llu\n", d ? "out" : "in", dump_protos[p],
+                           (unsigned long long)proto_frames[d][p]);
+                }
+            }
+        }
+        printf("samples %lu lost %lu\n", n, drops);
+    }
+    return 0;
+} /* -- main -- */
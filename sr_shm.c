@@ -0,0 +1,648 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_shm.c
+ *
+ * Description:
+ *
+ * Shared memory netdev backend (-d shm:SOCKET -i IFFILE), the router end
+ * of the transport described in sr_shm.h.  Its purpose is measuring the
+ * router's own forwarding cost: frames are routed straight out of the
+ * rx ring slots and written into tx ring slots, with no socket in the
+ * data path.
+ *
+ * The loop busy-polls the rx rings while there is traffic and falls back
+ * to blocking on its eventfd (together with the ARP timer, the control
+ * socket and the peer connection) after SR_SHM_SPIN empty polls.  It
+ * returns when the peer disconnects, like a closed VNS session.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+#include "sr_router.h"
+#include "sr_netdev.h"
+#include "sr_arpcache.h"
+#include "sr_egress.h"
+#include "sr_shm.h"
+
+#define SR_SHM_SPIN   4096 /* empty polls before blocking */
+#define SR_SHM_BURST  64   /* frames per ring per poll, or sr->burst */
+#define SR_SHM_EVERY  1024 /* busy polls between event checks */
+#define SR_SHM_EVENTS 16
+#define SR_SHM_TX_WAIT 1000 /* yields waiting for tx space before dropping */
+
+/* epoll tags */
+#define SR_SHM_EV_DOORBELL 1ULL
+#define SR_SHM_EV_TIMER    2ULL
+#define SR_SHM_EV_CTL      3ULL
+#define SR_SHM_EV_LISTEN   4ULL
+#define SR_SHM_EV_PEER     5ULL
+#define SR_SHM_EV_PACER    6ULL
+#define SR_SHM_EV_CLIENT   (1ULL << 32)
+
+struct sr_shm
+{
+    int lfd;            /* unix socket peers connect to */
+    int pfd;            /* attached peer, -1 if none */
+    int memfd;
+    int router_efd;     /* our doorbell */
+    int peer_efd;       /* the peer's doorbell */
+    int epfd;
+    int tfd;
+    int cfd;
+    int stop;
+
+    struct sr_shm_hdr* hdr;
+    size_t size;
+    int nifs;
+    struct sr_shm_ring* rx[SR_SHM_MAX_IFACES];
+    struct sr_shm_ring* tx[SR_SHM_MAX_IFACES];
+    uint32_t tx_head[SR_SHM_MAX_IFACES]; /* local copies of what we own */
+    uint32_t rx_tail[SR_SHM_MAX_IFACES];
+    int rx_next;        /* ring the next poll starts with */
+    int kick;           /* peer may be waiting on something we did */
+};
+
+/*---------------------------------------------------------------------
+ * Method: sr_shm_close(..)
+ * Scope:  Local
+ *---------------------------------------------------------------------*/
+
+static void sr_shm_close(struct sr_instance* sr)
+{
+    struct sr_shm* shm = sr->netdev_priv;
+
+    if (!shm)
+    { return; }
+
+    if (shm->hdr && (void*)shm->hdr != MAP_FAILED)
+    { munmap(shm->hdr, shm->size); }
+    if (shm->lfd >= 0)
+    {
+        close(shm->lfd);
+        unlink(sr->netdev_conf.arg);
+    }
+    if (shm->pfd >= 0)
+    { close(shm->pfd); }
+    if (shm->memfd >= 0)
+    { close(shm->memfd); }
+    if (shm->router_efd >= 0)
+    { close(shm->router_efd); }
+    if (shm->peer_efd >= 0)
+    { close(shm->peer_efd); }
+    free(shm);
+    sr->netdev_priv = 0;
+} /* -- sr_shm_close -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_shm_open(..)
+ * Scope:  Local
+ *
+ * Create the shared region, the doorbells and the listening socket.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_shm_open(struct sr_instance* sr)
+{
+    struct sr_netdev_conf* conf = &(sr->netdev_conf);
+    struct sockaddr_un addr;
+    struct sr_shm* shm;
+    struct sr_shm_hdr* hdr;
+    size_t hdr_size;
+    int i;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+
+    if (conf->arg[0] == '\0' || strlen(conf->arg) >= sizeof(addr.sun_path))
+    {
+        fprintf(stderr, "shm backend needs a socket path: -d shm:PATH\n");
+        return -1;
+    }
+    if (conf->nifs > SR_SHM_MAX_IFACES)
+    {
+        fprintf(stderr, "shm backend supports %d interfaces\n", SR_SHM_MAX_IFACES);
+        return -1;
+    }
+
+    if ((shm = (struct sr_shm*)calloc(1, sizeof(*shm))) == 0)
+    {
+        fprintf(stderr, "Error: out of memory (sr_shm_open)\n");
+        return -1;
+    }
+    shm->lfd = shm->pfd = shm->memfd = -1;
+    shm->router_efd = shm->peer_efd = -1;
+    sr->netdev_priv = shm;
+
+    /* -- region: header, then rx and tx ring of every interface -- */
+    hdr_size = (sizeof(struct sr_shm_hdr) + 4095) & ~(size_t)4095;
+    shm->nifs = conf->nifs;
+    shm->size = hdr_size + (size_t)conf->nifs * 2 * SR_SHM_RING_BYTES;
+
+    if ((shm->memfd = memfd_create("sr_shm", MFD_CLOEXEC)) < 0 ||
+        ftruncate(shm->memfd, shm->size) < 0)
+    {
+        perror("memfd:sr_shm.c::sr_shm_open");
+        sr_shm_close(sr);
+        return -1;
+    }
+    shm->hdr = mmap(0, shm->size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                    shm->memfd, 0);
+    if ((void*)shm->hdr == MAP_FAILED)
+    {
+        perror("mmap:sr_shm.c::sr_shm_open");
+        sr_shm_close(sr);
+        return -1;
+    }
+
+    hdr = shm->hdr;
+    hdr->magic = SR_SHM_MAGIC;
+    hdr->version = SR_SHM_VERSION;
+    hdr->nifs = conf->nifs;
+    hdr->slots = SR_SHM_SLOTS;
+    hdr->slot_size = SR_SHM_SLOT_SIZE;
+    hdr->size = shm->size;
+
+    for (i = 0; i < conf->nifs; i++)
+    {
+        struct sr_shm_iface* si = &hdr->ifs[i];
+
+        strncpy(si->name, conf->ifs[i].name, sizeof(si->name) - 1);
+        memcpy(si->mac, conf->ifs[i].iface->addr, 6);
+        si->ip = conf->ifs[i].iface->ip;
+        si->rx_off = hdr_size + (uint64_t)(2 * i) * SR_SHM_RING_BYTES;
+        si->tx_off = si->rx_off + SR_SHM_RING_BYTES;
+        shm->rx[i] = (struct sr_shm_ring*)((uint8_t*)hdr + si->rx_off);
+        shm->tx[i] = (struct sr_shm_ring*)((uint8_t*)hdr + si->tx_off);
+    }
+
+    shm->router_efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    shm->peer_efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (shm->router_efd < 0 || shm->peer_efd < 0)
+    {
+        perror("eventfd:sr_shm.c::sr_shm_open");
+        sr_shm_close(sr);
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, conf->arg, sizeof(addr.sun_path) - 1);
+    unlink(conf->arg);
+    if ((shm->lfd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0 ||
+        bind(shm->lfd, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+        listen(shm->lfd, 1) < 0)
+    {
+        perror("socket:sr_shm.c::sr_shm_open");
+        sr_shm_close(sr);
+        return -1;
+    }
+
+    printf("shm transport at %s, %d interface(s), %d slots per ring\n",
+           conf->arg, conf->nifs, SR_SHM_SLOTS);
+    return 0;
+} /* -- sr_shm_open -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_shm_attach(..)
+ * Scope:  Local
+ *
+ * Accept a peer and pass it the region and the doorbells.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_shm_attach(struct sr_instance* sr, struct sr_shm* shm)
+{
+    struct msghdr msg;
+    struct cmsghdr* cmsg;
+    struct iovec iov;
+    struct epoll_event ev;
+    union { char buf[CMSG_SPACE(3 * sizeof(int))]; struct cmsghdr align; } u;
+    int fds[3];
+    char one = 1;
+    int fd;
+
+    if ((fd = accept(shm->lfd, 0, 0)) < 0)
+    { return; }
+    if (shm->pfd >= 0)
+    {
+        fprintf(stderr, "shm: a peer is already attached\n");
+        close(fd);
+        return;
+    }
+
+    fds[0] = shm->memfd;
+    fds[1] = shm->router_efd;
+    fds[2] = shm->peer_efd;
+
+    memset(&msg, 0, sizeof(msg));
+    memset(&u, 0, sizeof(u));
+    iov.iov_base = &one;
+    iov.iov_len = 1;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = u.buf;
+    msg.msg_controllen = sizeof(u.buf);
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    if (sendmsg(fd, &msg, 0) != 1)
+    {
+        perror("sendmsg:sr_shm.c::sr_shm_attach");
+        close(fd);
+        return;
+    }
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN | EPOLLRDHUP;
+    ev.data.u64 = SR_SHM_EV_PEER;
+    epoll_ctl(shm->epfd, EPOLL_CTL_ADD, fd, &ev);
+    shm->pfd = fd;
+    printf("shm: peer attached\n");
+} /* -- sr_shm_attach -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_shm_add(..)
+ * Scope:  Local
+ *---------------------------------------------------------------------*/
+
+static int sr_shm_add(int epfd, int fd, uint64_t tag)
+{
+    struct epoll_event ev;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.u64 = tag;
+    return epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+} /* -- sr_shm_add -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_shm_events(..)
+ * Scope:  Local
+ *
+ * Everything besides the rings: doorbell, ARP tick, control socket and
+ * the peer connection.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_shm_events(struct sr_instance* sr, struct sr_shm* shm,
+                          int timeout)
+{
+    struct epoll_event events[SR_SHM_EVENTS];
+    uint64_t tag, val;
+    char c;
+    int i, n;
+
+    n = epoll_wait(shm->epfd, events, SR_SHM_EVENTS, timeout);
+    sr->stats.syscalls++;
+    if (n < 0)
+    {
+        if (errno != EINTR)
+        {
+            perror("epoll_wait(..):sr_shm.c::sr_shm_events");
+            shm->stop = 1;
+        }
+        return;
+    }
+
+    for (i = 0; i < n; i++)
+    {
+        tag = events[i].data.u64;
+
+        if (tag == SR_SHM_EV_DOORBELL)
+        {
+            if (read(shm->router_efd, &val, sizeof(val)) < 0)
+            { /* -- already drained -- */ }
+        }
+        else if (tag == SR_SHM_EV_TIMER)
+        {
+            if (read(shm->tfd, &val, sizeof(val)) > 0 && sr_arpcache_tick(sr))
+            { shm->stop = 1; }
+        }
+        else if (tag == SR_SHM_EV_PACER)
+        {
+            sr_egress_timer(sr);
+        }
+        else if (tag == SR_SHM_EV_LISTEN)
+        {
+            sr_shm_attach(sr, shm);
+        }
+        else if (tag == SR_SHM_EV_PEER)
+        {
+            if (recv(shm->pfd, &c, 1, MSG_DONTWAIT) <= 0)
+            {
+                printf("shm: peer detached\n");
+                shm->stop = 1;
+            }
+        }
+        else if (tag == SR_SHM_EV_CTL)
+        {
+            int fd = sr_ctl_accept(sr, shm->cfd);
+            if (fd >= 0 && sr_shm_add(shm->epfd, fd, SR_SHM_EV_CLIENT | fd) < 0)
+            { sr_ctl_close(fd); }
+        }
+        else
+        {
+            /* -- control client -- */
+            sr_ctl_serve_epoll(sr, shm->epfd, (int)(tag & 0xffffffffULL), tag);
+        }
+    }
+} /* -- sr_shm_events -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_shm_poll(..)
+ * Scope:  Local
+ *
+ * Route up to a burst from every rx ring, in place.  Returns the number
+ * of frames consumed.
+ *
+ *---------------------------------------------------------------------*/
+
+static unsigned int sr_shm_poll(struct sr_instance* sr, struct sr_shm* shm)
+{
+    uint8_t* pkts[SR_BURST_MAX];
+    unsigned int lens[SR_BURST_MAX];
+    char* names[SR_BURST_MAX];
+    unsigned int total = 0, count, n, k;
+    struct sr_shm_ring* r;
+    uint8_t* slot;
+    uint32_t tail, len, budget = SR_SHM_BURST;
+    int i, j, r_i;
+
+    if (sr->burst > budget)
+    { budget = sr->burst; }
+
+    /* -- backpressure: take no more than the fullest tx ring can hold,
+     *    so a slow peer sees a lossless link rather than tx drops -- */
+    for (i = 0; i < shm->nifs; i++)
+    {
+        if ((n = sr_shm_space(shm->tx[i], shm->tx_head[i])) < budget)
+        { budget = n; }
+    }
+
+    /* -- start with a different ring each time so none is starved -- */
+    r_i = shm->rx_next;
+    shm->rx_next = (shm->rx_next + 1) % shm->nifs;
+
+    for (j = 0; j < shm->nifs && budget > 0; j++)
+    {
+        i = (r_i + j) % shm->nifs;
+        r = shm->rx[i];
+        tail = shm->rx_tail[i];
+        if ((n = sr_shm_avail(r, tail)) == 0)
+        { continue; }
+        if (n > budget)
+        { n = budget; }
+
+        for (k = 0, count = 0; k < n; k++)
+        {
+            slot = sr_shm_slot(r, tail + k);
+            memcpy(&len, slot, 4);
+            if (len < sizeof(struct sr_ethernet_hdr) || len > SR_SHM_FRAME_MAX)
+            { continue; }
+            pkts[count] = slot + 4;
+            lens[count] = len;
+            names[count] = sr->netdev_conf.ifs[i].name;
+            sr->stats.rx_bytes += len;
+            count++;
+        }
+        sr->stats.rx_packets += count;
+
+        if (count > 0)
+        { sr_handlepacket_burst(sr, pkts, lens, names, count); }
+
+        /* -- slots go back to the peer only after routing them -- */
+        shm->rx_tail[i] = tail + n;
+        __atomic_store_n(&r->tail, tail + n, __ATOMIC_RELEASE);
+        total += n;
+        budget -= n;
+    }
+
+    if (total > 0)
+    { shm->kick = 1; }
+
+    return total;
+} /* -- sr_shm_poll -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_shm_doorbell(..)
+ * Scope:  Local
+ *
+ * Wake the peer if it went to sleep and we produced or freed slots.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_shm_doorbell(struct sr_instance* sr, struct sr_shm* shm)
+{
+    uint64_t one = 1;
+
+    if (!shm->kick)
+    { return; }
+    shm->kick = 0;
+
+    if (__atomic_load_n(&shm->hdr->peer_waiting, __ATOMIC_SEQ_CST))
+    {
+        if (write(shm->peer_efd, &one, sizeof(one)) < 0)
+        { /* -- counter saturated: peer is awake anyway -- */ }
+        sr->stats.syscalls++;
+    }
+} /* -- sr_shm_doorbell -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_shm_send_batch(..)
+ * Scope:  Local
+ *
+ * Copy n frames into the tx ring of iface and publish them with one
+ * head update.  Returns the number copied; the rest are dropped if the
+ * ring stays full.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_shm_send_batch(struct sr_instance* sr, const uint8_t** bufs,
+                             const unsigned int* lens, int n, const char* iface)
+{
+    struct sr_shm* shm = sr->netdev_priv;
+    struct sr_netdev_if* nif;
+    struct sr_shm_ring* r;
+    uint32_t head, len32;
+    uint8_t* slot;
+    int i, k, tries;
+
+    if (!shm || (nif = sr_netdev_find_if(sr, iface)) == 0)
+    { return 0; }
+
+    i = nif - sr->netdev_conf.ifs;
+    r = shm->tx[i];
+    head = shm->tx_head[i];
+
+    for (k = 0; k < n; k++)
+    {
+        if (lens[k] > SR_SHM_FRAME_MAX)
+        { break; }
+
+        /* -- a full ring is normally the peer lagging behind a burst (the
+         *    ARP queue being flushed): let it catch up before dropping -- */
+        for (tries = 0; sr_shm_space(r, head) == 0; tries++)
+        {
+            if (tries == SR_SHM_TX_WAIT)
+            { goto out; }
+            __atomic_store_n(&r->head, head, __ATOMIC_RELEASE);
+            shm->kick = 1;
+            sr_shm_doorbell(sr, shm);
+            sched_yield();
+        }
+
+        len32 = lens[k];
+        slot = sr_shm_slot(r, head);
+        memcpy(slot, &len32, 4);
+        memcpy(slot + 4, bufs[k], lens[k]);
+        head++;
+    }
+out:
+    if (head != shm->tx_head[i])
+    {
+        shm->tx_head[i] = head;
+        __atomic_store_n(&r->head, head, __ATOMIC_RELEASE);
+        shm->kick = 1;
+    }
+
+    return k;
+} /* -- sr_shm_send_batch -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_shm_send(..)
+ * Scope:  Local
+ *
+ * Copy a frame into the tx ring of iface.  Drops it if the ring is full.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_shm_send(struct sr_instance* sr, const uint8_t* buf,
+                       unsigned int len, const char* iface)
+{
+    return sr_shm_send_batch(sr, &buf, &len, 1, iface) == 1 ? 0 : -1;
+} /* -- sr_shm_send -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_shm_pending(..)
+ * Scope:  Local
+ *---------------------------------------------------------------------*/
+
+static int sr_shm_pending(struct sr_shm* shm)
+{
+    int i;
+
+    for (i = 0; i < shm->nifs; i++)
+    {
+        if (sr_shm_avail(shm->rx[i], shm->rx_tail[i]) > 0)
+        { return 1; }
+    }
+    return 0;
+} /* -- sr_shm_pending -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_shm_run(..)
+ * Scope:  Local
+ *
+ * Adaptive busy-poll loop; see the file comment.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_shm_run(struct sr_instance* sr)
+{
+    struct sr_shm* shm = sr->netdev_priv;
+    struct itimerspec its;
+    unsigned int idle = 0, busy = 0;
+
+    /* -- REQUIRES -- */
+    assert(shm);
+
+    sr->cache.use_locks = 0;
+    shm->cfd = -1;
+
+    if ((shm->epfd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+    {
+        perror("epoll_create1(..):sr_shm.c::sr_shm_run");
+        return -1;
+    }
+    sr_shm_add(shm->epfd, shm->router_efd, SR_SHM_EV_DOORBELL);
+    sr_shm_add(shm->epfd, shm->lfd, SR_SHM_EV_LISTEN);
+
+    if ((shm->tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) >= 0)
+    {
+        memset(&its, 0, sizeof(its));
+        its.it_value.tv_sec = 1;
+        its.it_interval.tv_sec = 1;
+        timerfd_settime(shm->tfd, 0, &its, 0);
+        sr_shm_add(shm->epfd, shm->tfd, SR_SHM_EV_TIMER);
+    }
+    if (sr_egress_timer_fd(sr) >= 0)
+    { sr_shm_add(shm->epfd, sr_egress_timer_fd(sr), SR_SHM_EV_PACER); }
+
+    if (sr->ctl_path[0] != '\0' && (shm->cfd = sr_ctl_listen(sr->ctl_path)) >= 0)
+    { sr_shm_add(shm->epfd, shm->cfd, SR_SHM_EV_CTL); }
+
+    while (!shm->stop)
+    {
+        if (sr_shm_poll(sr, shm) > 0)
+        {
+            idle = 0;
+            sr_shm_doorbell(sr, shm);
+            if (++busy % SR_SHM_EVERY == 0)
+            { sr_shm_events(sr, shm, 0); }
+            continue;
+        }
+        sr_shm_doorbell(sr, shm);
+
+        if (++idle < SR_SHM_SPIN)
+        {
+            sr_shm_cpu_relax();
+            continue;
+        }
+
+        /* -- nothing for a while: sleep on the doorbell -- */
+        __atomic_store_n(&shm->hdr->router_waiting, 1, __ATOMIC_SEQ_CST);
+        if (!sr_shm_pending(shm))
+        { sr_shm_events(sr, shm, -1); }
+        __atomic_store_n(&shm->hdr->router_waiting, 0, __ATOMIC_SEQ_CST);
+        idle = 0;
+    }
+
+    if (shm->cfd >= 0)
+    {
+        sr_ctl_disconnect(sr);
+        close(shm->cfd);
+        unlink(sr->ctl_path);
+    }
+    if (shm->tfd >= 0)
+    { close(shm->tfd); }
+    close(shm->epfd);
+
+    return 0;
+} /* -- sr_shm_run -- */
+
+const struct sr_netdev_ops sr_netdev_shm =
+{
+    "shm",
+    sr_shm_open,
+    sr_shm_run,
+    sr_shm_send,
+    sr_shm_close,
+    sr_shm_send_batch
+};
@@ -0,0 +1,115 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_shm.h
+ *
+ * Description:
+ *
+ * Shared memory frame transport between the router (sr_shm.c) and a
+ * local traffic source such as sr_shmgen.  One memfd holds a header and,
+ * per router interface, two single producer / single consumer rings:
+ *
+ *   rx  peer -> router, frames arriving on the interface
+ *   tx  router -> peer, frames the router sends out of it
+ *
+ * A ring is a power of two number of fixed size slots.  The producer
+ * owns head, the consumer owns tail; both only ever increase and are
+ * published with release stores.  Each side has an eventfd doorbell and
+ * a "waiting" flag in the header: a side sets its flag before it blocks
+ * on its eventfd, and the other side rings the doorbell only then, so
+ * busy-polling peers never pay for a system call.
+ *
+ * The router listens on a unix socket; a peer connects and receives the
+ * memfd and both eventfds (router first) with SCM_RIGHTS.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_SHM_H
+#define SR_SHM_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#define SR_SHM_MAGIC     0x73727368 /* "srsh" */
+#define SR_SHM_VERSION   1
+#define SR_SHM_SLOTS     1024       /* per ring, power of two */
+#define SR_SHM_SLOT_SIZE 2048       /* uint32_t length + frame */
+#define SR_SHM_FRAME_MAX (SR_SHM_SLOT_SIZE - 4)
+#define SR_SHM_MAX_IFACES 16
+#define SR_SHM_CACHELINE 64
+
+/* ----------------------------------------------------------------------------
+ * struct sr_shm_ring
+ *
+ * Ring control block; the slots follow it in the mapping.  head and tail
+ * sit on their own cache lines so producer and consumer don't share one.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_shm_ring
+{
+    volatile uint32_t head;
+    uint8_t pad0[SR_SHM_CACHELINE - 4];
+    volatile uint32_t tail;
+    uint8_t pad1[SR_SHM_CACHELINE - 4];
+};
+
+struct sr_shm_iface
+{
+    char name[32];
+    uint8_t mac[6];
+    uint8_t pad[2];
+    uint32_t ip;       /* network byte order */
+    uint64_t rx_off;   /* ring offsets from the start of the mapping */
+    uint64_t tx_off;
+};
+
+struct sr_shm_hdr
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t nifs;
+    uint32_t slots;
+    uint32_t slot_size;
+    uint32_t pad;
+    uint64_t size;     /* bytes in the mapping */
+    volatile uint32_t router_waiting;
+    uint8_t pad0[SR_SHM_CACHELINE - 4];
+    volatile uint32_t peer_waiting;
+    uint8_t pad1[SR_SHM_CACHELINE - 4];
+    struct sr_shm_iface ifs[SR_SHM_MAX_IFACES];
+};
+
+#define SR_SHM_RING_BYTES \
+    (sizeof(struct sr_shm_ring) + (uint64_t)SR_SHM_SLOTS * SR_SHM_SLOT_SIZE)
+
+/* -- ring helpers, shared by both ends -- */
+
+static __inline__ uint8_t* sr_shm_slot(struct sr_shm_ring* r, uint32_t idx)
+{
+    return (uint8_t*)(r + 1) + (uint64_t)(idx & (SR_SHM_SLOTS - 1)) * SR_SHM_SLOT_SIZE;
+}
+
+/* slots the producer may still fill */
+static __inline__ uint32_t sr_shm_space(struct sr_shm_ring* r, uint32_t head)
+{
+    return SR_SHM_SLOTS - (head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE));
+}
+
+/* slots the consumer may read */
+static __inline__ uint32_t sr_shm_avail(struct sr_shm_ring* r, uint32_t tail)
+{
+    return __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) - tail;
+}
+
+static __inline__ void sr_shm_cpu_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __asm__ __volatile__("pause");
+#endif
+}
+
+#endif /* -- SR_SHM_H -- */
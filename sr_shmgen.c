@@ -0,0 +1,703 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_shmgen.c
+ *
+ * Description:
+ *
+ * Traffic source for the shared memory transport (see sr_shm.h).  It
+ * attaches to a router started with -d shm:SOCKET, answers the router's
+ * ARP requests on every interface, pushes UDP frames into the rx ring of
+ * one interface and counts what the router forwards out of the others.
+ *
+ *   sr_shmgen -s SOCKET -d DST_IP [-i IFACE] [-S SRC_IP] [-n COUNT] [-l LEN]
+ *             [-F FLOWS] [-R] [-V] [-P EVERY]
+ *
+ * IFACE defaults to the first router interface and SRC_IP to the next
+ * address after the interface's own.
+ *
+ *   -F  cycle over FLOWS source ports, moving on to the next destination
+ *       port every 64512 flows; -F COUNT makes every frame a new flow
+ *   -R  send every forwarded frame back as the destination's reply and
+ *       count those returning on IFACE; at most half a ring of frames is
+ *       kept in flight so neither direction overflows
+ *   -V  check the IP and UDP checksums of everything that comes back
+ *   -P  after every EVERY frames ping the router's address on IFACE and
+ *       report the round trip times of the echo replies; with -R they
+ *       leave the router behind the returning frames
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "sr_protocol.h"
+#include "sr_shm.h"
+
+#define GEN_BURST 32
+#define GEN_SPIN  4096  /* empty polls before blocking */
+#define GEN_UDP   17
+#define GEN_DRAIN 1.0   /* seconds to wait for stragglers */
+#define GEN_WINDOW (SR_SHM_SLOTS / 2) /* -R: frames in flight, so replies fit */
+#define GEN_PORT0  1024  /* first source port */
+#define GEN_DPORT0 9     /* first destination port */
+#define GEN_PORTS  64512 /* source ports per destination port */
+#define GEN_FLOWS_MAX (1UL << 24)
+#define GEN_ICMP   1
+#define GEN_PROBE_LEN 64  /* -P: echo request frame length */
+#define GEN_PROBE_ID  0x5347
+#define GEN_PROBES_MAX (1UL << 20)
+
+static const uint8_t gen_mac[ETHER_ADDR_LEN] = { 0x02, 0x53, 0x48, 0x4d, 0x00, 0x01 };
+
+struct gen
+{
+    struct sr_shm_hdr* hdr;
+    int in;             /* interface we send on */
+    int reflect;        /* -R */
+    int verify;         /* -V */
+    int router_efd;
+    int peer_efd;
+    struct sr_shm_ring* rx[SR_SHM_MAX_IFACES];
+    struct sr_shm_ring* tx[SR_SHM_MAX_IFACES];
+    uint32_t rx_head[SR_SHM_MAX_IFACES];
+    uint32_t tx_tail[SR_SHM_MAX_IFACES];
+    unsigned long forwarded;
+    unsigned long returned;
+    unsigned long reflected;
+    unsigned long bad;
+    unsigned long arps;
+    unsigned long other;
+    unsigned long probes;   /* -P: echo requests sent */
+    unsigned long replies;
+    double* rtt;            /* seconds, one per reply */
+};
+
+static double gen_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+} /* -- gen_now -- */
+
+static uint32_t gen_sum(const void* data, int len, uint32_t sum)
+{
+    const uint8_t* p = data;
+
+    for (; len > 1; len -= 2, p += 2)
+    { sum += (p[0] << 8) | p[1]; }
+    if (len)
+    { sum += p[0] << 8; }
+    return sum;
+} /* -- gen_sum -- */
+
+/* checksum field for a sum, network byte order; 0 means the sum checks */
+static uint16_t gen_fold(uint32_t sum)
+{
+    while (sum >> 16)
+    { sum = (sum & 0xffff) + (sum >> 16); }
+    return htons(~sum & 0xffff);
+} /* -- gen_fold -- */
+
+static uint16_t gen_cksum(const void* data, int len)
+{
+    return gen_fold(gen_sum(data, len, 0));
+} /* -- gen_cksum -- */
+
+/* sum of the UDP pseudo header and datagram */
+static uint32_t gen_udp_sum(const sr_ip_hdr_t* ip, const uint16_t* udp)
+{
+    uint32_t sum = gen_sum(&ip->ip_src, 8, 0);
+
+    sum += GEN_UDP + ntohs(udp[2]);
+    return gen_sum(udp, ntohs(udp[2]), sum);
+} /* -- gen_udp_sum -- */
+
+/*---------------------------------------------------------------------
+ * Method: gen_attach(..)
+ *
+ * Connect to the router, receive memfd and doorbells, map the region.
+ *
+ *---------------------------------------------------------------------*/
+
+static int gen_attach(struct gen* g, const char* path)
+{
+    struct sockaddr_un addr;
+    struct msghdr msg;
+    struct cmsghdr* cmsg;
+    struct iovec iov;
+    struct stat st;
+    union { char buf[CMSG_SPACE(3 * sizeof(int))]; struct cmsghdr align; } u;
+    int fds[3];
+    char c;
+    int fd;
+    uint32_t i;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+    if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0 ||
+        connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0)
+    {
+        perror("connect");
+        return -1;
+    }
+
+    memset(&msg, 0, sizeof(msg));
+    iov.iov_base = &c;
+    iov.iov_len = 1;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = u.buf;
+    msg.msg_controllen = sizeof(u.buf);
+
+    if (recvmsg(fd, &msg, 0) != 1 || (cmsg = CMSG_FIRSTHDR(&msg)) == 0 ||
+        cmsg->cmsg_type != SCM_RIGHTS || cmsg->cmsg_len != CMSG_LEN(sizeof(fds)))
+    {
+        fprintf(stderr, "sr_shmgen: no descriptors from the router\n");
+        return -1;
+    }
+    memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+    g->router_efd = fds[1];
+    g->peer_efd = fds[2];
+
+    /* -- keep fd open: closing it tells the router we are gone -- */
+    if (fstat(fds[0], &st) < 0)
+    { return -1; }
+    g->hdr = mmap(0, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fds[0], 0);
+    close(fds[0]);
+    if ((void*)g->hdr == MAP_FAILED)
+    {
+        perror("mmap");
+        return -1;
+    }
+    if (g->hdr->magic != SR_SHM_MAGIC || g->hdr->version != SR_SHM_VERSION ||
+        g->hdr->slots != SR_SHM_SLOTS || g->hdr->slot_size != SR_SHM_SLOT_SIZE ||
+        g->hdr->nifs > SR_SHM_MAX_IFACES)
+    {
+        fprintf(stderr, "sr_shmgen: region layout mismatch\n");
+        return -1;
+    }
+
+    for (i = 0; i < g->hdr->nifs; i++)
+    {
+        g->rx[i] = (struct sr_shm_ring*)((uint8_t*)g->hdr + g->hdr->ifs[i].rx_off);
+        g->tx[i] = (struct sr_shm_ring*)((uint8_t*)g->hdr + g->hdr->ifs[i].tx_off);
+        g->rx_head[i] = g->rx[i]->head;
+        g->tx_tail[i] = g->tx[i]->tail;
+    }
+    return 0;
+} /* -- gen_attach -- */
+
+static void gen_kick(struct gen* g)
+{
+    uint64_t one = 1;
+
+    if (__atomic_load_n(&g->hdr->router_waiting, __ATOMIC_SEQ_CST))
+    {
+        if (write(g->router_efd, &one, sizeof(one)) < 0)
+        { /* -- router is awake anyway -- */ }
+    }
+} /* -- gen_kick -- */
+
+/*---------------------------------------------------------------------
+ * Method: gen_arp_reply(..)
+ *
+ * Answer an ARP request from the router with our own MAC.
+ *
+ *---------------------------------------------------------------------*/
+
+static void gen_arp_reply(struct gen* g, int i, const uint8_t* req)
+{
+    const sr_arp_hdr_t* rq = (const sr_arp_hdr_t*)(req + sizeof(sr_ethernet_hdr_t));
+    sr_ethernet_hdr_t* eh;
+    sr_arp_hdr_t* ah;
+    uint32_t len = sizeof(*eh) + sizeof(*ah);
+    uint8_t* slot;
+
+    if (sr_shm_space(g->rx[i], g->rx_head[i]) == 0)
+    { return; }
+
+    slot = sr_shm_slot(g->rx[i], g->rx_head[i]);
+    memcpy(slot, &len, 4);
+    eh = (sr_ethernet_hdr_t*)(slot + 4);
+    ah = (sr_arp_hdr_t*)(eh + 1);
+
+    memcpy(eh->ether_dhost, rq->ar_sha, ETHER_ADDR_LEN);
+    memcpy(eh->ether_shost, gen_mac, ETHER_ADDR_LEN);
+    eh->ether_type = htons(ethertype_arp);
+    ah->ar_hrd = htons(arp_hrd_ethernet);
+    ah->ar_pro = htons(ethertype_ip);
+    ah->ar_hln = ETHER_ADDR_LEN;
+    ah->ar_pln = 4;
+    ah->ar_op = htons(arp_op_reply);
+    memcpy(ah->ar_sha, gen_mac, ETHER_ADDR_LEN);
+    ah->ar_sip = rq->ar_tip;
+    memcpy(ah->ar_tha, rq->ar_sha, ETHER_ADDR_LEN);
+    ah->ar_tip = rq->ar_sip;
+
+    g->rx_head[i]++;
+    __atomic_store_n(&g->rx[i]->head, g->rx_head[i], __ATOMIC_RELEASE);
+} /* -- gen_arp_reply -- */
+
+/*---------------------------------------------------------------------
+ * Method: gen_reflect(..)
+ *
+ * Answer a forwarded UDP frame as its destination would: swap addresses
+ * and ports (which leaves the UDP checksum valid) and send it back in.
+ *
+ *---------------------------------------------------------------------*/
+
+static void gen_reflect(struct gen* g, int i, const uint8_t* frame, uint32_t len)
+{
+    sr_ethernet_hdr_t* eh;
+    sr_ip_hdr_t* ip;
+    uint16_t* udp;
+    uint32_t addr;
+    uint16_t port;
+    uint8_t* slot;
+
+    if (sr_shm_space(g->rx[i], g->rx_head[i]) == 0)
+    { return; }
+
+    slot = sr_shm_slot(g->rx[i], g->rx_head[i]);
+    memcpy(slot, &len, 4);
+    memcpy(slot + 4, frame, len);
+    eh = (sr_ethernet_hdr_t*)(slot + 4);
+    ip = (sr_ip_hdr_t*)(eh + 1);
+    udp = (uint16_t*)(ip + 1);
+
+    memcpy(eh->ether_dhost, ((const sr_ethernet_hdr_t*)frame)->ether_shost, ETHER_ADDR_LEN);
+    memcpy(eh->ether_shost, gen_mac, ETHER_ADDR_LEN);
+    addr = ip->ip_src;
+    ip->ip_src = ip->ip_dst;
+    ip->ip_dst = addr;
+    ip->ip_ttl = 64;
+    ip->ip_sum = 0;
+    ip->ip_sum = gen_cksum(ip, sizeof(*ip));
+    port = udp[0];
+    udp[0] = udp[1];
+    udp[1] = port;
+
+    g->rx_head[i]++;
+    __atomic_store_n(&g->rx[i]->head, g->rx_head[i], __ATOMIC_RELEASE);
+    g->reflected++;
+} /* -- gen_reflect -- */
+
+/*---------------------------------------------------------------------
+ * Method: gen_probe(..)
+ *
+ * Queue an ICMP echo request to the router's address on interface i,
+ * stamped with the time it was sent.
+ *
+ *---------------------------------------------------------------------*/
+
+static void gen_probe(struct gen* g, int i, uint32_t src)
+{
+    sr_ethernet_hdr_t* eh;
+    sr_ip_hdr_t* ip;
+    sr_icmp_echo_hdr_t* icmp;
+    uint32_t len = GEN_PROBE_LEN;
+    uint8_t* slot;
+    double now;
+
+    if (sr_shm_space(g->rx[i], g->rx_head[i]) == 0)
+    { return; }
+
+    slot = sr_shm_slot(g->rx[i], g->rx_head[i]);
+    memset(slot, 0, 4 + len);
+    memcpy(slot, &len, 4);
+    eh = (sr_ethernet_hdr_t*)(slot + 4);
+    ip = (sr_ip_hdr_t*)(eh + 1);
+    icmp = (sr_icmp_echo_hdr_t*)(ip + 1);
+
+    memcpy(eh->ether_dhost, g->hdr->ifs[i].mac, ETHER_ADDR_LEN);
+    memcpy(eh->ether_shost, gen_mac, ETHER_ADDR_LEN);
+    eh->ether_type = htons(ethertype_ip);
+    ip->ip_v = 4;
+    ip->ip_hl = 5;
+    ip->ip_len = htons(len - sizeof(*eh));
+    ip->ip_ttl = 64;
+    ip->ip_p = GEN_ICMP;
+    ip->ip_src = src;
+    ip->ip_dst = g->hdr->ifs[i].ip;
+    ip->ip_sum = gen_cksum(ip, sizeof(*ip));
+    icmp->icmp_type = 8;
+    icmp->icmp_id = htons(GEN_PROBE_ID);
+    icmp->icmp_seq = htons((uint16_t)g->probes);
+    now = gen_now();
+    memcpy(icmp + 1, &now, sizeof(now));
+    icmp->icmp_sum = gen_cksum(icmp, len - sizeof(*eh) - sizeof(*ip));
+
+    g->rx_head[i]++;
+    __atomic_store_n(&g->rx[i]->head, g->rx_head[i], __ATOMIC_RELEASE);
+    g->probes++;
+} /* -- gen_probe -- */
+
+/* -- -P: take the round trip time of an echo reply to one of our probes -- */
+static int gen_probe_reply(struct gen* g, const sr_ip_hdr_t* ip, uint32_t len)
+{
+    const sr_icmp_echo_hdr_t* icmp = (const sr_icmp_echo_hdr_t*)(ip + 1);
+    double sent;
+
+    if (!g->rtt || ip->ip_p != GEN_ICMP || len < GEN_PROBE_LEN ||
+        icmp->icmp_type != 0 || icmp->icmp_id != htons(GEN_PROBE_ID))
+    { return 0; }
+    memcpy(&sent, icmp + 1, sizeof(sent));
+    if (g->replies < GEN_PROBES_MAX)
+    { g->rtt[g->replies++] = gen_now() - sent; }
+    return 1;
+} /* -- gen_probe_reply -- */
+
+static int gen_rtt_cmp(const void* a, const void* b)
+{
+    double x = *(const double*)a, y = *(const double*)b;
+
+    return (x > y) - (x < y);
+} /* -- gen_rtt_cmp -- */
+
+/*---------------------------------------------------------------------
+ * Method: gen_drain(..)
+ *
+ * Consume everything the router sent.  Returns the number of frames.
+ *
+ *---------------------------------------------------------------------*/
+
+static unsigned int gen_drain(struct gen* g)
+{
+    unsigned int total = 0, n, k;
+    uint32_t i, len;
+    uint8_t* slot;
+    sr_ethernet_hdr_t* eh;
+    sr_arp_hdr_t* ah;
+
+    for (i = 0; i < g->hdr->nifs; i++)
+    {
+        n = sr_shm_avail(g->tx[i], g->tx_tail[i]);
+        for (k = 0; k < n; k++)
+        {
+            slot = sr_shm_slot(g->tx[i], g->tx_tail[i] + k);
+            memcpy(&len, slot, 4);
+            eh = (sr_ethernet_hdr_t*)(slot + 4);
+            ah = (sr_arp_hdr_t*)(eh + 1);
+
+            if (ntohs(eh->ether_type) == ethertype_arp)
+            {
+                if (len >= sizeof(*eh) + sizeof(*ah) &&
+                    ntohs(ah->ar_op) == arp_op_request)
+                {
+                    gen_arp_reply(g, i, slot + 4);
+                    g->arps++;
+                }
+            }
+            else if (memcmp(eh->ether_dhost, gen_mac, ETHER_ADDR_LEN) == 0 &&
+                     ntohs(eh->ether_type) == ethertype_ip &&
+                     ((sr_ip_hdr_t*)(eh + 1))->ip_p == GEN_UDP)
+            {
+                sr_ip_hdr_t* ip = (sr_ip_hdr_t*)(eh + 1);
+                uint16_t* udp = (uint16_t*)(ip + 1);
+
+                if (g->verify &&
+                    (gen_cksum(ip, sizeof(*ip)) != 0 ||
+                     (udp[3] != 0 && gen_fold(gen_udp_sum(ip, udp)) != 0)))
+                { g->bad++; }
+
+                if ((int)i == g->in)
+                { g->returned++; }
+                else
+                {
+                    g->forwarded++;
+                    if (g->reflect)
+                    { gen_reflect(g, i, slot + 4, len); }
+                }
+            }
+            else if (memcmp(eh->ether_dhost, gen_mac, ETHER_ADDR_LEN) == 0 &&
+                     ntohs(eh->ether_type) == ethertype_ip &&
+                     gen_probe_reply(g, (sr_ip_hdr_t*)(eh + 1), len))
+            { /* -- counted in rtt -- */ }
+            else
+            { g->other++; }
+        }
+        g->tx_tail[i] += n;
+        __atomic_store_n(&g->tx[i]->tail, g->tx_tail[i], __ATOMIC_RELEASE);
+        total += n;
+    }
+    if (total > 0)
+    { gen_kick(g); }
+
+    return total;
+} /* -- gen_drain -- */
+
+/*---------------------------------------------------------------------
+ * Method: gen_wait(..)
+ *
+ * Block on our doorbell until the router produces or frees something.
+ *
+ *---------------------------------------------------------------------*/
+
+static void gen_wait(struct gen* g, int in, int timeout_ms)
+{
+    struct pollfd pfd;
+    uint64_t val;
+    uint32_t i;
+    int ready = 0;
+
+    __atomic_store_n(&g->hdr->peer_waiting, 1, __ATOMIC_SEQ_CST);
+
+    /* -- re-check after publishing the flag, or a wakeup could be lost -- */
+    for (i = 0; i < g->hdr->nifs; i++)
+    {
+        if (sr_shm_avail(g->tx[i], g->tx_tail[i]) > 0)
+        { ready = 1; }
+    }
+    if (in >= 0 && sr_shm_space(g->rx[in], g->rx_head[in]) > 0)
+    { ready = 1; }
+
+    if (!ready)
+    {
+        pfd.fd = g->peer_efd;
+        pfd.events = POLLIN;
+        if (poll(&pfd, 1, timeout_ms) > 0 &&
+            read(g->peer_efd, &val, sizeof(val)) < 0)
+        { /* -- drained elsewhere -- */ }
+    }
+    __atomic_store_n(&g->hdr->peer_waiting, 0, __ATOMIC_SEQ_CST);
+} /* -- gen_wait -- */
+
+static void usage(const char* argv0)
+{
+    fprintf(stderr, "Usage: %s -s socket -d dst_ip [-i iface] [-S src_ip] "
+            "[-n count] [-l frame length] [-F flows] [-R] [-V] [-P every]\n", argv0);
+} /* -- usage -- */
+
+int main(int argc, char** argv)
+{
+    struct gen g;
+    uint8_t tmpl[SR_SHM_FRAME_MAX];
+    sr_ethernet_hdr_t* eh = (sr_ethernet_hdr_t*)tmpl;
+    sr_ip_hdr_t* ip = (sr_ip_hdr_t*)(eh + 1);
+    uint16_t* udp = (uint16_t*)(ip + 1);
+    const char* path = 0;
+    const char* iface = 0;
+    struct in_addr dst, src;
+    unsigned long count = 1000000, flows = 1, sent = 0, last, moved = 0;
+    unsigned long probe_every = 0, next_probe = 0;
+    unsigned int len = 64, k, n, idle = 0;
+    uint32_t head, len32, base_sum;
+    unsigned long flow;
+    uint16_t sport, dport;
+    double start, end, drain, progress;
+    int c, in = -1, have_src = 0;
+    uint32_t i;
+
+    memset(&g, 0, sizeof(g));
+    dst.s_addr = 0;
+    while ((c = getopt(argc, argv, "hs:d:i:S:n:l:F:RVP:")) != EOF)
+    {
+        switch (c)
+        {
+            case 'F': flows = strtoul(optarg, 0, 10); break;
+            case 'R': g.reflect = 1; break;
+            case 'V': g.verify = 1; break;
+            case 'P': probe_every = strtoul(optarg, 0, 10); break;
+            case 's': path = optarg; break;
+            case 'i': iface = optarg; break;
+            case 'n': count = strtoul(optarg, 0, 10); break;
+            case 'l': len = atoi(optarg); break;
+            case 'd':
+                if (inet_aton(optarg, &dst) == 0)
+                { usage(argv[0]); return 1; }
+                break;
+            case 'S':
+                if (inet_aton(optarg, &src) == 0)
+                { usage(argv[0]); return 1; }
+                have_src = 1;
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if (!path || dst.s_addr == 0 || flows == 0 || flows > GEN_FLOWS_MAX)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+    if (len < sizeof(*eh) + sizeof(*ip) + 8)
+    { len = sizeof(*eh) + sizeof(*ip) + 8; }
+    if (len > SR_SHM_FRAME_MAX)
+    { len = SR_SHM_FRAME_MAX; }
+
+    if (gen_attach(&g, path) != 0)
+    { return 1; }
+    if (probe_every)
+    {
+        n = count / probe_every + 1;
+        if ((g.rtt = malloc(sizeof(double) * (n < GEN_PROBES_MAX ? n : GEN_PROBES_MAX))) == 0)
+        { return 1; }
+        next_probe = probe_every;
+    }
+
+    for (i = 0; i < g.hdr->nifs; i++)
+    {
+        if (!iface || strcmp(g.hdr->ifs[i].name, iface) == 0)
+        {
+            in = i;
+            break;
+        }
+    }
+    if (in < 0)
+    {
+        fprintf(stderr, "sr_shmgen: no interface %s\n", iface);
+        return 1;
+    }
+    g.in = in;
+    if (!have_src)
+    { src.s_addr = htonl(ntohl(g.hdr->ifs[in].ip) + 1); }
+
+    /* -- frame template: UDP from src to dst, via the router's iface -- */
+    memset(tmpl, 0, sizeof(tmpl));
+    memcpy(eh->ether_dhost, g.hdr->ifs[in].mac, ETHER_ADDR_LEN);
+    memcpy(eh->ether_shost, gen_mac, ETHER_ADDR_LEN);
+    eh->ether_type = htons(ethertype_ip);
+    ip->ip_v = 4;
+    ip->ip_hl = 5;
+    ip->ip_len = htons(len - sizeof(*eh));
+    ip->ip_ttl = 64;
+    ip->ip_p = GEN_UDP;
+    ip->ip_src = src.s_addr;
+    ip->ip_dst = dst.s_addr;
+    ip->ip_sum = gen_cksum(ip, sizeof(*ip));
+    udp[0] = 0;
+    udp[1] = 0;
+    udp[2] = htons(len - sizeof(*eh) - sizeof(*ip));
+    udp[3] = 0;
+
+    /* -- UDP sum without the ports, added per flow -- */
+    base_sum = gen_udp_sum(ip, udp);
+    udp[0] = htons(GEN_PORT0);
+    udp[1] = htons(GEN_DPORT0);
+    udp[3] = gen_fold(base_sum + GEN_PORT0 + GEN_DPORT0);
+
+    printf("sr_shmgen: %lu x %u byte frames into %s, %s -> ",
+           count, len, g.hdr->ifs[in].name, inet_ntoa(src));
+    printf("%s, %lu flow(s)\n", inet_ntoa(dst), flows);
+
+    len32 = len;
+    start = progress = gen_now();
+    while (sent < count)
+    {
+        /* -- router rewrites frames in place, so refill every slot -- */
+        head = g.rx_head[in];
+        n = sr_shm_space(g.rx[in], head);
+        if (n > GEN_BURST)
+        { n = GEN_BURST; }
+        if (n > count - sent)
+        { n = count - sent; }
+        if (g.reflect && sent - g.returned + n > GEN_WINDOW)
+        { n = (sent - g.returned < GEN_WINDOW) ? GEN_WINDOW - (sent - g.returned) : 0; }
+        for (k = 0; k < n; k++)
+        {
+            uint8_t* slot = sr_shm_slot(g.rx[in], head + k);
+            memcpy(slot, &len32, 4);
+            memcpy(slot + 4, tmpl, len);
+            if (flows > 1)
+            {
+                uint16_t* u = (uint16_t*)(slot + 4 + sizeof(*eh) + sizeof(*ip));
+
+                flow = (sent + k) % flows;
+                sport = GEN_PORT0 + flow % GEN_PORTS;
+                dport = GEN_DPORT0 + flow / GEN_PORTS;
+                u[0] = htons(sport);
+                u[1] = htons(dport);
+                u[3] = gen_fold(base_sum + sport + dport);
+            }
+        }
+        if (n > 0)
+        {
+            g.rx_head[in] = head + n;
+            __atomic_store_n(&g.rx[in]->head, head + n, __ATOMIC_RELEASE);
+            sent += n;
+            if (probe_every && sent >= next_probe)
+            {
+                gen_probe(&g, in, src.s_addr);
+                next_probe += probe_every;
+            }
+            gen_kick(&g);
+        }
+
+        if (gen_drain(&g) > 0 || n > 0)
+        {
+            idle = 0;
+            continue;
+        }
+        if (++idle < GEN_SPIN)
+        {
+            sr_shm_cpu_relax();
+            continue;
+        }
+        gen_wait(&g, in, 100);
+        idle = 0;
+
+        /* -- with -R, frames the router dropped hold the window shut -- */
+        if (sent + g.forwarded + g.returned != moved)
+        {
+            moved = sent + g.forwarded + g.returned;
+            progress = gen_now();
+        }
+        else if (gen_now() - progress > GEN_DRAIN)
+        {
+            fprintf(stderr, "sr_shmgen: no progress, stopping\n");
+            break;
+        }
+    }
+
+    /* -- wait for the router to catch up -- */
+    drain = gen_now();
+    last = g.forwarded + g.returned;
+    while ((g.forwarded < sent || (g.reflect && g.returned < g.forwarded) ||
+            g.replies < g.probes) &&
+           gen_now() - drain < GEN_DRAIN)
+    {
+        if (gen_drain(&g) == 0)
+        { gen_wait(&g, -1, 10); }
+        if (g.forwarded + g.returned != last)
+        {
+            last = g.forwarded + g.returned;
+            drain = gen_now();
+        }
+    }
+    end = drain;
+
+    printf("sent %lu, forwarded %lu, returned %lu, arp %lu, other %lu, "
+           "bad checksums %lu in %.3f s\n", sent, g.forwarded, g.returned,
+           g.arps, g.other, g.bad, end - start);
+    printf("%.3f Mpps offered, %.3f Mpps forwarded, %.3f Mpps returned\n",
+           sent / (end - start) / 1e6, g.forwarded / (end - start) / 1e6,
+           g.returned / (end - start) / 1e6);
+
+    if (g.replies > 0)
+    {
+        qsort(g.rtt, g.replies, sizeof(double), gen_rtt_cmp);
+        printf("probes %lu, replies %lu, rtt p50 %.1f us, p99 %.1f us, max %.1f us\n",
+               g.probes, g.replies, g.rtt[g.replies / 2] * 1e6,
+               g.rtt[g.replies * 99 / 100] * 1e6, g.rtt[g.replies - 1] * 1e6);
+    }
+    else if (g.probes > 0)
+    { printf("probes %lu, no replies\n", g.probes); }
+
+    return (g.forwarded == sent && g.bad == 0 &&
+            (!g.reflect || g.returned == g.forwarded)) ? 0 : 2;
+} /* -- main -- */
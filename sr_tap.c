@@ -0,0 +1,479 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_tap.c
+ *
+ * Description:
+ *
+ * Linux TAP netdev backend.  Every router interface is bound to a TAP
+ * device (see the interface file in sr_netdev.h), so the router can
+ * forward between network namespaces on one host without the VNS tunnel.
+ *
+ * With -q N the devices are opened with IFF_MULTI_QUEUE and N queues
+ * each.  Receive thread q owns queue q of every device and transmits on
+ * the same queue, so threads never share a descriptor.  Thread 0 is the
+ * calling thread and also runs the ARP tick and the control socket.
+ * With more than one queue the ARP cache is locked; the packet counters
+ * are plain increments and only approximate in that case.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <net/if.h>
+
+#include "sr_router.h"
+#include "sr_netdev.h"
+#include "sr_arpcache.h"
+#include "sr_egress.h"
+
+#ifdef _LINUX_
+#include <linux/if_tun.h>
+#endif /* _LINUX_ */
+
+#define SR_TAP_BURST     32
+#define SR_TAP_FRAME_MAX 10000 /* same limit as a VNS command */
+#define SR_TAP_EVENTS    16
+
+/* epoll tags: devices use their index, the rest are flagged */
+#define SR_TAP_EV_TIMER  (1ULL << 32)
+#define SR_TAP_EV_CTL    (2ULL << 32)
+#define SR_TAP_EV_CLIENT (3ULL << 32)
+#define SR_TAP_EV_PACER  (4ULL << 32)
+
+struct sr_tap;
+
+struct sr_tap_worker
+{
+    struct sr_instance* sr;
+    struct sr_tap* tap;
+    int queue;
+    int ret;
+    pthread_t thread;
+};
+
+struct sr_tap
+{
+    int fds[SR_NETDEV_MAX_IFACES][SR_NETDEV_MAX_QUEUES];
+    int nifs;
+    int nqueues;
+    volatile int stop;
+    struct sr_tap_worker workers[SR_NETDEV_MAX_QUEUES];
+};
+
+/* queue the calling thread transmits on; threads other than the receive
+ * threads (e.g. the control socket) use queue 0 */
+static __thread int sr_tap_queue = 0;
+
+/*---------------------------------------------------------------------
+ * Method: sr_tap_open_queue(..)
+ * Scope:  Local
+ *
+ * Attach one queue to TAP device name.  Returns the descriptor or -1.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_tap_open_queue(const char* name, int multi_queue)
+{
+    struct ifreq ifr;
+    int fd;
+
+    if ((fd = open("/dev/net/tun", O_RDWR | O_CLOEXEC)) < 0)
+    {
+        perror("open(/dev/net/tun):sr_tap.c::sr_tap_open_queue");
+        return -1;
+    }
+
+    memset(&ifr, 0, sizeof(ifr));
+    ifr.ifr_flags = IFF_TAP | IFF_NO_PI | (multi_queue ? IFF_MULTI_QUEUE : 0);
+    strncpy(ifr.ifr_name, name, IFNAMSIZ - 1);
+    if (ioctl(fd, TUNSETIFF, &ifr) < 0)
+    {
+        fprintf(stderr, "TUNSETIFF %s: %s\n", name, strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    return fd;
+} /* -- sr_tap_open_queue -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_tap_set_up(..)
+ * Scope:  Local
+ *
+ * Bring the device up so it passes traffic once the peer side is set.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_tap_set_up(const char* name)
+{
+    struct ifreq ifr;
+    int s;
+
+    if ((s = socket(AF_INET, SOCK_DGRAM, 0)) < 0)
+    { return; }
+
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, name, IFNAMSIZ - 1);
+    if (ioctl(s, SIOCGIFFLAGS, &ifr) == 0 && !(ifr.ifr_flags & IFF_UP))
+    {
+        ifr.ifr_flags |= IFF_UP;
+        if (ioctl(s, SIOCSIFFLAGS, &ifr) < 0)
+        { fprintf(stderr, "cannot bring up %s: %s\n", name, strerror(errno)); }
+    }
+    close(s);
+} /* -- sr_tap_set_up -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_tap_close(..)
+ * Scope:  Local
+ *---------------------------------------------------------------------*/
+
+static void sr_tap_close(struct sr_instance* sr)
+{
+    struct sr_tap* tap = sr->netdev_priv;
+    int i, q;
+
+    if (!tap)
+    { return; }
+
+    for (i = 0; i < tap->nifs; i++)
+    {
+        for (q = 0; q < tap->nqueues; q++)
+        {
+            if (tap->fds[i][q] >= 0)
+            { close(tap->fds[i][q]); }
+        }
+    }
+    free(tap);
+    sr->netdev_priv = 0;
+} /* -- sr_tap_close -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_tap_open(..)
+ * Scope:  Local
+ *
+ * Open netdev_conf.queues queues on the device of every interface.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_tap_open(struct sr_instance* sr)
+{
+    struct sr_netdev_conf* conf = &(sr->netdev_conf);
+    struct sr_tap* tap;
+    int i, q;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+    assert(conf->queues >= 1 && conf->queues <= SR_NETDEV_MAX_QUEUES);
+
+    if ((tap = (struct sr_tap*)calloc(1, sizeof(*tap))) == 0)
+    {
+        fprintf(stderr, "Error: out of memory (sr_tap_open)\n");
+        return -1;
+    }
+    memset(tap->fds, -1, sizeof(tap->fds));
+    tap->nifs = conf->nifs;
+    tap->nqueues = conf->queues;
+    sr->netdev_priv = tap;
+
+    for (i = 0; i < conf->nifs; i++)
+    {
+        for (q = 0; q < conf->queues; q++)
+        {
+            tap->fds[i][q] = sr_tap_open_queue(conf->ifs[i].device,
+                                               conf->queues > 1);
+            if (tap->fds[i][q] < 0)
+            {
+                sr_tap_close(sr);
+                return -1;
+            }
+        }
+        sr_tap_set_up(conf->ifs[i].device);
+        printf("%s on tap %s, %d queue(s)\n", conf->ifs[i].name,
+               conf->ifs[i].device, conf->queues);
+    }
+
+    return 0;
+} /* -- sr_tap_open -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_tap_add(..)
+ * Scope:  Local
+ *---------------------------------------------------------------------*/
+
+static int sr_tap_add(int epfd, int fd, uint64_t tag)
+{
+    struct epoll_event ev;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.u64 = tag;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0)
+    {
+        perror("epoll_ctl(..):sr_tap.c::sr_tap_add(..)");
+        return -1;
+    }
+    return 0;
+} /* -- sr_tap_add -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_tap_rx(..)
+ * Scope:  Local
+ *
+ * Read up to a burst of frames from one queue and route them.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_tap_rx(struct sr_instance* sr, int fd, char* ifname,
+                      uint8_t** pkts)
+{
+    unsigned int lens[SR_TAP_BURST];
+    char* names[SR_TAP_BURST];
+    unsigned int count = 0;
+    ssize_t n;
+
+    while (count < SR_TAP_BURST)
+    {
+        n = read(fd, pkts[count], SR_TAP_FRAME_MAX);
+        sr->stats.syscalls++;
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            { continue; }
+            break; /* -- EAGAIN: queue drained -- */
+        }
+        if (n < (ssize_t)sizeof(struct sr_ethernet_hdr))
+        { continue; }
+
+        lens[count] = n;
+        names[count] = ifname;
+        sr->stats.rx_packets++;
+        sr->stats.rx_bytes += n;
+        count++;
+    }
+
+    if (count > 0)
+    { sr_handlepacket_burst(sr, pkts, lens, names, count); }
+} /* -- sr_tap_rx -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_tap_worker(..)
+ * Scope:  Local
+ *
+ * Receive loop of one queue.  Worker 0 also runs the ARP tick and the
+ * control socket, like sr_reactor_run does for the VNS socket.
+ *
+ *---------------------------------------------------------------------*/
+
+static void* sr_tap_worker(void* arg)
+{
+    struct sr_tap_worker* w = arg;
+    struct sr_instance* sr = w->sr;
+    struct sr_tap* tap = w->tap;
+    struct epoll_event events[SR_TAP_EVENTS];
+    struct itimerspec its;
+    uint8_t* pkts[SR_TAP_BURST];
+    uint8_t* pool;
+    uint64_t tag, expirations;
+    int epfd, tfd = -1, cfd = -1;
+    int i, n;
+
+    sr_tap_queue = w->queue;
+    w->ret = -1;
+
+    if ((pool = malloc((size_t)SR_TAP_BURST * SR_TAP_FRAME_MAX)) == 0)
+    {
+        fprintf(stderr, "Error: out of memory (sr_tap_worker)\n");
+        tap->stop = 1;
+        return NULL;
+    }
+    for (i = 0; i < SR_TAP_BURST; i++)
+    { pkts[i] = pool + (size_t)i * SR_TAP_FRAME_MAX; }
+
+    if ((epfd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+    {
+        perror("epoll_create1(..):sr_tap.c::sr_tap_worker");
+        free(pool);
+        tap->stop = 1;
+        return NULL;
+    }
+
+    for (i = 0; i < tap->nifs; i++)
+    { sr_tap_add(epfd, tap->fds[i][w->queue], (uint64_t)i); }
+
+    if (w->queue == 0)
+    {
+        tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (tfd >= 0)
+        {
+            memset(&its, 0, sizeof(its));
+            its.it_value.tv_sec = 1;
+            its.it_interval.tv_sec = 1;
+            timerfd_settime(tfd, 0, &its, 0);
+            sr_tap_add(epfd, tfd, SR_TAP_EV_TIMER);
+        }
+        if (sr_egress_timer_fd(sr) >= 0)
+        { sr_tap_add(epfd, sr_egress_timer_fd(sr), SR_TAP_EV_PACER); }
+        if (sr->ctl_path[0] != '\0' && (cfd = sr_ctl_listen(sr->ctl_path)) >= 0)
+        { sr_tap_add(epfd, cfd, SR_TAP_EV_CTL); }
+    }
+
+    while (!tap->stop)
+    {
+        /* -- wake up now and then to notice stop -- */
+        n = epoll_wait(epfd, events, SR_TAP_EVENTS, 1000);
+        sr->stats.syscalls++;
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            { continue; }
+            perror("epoll_wait(..):sr_tap.c::sr_tap_worker");
+            tap->stop = 1;
+            break;
+        }
+
+        for (i = 0; i < n; i++)
+        {
+            tag = events[i].data.u64;
+
+            if (tag < SR_NETDEV_MAX_IFACES)
+            {
+                sr_tap_rx(sr, tap->fds[tag][w->queue],
+                          sr->netdev_conf.ifs[tag].name, pkts);
+            }
+            else if (tag == SR_TAP_EV_TIMER)
+            {
+                if (read(tfd, &expirations, sizeof(expirations)) > 0 &&
+                    sr_arpcache_tick(sr))
+                { tap->stop = 1; }
+            }
+            else if (tag == SR_TAP_EV_PACER)
+            {
+                sr_egress_timer(sr);
+            }
+            else if (tag == SR_TAP_EV_CTL)
+            {
+                int fd = sr_ctl_accept(sr, cfd);
+                if (fd >= 0 && sr_tap_add(epfd, fd, SR_TAP_EV_CLIENT | fd) < 0)
+                { sr_ctl_close(fd); }
+            }
+            else
+            {
+                /* -- control client -- */
+                sr_ctl_serve_epoll(sr, epfd, (int)(tag & 0xffffffffULL), tag);
+            }
+        }
+    }
+
+    if (cfd >= 0)
+    {
+        sr_ctl_disconnect(sr);
+        close(cfd);
+        unlink(sr->ctl_path);
+    }
+    if (tfd >= 0)
+    { close(tfd); }
+    close(epfd);
+    free(pool);
+
+    w->ret = 0;
+    return NULL;
+} /* -- sr_tap_worker -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_tap_run(..)
+ * Scope:  Local
+ *
+ * Start a receive thread for queues 1..N-1 and serve queue 0 from the
+ * calling thread.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_tap_run(struct sr_instance* sr)
+{
+    struct sr_tap* tap = sr->netdev_priv;
+    int q, err;
+
+    /* -- REQUIRES -- */
+    assert(tap);
+
+    sr->cache.use_locks = tap->nqueues > 1;
+
+    for (q = 0; q < tap->nqueues; q++)
+    {
+        tap->workers[q].sr = sr;
+        tap->workers[q].tap = tap;
+        tap->workers[q].queue = q;
+    }
+
+    for (q = 1; q < tap->nqueues; q++)
+    {
+        if ((err = pthread_create(&tap->workers[q].thread, 0, sr_tap_worker,
+                                  &tap->workers[q])) != 0)
+        {
+            fprintf(stderr, "pthread_create: %s\n", strerror(err));
+            tap->stop = 1;
+            tap->nqueues = q; /* -- only join what was started -- */
+            break;
+        }
+    }
+
+    sr_tap_worker(&tap->workers[0]);
+
+    tap->stop = 1;
+    for (q = 1; q < tap->nqueues; q++)
+    { pthread_join(tap->workers[q].thread, 0); }
+
+    return tap->workers[0].ret;
+} /* -- sr_tap_run -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_tap_send(..)
+ * Scope:  Local
+ *
+ * Write one frame to the calling thread's queue of iface's device.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_tap_send(struct sr_instance* sr, const uint8_t* buf,
+                       unsigned int len, const char* iface)
+{
+    struct sr_tap* tap = sr->netdev_priv;
+    struct sr_netdev_if* nif;
+    int idx, q;
+    ssize_t n;
+
+    if (!tap || (nif = sr_netdev_find_if(sr, iface)) == 0)
+    { return -1; }
+
+    idx = nif - sr->netdev_conf.ifs;
+    q = sr_tap_queue < tap->nqueues ? sr_tap_queue : 0;
+
+    do
+    {
+        n = write(tap->fds[idx][q], buf, len);
+        sr->stats.syscalls++;
+    } while (n < 0 && errno == EINTR);
+
+    return n == (ssize_t)len ? 0 : -1;
+} /* -- sr_tap_send -- */
+
+const struct sr_netdev_ops sr_netdev_tap =
+{
+    "tap",
+    sr_tap_open,
+    sr_tap_run,
+    sr_tap_send,
+    sr_tap_close
+};
@@ -0,0 +1,407 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_trace.c
+ *
+ * Description:
+ *
+ * Per thread trace rings and the thread that drains them, see sr_trace.h.
+ *
+ * A thread gets its ring on its first record.  Rings are never freed
+ * while the trace runs, so a thread that exits leaves its last records
+ * to be drained like any other.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "sr_trace.h"
+#include "sr_common.h"
+
+#define SR_TRACE_CACHELINE 64
+
+/* ----------------------------------------------------------------------------
+ * struct sr_trace_ring
+ *
+ * head is written by the owning thread only, tail by the trace thread
+ * only; both only ever increase and are published with release stores,
+ * as in sr_shm.h.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_trace_ring
+{
+    uint32_t head;
+    uint8_t pad0[SR_TRACE_CACHELINE - 4];
+    uint32_t tail;
+    uint32_t dropped;   /* full ring, taken by the trace thread */
+    uint32_t thread;    /* index in sr_trace_rings */
+    uint8_t pad1[SR_TRACE_CACHELINE - 12];
+    struct sr_trace_rec recs[SR_TRACE_RING];
+};
+
+int sr_trace_level = 0;
+
+const struct sr_trace_event_desc sr_trace_events[SR_EV_COUNT] =
+{
+    { "trace_dropped",   "thread:u records:u" },
+    { "rx_frame",        "ethertype:x len:u" },
+    { "ip_bad_version",  "src:ip dst:ip version:u" },
+    { "ip_bad_cksum",    "src:ip dst:ip sum:x" },
+    { "ip_bad_len",      "src:ip dst:ip len:u need:u" },
+    { "icmp_sent",       "dst:ip type:u code:u" },
+    { "arp_gave_up",     "ip:ip packets:u" },
+    { "send_short",      "len:u" },
+    { "send_no_iface",   "" },
+    { "send_bad_src",    "" },
+    { "send_failed",     "len:u" },
+    { "vns_unknown_cmd", "command:u len:u" },
+    { "vns_lost",        "drops:u" },
+    { "vns_reopened",    "attempts:u us:u" }
+};
+
+static const char* sr_trace_level_names[] =
+{ "off", "error", "warn", "info", "debug" };
+
+static struct sr_trace_ring* sr_trace_rings[SR_TRACE_THREADS];
+static unsigned int sr_trace_nrings = 0;     /* published with release */
+static pthread_mutex_t sr_trace_reg_lock = PTHREAD_MUTEX_INITIALIZER;
+static __thread struct sr_trace_ring* sr_trace_self = 0;
+static __thread int sr_trace_refused = 0;    /* no ring left for the thread */
+
+static FILE* sr_trace_file = 0;
+static char sr_trace_path[256];
+static pthread_t sr_trace_thread;
+static volatile int sr_trace_stopping = 0;
+static uint64_t sr_trace_written = 0;        /* trace thread only */
+static uint64_t sr_trace_lost = 0;
+static uint32_t sr_trace_unowned = 0;        /* records of threads refused a ring */
+
+/*---------------------------------------------------------------------
+ * Method: sr_trace_register(..)
+ * Scope:  Local
+ *
+ * Give the calling thread a ring, or NULL once SR_TRACE_THREADS threads
+ * have one.  Runs once per thread, so it may take a lock.
+ *
+ *---------------------------------------------------------------------*/
+
+static struct sr_trace_ring* sr_trace_register(void)
+{
+    struct sr_trace_ring* ring = 0;
+    unsigned int n;
+
+    pthread_mutex_lock(&sr_trace_reg_lock);
+    n = __atomic_load_n(&sr_trace_nrings, __ATOMIC_ACQUIRE);
+    if (n < SR_TRACE_THREADS &&
+        (ring = (struct sr_trace_ring*)calloc(1, sizeof(*ring))) != 0)
+    {
+        ring->thread = n;
+        sr_trace_rings[n] = ring;
+        __atomic_store_n(&sr_trace_nrings, n + 1, __ATOMIC_RELEASE);
+        sr_trace_self = ring;
+    }
+    else
+    { sr_trace_refused = 1; }
+    pthread_mutex_unlock(&sr_trace_reg_lock);
+    return ring;
+} /* -- sr_trace_register -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_trace_emit(..)
+ * Scope:  Global
+ *
+ * Append a record to the calling thread's ring, called by SR_TRACE.
+ * Never blocks: a record that does not fit is counted as dropped.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_trace_emit(int level, int event, uint32_t a0, uint32_t a1,
+                   uint32_t a2, uint32_t a3)
+{
+    struct sr_trace_ring* ring = sr_trace_self;
+    struct sr_trace_rec* rec;
+    uint32_t head;
+
+    if (ring == 0)
+    {
+        if (sr_trace_refused || (ring = sr_trace_register()) == 0)
+        {
+            __atomic_fetch_add(&sr_trace_unowned, 1, __ATOMIC_RELAXED);
+            return;
+        }
+    }
+
+    head = ring->head;
+    if (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) >= SR_TRACE_RING)
+    {
+        __atomic_fetch_add(&ring->dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    rec = &ring->recs[head & (SR_TRACE_RING - 1)];
+    rec->ts = sr_now_ns();
+    rec->event = (uint16_t)event;
+    rec->level = (uint8_t)level;
+    rec->thread = (uint8_t)ring->thread;
+    rec->arg[0] = a0;
+    rec->arg[1] = a1;
+    rec->arg[2] = a2;
+    rec->arg[3] = a3;
+    rec->pad = 0;
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+} /* -- sr_trace_emit -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_trace_drain(..)
+ * Scope:  Local
+ *
+ * Move every ring's records to the trace file, each ring's losses since
+ * the last drain becoming a trace_dropped record.  Trace thread only.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_trace_drain(void)
+{
+    unsigned int i, n = __atomic_load_n(&sr_trace_nrings, __ATOMIC_ACQUIRE);
+    struct sr_trace_ring* ring;
+    struct sr_trace_rec drop;
+    uint32_t head, tail, run, lost;
+
+    for (i = 0; i < n; i++)
+    {
+        ring = sr_trace_rings[i];
+        head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        tail = ring->tail;
+
+        /* -- at most two runs, the second after the ring wraps -- */
+        while (tail != head)
+        {
+            run = SR_TRACE_RING - (tail & (SR_TRACE_RING - 1));
+            if (run > head - tail)
+            { run = head - tail; }
+            fwrite(&ring->recs[tail & (SR_TRACE_RING - 1)],
+                   sizeof(struct sr_trace_rec), run, sr_trace_file);
+            tail += run;
+            sr_trace_written += run;
+        }
+        __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+
+        if ((lost = __atomic_exchange_n(&ring->dropped, 0, __ATOMIC_RELAXED)) != 0)
+        {
+            memset(&drop, 0, sizeof(drop));
+            drop.ts = sr_now_ns();
+            drop.event = SR_EV_TRACE_DROPPED;
+            drop.level = SR_TRACE_WARN;
+            drop.thread = (uint8_t)ring->thread;
+            drop.arg[0] = ring->thread;
+            drop.arg[1] = lost;
+            fwrite(&drop, sizeof(drop), 1, sr_trace_file);
+            sr_trace_lost += lost;
+        }
+    }
+    fflush(sr_trace_file);
+} /* -- sr_trace_drain -- */
+
+static void* sr_trace_run(void* arg)
+{
+    struct timespec ts;
+
+    ts.tv_sec = 0;
+    ts.tv_nsec = SR_TRACE_FLUSH_MS * 1000000L;
+    while (!sr_trace_stopping)
+    {
+        nanosleep(&ts, 0);
+        sr_trace_drain();
+    }
+    return 0;
+} /* -- sr_trace_run -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_trace_start(..)
+ * Scope:  Global
+ *
+ * Create the trace file at path, start the trace thread and record
+ * events up to level from then on.  Once per process; sr_trace_stop
+ * runs at exit.  Returns 0, or -1 with a message on stderr.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_trace_start(const char* path, int level)
+{
+    struct sr_trace_file_hdr hdr;
+    int err;
+
+    if (sr_trace_file)
+    {
+        fprintf(stderr, "trace: already writing %s\n", sr_trace_path);
+        return -1;
+    }
+    if ((sr_trace_file = fopen(path, "wb")) == 0)
+    {
+        fprintf(stderr, "trace: cannot create %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    strncpy(sr_trace_path, path, sizeof(sr_trace_path) - 1);
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, SR_TRACE_MAGIC, sizeof(SR_TRACE_MAGIC));
+    hdr.version = SR_TRACE_VERSION;
+    hdr.rec_size = sizeof(struct sr_trace_rec);
+    hdr.mono_ns = sr_now_ns();
+    hdr.real_ns = sr_clock_ns(CLOCK_REALTIME);
+    fwrite(&hdr, sizeof(hdr), 1, sr_trace_file);
+    fflush(sr_trace_file);
+
+    if ((err = pthread_create(&sr_trace_thread, 0, sr_trace_run, 0)) != 0)
+    {
+        fprintf(stderr, "trace: pthread_create: %s\n", strerror(err));
+        fclose(sr_trace_file);
+        sr_trace_file = 0;
+        return -1;
+    }
+    sr_trace_level = level;
+    atexit(sr_trace_stop);
+    return 0;
+} /* -- sr_trace_start -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_trace_stop(..)
+ * Scope:  Global
+ *
+ * Stop recording, drain what is left and close the file.  The rings
+ * stay allocated for threads that may still be in sr_trace_emit.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_trace_stop(void)
+{
+    if (sr_trace_file == 0)
+    { return; }
+    sr_trace_level = 0;
+    sr_trace_stopping = 1;
+    pthread_join(sr_trace_thread, 0);
+    sr_trace_drain();
+    fclose(sr_trace_file);
+    sr_trace_file = 0;
+} /* -- sr_trace_stop -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_trace_set_level(..)
+ * Scope:  Global
+ *
+ * Change the level of a running trace.  Returns 0, or -1 if there is
+ * none.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_trace_set_level(int level)
+{
+    if (sr_trace_file == 0)
+    { return -1; }
+    sr_trace_level = level;
+    return 0;
+} /* -- sr_trace_set_level -- */
+
+/* -- level by name or number, -1 if neither -- */
+int sr_trace_parse_level(const char* name)
+{
+    int i;
+
+    for (i = 0; i <= SR_TRACE_DEBUG; i++)
+    {
+        if (strcmp(name, sr_trace_level_names[i]) == 0)
+        { return i; }
+    }
+    if (name[0] >= '0' && name[0] <= '0' + SR_TRACE_DEBUG && name[1] == '\0')
+    { return name[0] - '0'; }
+    return -1;
+} /* -- sr_trace_parse_level -- */
+
+const char* sr_trace_level_name(int level)
+{
+    if (level < 0 || level > SR_TRACE_DEBUG)
+    { return "?"; }
+    return sr_trace_level_names[level];
+} /* -- sr_trace_level_name -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_trace_report(..)
+ * Scope:  Global
+ *
+ * Trace state for the control socket.  The counts are as of the last
+ * drain.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_trace_report(FILE* out)
+{
+    fprintf(out, "trace_file %s\n", sr_trace_file ? sr_trace_path : "-");
+    fprintf(out, "trace_level %s\n", sr_trace_level_name(sr_trace_level));
+    fprintf(out, "trace_max_level %s\n", sr_trace_level_name(SR_TRACE_MAX));
+    fprintf(out, "trace_threads %u\n",
+            __atomic_load_n(&sr_trace_nrings, __ATOMIC_ACQUIRE));
+    fprintf(out, "trace_records %llu\n", (unsigned long long)sr_trace_written);
+    fprintf(out, "trace_dropped %llu\n", (unsigned long long)
+            (sr_trace_lost + __atomic_load_n(&sr_trace_unowned, __ATOMIC_RELAXED)));
+} /* -- sr_trace_report -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_trace_format(..)
+ * Scope:  Global
+ *
+ * Write "event name=value ..." for rec into buf, as snprintf does.
+ * Used by sr_tracedump.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_trace_format(const struct sr_trace_rec* rec, char* buf, int size)
+{
+    const char* args;
+    const char* colon;
+    char addr[INET_ADDRSTRLEN];
+    struct in_addr in;
+    int n, i, namelen;
+
+    if (rec->event >= SR_EV_COUNT)
+    {
+        return snprintf(buf, size, "event_%u %u %u %u %u", rec->event,
+                        rec->arg[0], rec->arg[1], rec->arg[2], rec->arg[3]);
+    }
+
+    n = snprintf(buf, size, "%s", sr_trace_events[rec->event].name);
+    args = sr_trace_events[rec->event].args;
+    for (i = 0; i < 4 && *args && n < size; i++)
+    {
+        colon = strchr(args, ':');
+        namelen = (int)(colon - args);
+        args = colon + 1;
+        if (strncmp(args, "ip", 2) == 0)
+        {
+            in.s_addr = rec->arg[i];
+            inet_ntop(AF_INET, &in, addr, sizeof(addr));
+            n += snprintf(buf + n, size - n, " %.*s=%s", namelen,
+                          colon - namelen, addr);
+        }
+        else if (*args == 'x')
+        {
+            n += snprintf(buf + n, size - n, " %.*s=0x%x", namelen,
+                          colon - namelen, rec->arg[i]);
+        }
+        else
+        {
+            n += snprintf(buf + n, size - n, " %.*s=%u", namelen,
+                          colon - namelen, rec->arg[i]);
+        }
+        while (*args && *args != ' ')
+        { args++; }
+        while (*args == ' ')
+        { args++; }
+    }
+    return n;
+} /* -- sr_trace_format -- */
@@ -0,0 +1,132 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_trace.h
+ *
+ * Description:
+ *
+ * Binary event trace for the packet path, in place of printing to stderr.
+ *
+ * SR_TRACE(level, event, a0, a1, a2, a3) appends a fixed size record (a
+ * timestamp, the event id and four 32 bit arguments) to a ring owned by
+ * the calling thread.  Each ring has that thread as its only producer
+ * and the trace thread as its only consumer, so recording takes no lock
+ * and no system call; when a ring is full the record is counted as
+ * dropped rather than waited for.  The trace thread drains every ring to
+ * the trace file a few times a second and writes a trace_dropped record
+ * for whatever was lost.  sr_tracedump decodes the file.
+ *
+ * Records above the runtime level (sr_trace_level, 0 until sr_trace_start)
+ * cost one comparison.  Records above SR_TRACE_MAX are compiled out;
+ * build with -DSR_TRACE_MAX=0 to compile out tracing altogether.
+ *
+ * The file is a struct sr_trace_file_hdr followed by records, both in
+ * host byte order.  Records of different threads are not interleaved in
+ * time order; the decoder sorts them.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef SR_TRACE_H
+#define SR_TRACE_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#include <stdio.h>
+
+#define SR_TRACE_MAGIC   "SRTRACE"
+#define SR_TRACE_VERSION 1
+#define SR_TRACE_RING    4096   /* records per thread, power of two */
+#define SR_TRACE_THREADS 64     /* threads that can record */
+#define SR_TRACE_FLUSH_MS 100   /* how often the trace thread drains */
+
+/* -- severity, lower is more severe -- */
+#define SR_TRACE_ERROR 1
+#define SR_TRACE_WARN  2
+#define SR_TRACE_INFO  3
+#define SR_TRACE_DEBUG 4
+
+#ifndef SR_TRACE_MAX
+#define SR_TRACE_MAX SR_TRACE_DEBUG
+#endif
+
+/* -- event ids, named and described by sr_trace_events[] in sr_trace.c;
+ *    append only, the ids are in trace files -- */
+enum sr_trace_event
+{
+    SR_EV_TRACE_DROPPED = 0, /* thread, records */
+    SR_EV_RX_FRAME,          /* ethertype, len */
+    SR_EV_IP_BAD_VERSION,    /* src, dst, version */
+    SR_EV_IP_BAD_CKSUM,      /* src, dst, sum */
+    SR_EV_IP_BAD_LEN,        /* src, dst, len, need */
+    SR_EV_ICMP_SENT,         /* dst, type, code */
+    SR_EV_ARP_GAVE_UP,       /* ip, packets */
+    SR_EV_SEND_SHORT,        /* len */
+    SR_EV_SEND_NO_IFACE,     /* - */
+    SR_EV_SEND_BAD_SRC,      /* - */
+    SR_EV_SEND_FAILED,       /* len */
+    SR_EV_VNS_UNKNOWN_CMD,   /* command, len */
+    SR_EV_VNS_LOST,          /* drops */
+    SR_EV_VNS_REOPENED,      /* attempts, us */
+    SR_EV_COUNT
+};
+
+/* ----------------------------------------------------------------------------
+ * struct sr_trace_rec
+ *
+ * One event.  ts is CLOCK_MONOTONIC in nanoseconds, thread the index of
+ * the recording thread's ring.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_trace_rec
+{
+    uint64_t ts;
+    uint16_t event;
+    uint8_t  level;
+    uint8_t  thread;
+    uint32_t arg[4];
+    uint32_t pad;
+};
+
+struct sr_trace_file_hdr
+{
+    char     magic[8];
+    uint32_t version;
+    uint32_t rec_size;
+    uint64_t mono_ns;   /* CLOCK_MONOTONIC when the trace started */
+    uint64_t real_ns;   /* CLOCK_REALTIME at the same moment */
+};
+
+struct sr_trace_event_desc
+{
+    const char* name;
+    const char* args;   /* "name:kind ...", kind u (decimal), x (hex) or ip
+                           (IPv4 address in network byte order) */
+};
+
+extern int sr_trace_level;
+extern const struct sr_trace_event_desc sr_trace_events[SR_EV_COUNT];
+
+#if SR_TRACE_MAX > 0
+#define SR_TRACE(level, event, a0, a1, a2, a3) \
+    do { if ((level) <= SR_TRACE_MAX && (level) <= sr_trace_level) \
+         sr_trace_emit((level), (event), (a0), (a1), (a2), (a3)); } while (0)
+#else
+#define SR_TRACE(level, event, a0, a1, a2, a3) do{}while(0)
+#endif
+
+void sr_trace_emit(int level, int event, uint32_t a0, uint32_t a1,
+                   uint32_t a2, uint32_t a3);
+int  sr_trace_start(const char* path, int level);
+void sr_trace_stop(void);
+int  sr_trace_set_level(int level);
+int  sr_trace_parse_level(const char* name);
+const char* sr_trace_level_name(int level);
+void sr_trace_report(FILE* out);
+int  sr_trace_format(const struct sr_trace_rec* rec, char* buf, int size);
+
+#endif /* SR_TRACE_H */
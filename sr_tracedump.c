@@ -0,0 +1,170 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_tracedump.c
+ *
+ * Description:
+ *
+ * Decoder for the trace files written with sr -L (see sr_trace.h).
+ * Prints one line per record in time order:
+ *
+ *   16:10:02.501873214 t0 warn ip_bad_cksum src=10.0.1.100 dst=8.8.8.8 sum=0x1c2e
+ *
+ *   sr_tracedump [-l level] [-e event] [-c] tracefile
+ *
+ * -l shows only records at or below level, -e only the named event and
+ * -c prints a count per event, and the records lost to full rings,
+ * instead of the records.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "sr_trace.h"
+
+struct dump_rec
+{
+    struct sr_trace_rec rec;
+    unsigned long seq;        /* file order, keeps the sort stable */
+};
+
+static int dump_cmp(const void* a, const void* b)
+{
+    const struct dump_rec* x = (const struct dump_rec*)a;
+    const struct dump_rec* y = (const struct dump_rec*)b;
+
+    if (x->rec.ts != y->rec.ts)
+    { return x->rec.ts < y->rec.ts ? -1 : 1; }
+    return x->seq < y->seq ? -1 : (x->seq > y->seq);
+} /* -- dump_cmp -- */
+
+static void usage(const char* argv0)
+{
+    fprintf(stderr, "Usage: %s [-l level] [-e event] [-c] tracefile\n", argv0);
+} /* -- usage -- */
+
+int main(int argc, char** argv)
+{
+    struct sr_trace_file_hdr hdr;
+    struct dump_rec* recs = 0;
+    unsigned long n = 0, cap = 0, i, lost = 0;
+    unsigned long counts[SR_EV_COUNT + 1];
+    const char* event = 0;
+    int level = SR_TRACE_DEBUG, count = 0, c, e;
+    char line[256], stamp[32];
+    uint64_t wall;
+    time_t secs;
+    struct tm tm;
+    FILE* in;
+
+    while ((c = getopt(argc, argv, "hl:e:c")) != EOF)
+    {
+        switch (c)
+        {
+            case 'l':
+                if ((level = sr_trace_parse_level(optarg)) < 0)
+                {
+                    fprintf(stderr, "unknown level %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'e':
+                event = optarg;
+                break;
+            case 'c':
+                count = 1;
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if (optind != argc - 1)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if ((in = fopen(argv[optind], "rb")) == 0)
+    {
+        perror(argv[optind]);
+        return 1;
+    }
+    if (fread(&hdr, sizeof(hdr), 1, in) != 1 ||
+        memcmp(hdr.magic, SR_TRACE_MAGIC, sizeof(SR_TRACE_MAGIC)) != 0)
+    {
+        fprintf(stderr, "%s: not a trace file\n", argv[optind]);
+        return 1;
+    }
+    if (hdr.version != SR_TRACE_VERSION || hdr.rec_size != sizeof(struct sr_trace_rec))
+    {
+        fprintf(stderr, "%s: trace version %u, record size %u, expected %d and %u\n",
+                argv[optind], hdr.version, hdr.rec_size, SR_TRACE_VERSION,
+                (unsigned)sizeof(struct sr_trace_rec));
+        return 1;
+    }
+
+    for (;;)
+    {
+        if (n == cap)
+        {
+            cap = cap ? cap * 2 : 4096;
+            if ((recs = (struct dump_rec*)realloc(recs, cap * sizeof(*recs))) == 0)
+            {
+                fprintf(stderr, "out of memory\n");
+                return 1;
+            }
+        }
+        if (fread(&recs[n].rec, sizeof(recs[n].rec), 1, in) != 1)
+        { break; }
+        recs[n].seq = n;
+        n++;
+    }
+    fclose(in);
+    qsort(recs, n, sizeof(*recs), dump_cmp);
+
+    memset(counts, 0, sizeof(counts));
+    for (i = 0; i < n; i++)
+    {
+        const struct sr_trace_rec* rec = &recs[i].rec;
+
+        e = rec->event < SR_EV_COUNT ? rec->event : SR_EV_COUNT;
+        if (rec->level > level ||
+            (event && (e == SR_EV_COUNT || strcmp(event, sr_trace_events[e].name) != 0)))
+        { continue; }
+        if (count)
+        {
+            counts[e]++;
+            if (e == SR_EV_TRACE_DROPPED)
+            { lost += rec->arg[1]; }
+            continue;
+        }
+
+        wall = hdr.real_ns + (rec->ts - hdr.mono_ns);
+        secs = (time_t)(wall / 1000000000ULL);
+        localtime_r(&secs, &tm);
+        strftime(stamp, sizeof(stamp), "%H:%M:%S", &tm);
+        sr_trace_format(rec, line, sizeof(line));
+        printf("%s.%09lu t%u %s %s\n", stamp,
+               (unsigned long)(wall % 1000000000ULL), rec->thread,
+               sr_trace_level_name(rec->level), line);
+    }
+
+    if (count)
+    {
+        for (e = 0; e <= SR_EV_COUNT; e++)
+        {
+            if (counts[e])
+            {
+                printf("%-16s %lu\n", e < SR_EV_COUNT ? sr_trace_events[e].name :
+                       "unknown", counts[e]);
+            }
+        }
+        if (lost)
+        { printf("%-16s %lu\n", "records_lost", lost); }
+    }
+    free(recs);
+    return 0;
+} /* -- main -- */
@@ -0,0 +1,729 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_uring.c
+ *
+ * Description:
+ *
+ * io_uring backend for the VNS socket, driven through the raw system
+ * calls so no library is needed.
+ *
+ *  - receive: one multishot IORING_OP_RECV picks buffers from a provided
+ *    buffer ring.  Completions are framed by sr_vns_consume straight out
+ *    of the kernel filled buffer; only a command split across buffers is
+ *    copied into a reassembly buffer.
+ *  - send: sr_send_packet appends VNSPACKET commands to one of two
+ *    registered transmit buffers (a copy, counted in sr_pbuf_stats).  The batch is sent with a single
+ *    IORING_OP_WRITE_FIXED, one write in flight at a time so the TCP
+ *    stream stays in order.
+ *  - the ARP tick is an IORING_OP_TIMEOUT and the control socket is
+ *    watched with IORING_OP_POLL_ADD.
+ *
+ * In steady state each loop iteration is one io_uring_enter that submits
+ * the pending send and reaps every completion that arrived since.
+ *
+ * Like the epoll loop this runs on a single thread without cache locks.
+ * If the kernel (or the headers the router was built against) lack any
+ * of the above, sr_uring_run returns SR_URING_UNAVAILABLE before touching
+ * the socket and the caller falls back to sr_reactor_run.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+
+#include "sr_router.h"
+#include "sr_arpcache.h"
+#include "sr_egress.h"
+#include "sr_pbuf.h"
+#include "sr_protocol.h"
+#include "vnscommand.h"
+
+#if defined(_LINUX_) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#ifdef IORING_RECV_MULTISHOT
+#define SR_HAVE_URING 1
+#endif
+#endif
+#endif
+
+#ifdef SR_HAVE_URING
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <linux/time_types.h>
+
+#define SR_URING_ENTRIES 64
+#define SR_URING_NBUFS   64           /* provided receive buffers */
+#define SR_URING_BUFSZ   (16 * 1024)
+#define SR_URING_BGID    0
+#define SR_URING_TXSZ    (256 * 1024) /* per registered transmit buffer */
+#define SR_URING_RXBUF   (64 * 1024)  /* reassembly of split commands */
+
+/* user_data tags; control clients carry their fd in the low bits */
+#define SR_UD_RECV   1ULL
+#define SR_UD_SEND   2ULL
+#define SR_UD_TIMER  3ULL
+#define SR_UD_CTL    4ULL
+#define SR_UD_PACER  6ULL
+#define SR_UD_CLIENT (5ULL << 32)
+
+struct sr_uring
+{
+    int fd;
+
+    /* -- submission queue -- */
+    void* sq_ring;
+    size_t sq_ring_sz;
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned* sq_mask;
+    unsigned* sq_array;
+    unsigned sq_entries;
+    struct io_uring_sqe* sqes;
+    size_t sqes_sz;
+    unsigned to_submit;
+
+    /* -- completion queue -- */
+    void* cq_ring;
+    size_t cq_ring_sz;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned* cq_mask;
+    struct io_uring_cqe* cqes;
+
+    /* -- provided receive buffers -- */
+    struct io_uring_buf_ring* br;
+    size_t br_sz;
+    uint8_t* bufs;
+    uint16_t br_tail;
+    int recv_armed;
+    int recv_seen;
+
+    /* recv completions waiting for the main loop, in arrival order */
+    struct { uint16_t bid; int len; } pend[SR_URING_NBUFS];
+    unsigned pend_head;
+    unsigned pend_count;
+
+    /* -- reassembly -- */
+    uint8_t* rxbuf;
+    unsigned int fill;
+
+    /* -- double buffered transmit -- */
+    uint8_t* tx[2];
+    unsigned int tx_fill[2];
+    int tx_active;
+    int tx_inflight;     /* buffer being written, -1 if none */
+    unsigned int tx_off; /* bytes of it already written */
+
+    /* -- deferred events -- */
+    struct __kernel_timespec tick;
+    int timer_fired;
+    int pacer_fired;     /* egress shaping timer */
+    int cfd;
+    int ctl_ready;
+    int clients[SR_CTL_CLIENTS]; /* one poll armed per client, so room */
+    int nclients;                /* for every completion of a pass */
+
+    int status;          /* 1 running, 0 closed, -1 error */
+};
+
+static int sr_uring_setup(unsigned entries, struct io_uring_params* p)
+{ return (int)syscall(__NR_io_uring_setup, entries, p); }
+
+static int sr_uring_register(int fd, unsigned op, void* arg, unsigned n)
+{ return (int)syscall(__NR_io_uring_register, fd, op, arg, n); }
+
+/*---------------------------------------------------------------------
+ * Method: sr_uring_enter(..)
+ * Scope:  Local
+ *
+ * Submit whatever is queued and wait for at least min_complete events.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_uring_enter(struct sr_instance* sr, struct sr_uring* u,
+                          unsigned min_complete)
+{
+    int ret;
+
+    ret = (int)syscall(__NR_io_uring_enter, u->fd, u->to_submit, min_complete,
+                       min_complete ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+    sr->stats.syscalls++;
+    if (ret >= 0)
+    {
+        u->to_submit -= (unsigned)ret < u->to_submit ? (unsigned)ret : u->to_submit;
+        return 0;
+    }
+    return errno == EINTR ? 0 : -1;
+} /* -- sr_uring_enter -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_uring_get_sqe(..)
+ * Scope:  Local
+ *
+ * Reserve and publish the next submission slot, flushing the queue to
+ * the kernel first if it is full.
+ *
+ *---------------------------------------------------------------------*/
+
+static struct io_uring_sqe* sr_uring_get_sqe(struct sr_instance* sr,
+                                             struct sr_uring* u)
+{
+    unsigned tail = *u->sq_tail;
+    unsigned idx;
+    struct io_uring_sqe* sqe;
+
+    while (tail - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE) >= u->sq_entries)
+    {
+        if (sr_uring_enter(sr, u, 0) < 0)
+        { return NULL; }
+    }
+
+    idx = tail & *u->sq_mask;
+    sqe = &u->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    u->sq_array[idx] = idx;
+    __atomic_store_n(u->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    u->to_submit++;
+
+    return sqe;
+} /* -- sr_uring_get_sqe -- */
+
+/*---------------------------------------------------------------------
+ * Submission helpers.  The SQE is filled in after the tail moved, which
+ * is fine: the kernel only reads it in io_uring_enter.
+ *---------------------------------------------------------------------*/
+
+static void sr_uring_arm_recv(struct sr_instance* sr, struct sr_uring* u)
+{
+    struct io_uring_sqe* sqe = sr_uring_get_sqe(sr, u);
+
+    if (!sqe)
+    { return; }
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = sr->sockfd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = SR_URING_BGID;
+    sqe->user_data = SR_UD_RECV;
+    u->recv_armed = 1;
+}
+
+static void sr_uring_arm_timer(struct sr_instance* sr, struct sr_uring* u)
+{
+    struct io_uring_sqe* sqe = sr_uring_get_sqe(sr, u);
+
+    if (!sqe)
+    { return; }
+    sqe->opcode = IORING_OP_TIMEOUT;
+    sqe->addr = (uint64_t)(uintptr_t)&u->tick;
+    sqe->len = 1;
+    sqe->user_data = SR_UD_TIMER;
+}
+
+static void sr_uring_arm_poll(struct sr_instance* sr, struct sr_uring* u,
+                              int fd, short events, uint64_t user_data)
+{
+    struct io_uring_sqe* sqe = sr_uring_get_sqe(sr, u);
+
+    if (!sqe)
+    { return; }
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = events;
+    sqe->user_data = user_data;
+}
+
+static void sr_uring_write_tx(struct sr_instance* sr, struct sr_uring* u)
+{
+    struct io_uring_sqe* sqe = sr_uring_get_sqe(sr, u);
+    int b = u->tx_inflight;
+
+    if (!sqe)
+    { return; }
+    sqe->opcode = IORING_OP_WRITE_FIXED;
+    sqe->fd = sr->sockfd;
+    sqe->off = (uint64_t)-1;
+    sqe->addr = (uint64_t)(uintptr_t)(u->tx[b] + u->tx_off);
+    sqe->len = u->tx_fill[b] - u->tx_off;
+    sqe->buf_index = b;
+    sqe->user_data = SR_UD_SEND;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_uring_recycle(..)
+ * Scope:  Local
+ *
+ * Hand a receive buffer back to the kernel.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_uring_recycle(struct sr_uring* u, uint16_t bid)
+{
+    struct io_uring_buf* b = &u->br->bufs[u->br_tail & (SR_URING_NBUFS - 1)];
+
+    b->addr = (uint64_t)(uintptr_t)(u->bufs + (size_t)bid * SR_URING_BUFSZ);
+    b->len = SR_URING_BUFSZ;
+    b->bid = bid;
+    u->br_tail++;
+    __atomic_store_n(&u->br->tail, u->br_tail, __ATOMIC_RELEASE);
+} /* -- sr_uring_recycle -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_uring_flush(..)
+ * Scope:  Local
+ *
+ * Queue a write of the active transmit buffer unless one is in flight.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_uring_flush(struct sr_instance* sr, struct sr_uring* u)
+{
+    if (u->tx_inflight >= 0 || u->tx_fill[u->tx_active] == 0)
+    { return; }
+
+    u->tx_inflight = u->tx_active;
+    u->tx_off = 0;
+    u->tx_active ^= 1;
+    sr_uring_write_tx(sr, u);
+} /* -- sr_uring_flush -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_uring_reap(..)
+ * Scope:  Local
+ *
+ * Drain the completion queue.  Write completions are finished here;
+ * everything that could re-enter the router is only recorded, for the
+ * main loop to act on, so this is safe to call from sr_uring_send.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_uring_reap(struct sr_instance* sr, struct sr_uring* u)
+{
+    struct io_uring_cqe cqe;
+    unsigned head;
+
+    while ((head = *u->cq_head) != __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE))
+    {
+        cqe = u->cqes[head & *u->cq_mask];
+        __atomic_store_n(u->cq_head, head + 1, __ATOMIC_RELEASE);
+
+        if (cqe.user_data == SR_UD_RECV)
+        {
+            if (!(cqe.flags & IORING_CQE_F_MORE))
+            { u->recv_armed = 0; }
+
+            if (cqe.res > 0 && (cqe.flags & IORING_CQE_F_BUFFER))
+            {
+                unsigned slot = (u->pend_head + u->pend_count) % SR_URING_NBUFS;
+                u->pend[slot].bid = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+                u->pend[slot].len = cqe.res;
+                u->pend_count++;
+                u->recv_seen = 1;
+            }
+            else if (cqe.res == 0)
+            {
+                fprintf(stderr, "VNS server closed connection.\n");
+                u->status = 0;
+            }
+            else if (cqe.res == -EINVAL && !u->recv_seen)
+            {
+                /* -- kernel without multishot recv / buffer rings -- */
+                u->status = SR_URING_UNAVAILABLE;
+            }
+            else if (cqe.res != -ENOBUFS && cqe.res != -EINTR)
+            {
+                fprintf(stderr, "io_uring recv: %s\n", strerror(-cqe.res));
+                u->status = -1;
+            }
+        }
+        else if (cqe.user_data == SR_UD_SEND)
+        {
+            int b = u->tx_inflight;
+
+            if (cqe.res < 0 && cqe.res != -EINTR && cqe.res != -EAGAIN)
+            {
+                fprintf(stderr, "io_uring write: %s\n", strerror(-cqe.res));
+                sr->stats.tx_errors++;
+                u->tx_off = u->tx_fill[b];
+            }
+            else if (cqe.res > 0)
+            {
+                u->tx_off += cqe.res;
+            }
+
+            if (u->tx_off < u->tx_fill[b])
+            {
+                sr_uring_write_tx(sr, u);
+            }
+            else
+            {
+                u->tx_fill[b] = 0;
+                u->tx_inflight = -1;
+            }
+        }
+        else if (cqe.user_data == SR_UD_TIMER)
+        {
+            u->timer_fired = 1;
+        }
+        else if (cqe.user_data == SR_UD_PACER)
+        {
+            u->pacer_fired = 1;
+        }
+        else if (cqe.user_data == SR_UD_CTL)
+        {
+            u->ctl_ready = 1;
+        }
+        else if ((cqe.user_data & ~0xffffffffULL) == SR_UD_CLIENT)
+        {
+            u->clients[u->nclients++] = (int)(cqe.user_data & 0xffffffffULL);
+        }
+    }
+} /* -- sr_uring_reap -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_uring_process_rx(..)
+ * Scope:  Local
+ *
+ * Frame and dispatch received data in arrival order, then return the
+ * buffers to the kernel.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_uring_process_rx(struct sr_instance* sr, struct sr_uring* u)
+{
+    unsigned int consumed;
+    uint8_t* data;
+    uint16_t bid;
+    int len, ret;
+
+    while (u->pend_count > 0 && u->status == 1)
+    {
+        bid = u->pend[u->pend_head].bid;
+        len = u->pend[u->pend_head].len;
+        u->pend_head = (u->pend_head + 1) % SR_URING_NBUFS;
+        u->pend_count--;
+
+        data = u->bufs + (size_t)bid * SR_URING_BUFSZ;
+
+        if (u->fill == 0)
+        {
+            /* -- common case: frame directly out of the kernel buffer -- */
+            ret = sr_vns_consume(sr, data, len, &consumed);
+            memcpy(u->rxbuf, data + consumed, len - consumed);
+            u->fill = len - consumed;
+        }
+        else
+        {
+            memcpy(u->rxbuf + u->fill, data, len);
+            u->fill += len;
+            ret = sr_vns_consume(sr, u->rxbuf, u->fill, &consumed);
+            memmove(u->rxbuf, u->rxbuf + consumed, u->fill - consumed);
+            u->fill -= consumed;
+        }
+
+        sr_uring_recycle(u, bid);
+
+        if (ret != 1)
+        { u->status = ret; }
+    }
+
+    if (!u->recv_armed && u->status == 1)
+    { sr_uring_arm_recv(sr, u); }
+} /* -- sr_uring_process_rx -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_uring_send(..)
+ * Scope:  Global
+ *
+ * Append one frame, wrapped in a VNSPACKET header, to the transmit batch.
+ * Called by sr_send_packet when sr->uring is set.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_uring_send(struct sr_instance* sr, const uint8_t* buf,
+                  unsigned int len, const char* iface)
+{
+    struct sr_uring* u = sr->uring;
+    unsigned int total_len = len + sizeof(c_packet_header);
+    c_packet_header* hdr;
+
+    /* REQUIRES */
+    assert(u);
+
+    if (total_len > SR_URING_TXSZ)
+    { return -1; }
+
+    if (u->tx_fill[u->tx_active] + total_len > SR_URING_TXSZ)
+    {
+        /* -- both buffers busy: wait for the write in flight -- */
+        while (u->tx_inflight >= 0)
+        {
+            if (sr_uring_enter(sr, u, 1) < 0)
+            { return -1; }
+            sr_uring_reap(sr, u);
+        }
+        sr_uring_flush(sr, u);
+    }
+
+    hdr = (c_packet_header*)(u->tx[u->tx_active] + u->tx_fill[u->tx_active]);
+    hdr->mLen = htonl(total_len);
+    hdr->mType = htonl(VNSPACKET);
+    strncpy(hdr->mInterfaceName, iface, 16);
+    memcpy((uint8_t*)hdr + sizeof(c_packet_header), buf, len);
+    u->tx_fill[u->tx_active] += total_len;
+    sr_pbuf_copied(len);
+
+    return 0;
+} /* -- sr_uring_send -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_uring_destroy(..)
+ * Scope:  Local
+ *---------------------------------------------------------------------*/
+
+static void sr_uring_destroy(struct sr_uring* u)
+{
+    if (u->fd >= 0)
+    { close(u->fd); }
+    if (u->sq_ring && u->sq_ring != MAP_FAILED)
+    { munmap(u->sq_ring, u->sq_ring_sz); }
+    if (u->cq_ring && u->cq_ring != MAP_FAILED && u->cq_ring != u->sq_ring)
+    { munmap(u->cq_ring, u->cq_ring_sz); }
+    if (u->sqes && u->sqes != MAP_FAILED)
+    { munmap(u->sqes, u->sqes_sz); }
+    if (u->br && u->br != MAP_FAILED)
+    { munmap(u->br, u->br_sz); }
+    free(u->bufs);
+    free(u->rxbuf);
+    free(u->tx[0]);
+    free(u->tx[1]);
+    free(u);
+} /* -- sr_uring_destroy -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_uring_create(..)
+ * Scope:  Local
+ *
+ * Set up the rings, the provided buffer ring and the registered transmit
+ * buffers.  Returns NULL if any step is not supported.
+ *
+ *---------------------------------------------------------------------*/
+
+static struct sr_uring* sr_uring_create(void)
+{
+    struct io_uring_params p;
+    struct io_uring_buf_reg reg;
+    struct iovec iov[2];
+    struct sr_uring* u;
+    uint16_t i;
+
+    if ((u = calloc(1, sizeof(*u))) == 0)
+    { return NULL; }
+    u->fd = -1;
+    u->cfd = -1;
+    u->tx_inflight = -1;
+    u->status = 1;
+
+    memset(&p, 0, sizeof(p));
+    if ((u->fd = sr_uring_setup(SR_URING_ENTRIES, &p)) < 0 ||
+        !(p.features & IORING_FEAT_SINGLE_MMAP))
+    { goto fail; }
+
+    /* -- rings -- */
+    u->sq_ring_sz = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    u->cq_ring_sz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (u->cq_ring_sz > u->sq_ring_sz)
+    { u->sq_ring_sz = u->cq_ring_sz; }
+    u->cq_ring_sz = u->sq_ring_sz;
+
+    u->sq_ring = mmap(0, u->sq_ring_sz, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+    if (u->sq_ring == MAP_FAILED)
+    { goto fail; }
+    u->cq_ring = u->sq_ring;
+
+    u->sqes_sz = p.sq_entries * sizeof(struct io_uring_sqe);
+    u->sqes = mmap(0, u->sqes_sz, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQES);
+    if (u->sqes == MAP_FAILED)
+    { goto fail; }
+
+    u->sq_head = (unsigned*)((uint8_t*)u->sq_ring + p.sq_off.head);
+    u->sq_tail = (unsigned*)((uint8_t*)u->sq_ring + p.sq_off.tail);
+    u->sq_mask = (unsigned*)((uint8_t*)u->sq_ring + p.sq_off.ring_mask);
+    u->sq_array = (unsigned*)((uint8_t*)u->sq_ring + p.sq_off.array);
+    u->sq_entries = p.sq_entries;
+    u->cq_head = (unsigned*)((uint8_t*)u->cq_ring + p.cq_off.head);
+    u->cq_tail = (unsigned*)((uint8_t*)u->cq_ring + p.cq_off.tail);
+    u->cq_mask = (unsigned*)((uint8_t*)u->cq_ring + p.cq_off.ring_mask);
+    u->cqes = (struct io_uring_cqe*)((uint8_t*)u->cq_ring + p.cq_off.cqes);
+
+    /* -- provided buffer ring for multishot recv -- */
+    u->br_sz = SR_URING_NBUFS * sizeof(struct io_uring_buf);
+    u->br = mmap(0, u->br_sz, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    u->bufs = malloc((size_t)SR_URING_NBUFS * SR_URING_BUFSZ);
+    u->rxbuf = malloc(SR_URING_RXBUF);
+    if (u->br == MAP_FAILED || !u->bufs || !u->rxbuf)
+    { goto fail; }
+
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)u->br;
+    reg.ring_entries = SR_URING_NBUFS;
+    reg.bgid = SR_URING_BGID;
+    if (sr_uring_register(u->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+    { goto fail; }
+    for (i = 0; i < SR_URING_NBUFS; i++)
+    { sr_uring_recycle(u, i); }
+
+    /* -- registered transmit buffers -- */
+    u->tx[0] = malloc(SR_URING_TXSZ);
+    u->tx[1] = malloc(SR_URING_TXSZ);
+    if (!u->tx[0] || !u->tx[1])
+    { goto fail; }
+    iov[0].iov_base = u->tx[0];
+    iov[0].iov_len = SR_URING_TXSZ;
+    iov[1].iov_base = u->tx[1];
+    iov[1].iov_len = SR_URING_TXSZ;
+    if (sr_uring_register(u->fd, IORING_REGISTER_BUFFERS, iov, 2) < 0)
+    { goto fail; }
+
+    u->tick.tv_sec = 1;
+    return u;
+
+fail:
+    sr_uring_destroy(u);
+    return NULL;
+} /* -- sr_uring_create -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_uring_run(..)
+ * Scope:  Global
+ *
+ * Run the router on io_uring until the session ends.
+ *
+ * RETURN VALUES:
+ *
+ *  0 on orderly shutdown, -1 on error, SR_URING_UNAVAILABLE if io_uring
+ *  cannot be used and nothing has been read from the socket
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_uring_run(struct sr_instance* sr)
+{
+    struct sr_uring* u;
+    int i, ret;
+
+    /* REQUIRES */
+    assert(sr);
+    assert(sr->loop_mode == SR_LOOP_EVENT);
+
+    if ((u = sr_uring_create()) == NULL)
+    {
+        fprintf(stderr, "io_uring not available, using the epoll loop\n");
+        return SR_URING_UNAVAILABLE;
+    }
+    sr->uring = u;
+
+    sr_uring_arm_recv(sr, u);
+    sr_uring_arm_timer(sr, u);
+    if (sr_egress_timer_fd(sr) >= 0)
+    { sr_uring_arm_poll(sr, u, sr_egress_timer_fd(sr), POLLIN, SR_UD_PACER); }
+    if (sr->ctl_path[0] != '\0' && (u->cfd = sr_ctl_listen(sr->ctl_path)) >= 0)
+    { sr_uring_arm_poll(sr, u, u->cfd, POLLIN, SR_UD_CTL); }
+
+    while (u->status == 1)
+    {
+        sr_uring_flush(sr, u);
+
+        if (sr_uring_enter(sr, u, 1) < 0)
+        {
+            perror("io_uring_enter(..):sr_uring.c::sr_uring_run");
+            u->status = -1;
+            break;
+        }
+        sr_uring_reap(sr, u);
+
+        sr_uring_process_rx(sr, u);
+
+        if (u->timer_fired)
+        {
+            u->timer_fired = 0;
+            if (sr_arpcache_tick(sr))
+            { u->status = 0; }
+            sr_uring_arm_timer(sr, u);
+        }
+        if (u->pacer_fired)
+        {
+            u->pacer_fired = 0;
+            sr_egress_timer(sr);
+            sr_uring_arm_poll(sr, u, sr_egress_timer_fd(sr), POLLIN, SR_UD_PACER);
+        }
+        if (u->ctl_ready)
+        {
+            int fd = sr_ctl_accept(sr, u->cfd);
+            u->ctl_ready = 0;
+            if (fd >= 0)
+            { sr_uring_arm_poll(sr, u, fd, POLLIN, SR_UD_CLIENT | (uint32_t)fd); }
+            sr_uring_arm_poll(sr, u, u->cfd, POLLIN, SR_UD_CTL);
+        }
+        for (i = 0; i < u->nclients; i++)
+        {
+            int fd = u->clients[i], want = sr_ctl_serve(sr, fd);
+            if (want)
+            {
+                /* -- a route load is waited for on its eventfd -- */
+                sr_uring_arm_poll(sr, u, (want == SR_CTL_LOAD) ? sr_ctl_wait_fd(fd) : fd,
+                                  (want == SR_CTL_WRITE) ? POLLOUT : POLLIN,
+                                  SR_UD_CLIENT | (uint32_t)fd);
+            }
+        }
+        u->nclients = 0;
+    }
+
+    /* -- push out anything still batched -- */
+    while (u->status != SR_URING_UNAVAILABLE &&
+           (u->tx_inflight >= 0 || u->tx_fill[u->tx_active] > 0))
+    {
+        sr_uring_flush(sr, u);
+        if (sr_uring_enter(sr, u, 1) < 0)
+        { break; }
+        sr_uring_reap(sr, u);
+    }
+
+    ret = u->status;
+    if (u->cfd >= 0)
+    {
+        sr_ctl_disconnect(sr);
+        close(u->cfd);
+        unlink(sr->ctl_path);
+    }
+    sr->uring = NULL;
+    sr_uring_destroy(u);
+
+    return ret == 0 ? 0 : (ret == SR_URING_UNAVAILABLE ? ret : -1);
+} /* -- sr_uring_run -- */
+
+#else /* -- !SR_HAVE_URING -- */
+
+int sr_uring_send(struct sr_instance* sr, const uint8_t* buf,
+                  unsigned int len, const char* iface)
+{
+    return -1;
+}
+
+int sr_uring_run(struct sr_instance* sr)
+{
+    fprintf(stderr, "built without io_uring support, using the epoll loop\n");
+    return SR_URING_UNAVAILABLE;
+}
+
+#endif /* -- SR_HAVE_URING -- */
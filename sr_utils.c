@@ -3,22 +3,19 @@
 #include <string.h>
 #include "sr_protocol.h"
 #include "sr_utils.h"
+#include "sr_cksum.h"
 
 
 uint16_t cksum (const void *_data, int len) {
-  const uint8_t *data = _data;
-  uint32_t sum;
-
-  for (sum = 0;len >= 2; data += 2, len -= 2)
-    sum += data[0] << 8 | data[1];
-  if (len > 0)
-    sum += data[0] << 8;
-  while (sum > 0xffff)
-    sum = (sum >> 16) + (sum & 0xffff);
-  sum = htons (~sum);
+  uint16_t sum = ~sr_cksum_sum(_data, len);
   return sum ? sum : 0xffff;
 }
 
+/* Returns nonzero if the buffer, checksum field included, sums to zero. */
+int cksum_verify (const void *_data, int len) {
+  return sr_cksum_sum(_data, len) == 0xffff;
+}
+
 
 uint16_t ethertype(uint8_t *buf) {
   sr_ethernet_hdr_t *ehdr = (sr_ethernet_hdr_t *)buf;
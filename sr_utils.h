@@ -29,6 +29,7 @@
 #define SR_UTILS_H
 
 uint16_t cksum(const void *_data, int len);
+int cksum_verify(const void *_data, int len);
 
 uint16_t ethertype(uint8_t *buf);
 uint8_t ip_protocol(uint8_t *buf);
@@ -30,8 +30,13 @@
 #include <unistd.h>
 #include <netdb.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <pthread.h>
 
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <sys/time.h>
@@ -40,16 +45,28 @@
 #include "sr_router.h"
 #include "sr_if.h"
 #include "sr_protocol.h"
+#include "sr_trace.h"
+#include "sr_sflow.h"
+#include "sr_egress.h"
+#include "sr_pbuf.h"
+#include "sr_common.h"
 
 #include "sha1.h"
 #include "vnscommand.h"
 
 static void sr_log_packet(struct sr_instance* , uint8_t* , int );
-static int  sr_arp_req_not_for_us(struct sr_instance* sr,
-                                  uint8_t * packet /* lent */,
-                                  unsigned int len,
-                                  char* interface  /* lent */);
 int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expected_cmd);
+static int  sr_handle_command(struct sr_instance* sr, uint8_t* buf,
+                              int len, int expected_cmd);
+static int  sr_vns_open(struct sr_instance* sr, int timeout);
+static int  sr_vns_connect(struct sr_instance* sr, int fd, int timeout);
+static void sr_vns_drop(struct sr_instance* sr);
+static int  sr_unwrap_packet(struct sr_instance* sr, uint8_t* buf, int len,
+                             uint8_t** frame, unsigned int* frame_len,
+                             char** iface);
+
+/* -- the socket sr_vns_open is handshaking on, on this thread -- */
+static __thread int sr_vns_opening = -1;
 
 /*-----------------------------------------------------------------------------
  * Method: sr_session_closed_help(..)
@@ -77,26 +94,30 @@ int sr_connect_to_server(struct sr_instance* sr,unsigned short port,
                          char* server)
 {
     struct hostent *hp;
-    c_open command;
-    c_open_template ot;
-    char* buf;
-    uint32_t buf_len;
+#ifdef _LINUX_
+    struct hostent hent;
+    char hbuf[1024];
+    int herr;
+#endif /* _LINUX_ */
 
     /* REQUIRES */
     assert(sr);
     assert(server);
 
-    /* purify UMR be gone ! */
-    memset((void*)&command,0,sizeof(c_open));
-
     /* zero out server address struct */
     memset(&(sr->sr_addr),0,sizeof(struct sockaddr_in));
 
     sr->sr_addr.sin_family = AF_INET;
     sr->sr_addr.sin_port = htons(port);
 
-    /* grab hosts address from domain name */
+    /* grab hosts address from domain name (reentrant where available,
+     * several routers may connect at once, see sr_multi.c) */
+#ifdef _LINUX_
+    if (gethostbyname_r(server, &hent, hbuf, sizeof(hbuf), &hp, &herr) != 0 ||
+        hp == 0)
+#else
     if ((hp = gethostbyname(server))==0)
+#endif /* _LINUX_ */
     {
         perror("gethostbyname:sr_client.c::sr_connect_to_server(..)");
         return -1;
@@ -105,26 +126,69 @@ int sr_connect_to_server(struct sr_instance* sr,unsigned short port,
     /* set server address */
     memcpy(&(sr->sr_addr.sin_addr),hp->h_addr,hp->h_length);
 
+    return sr_vns_open(sr, 0);
+} /* -- sr_connect_to_server -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_vns_open(..)
+ * Scope: Local
+ *
+ * Open a session with the server at sr->sr_addr: connect, authenticate
+ * and ask for the topology (and the rtable of a template).  With a
+ * timeout (seconds) a server that does not accept the connection or
+ * stops answering fails the handshake instead of hanging it.
+ *
+ * The handshake runs on a socket of its own; sr->sockfd gets it only
+ * once the session is open, so that senders on other threads do not
+ * write frames into the middle of the handshake.
+ *
+ * RETURN VALUES:
+ *
+ *  0 on success
+ *  -1 on error, with the socket closed
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_vns_open(struct sr_instance* sr, int timeout)
+{
+    c_open command;
+    c_open_template ot;
+    struct timeval tv;
+    char* buf;
+    uint32_t buf_len;
+    int fd;
+
+    /* purify UMR be gone ! */
+    memset((void*)&command,0,sizeof(c_open));
+
     /* create socket */
-    if ((sr->sockfd = socket(AF_INET, SOCK_STREAM, 0)) < 0)
+    if ((fd = socket(AF_INET, SOCK_STREAM, 0)) < 0)
     {
         perror("socket(..):sr_client.c::sr_connect_to_server(..)");
         return -1;
     }
+    sr_vns_opening = fd;
 
     /* attempt to connect to the server */
-    if (connect(sr->sockfd, (struct sockaddr *)&(sr->sr_addr),
-                sizeof(sr->sr_addr)) < 0)
+    if (sr_vns_connect(sr, fd, timeout) < 0)
     {
         perror("connect(..):sr_client.c::sr_connect_to_server(..)");
-        close(sr->sockfd);
+        sr_vns_drop(sr);
         return -1;
     }
 
+    memset(&tv, 0, sizeof(tv));
+    tv.tv_sec = timeout;
+    if (timeout)
+    { setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)); }
+
     /* wait for authentication to be completed (server sends the first message) */
     if(sr_read_from_server_expect(sr, VNS_AUTH_REQUEST)!= 1 ||
        sr_read_from_server_expect(sr, VNS_AUTH_STATUS) != 1)
+    {
+        sr_vns_drop(sr);
         return -1; /* failed to receive expected message */
+    }
 
     if(strlen(sr->template) > 0) {
         /* send VNS_OPEN_TEMPLATE message to server */
@@ -149,18 +213,144 @@ int sr_connect_to_server(struct sr_instance* sr,unsigned short port,
         buf_len = sizeof(command);
     }
 
-    if(send(sr->sockfd, buf, buf_len, 0) != buf_len)
+    if(send(fd, buf, buf_len, 0) != buf_len)
     {
         perror("send(..):sr_client.c::sr_connect_to_server()");
+        sr_vns_drop(sr);
         return -1;
     }
 
     if(strlen(sr->template) > 0)
         if(sr_read_from_server_expect(sr, VNS_RTABLE) != 1)
+        {
+            sr_vns_drop(sr);
             return -1; /* needed to get the rtable */
+        }
+
+    /* -- the session reads block again, see sr_vns_run -- */
+    if (timeout)
+    {
+        tv.tv_sec = 0;
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    }
+
+    /* -- open: hand it to the senders -- */
+    sr_vns_opening = -1;
+    pthread_mutex_lock(&(sr->vns_lock));
+    sr->sockfd = fd;
+    pthread_mutex_unlock(&(sr->vns_lock));
 
     return 0;
-} /* -- sr_connect_to_server -- */
+} /* -- sr_vns_open -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_vns_connect(..)
+ * Scope: Local
+ *
+ * Connect fd to the server, giving up after timeout seconds unless
+ * timeout is 0.  The socket is left blocking.
+ *
+ * RETURN VALUES: 0 on success, -1 with errno set on error
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_vns_connect(struct sr_instance* sr, int fd, int timeout)
+{
+    struct pollfd pfd;
+    socklen_t slen = sizeof(int);
+    int flags, err = 0, n;
+
+    if (timeout == 0)
+    {
+        return connect(fd, (struct sockaddr *)&(sr->sr_addr),
+                       sizeof(sr->sr_addr));
+    }
+
+    flags = fcntl(fd, F_GETFL);
+    fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+    if (connect(fd, (struct sockaddr *)&(sr->sr_addr),
+                sizeof(sr->sr_addr)) < 0)
+    {
+        if (errno != EINPROGRESS)
+        { return -1; }
+
+        pfd.fd = fd;
+        pfd.events = POLLOUT;
+        while ((n = poll(&pfd, 1, timeout * 1000)) < 0 && errno == EINTR)
+        { /* -- the full timeout again, good enough -- */ }
+        if (n == 0)
+        {
+            errno = ETIMEDOUT;
+            return -1;
+        }
+        if (n < 0 ||
+            getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &slen) < 0)
+        { return -1; }
+        if (err != 0)
+        {
+            errno = err;
+            return -1;
+        }
+    }
+    fcntl(fd, F_SETFL, flags);
+    return 0;
+} /* -- sr_vns_connect -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_vns_drop(..)
+ * Scope: Local
+ *
+ * Close the connection to the server, or the one this thread is still
+ * opening.  Senders hold vns_lock across their write: shutdown wakes a
+ * sender blocked on a full socket, and the descriptor is closed only
+ * once none uses it, so a sender never writes to a reused descriptor.
+ * Senders after that see sockfd -1, see sr_writev_all.
+ *
+ *---------------------------------------------------------------------------*/
+
+static void sr_vns_drop(struct sr_instance* sr)
+{
+    int fd = sr_vns_opening;
+
+    if (fd >= 0)
+    {
+        sr_vns_opening = -1;
+        close(fd);
+        return;
+    }
+
+    if ((fd = sr->sockfd) < 0)
+    { return; }
+    shutdown(fd, SHUT_RDWR);
+    pthread_mutex_lock(&(sr->vns_lock));
+    sr->sockfd = -1;
+    pthread_mutex_unlock(&(sr->vns_lock));
+    close(fd);
+} /* -- sr_vns_drop -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_vns_stop(..)
+ * Scope: Global
+ *
+ * End the reads of the session, for a receive loop blocked in them to
+ * return as the router shuts down.  Sending still works, for what the
+ * router drains on its way out.
+ *
+ *---------------------------------------------------------------------------*/
+
+void sr_vns_stop(struct sr_instance* sr)
+{
+    pthread_mutex_lock(&(sr->vns_lock));
+    if (sr->sockfd >= 0)
+    { shutdown(sr->sockfd, SHUT_RD); }
+    pthread_mutex_unlock(&(sr->vns_lock));
+} /* -- sr_vns_stop -- */
+
+/* -- the socket commands are read from: the one being opened, if any -- */
+static int sr_vns_fd(struct sr_instance* sr)
+{
+    return sr_vns_opening >= 0 ? sr_vns_opening : sr->sockfd;
+} /* -- sr_vns_fd -- */
 
 
 
@@ -170,11 +360,15 @@ int sr_connect_to_server(struct sr_instance* sr,unsigned short port,
  *
  *
  * Read, from the server, the hardware information for the reserved host.
+ * A reopened session sends it again; interfaces the router already has
+ * are updated in place, keeping their queues, counters and neighbors.
  *
  *---------------------------------------------------------------------------*/
 
 int sr_handle_hwinfo(struct sr_instance* sr, c_hwinfo* hwinfo)
 {
+    struct sr_if* known = 0; /* the interface entries are for, if not new */
+    uint32_t mbit;
     int num_entries;
     int i = 0;
 
@@ -196,11 +390,22 @@ int sr_handle_hwinfo(struct sr_instance* sr, c_hwinfo* hwinfo)
                 break;
             case HWINTERFACE:
                 /*Debug("INTERFACE: %s\n",hwinfo->mHWInfo[i].value);*/
-                sr_add_interface(sr,hwinfo->mHWInfo[i].value);
+                known = sr_get_interface(sr,hwinfo->mHWInfo[i].value);
+                if ( !known )
+                { sr_add_interface(sr,hwinfo->mHWInfo[i].value); }
                 break;
             case HWSPEED:
                 /* Debug("Speed: %d\n",
                         ntohl(*((unsigned int*)hwinfo->mHWInfo[i].value))); */
+                mbit = ntohl(*((uint32_t*)hwinfo->mHWInfo[i].value));
+                if ( !known )
+                { sr_set_ether_speed(sr, mbit); }
+                else if ( known->speed != mbit )
+                {
+                    known->speed = mbit;
+                    if ( known->egress && !sr->egress_rate )
+                    { sr_egress_set_rate(sr, known, mbit, 0); }
+                }
                 break;
             case HWSUBNET:
                 /* Debug("Subnet: %s\n",inet_ntoa(
@@ -213,22 +418,46 @@ int sr_handle_hwinfo(struct sr_instance* sr, c_hwinfo* hwinfo)
             case HWETHIP:
                 /*Debug("IP: %s\n",inet_ntoa(
                             *((struct in_addr*)(hwinfo->mHWInfo[i].value))));*/
-                sr_set_ether_ip(sr,*((uint32_t*)hwinfo->mHWInfo[i].value));
+                if ( known )
+                { known->ip = *((uint32_t*)hwinfo->mHWInfo[i].value); }
+                else
+                { sr_set_ether_ip(sr,*((uint32_t*)hwinfo->mHWInfo[i].value)); }
                 break;
             case HWETHER:
                 /*Debug("\tHardware Address: ");
                 DebugMAC(hwinfo->mHWInfo[i].value);
                 Debug("\n"); */
-                sr_set_ether_addr(sr,(unsigned char*)hwinfo->mHWInfo[i].value);
+                if ( known )
+                { sr_if_set_ether_addr(known,(unsigned char*)hwinfo->mHWInfo[i].value); }
+                else
+                { sr_set_ether_addr(sr,(unsigned char*)hwinfo->mHWInfo[i].value); }
                 break;
             default:
                 printf (" %d \n",ntohl(hwinfo->mHWInfo[i].mKey));
         } /* -- switch -- */
     } /* -- for -- */
 
+    /* -- VNS interfaces arrive after sr_init, sample them at the -S rate -- */
+    if ( sr->sflow )
+    {
+        struct sr_if* iface;
+
+        for ( iface = sr->if_list; iface; iface = iface->next )
+        {
+            sr_sflow_set_rate(sr, iface, SR_SFLOW_IN, sr->sflow_rate);
+            sr_sflow_set_rate(sr, iface, SR_SFLOW_OUT, sr->sflow_rate);
+        }
+    }
+
+    /* -- and get their egress queues, shaped to the link speed -- */
+    if ( sr->egress_limit )
+    { sr_egress_attach(sr); }
+
     printf("Router interfaces:\n");
     sr_print_if_list(sr);
 
+    sr_arpcache_warm(sr);
+
     return num_entries;
 } /* -- sr_handle_hwinfo -- */
 
@@ -295,7 +524,7 @@ int sr_handle_auth_request(struct sr_instance* sr, c_auth_request* req) {
             sha1.Message_Digest[i] = htonl(sha1.Message_Digest[i]);
         memcpy(ar->username + len_username, sha1.Message_Digest, SHA1_LEN);
 
-        if(send(sr->sockfd, buf, len, 0) != len) {
+        if(send(sr_vns_fd(sr), buf, len, 0) != len) {
             perror("send(..):sr_client.c::sr_handle_auth_request()");
             ret = 0;
         }
@@ -333,14 +562,17 @@ int sr_read_from_server(struct sr_instance* sr /* borrowed */)
 
 int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expected_cmd)
 {
-    int command, len;
+    int len;
     unsigned char *buf = 0;
-    c_packet_ethernet_header* sr_pkt = 0;
+    struct sr_pbuf *pb, *prev;
     int ret = 0, bytes_read = 0;
+    int fd;
 
     /* REQUIRES */
     assert(sr);
 
+    fd = sr_vns_fd(sr);
+
     /*---------------------------------------------------------------------------
       Read a command from the server
       -------------------------------------------------------------------------*/
@@ -353,13 +585,24 @@ int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expect
         do
         { /* -- just in case SIGALRM breaks recv -- */
             errno = 0; /* -- hacky glibc workaround -- */
-            if((ret = recv(sr->sockfd,((uint8_t*)&len) + bytes_read,
+            sr->stats.syscalls++;
+            if((ret = recv(fd,((uint8_t*)&len) + bytes_read,
                             4 - bytes_read, 0)) == -1)
             {
                 if ( errno == EINTR )
                 { continue; }
 
                 perror("recv(..):sr_client.c::sr_read_from_server");
+                sr_vns_drop(sr);
+                return -1;
+            }
+            if ( ret == 0 )
+            {
+                /* -- sr_vns_stop: the router is shutting down -- */
+                if ( sr_stop_requested )
+                { return 0; }
+                fprintf(stderr, "VNS server closed connection.\n");
+                sr_vns_drop(sr);
                 return -1;
             }
             bytes_read += ret;
@@ -372,15 +615,17 @@ int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expect
     if ( len > 10000 || len < 0 )
     {
         fprintf(stderr,"Error: command length to large %d\n",len);
-        close(sr->sockfd);
+        sr_vns_drop(sr);
         return -1;
     }
 
-    if((buf = malloc(len)) == 0)
+    /* -- frames kept past this call hold the buffer, see sr_pbuf.h -- */
+    if((pb = sr_pbuf_alloc(len)) == 0)
     {
         fprintf(stderr,"Error: out of memory (sr_read_from_server)\n");
         return -1;
     }
+    buf = pb->data;
 
     /* set first field of command since we've already read it */
     *((int *)buf) = htonl(len);
@@ -393,22 +638,54 @@ int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expect
         do
         {/* -- just in case SIGALRM breaks recv -- */
             errno = 0; /* -- hacky glibc workaround -- */
-            if ((ret = read(sr->sockfd, buf+4+bytes_read, len - 4 - bytes_read)) ==
-                    -1)
+            sr->stats.syscalls++;
+            if ((ret = read(fd, buf+4+bytes_read, len - 4 - bytes_read)) <=
+                    0)
             {
-                if ( errno == EINTR )
+                if ( ret < 0 && errno == EINTR )
                 { continue; }
                 fprintf(stderr,"Error: failed reading command body %d\n",ret);
-                close(sr->sockfd);
+                sr_pbuf_put(pb);
+                sr_vns_drop(sr);
                 return -1;
             }
             bytes_read += ret;
         } while (errno == EINTR); /* be mindful of signals */
     }
 
-    /* My entry for most unreadable line of code - guido */
-    /* ... you win - mc                                  */
-    command = *(((int *)buf)+1) = ntohl(*(((int *)buf)+1));
+    prev = sr_pbuf_rx_set(pb);
+    ret = sr_handle_command(sr, buf, len, expected_cmd);
+    sr_pbuf_rx_set(prev);
+
+    sr_pbuf_put(pb);
+    return ret;
+}/* -- sr_read_from_server -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_handle_command(..)
+ * Scope: Local
+ *
+ * Act on one complete command from the server.  buf holds the whole
+ * message, length field included, and is modified in place.
+ *
+ * RETURN VALUES:
+ *
+ *  1 on success, 0 if the server closed the session, -1 on error
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_handle_command(struct sr_instance* sr /* borrowed */,
+                             uint8_t* buf /* borrowed */,
+                             int len, int expected_cmd)
+{
+    int command, ret;
+    uint8_t* frame = 0;
+    unsigned int frame_len = 0;
+    char* iface = 0;
+
+    memcpy(&command, buf + 4, 4);
+    command = ntohl(command);
+    memcpy(buf + 4, &command, 4);
 
     /* make sure the command is what we expected if we were expecting something */
     if(expected_cmd && command!=expected_cmd) {
@@ -424,26 +701,9 @@ int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expect
         /* -------------        VNSPACKET     -------------------- */
 
         case VNSPACKET:
-            sr_pkt = (c_packet_ethernet_header *)buf;
-
-            /* -- check if it is an ARP to another router if so drop   -- */
-            if ( sr_arp_req_not_for_us(sr,
-                    (buf+sizeof(c_packet_header)),
-                    len - sizeof(c_packet_ethernet_header) +
-                    sizeof(struct sr_ethernet_hdr),
-                    (char*)(buf + sizeof(c_base))) )
-            { break; }
-
-            /* -- log packet -- */
-            sr_log_packet(sr, buf + sizeof(c_packet_header),
-                    ntohl(sr_pkt->mLen) - sizeof(c_packet_header));
-
             /* -- pass to router, student's code should take over here -- */
-            sr_handlepacket(sr,
-                    (buf+sizeof(c_packet_header)),
-                    len - sizeof(c_packet_ethernet_header) +
-                    sizeof(struct sr_ethernet_hdr),
-                    (char*)(buf + sizeof(c_base)));
+            if ( sr_unwrap_packet(sr, buf, len, &frame, &frame_len, &iface) )
+            { sr_handlepacket(sr, frame, frame_len, iface); }
 
             break;
 
@@ -453,9 +713,8 @@ int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expect
             fprintf(stderr,"VNS server closed session.\n");
             fprintf(stderr,"Reason: %s\n",((c_close*)buf)->mErrorMessage);
             sr_session_closed_help();
+            sr->vns_closed = 1;
 
-            if(buf)
-            { free(buf); }
             return 0;
             break;
 
@@ -496,25 +755,142 @@ int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expect
             break;
 
         default:
-            Debug("unknown command: %d\n", command);
+            SR_TRACE(SR_TRACE_WARN, SR_EV_VNS_UNKNOWN_CMD, command, len, 0, 0);
             break;
 
     }/* -- switch -- */
 
-    if(buf)
-    { free(buf); }
     return ret;
-}/* -- sr_read_from_server -- */
+}/* -- sr_handle_command -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_unwrap_packet(..)
+ * Scope: Local
+ *
+ * Strip the VNSPACKET header off a message, count and log the frame.
+ * What the frame carries is checked by sr_pkt_parse, ARP requests for
+ * other hosts included.
+ *
+ * RETURN VALUES:
+ *
+ *  1 with the frame for the router, 0 if the message is too short to
+ *  hold a VNSPACKET header and an ethernet header
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_unwrap_packet(struct sr_instance* sr /* borrowed */,
+                            uint8_t* buf /* borrowed */,
+                            int len,
+                            uint8_t** frame, unsigned int* frame_len,
+                            char** iface)
+{
+    if ( len < (int)sizeof(c_packet_ethernet_header) )
+    { return 0; }
+
+    *frame = buf + sizeof(c_packet_header);
+    *frame_len = len - sizeof(c_packet_ethernet_header) +
+                 sizeof(struct sr_ethernet_hdr);
+    *iface = (char*)(buf + sizeof(c_base));
+
+    sr->stats.rx_packets++;
+    sr->stats.rx_bytes += *frame_len;
+
+    /* -- log packet -- */
+    sr_log_packet(sr, *frame, *frame_len);
+
+    return 1;
+} /* -- sr_unwrap_packet -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_vns_consume(..)
+ * Scope: Global
+ *
+ * Incremental framing for non-blocking readers: handle every complete
+ * command at the front of buf.  Runs of VNSPACKET frames are handed to
+ * sr_handlepacket_burst together.  The number of bytes used up is stored
+ * in *consumed; a trailing partial command is left for the next call.
+ *
+ * RETURN VALUES:
+ *
+ *  1 on success, 0 if the server closed the session, -1 on error
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_vns_consume(struct sr_instance* sr /* borrowed */,
+                   uint8_t* buf /* borrowed */,
+                   unsigned int avail, unsigned int* consumed)
+{
+    uint8_t* frames[SR_BURST_MAX];
+    unsigned int lens[SR_BURST_MAX];
+    char* ifaces[SR_BURST_MAX];
+    unsigned int n = 0, off = 0;
+    uint32_t len, command;
+    int ret = 1;
+
+    /* REQUIRES */
+    assert(sr);
+    assert(buf);
+    assert(consumed);
+
+    while ( ret == 1 && avail - off >= sizeof(c_base) )
+    {
+        memcpy(&len, buf + off, 4);
+        len = ntohl(len);
+
+        if ( len > 10000 || len < sizeof(c_base) )
+        {
+            fprintf(stderr,"Error: command length to large %d\n",(int)len);
+            ret = -1;
+            break;
+        }
+        if ( avail - off < len )
+        { break; }
+
+        memcpy(&command, buf + off + 4, 4);
+        if ( ntohl(command) == VNSPACKET )
+        {
+            if ( sr_unwrap_packet(sr, buf + off, len,
+                        &frames[n], &lens[n], &ifaces[n]) )
+            { n++; }
+        }
+        else
+        {
+            /* -- keep order: frames before this command go first -- */
+            if ( n > 0 )
+            {
+                sr_handlepacket_burst(sr, frames, lens, ifaces, n);
+                n = 0;
+            }
+            ret = sr_handle_command(sr, buf + off, len, 0);
+        }
+
+        off += len;
+
+        if ( n == SR_BURST_MAX )
+        {
+            sr_handlepacket_burst(sr, frames, lens, ifaces, n);
+            n = 0;
+        }
+    }
+
+    if ( n > 0 )
+    { sr_handlepacket_burst(sr, frames, lens, ifaces, n); }
+
+    *consumed = off;
+    return ret;
+} /* -- sr_vns_consume -- */
+
 
 /*-----------------------------------------------------------------------------
  * Method: sr_ether_addrs_match_interface(..)
  * Scope: Local
  *
  * Make sure ethernet addresses are sane so we don't muck uo the system.
+ * Returns the sending interface, or 0 if they are not.
  *
  *----------------------------------------------------------------------------*/
 
-static int
+static struct sr_if*
 sr_ether_addrs_match_interface( struct sr_instance* sr, /* borrowed */
                                 uint8_t* buf, /* borrowed */
                                 const char* name /* borrowed */ )
@@ -531,12 +907,12 @@ sr_ether_addrs_match_interface( struct sr_instance* sr, /* borrowed */
     iface = sr_get_interface(sr, name);
 
     if ( iface == 0 ){
-        fprintf( stderr, "** Error, interface %s, does not exist\n", name);
+        SR_TRACE(SR_TRACE_ERROR, SR_EV_SEND_NO_IFACE, 0, 0, 0, 0);
         return 0;
     }
 
     if ( memcmp( ether_hdr->ether_shost, iface->addr, ETHER_ADDR_LEN) != 0 ){
-        fprintf( stderr, "** Error, source address does not match interface\n");
+        SR_TRACE(SR_TRACE_ERROR, SR_EV_SEND_BAD_SRC, 0, 0, 0, 0);
         return 0;
     }
 
@@ -546,69 +922,423 @@ sr_ether_addrs_match_interface( struct sr_instance* sr, /* borrowed */
      * Note: This check should really be done server side ...
      */
 
-    return 1;
+    return iface;
 
 } /* -- sr_ether_addrs_match_interface -- */
 
 /*-----------------------------------------------------------------------------
- * Method: sr_send_packet(..)
+ * Method: sr_writev_all(..)
+ * Scope: Local
+ *
+ * Write all of iov to the VNS socket.  The socket is non-blocking in event loop mode,
+ * so wait for room rather than dropping a partially written command.
+ * iov is used up in the process.  Without a session (sockfd -1, lost or
+ * still opening) nothing is written and the frames count as tx errors.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_writev_all(struct sr_instance* sr, struct iovec* iov,
+                         int iovcnt)
+{
+    int fd, rv = 0;
+    struct pollfd pfd;
+    ssize_t ret;
+
+    /* -- held across the write, see sr_vns_drop; it also keeps the
+     *    commands of senders on other threads from interleaving -- */
+    pthread_mutex_lock(&(sr->vns_lock));
+    if ( (fd = sr->sockfd) < 0 )
+    { iovcnt = 0; rv = -1; }
+
+    while ( iovcnt > 0 )
+    {
+        ret = writev(fd, iov, iovcnt);
+        sr->stats.syscalls++;
+        if ( ret < 0 )
+        {
+            if ( errno == EINTR )
+            { continue; }
+            if ( errno != EAGAIN && errno != EWOULDBLOCK )
+            { rv = -1; break; }
+
+            pfd.fd = fd;
+            pfd.events = POLLOUT;
+            sr->stats.syscalls++;
+            if ( poll(&pfd, 1, 1000) <= 0 )
+            { rv = -1; break; }
+            continue;
+        }
+
+        /* -- skip what went, the rest may start part way into an entry -- */
+        while ( iovcnt > 0 && (size_t)ret >= iov->iov_len )
+        {
+            ret -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if ( iovcnt > 0 )
+        {
+            iov->iov_base = (uint8_t*)iov->iov_base + ret;
+            iov->iov_len -= ret;
+        }
+    }
+    pthread_mutex_unlock(&(sr->vns_lock));
+
+    return rv;
+} /* -- sr_writev_all -- */
+
+/* -- the VNSPACKET header for a frame, written in front of it -- */
+static void sr_vns_header(c_packet_header* hdr, unsigned int len,
+                          const char* iface)
+{
+    hdr->mLen  = htonl(len + sizeof(c_packet_header));
+    hdr->mType = htonl(VNSPACKET);
+    strncpy(hdr->mInterfaceName,iface,16);
+} /* -- sr_vns_header -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_vns_send(..)
+ * Scope: Local
+ *
+ * VNS transmit: wrap the frame in a VNSPACKET command for the server.
+ * The header and the frame go out with one writev, the frame where it is.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_vns_send(struct sr_instance* sr /* borrowed */,
+                       const uint8_t* buf /* borrowed */ ,
+                       unsigned int len,
+                       const char* iface /* borrowed(outgoing interface) */)
+{
+    c_packet_header hdr;
+    struct iovec iov[2];
+
+    /* -- io_uring loop batches the write itself -- */
+    if ( sr->uring ){
+        return sr_uring_send(sr, buf, len, iface);
+    }
+
+    sr_vns_header(&hdr, len, iface);
+    iov[0].iov_base = &hdr;
+    iov[0].iov_len = sizeof(hdr);
+    iov[1].iov_base = (void*)buf;
+    iov[1].iov_len = len;
+
+    /*printf("SENDING PACKET");*/
+    return sr_writev_all(sr, iov, 2);
+} /* -- sr_vns_send -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_vns_send_batch(..)
+ * Scope: Local
+ *
+ * VNS transmit of several frames out of one interface: their VNSPACKET
+ * commands go to the server in a single writev per SR_VNS_IOV_FRAMES.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_vns_send_batch(struct sr_instance* sr /* borrowed */,
+                             const uint8_t** bufs /* borrowed */,
+                             const unsigned int* lens, int n,
+                             const char* iface /* borrowed */)
+{
+    c_packet_header hdrs[SR_VNS_IOV_FRAMES];
+    struct iovec iov[2 * SR_VNS_IOV_FRAMES];
+    int sent, i;
+
+    if ( sr->uring ){
+        for ( i = 0; i < n; i++ ){
+            if ( sr_uring_send(sr, bufs[i], lens[i], iface) < 0 )
+            { return i; }
+        }
+        return n;
+    }
+
+    for ( sent = 0; sent < n; sent += i )
+    {
+        for ( i = 0; i < SR_VNS_IOV_FRAMES && sent + i < n; i++ )
+        {
+            sr_vns_header(&hdrs[i], lens[sent + i], iface);
+            iov[2 * i].iov_base = &hdrs[i];
+            iov[2 * i].iov_len = sizeof(c_packet_header);
+            iov[2 * i + 1].iov_base = (void*)bufs[sent + i];
+            iov[2 * i + 1].iov_len = lens[sent + i];
+        }
+        if ( sr_writev_all(sr, iov, 2 * i) < 0 )
+        { return sent; }
+    }
+
+    return n;
+} /* -- sr_vns_send_batch -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_vns_reconnect(..)
+ * Scope: Local
+ *
+ * The session was lost rather than closed: open a new one, retrying
+ * with exponential backoff for up to sr->vns_retry seconds.  The routes,
+ * interfaces and ARP cache are kept as they are; the server sends the
+ * hardware information again, see sr_handle_hwinfo.
+ *
+ * RETURN VALUES:
+ *
+ *  0 with a new session, -1 when the router should exit
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_vns_reconnect(struct sr_instance* sr)
+{
+    struct timespec ts;
+    uint64_t lost, recover;
+    unsigned int backoff = 0, delay, attempts = 0;
+
+    if ( sr->vns_closed || sr->vns_retry == 0 || sr_stop_requested )
+    { return -1; }
+
+    sr_vns_drop(sr);
+    sr->stats.vns_drops++;
+    lost = sr_now_ns();
+    SR_TRACE(SR_TRACE_WARN, SR_EV_VNS_LOST, (uint32_t)sr->stats.vns_drops,
+             0, 0, 0);
+    fprintf(stderr, "VNS session lost, reconnecting to %s:%d\n",
+            inet_ntoa(sr->sr_addr.sin_addr), ntohs(sr->sr_addr.sin_port));
+
+    while ( 1 )
+    {
+        /* -- half the backoff and a random part of the rest, so that
+         *    routers dropped together do not come back together -- */
+        if ( backoff )
+        {
+            delay = backoff / 2 + rand() % (backoff / 2 + 1);
+            ts.tv_sec = delay / 1000;
+            ts.tv_nsec = (long)(delay % 1000) * 1000000;
+            nanosleep(&ts, 0);
+        }
+        if ( sr_stop_requested )
+        { return -1; }
+
+        attempts++;
+        if ( sr_vns_open(sr, SR_VNS_HANDSHAKE_TIMEOUT) == 0 )
+        { break; }
+        sr->stats.vns_failed_attempts++;
+
+        if ( sr_now_ns() - lost >= (uint64_t)sr->vns_retry * SR_NS_PER_SEC )
+        {
+            fprintf(stderr, "VNS server unreachable for %u seconds, giving up\n",
+                    sr->vns_retry);
+            return -1;
+        }
+        backoff = backoff ? backoff * 2 : SR_VNS_BACKOFF_MIN;
+        if ( backoff > SR_VNS_BACKOFF_MAX )
+        { backoff = SR_VNS_BACKOFF_MAX; }
+    }
+
+    recover = (sr_now_ns() - lost) / 1000;
+    sr->stats.vns_reconnects++;
+    sr->stats.vns_recover_last_us = recover;
+    if ( recover > sr->stats.vns_recover_max_us )
+    { sr->stats.vns_recover_max_us = recover; }
+    sr->stats.vns_down_us += recover;
+    SR_TRACE(SR_TRACE_INFO, SR_EV_VNS_REOPENED, attempts, (uint32_t)recover,
+             0, 0);
+    printf("VNS session reopened after %u attempts in %llu us\n", attempts,
+           (unsigned long long)recover);
+
+    return 0;
+} /* -- sr_vns_reconnect -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_vns_run(..)
+ * Scope: Local
+ *
+ * VNS receive loop for the configured loop mode, run again on each
+ * session sr_vns_reconnect reopens.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_vns_run(struct sr_instance* sr)
+{
+    int ret;
+
+    do
+    {
+        if(sr->loop_mode == SR_LOOP_EVENT)
+        {
+            if(!sr->use_uring || (ret = sr_uring_run(sr)) == SR_URING_UNAVAILABLE)
+            { ret = sr_reactor_run(sr); }
+        }
+        else
+        {
+            while( (ret = sr_read_from_server(sr)) == 1);
+        }
+    } while( sr_vns_reconnect(sr) == 0 );
+
+    return ret < 0 ? -1 : 0;
+} /* -- sr_vns_run -- */
+
+/* -- the session is set up by sr_connect_to_server, hence no open -- */
+const struct sr_netdev_ops sr_netdev_vns =
+{
+    "vns",
+    0,
+    sr_vns_run,
+    sr_vns_send,
+    0,
+    sr_vns_send_batch
+};
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_transmit(..)
  * Scope: Global
  *
- * Send a packet (ethernet header included!) of length 'len' to the server
- * to be injected onto the wire.
+ * Hand n frames for iface to the netdev backend, in one call if it can
+ * take a batch, and count them.  Returns how many were sent.
  *
  *---------------------------------------------------------------------------*/
 
-int sr_send_packet(struct sr_instance* sr /* borrowed */,
+int sr_transmit(struct sr_instance* sr /* borrowed */,
+                const uint8_t** bufs /* borrowed */,
+                const unsigned int* lens, int n,
+                const char* iface /* borrowed */)
+{
+    int sent, i;
+
+    if ( sr->netdev->send_batch && n > 1 ){
+        sent = sr->netdev->send_batch(sr, bufs, lens, n, iface);
+    }
+    else {
+        for ( sent = 0; sent < n; sent++ ){
+            if ( sr->netdev->send(sr, bufs[sent], lens[sent], iface) < 0 )
+            { break; }
+        }
+    }
+
+    for ( i = 0; i < n; i++ ){
+        if ( i < sent ){
+            sr->stats.tx_packets++;
+            sr->stats.tx_bytes += lens[i];
+            continue;
+        }
+        SR_TRACE(SR_TRACE_ERROR, SR_EV_SEND_FAILED, lens[i], 0, 0, 0);
+        sr->stats.tx_errors++;
+    }
+
+    return sent;
+} /* -- sr_transmit -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_send_frame(..)
+ * Scope: Local
+ *
+ * Common part of sr_send_packet, sr_send_control_packet and
+ * sr_send_pbuf: check, log and sample the frame, then queue it for the
+ * egress scheduler or send it right away.  The queue holds pb, if the
+ * frame is in one, or the frame by sr_pbuf_hold.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_send_frame(struct sr_instance* sr /* borrowed */,
+                         struct sr_pbuf* pb /* borrowed, or 0 */,
                          uint8_t* buf /* borrowed */ ,
                          unsigned int len,
-                         const char* iface /* borrowed(outgoing interface) */)
+                         const char* iface /* borrowed(outgoing interface) */,
+                         int control)
 {
-    c_packet_header *sr_pkt;
-    unsigned int total_len =  len + (sizeof(c_packet_header));
+    struct sr_if* out;
+    const uint8_t* bufs[1];
 
     /* REQUIRES */
     assert(sr);
     assert(buf);
     assert(iface);
+    assert(sr->netdev);
 
     /* don't waste my time ... */
     if ( len < sizeof(struct sr_ethernet_hdr) ){
-        fprintf(stderr , "** Error: packet is wayy to short \n");
+        SR_TRACE(SR_TRACE_ERROR, SR_EV_SEND_SHORT, len, 0, 0, 0);
         return -1;
     }
 
-    /* Create packet */
-    sr_pkt = (c_packet_header *)malloc(len +
-            sizeof(c_packet_header));
-    assert(sr_pkt);
-    sr_pkt->mLen  = htonl(total_len);
-    sr_pkt->mType = htonl(VNSPACKET);
-    strncpy(sr_pkt->mInterfaceName,iface,16);
-    memcpy(((uint8_t*)sr_pkt) + sizeof(c_packet_header),
-            buf,len);
-
     /* -- log packet -- */
     sr_log_packet(sr,buf,len);
 
-    if ( ! sr_ether_addrs_match_interface( sr, buf, iface) ){
-        fprintf( stderr, "*** Error: problem with ethernet header, check log\n");
-        free ( sr_pkt );
+    if ( (out = sr_ether_addrs_match_interface( sr, buf, iface)) == 0 ){
         return -1;
     }
 
-    if( write(sr->sockfd, sr_pkt, total_len) < total_len ){
-        fprintf(stderr, "Error writing packet\n");
-        free(sr_pkt);
-        return -1;
+    if ( sr->sflow && SR_SFLOW_OUT_DUE(out) ){
+        sr_sflow_egress(sr, out, buf, len);
     }
 
-    /*printf("SENDING PACKET");*/
-    free(sr_pkt);
+    /* -- within a receive burst the queues drain when it has been handled -- */
+    if ( out->egress ){
+        if ( pb )
+        { sr_pbuf_get(pb); }
+        else if ( (pb = sr_pbuf_hold(buf, len)) == 0 )
+        { return -1; }
+        if ( sr_egress_enqueue(sr, out, pb, control) < 0 )
+        { return -1; }
+        if ( !sr_egress_held() )
+        { sr_egress_drain(sr, out); }
+        return 0;
+    }
 
-    return 0;
+    bufs[0] = buf;
+    return ( sr_transmit(sr, bufs, &len, 1, iface) == 1 ) ? 0 : -1;
+} /* -- sr_send_frame -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_send_packet(..)
+ * Scope: Global
+ *
+ * Send a packet (ethernet header included!) of length 'len' to the server
+ * to be injected onto the wire, or out of the local device when another
+ * netdev backend is in use.
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_send_packet(struct sr_instance* sr /* borrowed */,
+                         uint8_t* buf /* borrowed */ ,
+                         unsigned int len,
+                         const char* iface /* borrowed(outgoing interface) */)
+{
+    return sr_send_frame(sr, 0, buf, len, iface, 0);
 } /* -- sr_send_packet -- */
 
+/*-----------------------------------------------------------------------------
+ * Method: sr_send_control_packet(..)
+ * Scope: Global
+ *
+ * sr_send_packet for the router's own ARP, ICMP and ICMPv6 messages,
+ * which the egress scheduler sends ahead of queued data.
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_send_control_packet(struct sr_instance* sr /* borrowed */,
+                           uint8_t* buf /* borrowed */ ,
+                           unsigned int len,
+                           const char* iface /* borrowed(outgoing interface) */)
+{
+    return sr_send_frame(sr, 0, buf, len, iface, 1);
+} /* -- sr_send_control_packet -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_send_pbuf(..)
+ * Scope: Global
+ *
+ * sr_send_packet for a frame kept in a pbuf, such as one that waited for
+ * ARP: the egress queues take a reference to it instead of holding the
+ * frame anew.
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_send_pbuf(struct sr_instance* sr /* borrowed */,
+                 struct sr_pbuf* pb /* borrowed */,
+                 const char* iface /* borrowed(outgoing interface) */)
+{
+    return sr_send_frame(sr, pb, pb->data, pb->len, iface, 0);
+} /* -- sr_send_pbuf -- */
+
 /*-----------------------------------------------------------------------------
  * Method: sr_log_packet()
  * Scope: Local
@@ -635,34 +1365,3 @@ void sr_log_packet(struct sr_instance* sr, uint8_t* buf, int len )
     sr_dump(sr->logfile, &h, buf);
     fflush(sr->logfile);
 } /* -- sr_log_packet -- */
-
-/*-----------------------------------------------------------------------------
- * Method: sr_arp_req_not_for_us()
- * Scope: Local
- *
- *---------------------------------------------------------------------------*/
-
-int  sr_arp_req_not_for_us(struct sr_instance* sr,
-                           uint8_t * packet /* lent */,
-                           unsigned int len,
-                           char* interface  /* lent */)
-{
-    struct sr_if* iface = sr_get_interface(sr, interface);
-    struct sr_ethernet_hdr* e_hdr = 0;
-    struct sr_arp_hdr*       a_hdr = 0;
-
-    if (len < sizeof(struct sr_ethernet_hdr) + sizeof(struct sr_arp_hdr) )
-    { return 0; }
-
-    assert(iface);
-
-    e_hdr = (struct sr_ethernet_hdr*)packet;
-    a_hdr = (struct sr_arp_hdr*)(packet + sizeof(struct sr_ethernet_hdr));
-
-    if ( (e_hdr->ether_type == htons(ethertype_arp)) &&
-            (a_hdr->ar_op      == htons(arp_op_request))   &&
-            (a_hdr->ar_tip     != iface->ip ) )
-    { return 1; }
-
-    return 0;
-} /* -- sr_arp_req_not_for_us -- */